@@ -5,14 +5,140 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #define ESC_TELEMETRY_BUF_SIZE 10
+#define ESC_TELEMETRY_DATA_SIZE (ESC_TELEMETRY_BUF_SIZE - 1)
+
+// KISS CRC8 poly: 0x07
+static const uint8_t kiss_crc8_table[] = {
+  0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24,
+  0x23, 0x2a, 0x2d, 0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65, 0x48, 0x4f,
+  0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d, 0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2,
+  0xf5, 0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd, 0x90, 0x97, 0x9e, 0x99,
+  0x8c, 0x8b, 0x82, 0x85, 0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd, 0xc7,
+  0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2, 0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4,
+  0xed, 0xea, 0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2, 0x8f, 0x88, 0x81,
+  0x86, 0x93, 0x94, 0x9d, 0x9a, 0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32,
+  0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a, 0x57, 0x50, 0x59, 0x5e, 0x4b,
+  0x4c, 0x45, 0x42, 0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a, 0x89, 0x8e,
+  0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c, 0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3,
+  0xa4, 0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec, 0xc1, 0xc6, 0xcf, 0xc8,
+  0xdd, 0xda, 0xd3, 0xd4, 0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c, 0x51,
+  0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44, 0x19, 0x1e, 0x17, 0x10, 0x05, 0x02,
+  0x0b, 0x0c, 0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34, 0x4e, 0x49, 0x40,
+  0x47, 0x52, 0x55, 0x5c, 0x5b, 0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+  0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b, 0x06, 0x01, 0x08, 0x0f, 0x1a,
+  0x1d, 0x14, 0x13, 0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb, 0x96, 0x91,
+  0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83, 0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc,
+  0xcb, 0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3};
+
+// CRC8 of a byte followed by ESC_TELEMETRY_DATA_SIZE zero bytes
+// XOR'ing this into a running CRC removes that byte from the front of a ESC_TELEMETRY_DATA_SIZE byte window
+static const uint8_t kiss_crc8_drop_table[] = {
+  0x00, 0x68, 0xd0, 0xb8, 0xa7, 0xcf, 0x77, 0x1f, 0x49, 0x21, 0x99, 0xf1, 0xee,
+  0x86, 0x3e, 0x56, 0x92, 0xfa, 0x42, 0x2a, 0x35, 0x5d, 0xe5, 0x8d, 0xdb, 0xb3,
+  0x0b, 0x63, 0x7c, 0x14, 0xac, 0xc4, 0x23, 0x4b, 0xf3, 0x9b, 0x84, 0xec, 0x54,
+  0x3c, 0x6a, 0x02, 0xba, 0xd2, 0xcd, 0xa5, 0x1d, 0x75, 0xb1, 0xd9, 0x61, 0x09,
+  0x16, 0x7e, 0xc6, 0xae, 0xf8, 0x90, 0x28, 0x40, 0x5f, 0x37, 0x8f, 0xe7, 0x46,
+  0x2e, 0x96, 0xfe, 0xe1, 0x89, 0x31, 0x59, 0x0f, 0x67, 0xdf, 0xb7, 0xa8, 0xc0,
+  0x78, 0x10, 0xd4, 0xbc, 0x04, 0x6c, 0x73, 0x1b, 0xa3, 0xcb, 0x9d, 0xf5, 0x4d,
+  0x25, 0x3a, 0x52, 0xea, 0x82, 0x65, 0x0d, 0xb5, 0xdd, 0xc2, 0xaa, 0x12, 0x7a,
+  0x2c, 0x44, 0xfc, 0x94, 0x8b, 0xe3, 0x5b, 0x33, 0xf7, 0x9f, 0x27, 0x4f, 0x50,
+  0x38, 0x80, 0xe8, 0xbe, 0xd6, 0x6e, 0x06, 0x19, 0x71, 0xc9, 0xa1, 0x8c, 0xe4,
+  0x5c, 0x34, 0x2b, 0x43, 0xfb, 0x93, 0xc5, 0xad, 0x15, 0x7d, 0x62, 0x0a, 0xb2,
+  0xda, 0x1e, 0x76, 0xce, 0xa6, 0xb9, 0xd1, 0x69, 0x01, 0x57, 0x3f, 0x87, 0xef,
+  0xf0, 0x98, 0x20, 0x48, 0xaf, 0xc7, 0x7f, 0x17, 0x08, 0x60, 0xd8, 0xb0, 0xe6,
+  0x8e, 0x36, 0x5e, 0x41, 0x29, 0x91, 0xf9, 0x3d, 0x55, 0xed, 0x85, 0x9a, 0xf2,
+  0x4a, 0x22, 0x74, 0x1c, 0xa4, 0xcc, 0xd3, 0xbb, 0x03, 0x6b, 0xca, 0xa2, 0x1a,
+  0x72, 0x6d, 0x05, 0xbd, 0xd5, 0x83, 0xeb, 0x53, 0x3b, 0x24, 0x4c, 0xf4, 0x9c,
+  0x58, 0x30, 0x88, 0xe0, 0xff, 0x97, 0x2f, 0x47, 0x11, 0x79, 0xc1, 0xa9, 0xb6,
+  0xde, 0x66, 0x0e, 0xe9, 0x81, 0x39, 0x51, 0x4e, 0x26, 0x9e, 0xf6, 0xa0, 0xc8,
+  0x70, 0x18, 0x07, 0x6f, 0xd7, 0xbf, 0x7b, 0x13, 0xab, 0xc3, 0xdc, 0xb4, 0x0c,
+  0x64, 0x32, 0x5a, 0xe2, 0x8a, 0x95, 0xfd, 0x45, 0x2d};
+
+// Finds KISS telemetry frames in a byte stream. Does not depend on Arduino, so it can be built and tested on a host.
+// Keeps a running CRC8 over the last ESC_TELEMETRY_DATA_SIZE bytes, so each byte costs two table lookups instead of a full CRC.
+class ESCTelemetryFramer {
+private:
+    // Circular buffer of the last ESC_TELEMETRY_DATA_SIZE bytes, escTelemetryWindowPos points at the oldest one
+    uint8_t escTelemetryWindow[ESC_TELEMETRY_DATA_SIZE] = {};
+    uint8_t escTelemetryWindowPos = 0;
+
+    // CRC8 of everything in escTelemetryWindow
+    uint8_t escTelemetryWindowCRC = 0;
+
+    // Don't report frames until the window has been filled with real bytes
+    uint8_t bytesNeeded = ESC_TELEMETRY_DATA_SIZE;
+
+    // Once we have seen a frame, the next one is expected exactly ESC_TELEMETRY_BUF_SIZE bytes later
+    bool synced = false;
+    uint8_t bytesSinceFrame = 0;
+
+public:
+    // Most recent frame, only valid after push() returns true
+    uint8_t frame[ESC_TELEMETRY_BUF_SIZE];
+
+    // Number of times the expected frame boundary did not have a valid CRC
+    uint32_t crcRejectCount = 0;
+
+    // Push in the next byte from the stream
+    // Returns true if this byte completed a frame with a valid CRC. Frame will get copied to 'frame'
+    bool push(const uint8_t byte) {
+        bool frameReceived = false;
+
+        // The incoming byte is a CRC candidate for the bytes already in the window. Once synced, only at the expected
+        // frame boundary: a data byte matching the CRC by chance (1 in 256) would otherwise break the sync
+        const bool atBoundary = !synced || bytesSinceFrame == ESC_TELEMETRY_DATA_SIZE;
+        if (bytesNeeded == 0 && atBoundary && byte == escTelemetryWindowCRC) {
+            for (uint8_t i = 0; i < ESC_TELEMETRY_DATA_SIZE; i++)
+                frame[i] = escTelemetryWindow[(escTelemetryWindowPos + i) % ESC_TELEMETRY_DATA_SIZE];
+            frame[ESC_TELEMETRY_DATA_SIZE] = byte;
+            frameReceived = true;
+        }
+
+        // Keep track of frames that should have been here but failed the CRC
+        if (frameReceived) {
+            synced = true;
+            bytesSinceFrame = 0;
+        } else if (synced && ++bytesSinceFrame == ESC_TELEMETRY_BUF_SIZE) {
+            crcRejectCount++;
+            synced = false;
+        }
+
+        // Slide the window forward one byte, updating the CRC in place
+        const uint8_t oldestByte = escTelemetryWindow[escTelemetryWindowPos];
+        escTelemetryWindow[escTelemetryWindowPos] = byte;
+        escTelemetryWindowPos = (escTelemetryWindowPos + 1) % ESC_TELEMETRY_DATA_SIZE;
+        escTelemetryWindowCRC = kiss_crc8_table[escTelemetryWindowCRC ^ byte] ^ kiss_crc8_drop_table[oldestByte];
+
+        if (bytesNeeded > 0)
+            bytesNeeded--;
+
+        return frameReceived;
+    }
+
+    void reset() {
+        memset(escTelemetryWindow, 0, sizeof(escTelemetryWindow));
+        escTelemetryWindowPos = 0;
+        escTelemetryWindowCRC = 0;
+        bytesNeeded = ESC_TELEMETRY_DATA_SIZE;
+        synced = false;
+        bytesSinceFrame = 0;
+    }
+
+    // KISS ESC telemetry CRC calculation
+    static uint8_t getCRC8(const uint8_t *data, const uint8_t length) {
+        uint8_t crc = 0;
+        for (uint8_t i = 0; i < length; i++)
+            crc = kiss_crc8_table[crc ^ data[i]];
+        return crc;
+    }
+};
 
 class ESCTelemetry {
 private:
-    // Circular buffer for reading in bytes from the serial interface
-    uint8_t escTelemetryBuf[ESC_TELEMETRY_BUF_SIZE];
-    uint8_t escTelemetryBufPos = 0;
+    ESCTelemetryFramer framer;
 
     // Stream to use
     Stream &serialPort;
@@ -23,17 +149,11 @@ public:
 
     ESCTelemetry(Stream &serialPort) : serialPort(serialPort) {}
 
+    uint32_t getCRCRejectCount() const { return framer.crcRejectCount; }
+
     // KISS ESC telemetry CRC calculation
     uint8_t getCRC8(uint8_t *data, uint8_t length) {
-        uint8_t crc = 0;
-        for (uint8_t i = 0; i < length; i++) {
-            uint8_t crcU = data[i];
-            crcU ^= crc;
-            for (uint8_t j = 0; j < 8; j++)
-                crcU = (crcU & 0x80) ? 0x7 ^ (crcU << 1) : (crcU << 1);
-            crc = crcU;
-        }
-        return crc;
+        return ESCTelemetryFramer::getCRC8(data, length);
     }
 
     // Main update function. Run this as often as possible.
@@ -42,24 +162,11 @@ public:
         bool packetReceived = false;
 
         while (serialPort.available()) {
-            // Read in the next byte from the serial interface into the circular buffer
-            escTelemetryBuf[escTelemetryBufPos] = serialPort.read();
-            
-            // Unwrap the circular buffer into tempBuffer so that byte 0 of the telemetry packet actually starts at intex 0
-            uint8_t tempBuffer[ESC_TELEMETRY_BUF_SIZE];
-            for (uint8_t i = 0; i < ESC_TELEMETRY_BUF_SIZE; i++)
-              tempBuffer[i] = escTelemetryBuf[(escTelemetryBufPos + i + 1) % ESC_TELEMETRY_BUF_SIZE];
-
-            // Check tempBuffer CRC
-            const uint8_t calculatedCRC = getCRC8(tempBuffer, ESC_TELEMETRY_BUF_SIZE - 1);
-            if (calculatedCRC == tempBuffer[ESC_TELEMETRY_BUF_SIZE - 1]) {
-              // Copy the private buffer to a public buffer
-              memcpy(buffer, tempBuffer, ESC_TELEMETRY_BUF_SIZE);
-              packetReceived = true;
+            if (framer.push(serialPort.read())) {
+                // Copy the framer's buffer to a public buffer
+                memcpy(buffer, framer.frame, ESC_TELEMETRY_BUF_SIZE);
+                packetReceived = true;
             }
-
-            // Increment escTelemetryBufPos
-            escTelemetryBufPos = (escTelemetryBufPos + 1) % ESC_TELEMETRY_BUF_SIZE;            
         }
 
         return packetReceived;
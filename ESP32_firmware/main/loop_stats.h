@@ -0,0 +1,111 @@
+#ifndef __LOOP_STATS_H__
+#define __LOOP_STATS_H__
+
+// Keeps track of how long loop() takes, along with counters for events that are worth reporting to the pi.
+// Does not depend on Arduino, so it can be built and tested on a host.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LOOP_STATS_NUM_BUCKETS 8
+
+// -- PAYLOAD FORMAT --
+// All values are little endian uint32_t
+// loop count           - loops since the last report
+// loop min             - microseconds
+// loop mean            - microseconds
+// loop max             - microseconds
+// buckets x 8          - loop counts, see loopStatsBucketLimitsMicros
+// fifo overflows       - total since boot
+// esc crc rejects      - total since boot
+// failsafe activations - total since boot
+// bytes in             - total since boot (pi UART)
+// bytes out            - total since boot (pi UART)
+
+// Upper limit (exclusive, microseconds) of each histogram bucket. The last bucket holds everything else
+// Written out again in source/maus_board.cpp (MausBoard::LoopStats), source/tests/test_loop_stats checks they match
+static const uint32_t loopStatsBucketLimitsMicros[LOOP_STATS_NUM_BUCKETS - 1] = {50, 100, 200, 500, 1000, 2000, 5000};
+
+class LoopStats {
+public:
+    enum Counter : uint8_t {
+        COUNTER_FIFO_OVERFLOWS = 0,
+        COUNTER_ESC_CRC_REJECTS,
+        COUNTER_FAILSAFE_ACTIVATIONS,
+        COUNTER_BYTES_IN,
+        COUNTER_BYTES_OUT,
+        NUM_COUNTERS
+    };
+
+    static const size_t PAYLOAD_SIZE = (4 + LOOP_STATS_NUM_BUCKETS + NUM_COUNTERS) * 4;
+
+private:
+    // Loop timing, reset after every report
+    uint32_t loopCount = 0;
+    uint32_t loopMinMicros = UINT32_MAX;
+    uint32_t loopMaxMicros = 0;
+    uint64_t loopTotalMicros = 0;
+    uint32_t buckets[LOOP_STATS_NUM_BUCKETS] = {};
+
+    // Counters are never reset so the pi can work out rates even if a report gets dropped
+    uint32_t counters[NUM_COUNTERS] = {};
+
+public:
+    void addLoopTime(const uint32_t loopMicros) {
+        loopCount++;
+        loopTotalMicros += loopMicros;
+        if (loopMicros < loopMinMicros)
+            loopMinMicros = loopMicros;
+        if (loopMicros > loopMaxMicros)
+            loopMaxMicros = loopMicros;
+
+        uint8_t bucket = 0;
+        while (bucket < (LOOP_STATS_NUM_BUCKETS - 1) && loopMicros >= loopStatsBucketLimitsMicros[bucket])
+            bucket++;
+        buckets[bucket]++;
+    }
+
+    void count(const Counter counter, const uint32_t amount = 1) {
+        counters[counter] += amount;
+    }
+
+    void setCounter(const Counter counter, const uint32_t value) {
+        counters[counter] = value;
+    }
+
+    uint32_t getCounter(const Counter counter) const {
+        return counters[counter];
+    }
+
+    uint32_t getLoopCount() const { return loopCount; }
+    uint32_t getLoopMinMicros() const { return loopCount ? loopMinMicros : 0; }
+    uint32_t getLoopMeanMicros() const { return loopCount ? (uint32_t)(loopTotalMicros / loopCount) : 0; }
+    uint32_t getLoopMaxMicros() const { return loopMaxMicros; }
+    uint32_t getBucket(const uint8_t bucket) const { return buckets[bucket]; }
+
+    // Writes the stats to payload (must have room for PAYLOAD_SIZE bytes). Returns the number of bytes written
+    size_t serialize(uint8_t* payload) const {
+        uint32_t values[PAYLOAD_SIZE / 4];
+        values[0] = getLoopCount();
+        values[1] = getLoopMinMicros();
+        values[2] = getLoopMeanMicros();
+        values[3] = getLoopMaxMicros();
+        memcpy(&values[4], buckets, sizeof(buckets));
+        memcpy(&values[4 + LOOP_STATS_NUM_BUCKETS], counters, sizeof(counters));
+
+        memcpy(payload, values, PAYLOAD_SIZE);
+        return PAYLOAD_SIZE;
+    }
+
+    // Clears the loop timing (counters are kept)
+    void resetLoopTimes() {
+        loopCount = 0;
+        loopMinMicros = UINT32_MAX;
+        loopMaxMicros = 0;
+        loopTotalMicros = 0;
+        memset(buckets, 0, sizeof(buckets));
+    }
+};
+
+#endif
@@ -5,6 +5,7 @@
 
 #include "messaging.h"
 #include "esc_telemetry.h"
+#include "loop_stats.h"
 
 // -- HARDWARE --
 #define PIN_MPU6050_INT 15
@@ -46,6 +47,22 @@
 // 0x05 - telemetry dump  - sent to the pi with ESC telemetry data
 //                        - payload 10 byte ESC telemetry buffer
 
+#define CMD_LOOP_STATS 0x06
+// 0x06 - loop stats      - sent to the pi periodically with loop timing and diagnostic counters
+//                        - payload see loop_stats.h
+
+#define CMD_SET_IMU_MODE 0x07
+// 0x07 - set imu mode    - sent by the pi to switch between DMP quaternions and raw gyro/accel
+//                        - payload uint8_t mode (IMU_MODE_*), uint16_t raw sample rate Hz (4 - 1000)
+
+#define CMD_IMU_RAW_DUMP 0x08
+// 0x08 - imu raw dump    - sent to the pi with a batch of raw samples (raw mode only)
+//                        - payload uint8_t sample count, then per sample:
+//                          uint32_t micros, int16_t accel x/y/z (8192 per G), int16_t gyro x/y/z (16.4 per deg/s)
+
+#define IMU_MODE_DMP 0
+#define IMU_MODE_RAW 1
+
 // Debug switch
 const bool debugMode = false;
 
@@ -74,6 +91,7 @@ Servo throttleServo;
 bool newServoData = false;
 uint32_t lastSetServoMillis = 0;
 const uint32_t maxSetServoIntervalMillis = 1000;
+bool failsafeActive = false;
 
 // ESC Telemetry
 const bool ESC_TELEMETRY_ENABLED = true;
@@ -85,6 +103,18 @@ bool dmpReady = false;
 uint16_t packetSize = 0;
 uint8_t fifoBuffer[64];
 
+// Loop stats
+LoopStats loopStats;
+uint32_t lastLoopStatsMillis = 0;
+const uint32_t loopStatsIntervalMillis = 1000;
+
+// Raw IMU mode, samples are collected in the MPU6050 FIFO and sent in batches
+uint8_t imuMode = IMU_MODE_DMP;
+uint32_t imuRawPeriodMicros = 1000;
+#define IMU_RAW_SAMPLE_SIZE 12
+#define IMU_RAW_BATCH_SIZE 8
+#define IMU_FIFO_SIZE 1024
+
 // To be completely honest, I don't know if this is required. I just saw this in the convoluted MPU6050 motionapps example
 volatile bool mpuInterrupt = false;
 void dmpDataReady() {
@@ -124,6 +154,80 @@ void initMPU6050() {
     }
 }
 
+void setImuMode(const uint8_t mode, const uint16_t rateHz) {
+    if (!dmpReady && imuMode == IMU_MODE_DMP)
+        return;
+
+    if (mode == IMU_MODE_RAW) {
+        const uint16_t clampedRateHz = (rateHz < 4) ? 4 : ((rateHz > 1000) ? 1000 : rateHz);
+        // The sample rate divider is whole milliseconds, so is the period (e.g. 300Hz samples every 3ms, at 333Hz)
+        imuRawPeriodMicros = (1000 / clampedRateHz) * 1000;
+
+        // Stop the DMP and have the FIFO collect accel and gyro at 1kHz / (1 + rate)
+        mpu.setDMPEnabled(false);
+        mpu.setFullScaleGyroRange(MPU6050_GYRO_FS_2000);
+        mpu.setFullScaleAccelRange(MPU6050_ACCEL_FS_4);
+        mpu.setDLPFMode(MPU6050_DLPF_BW_188);
+        mpu.setRate((1000 / clampedRateHz) - 1);
+        mpu.setAccelFIFOEnabled(true);
+        mpu.setXGyroFIFOEnabled(true);
+        mpu.setYGyroFIFOEnabled(true);
+        mpu.setZGyroFIFOEnabled(true);
+        mpu.resetFIFO();
+        mpu.setFIFOEnabled(true);
+
+        imuMode = IMU_MODE_RAW;
+    } else if (mode == IMU_MODE_DMP && imuMode != IMU_MODE_DMP) {
+        // Going back to the DMP needs a full re-initialization (and calibration)
+        mpu.setAccelFIFOEnabled(false);
+        mpu.setXGyroFIFOEnabled(false);
+        mpu.setYGyroFIFOEnabled(false);
+        mpu.setZGyroFIFOEnabled(false);
+        dmpReady = false;
+        initMPU6050();
+
+        imuMode = IMU_MODE_DMP;
+    }
+}
+
+void sendRawImuSamples() {
+    const uint32_t readMicros = micros();
+
+    const uint16_t fifoCount = mpu.getFIFOCount();
+    if (fifoCount >= (IMU_FIFO_SIZE - IMU_RAW_SAMPLE_SIZE)) {
+        // Too late, the FIFO has overflowed and is out of alignment
+        loopStats.count(LoopStats::COUNTER_FIFO_OVERFLOWS);
+        mpu.resetFIFO();
+        return;
+    }
+
+    const uint16_t samplesAvailable = fifoCount / IMU_RAW_SAMPLE_SIZE;
+    if (samplesAvailable < IMU_RAW_BATCH_SIZE)
+        return;
+
+    uint8_t fifoBytes[IMU_RAW_BATCH_SIZE * IMU_RAW_SAMPLE_SIZE];
+    mpu.getFIFOBytes(fifoBytes, sizeof(fifoBytes));
+
+    uint8_t payload[2 + (IMU_RAW_BATCH_SIZE * 16)];
+    payload[0] = CMD_IMU_RAW_DUMP;
+    payload[1] = IMU_RAW_BATCH_SIZE;
+    for (uint8_t sampleIndex = 0; sampleIndex < IMU_RAW_BATCH_SIZE; sampleIndex++) {
+        // The newest sample in the FIFO was taken about now, work backwards from there
+        const uint32_t sampleMicros = readMicros - ((samplesAvailable - 1 - sampleIndex) * imuRawPeriodMicros);
+
+        // FIFO order is accel x/y/z then gyro x/y/z, big endian
+        const uint8_t* sample = &fifoBytes[sampleIndex * IMU_RAW_SAMPLE_SIZE];
+        int16_t values[6];
+        for (uint8_t valueIndex = 0; valueIndex < 6; valueIndex++)
+            values[valueIndex] = (int16_t)((sample[valueIndex * 2] << 8) | sample[(valueIndex * 2) + 1]);
+
+        uint8_t* payloadSample = &payload[2 + (sampleIndex * 16)];
+        memcpy(payloadSample, &sampleMicros, 4);
+        memcpy(payloadSample + 4, values, 12);
+    }
+    piMessaging.sendMessage(payload, sizeof(payload));
+}
+
 void initRGB() {
     rgb.begin();
     rgb.clear();
@@ -210,12 +314,34 @@ bool piMessageReceived(const uint8_t* payload, const uint16_t payloadSize) {
                 lastSetServoMillis = millis();
             }
         }
+        if (commandId == CMD_SET_IMU_MODE) {
+            if (payloadSize >= 4) {
+                const uint16_t rateHz = *reinterpret_cast<const uint16_t*>(&payload[2]);
+                setImuMode(payload[1], rateHz);
+            }
+        }
     }
 
     return true;
 }
 
+void sendLoopStats() {
+    // Fill in the counters that are kept elsewhere
+    loopStats.setCounter(LoopStats::COUNTER_ESC_CRC_REJECTS, escTelemetry.getCRCRejectCount());
+    loopStats.setCounter(LoopStats::COUNTER_BYTES_IN, piMessaging.bytesReceived);
+    loopStats.setCounter(LoopStats::COUNTER_BYTES_OUT, piMessaging.bytesSent);
+
+    uint8_t payload[1 + LoopStats::PAYLOAD_SIZE];
+    payload[0] = CMD_LOOP_STATS;
+    const size_t statsSize = loopStats.serialize(&payload[1]);
+    piMessaging.sendMessage(payload, 1 + statsSize);
+
+    loopStats.resetLoopTimes();
+}
+
 void loop() {
+    const uint32_t loopStartMicros = micros();
+
     piMessaging.update();
     
     uint32_t currentMillis = millis();
@@ -231,7 +357,15 @@ void loop() {
     }
 
     // MPU6050
-    if (mpu.dmpGetCurrentFIFOPacket(fifoBuffer)) {
+    if (imuMode == IMU_MODE_RAW) {
+        sendRawImuSamples();
+    } else if (mpuInterrupt && dmpReady) {
+        // Only check the overflow flag when the IMU tells us something happened, it costs an I2C read
+        mpuInterrupt = false;
+        if (mpu.getIntFIFOBufferOverflowStatus())
+            loopStats.count(LoopStats::COUNTER_FIFO_OVERFLOWS);
+    }
+    if (imuMode == IMU_MODE_DMP && mpu.dmpGetCurrentFIFOPacket(fifoBuffer)) {
         // Send the FIFO buffer
         uint8_t payload[1 + packetSize];
         payload[0] = CMD_IMU_DUMP;
@@ -241,10 +375,23 @@ void loop() {
 
     // If we havent received a servo update in maxSetServoIntervalMillis, set the servos back to their defaults (failsafe)
     if ((currentMillis - lastSetServoMillis) > maxSetServoIntervalMillis) {
+        if (!failsafeActive) {
+            failsafeActive = true;
+            loopStats.count(LoopStats::COUNTER_FAILSAFE_ACTIVATIONS);
+        }
         steeringServo.write(steeringServoDefaultMicros);
         throttleServo.write(throttleServoDefaultMicros);
     } else if (newServoData) {
+        failsafeActive = false;
         steeringServo.write(steeringServoMicrosNew);
         throttleServo.write(throttleServoMicrosNew);
     }
+
+    // Loop stats
+    if ((currentMillis - lastLoopStatsMillis) >= loopStatsIntervalMillis) {
+        lastLoopStatsMillis = currentMillis;
+        sendLoopStats();
+    }
+
+    loopStats.addLoopTime(micros() - loopStartMicros);
 }
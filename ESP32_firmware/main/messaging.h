@@ -74,6 +74,10 @@ private:
     // Message received callback, passes the payload and payload size
     bool (*messageReceivedCallback)(const uint8_t*,const uint16_t);
 public:
+    // Byte counters for diagnostics
+    uint32_t bytesReceived = 0;
+    uint32_t bytesSent = 0;
+
     MessageInterface(Stream &serialPort, bool (*messageReceivedCallback)(const uint8_t*, const uint16_t)) : serialPort(serialPort), messageReceivedCallback(messageReceivedCallback) {}
 
     void tryParseMessageBuffer() {
@@ -144,6 +148,7 @@ public:
             while (serialPort.available()) {
                 messageBuffer[messageBufferPos] = serialPort.read();
                 messageBufferPos = (messageBufferPos + 1) % MAX_MESSAGE_SIZE;
+                bytesReceived++;
             }
 
             // Check if we can parse out a message
@@ -168,6 +173,8 @@ public:
 
         // Write the payload
         serialPort.write(payload, payloadSize);
+
+        bytesSent += 5 + payloadSize;
     }
 };
 
@@ -0,0 +1,107 @@
+#include "alloc_audit.h"
+
+#ifdef MAUS_ALLOCATION_AUDIT
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+static std::atomic<uint64_t> allocationCount{0};
+static std::atomic<uint64_t> allocationBytes{0};
+static std::atomic<uint64_t> guardViolations{0};
+static thread_local uint64_t threadAllocationCount = 0;
+static thread_local bool threadGuarded = false;
+
+static void countAllocation(const size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    threadAllocationCount++;
+    if (threadGuarded && (guardViolations.fetch_add(1, std::memory_order_relaxed) == 0)) {
+        // No printf, it could allocate
+        static const char message[] = "AllocationAudit: allocation on a guarded thread\n";
+        const ssize_t ignored = write(STDERR_FILENO, message, sizeof(message) - 1);
+        (void)ignored;
+    }
+}
+
+static void* allocate(const size_t size) {
+    countAllocation(size);
+    return malloc((size > 0) ? size : 1);
+}
+
+static void* allocateAligned(const size_t size, const std::align_val_t alignment) {
+    countAllocation(size);
+    void* pointer = nullptr;
+    if (posix_memalign(&pointer, std::max((size_t)alignment, sizeof(void*)), (size > 0) ? size : 1) != 0)
+        return nullptr;
+    return pointer;
+}
+
+// Every variant is replaced, not just the ones the others forward to, in case something else (e.g. a sanitizer runtime)
+// provides its own versions of the rest
+void* operator new(size_t size) {
+    void* pointer = allocate(size);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    void* pointer = allocate(size);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    void* pointer = allocateAligned(size, alignment);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    void* pointer = allocateAligned(size, alignment);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocateAligned(size, alignment); }
+
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { free(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { free(pointer); }
+
+bool AllocationAudit::isEnabled() { return true; }
+uint64_t AllocationAudit::getCount() { return allocationCount.load(std::memory_order_relaxed); }
+uint64_t AllocationAudit::getThreadCount() { return threadAllocationCount; }
+uint64_t AllocationAudit::getBytes() { return allocationBytes.load(std::memory_order_relaxed); }
+void AllocationAudit::setThreadGuard(const bool guarded) { threadGuarded = guarded; }
+uint64_t AllocationAudit::getGuardViolations() { return guardViolations.load(std::memory_order_relaxed); }
+
+#else
+
+bool AllocationAudit::isEnabled() { return false; }
+uint64_t AllocationAudit::getCount() { return 0; }
+uint64_t AllocationAudit::getThreadCount() { return 0; }
+uint64_t AllocationAudit::getBytes() { return 0; }
+void AllocationAudit::setThreadGuard(const bool) {}
+uint64_t AllocationAudit::getGuardViolations() { return 0; }
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef __ALLOC_AUDIT_H__
+#define __ALLOC_AUDIT_H__
+
+// Counts heap allocations, to check that hot paths don't allocate once they're warmed up
+// Built with MAUS_ALLOCATION_AUDIT defined (make DEFINES=-DMAUS_ALLOCATION_AUDIT), alloc_audit.cpp replaces the global
+// operator new/delete with counting versions. Without it nothing is replaced, isEnabled() is false and the counts stay
+// 0, so checks built on them pass trivially in regular builds.
+//
+// Only C++ allocations are seen (operator new, so containers, std::string, std::function...), not direct malloc calls.
+//
+//   AllocationAudit::Scope scope;
+//   lidar.parse(bytes, length);
+//   if (scope.getCount() != 0) ...
+//
+// A thread can also be guarded (e.g. the control loop after its first iteration): every allocation made on it while
+// guarded is counted in getGuardViolations(), and the first one prints a warning.
+
+#include <stdint.h>
+
+class AllocationAudit {
+public:
+    static bool isEnabled();
+
+    // Allocations since the program started, by every thread and by the calling one
+    static uint64_t getCount();
+    static uint64_t getThreadCount();
+
+    // Bytes requested by every thread
+    static uint64_t getBytes();
+
+    static void setThreadGuard(const bool guarded);
+    static uint64_t getGuardViolations();
+
+    // Allocations made by the calling thread during the scope's lifetime
+    class Scope {
+    private:
+        const uint64_t startCount;
+
+    public:
+        Scope() : startCount(getThreadCount()) {}
+        uint64_t getCount() const { return getThreadCount() - startCount; }
+    };
+};
+
+#endif
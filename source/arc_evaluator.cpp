@@ -0,0 +1,386 @@
+#include "arc_evaluator.h"
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+#include "timestamp.h"
+
+ArcEvaluator::ArcEvaluator() : ArcEvaluator(Config()) {}
+
+ArcEvaluator::ArcEvaluator(const Config& config) :
+    config(config),
+    arcStride((config.arcCount + SIMD_WIDTH - 1) & ~(SIMD_WIDTH - 1)),
+    steeringMicros(new uint16_t[config.arcCount]),
+    curvatures(new float[config.arcCount]),
+    table(new TableEntry[config.binCount * arcStride / SIMD_WIDTH]),
+    binArcBegin(new uint16_t[config.binCount]),
+    binArcEnd(new uint16_t[config.binCount]),
+    binMaxFar(new float[config.binCount]),
+    activeBins(new uint16_t[config.binCount]),
+    activeDistances(new float[config.binCount]),
+    freeDistances(new float[arcStride]),
+    timesToCollision(new float[config.arcCount]),
+    evaluated(new uint8_t[arcStride]) {
+
+    for (size_t arc = config.arcCount; arc < arcStride; arc++)
+        freeDistances[arc] = config.horizon;
+    for (size_t arc = 0; arc < config.arcCount; arc++) {
+        const float fraction = (config.arcCount > 1) ? ((float)arc / (float)(config.arcCount - 1)) : 0.5f;
+        steeringMicros[arc] = (uint16_t)std::lround(config.minSteeringMicros + (fraction * (config.maxSteeringMicros - config.minSteeringMicros)));
+
+        const float steeringAngle = ((float)steeringMicros[arc] - (float)config.steeringCenterMicros) * config.steeringRadiansPerMicro;
+        curvatures[arc] = std::tan(steeringAngle) / config.wheelbase;
+
+        freeDistances[arc] = config.horizon;
+        timesToCollision[arc] = INFINITY;
+        evaluated[arc] = 0;
+    }
+
+    buildTables();
+}
+
+float ArcEvaluator::collisionDistance(const float x, const float y, const float curvature) const {
+    const float xMin = -(config.footprintRear + config.safetyMargin);
+    const float xMax = config.footprintFront + config.safetyMargin;
+    const float yMax = config.footprintHalfWidth + config.safetyMargin;
+    const float yMin = -yMax;
+
+    // Turning right is the mirror image of turning left (the footprint is symmetric)
+    const float pointY = (curvature < 0.0f) ? -y : y;
+    const float leftCurvature = std::fabs(curvature);
+
+    if ((x >= xMin) && (x <= xMax) && (pointY >= yMin) && (pointY <= yMax))
+        return 0.0f;
+
+    if (leftCurvature < 1e-4f) {
+        if ((pointY < yMin) || (pointY > yMax) || (x < xMax))
+            return -1.0f;
+        const float distance = x - xMax;
+        return (distance <= config.horizon) ? distance : -1.0f;
+    }
+
+    // In the car's frame the point circles the turn center clockwise as the car drives, find where it first crosses the
+    // footprint's outline
+    const float radius = 1.0f / leftCurvature;
+    const float vx = x;
+    const float vy = pointY - radius;
+    const float rhoSquared = (vx * vx) + (vy * vy);
+
+    const float nearestY = std::max(std::max(yMin - radius, 0.0f), radius - yMax);
+    const float farthest = sweptRadius(radius);
+    if ((rhoSquared < (nearestY * nearestY)) || (rhoSquared > (farthest * farthest)))
+        return -1.0f;
+
+    const float startAngle = std::atan2(vy, vx);
+    float firstTurn = INFINITY;
+    auto addCrossing = [&](const float cx, const float cy) {
+        float turn = startAngle - std::atan2(cy, cx);
+        turn -= (2.0f * (float)M_PI) * std::floor(turn / (2.0f * (float)M_PI));
+        firstTurn = std::min(firstTurn, turn);
+    };
+
+    for (const float edgeX : {xMin, xMax}) {
+        if ((edgeX * edgeX) > rhoSquared)
+            continue;
+        const float h = std::sqrt(rhoSquared - (edgeX * edgeX));
+        for (const float cy : {h, -h}) {
+            if (((cy + radius) >= yMin) && ((cy + radius) <= yMax))
+                addCrossing(edgeX, cy);
+        }
+    }
+    for (const float edgeY : {yMin, yMax}) {
+        const float cy = edgeY - radius;
+        if ((cy * cy) > rhoSquared)
+            continue;
+        const float h = std::sqrt(rhoSquared - (cy * cy));
+        for (const float cx : {h, -h}) {
+            if ((cx >= xMin) && (cx <= xMax))
+                addCrossing(cx, cy);
+        }
+    }
+
+    if (firstTurn == INFINITY)
+        return -1.0f;
+    const float distance = firstTurn * radius;
+    return (distance <= config.horizon) ? distance : -1.0f;
+}
+
+float ArcEvaluator::sweptRadius(const float radius) const {
+    // Footprint corner furthest from the turn center (at (0, radius))
+    const float farthestX = std::max(config.footprintRear, config.footprintFront) + config.safetyMargin;
+    const float farthestY = radius + config.footprintHalfWidth + config.safetyMargin;
+    return std::sqrt((farthestX * farthestX) + (farthestY * farthestY));
+}
+
+bool ArcEvaluator::sweptRanges(const float directionX, const float directionY, const float curvature, float& begin, float& end) const {
+    const float yMax = config.footprintHalfWidth + config.safetyMargin;
+    const float mountY = (curvature < 0.0f) ? -config.lidarMount.y : config.lidarMount.y;
+    const float rayY = (curvature < 0.0f) ? -directionY : directionY;
+
+    if (std::fabs(curvature) < 1e-4f) {
+        // Band along the x axis
+        if (std::fabs(rayY) < 1e-6f) {
+            begin = 0.0f;
+            end = (std::fabs(mountY) <= yMax) ? INFINITY : -1.0f;
+        } else {
+            const float a = (-yMax - mountY) / rayY;
+            const float b = (yMax - mountY) / rayY;
+            begin = std::min(a, b);
+            end = std::max(a, b);
+        }
+        return end >= begin;
+    }
+
+    // Disc around the turn center the footprint stays in
+    const float radius = 1.0f / std::fabs(curvature);
+    const float farthest = sweptRadius(radius);
+    const float wx = config.lidarMount.x;
+    const float wy = mountY - radius;
+    const float b = (wx * directionX) + (wy * rayY);
+    const float c = (wx * wx) + (wy * wy) - (farthest * farthest);
+    const float discriminant = (b * b) - c;
+    if (discriminant < 0.0f)
+        return false;
+    begin = -b - std::sqrt(discriminant);
+    end = -b + std::sqrt(discriminant);
+    return true;
+}
+
+void ArcEvaluator::buildTables() {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    static const size_t SUB_ANGLES = 3;     // Bin edges and center, any point in the bin is covered
+    const size_t arcCount = config.arcCount;
+    const float binSize = (2.0f * (float)M_PI) / config.binCount;
+    const float step = config.tableRangeStep;
+
+    // Furthest the swept footprint can be from the lidar
+    const float reachX = config.horizon + config.footprintFront + config.safetyMargin;
+    const float reachY = config.footprintHalfWidth + config.safetyMargin;
+    const float maxRange = std::sqrt((reachX * reachX) + (reachY * reachY)) +
+        std::sqrt((config.lidarMount.x * config.lidarMount.x) + (config.lidarMount.y * config.lidarMount.y));
+    const size_t rangeSteps = (size_t)std::ceil((maxRange - config.minRange) / step) + 1;
+    std::unique_ptr<float[]> hitDistance(new float[rangeSteps]);
+
+    for (size_t bin = 0; bin < config.binCount; bin++) {
+        float directionX[SUB_ANGLES];
+        float directionY[SUB_ANGLES];
+        for (size_t i = 0; i < SUB_ANGLES; i++) {
+            const float angle = config.lidarMount.yaw + ((bin + ((float)i / (SUB_ANGLES - 1))) * binSize);
+            directionX[i] = std::cos(angle);
+            directionY[i] = std::sin(angle);
+        }
+
+        size_t arcBegin = arcCount;
+        size_t arcEnd = 0;
+        float maxFar = -1.0f;
+        for (size_t arc = 0; arc < arcStride; arc++) {
+            // Travel before the first hit at each range, over the directions in the bin
+            for (size_t r = 0; r < rangeSteps; r++)
+                hitDistance[r] = INFINITY;
+            size_t first = rangeSteps;
+            size_t last = 0;
+            for (size_t i = 0; (i < SUB_ANGLES) && (arc < arcCount); i++) {
+                float begin;
+                float end;
+                if (!sweptRanges(directionX[i], directionY[i], curvatures[arc], begin, end))
+                    continue;
+                const float rangeBegin = std::max(std::ceil((begin - config.minRange) / step), 0.0f);
+                const float rangeEnd = std::min(std::floor((end - config.minRange) / step), (float)(rangeSteps - 1));
+                for (size_t r = (size_t)rangeBegin; (float)r <= rangeEnd; r++) {
+                    const float range = config.minRange + (r * step);
+                    const float x = config.lidarMount.x + (range * directionX[i]);
+                    const float y = config.lidarMount.y + (range * directionY[i]);
+                    const float distance = collisionDistance(x, y, curvatures[arc]);
+                    if ((distance >= 0.0f) && (distance < hitDistance[r])) {
+                        hitDistance[r] = distance;
+                        first = std::min(first, r);
+                        last = std::max(last, r);
+                    }
+                }
+            }
+
+            TableEntry& entry = table[((bin * arcStride) + arc) / SIMD_WIDTH];
+            const size_t lane = arc % SIMD_WIDTH;
+            if ((arc >= arcCount) || (first == rangeSteps)) {
+                entry.near[lane] = FAR_AWAY;
+                entry.far[lane] = -1.0f;
+                entry.sMin[lane] = config.horizon;
+                entry.sNear[lane] = config.horizon;
+                entry.slope[lane] = 0.0f;
+                continue;
+            }
+
+            // Lower bound of the travel over the hit ranges: the closest hit, or a line through the last closest hit
+            // and the furthest one (close points are usually already in the footprint's path, further ones get there
+            // later). Widened by a range step each way for the ranges between samples
+            size_t kink = first;
+            for (size_t r = first; r <= last; r++) {
+                if (hitDistance[r] <= hitDistance[kink])
+                    kink = r;
+            }
+            const float nearRange = config.minRange + (first * step);
+            const float farRange = config.minRange + (last * step);
+            const float slope = (last > kink) ? ((hitDistance[last] - hitDistance[kink]) / ((last - kink) * step)) : 0.0f;
+            float offset = hitDistance[kink];
+            for (size_t r = first; r <= last; r++) {
+                if (hitDistance[r] != INFINITY)
+                    offset = std::min(offset, hitDistance[r] - (slope * ((float)r - (float)first) * step));
+            }
+
+            entry.near[lane] = nearRange - step;
+            entry.far[lane] = farRange + step;
+            entry.sMin[lane] = hitDistance[kink];
+            entry.sNear[lane] = offset - (slope * step) - (std::fabs(slope) * step);
+            entry.slope[lane] = slope;
+
+            arcBegin = std::min(arcBegin, arc);
+            arcEnd = arc + 1;
+            maxFar = std::max(maxFar, entry.far[lane]);
+        }
+
+        binArcBegin[bin] = (arcBegin < arcEnd) ? arcBegin : 0;
+        binArcEnd[bin] = (arcBegin < arcEnd) ? arcEnd : 0;
+        binMaxFar[bin] = maxFar;
+    }
+
+    stats.buildNsecs = TimeStamp::getMonotonic() - startTime;
+}
+
+void ArcEvaluator::evaluateBlock(const size_t begin, const size_t end) {
+    float* freeDistance = freeDistances.get();
+
+    for (size_t arc = begin; arc < end; arc++)
+        freeDistance[arc] = config.horizon;
+
+    for (size_t i = 0; i < activeCount; i++) {
+        const size_t bin = activeBins[i];
+
+        // Whole vectors, the padding and the arcs outside the bin's range can't hit anything
+        const size_t arcBegin = std::max(begin, (size_t)binArcBegin[bin] & ~(SIMD_WIDTH - 1));
+        const size_t arcEnd = std::min(end, ((size_t)binArcEnd[bin] + SIMD_WIDTH - 1) & ~(SIMD_WIDTH - 1));
+        if (arcBegin >= arcEnd)
+            continue;
+
+        const float distance = activeDistances[i];
+        const FloatVector distances = {distance, distance, distance, distance};
+        const TableEntry* entry = &table[((bin * arcStride) + arcBegin) / SIMD_WIDTH];
+        float* free = &freeDistance[arcBegin];
+
+        // memcpy loads and stores, a float array from new is only 8 byte aligned on armv7 (they compile to plain
+        // vector loads and stores either way)
+        const size_t vectors = (arcEnd - arcBegin) / SIMD_WIDTH;
+        for (size_t v = 0; v < vectors; v++) {
+            FloatVector current;
+            memcpy(&current, &free[v * SIMD_WIDTH], sizeof(current));
+            FloatVector travel = entry[v].sNear + (entry[v].slope * (distances - entry[v].near));
+            travel = (travel < entry[v].sMin) ? entry[v].sMin : travel;
+            const IntVector hit = (distances >= entry[v].near) & (distances <= entry[v].far) & (travel < current);
+            current = hit ? travel : current;
+            memcpy(&free[v * SIMD_WIDTH], &current, sizeof(current));
+        }
+        stats.arcBinChecks += arcEnd - arcBegin;
+    }
+
+    for (size_t arc = begin; arc < end; arc++) {
+        freeDistance[arc] = std::max(freeDistance[arc], 0.0f);
+        evaluated[arc] = 1;
+    }
+}
+
+ArcEvaluator::Result ArcEvaluator::evaluate(const float* distances, const size_t binCount, const float speed,
+    const uint16_t preferredSteeringMicros) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+    const uint64_t deadline = startTime + config.timeBudgetNsecs;
+
+    Result result = {};
+    memset(evaluated.get(), 0, arcStride);
+
+    if (binCount != config.binCount) {
+        printf("ArcEvaluator: scan has %zu bins, the tables are for %zu\n", binCount, config.binCount);
+        return result;
+    }
+
+    // Only bins with a point close enough to hit something matter
+    activeCount = 0;
+    for (size_t bin = 0; bin < binCount; bin++) {
+        const float distance = distances[bin];
+        if ((distance >= config.minRange) && (distance <= binMaxFar[bin])) {
+            activeBins[activeCount] = bin;
+            activeDistances[activeCount] = distance;
+            activeCount++;
+        }
+    }
+
+    // Arc closest to the preferred steering
+    size_t preferredArc = 0;
+    for (size_t arc = 1; arc < config.arcCount; arc++) {
+        if (std::abs((int)steeringMicros[arc] - (int)preferredSteeringMicros) < std::abs((int)steeringMicros[preferredArc] - (int)preferredSteeringMicros))
+            preferredArc = arc;
+    }
+
+    // Blocks outwards from the preferred one until the budget runs out
+    const size_t blockSize = (std::max(config.arcsPerBlock, (size_t)1) + SIMD_WIDTH - 1) & ~(SIMD_WIDTH - 1);
+    const int blockCount = (int)((config.arcCount + blockSize - 1) / blockSize);
+    const int preferredBlock = (int)(preferredArc / blockSize);
+    for (int step = 0; step <= (2 * blockCount); step++) {
+        const int block = preferredBlock + ((step & 1) ? ((step + 1) / 2) : -(step / 2));
+        if ((block < 0) || (block >= blockCount))
+            continue;
+        if ((result.evaluatedArcs > 0) && (TimeStamp::getMonotonic() > deadline)) {
+            result.timedOut = true;
+            break;
+        }
+
+        const size_t begin = block * blockSize;
+        const size_t end = std::min(begin + blockSize, arcStride);
+        evaluateBlock(begin, end);
+        result.evaluatedArcs += std::min(end, config.arcCount) - begin;
+    }
+
+    // Times to collision and the best arc
+    result.bestArc = preferredArc;
+    result.bestFreeDistance = -1.0f;
+    for (size_t arc = 0; arc < config.arcCount; arc++) {
+        if (!evaluated[arc]) {
+            timesToCollision[arc] = INFINITY;
+            continue;
+        }
+
+        const bool blocked = freeDistances[arc] < config.horizon;
+        timesToCollision[arc] = (blocked && (speed > 0.0f)) ? (freeDistances[arc] / speed) : INFINITY;
+
+        const size_t offset = (arc > preferredArc) ? (arc - preferredArc) : (preferredArc - arc);
+        const size_t bestOffset = (result.bestArc > preferredArc) ? (result.bestArc - preferredArc) : (preferredArc - result.bestArc);
+        if ((freeDistances[arc] > result.bestFreeDistance) || ((freeDistances[arc] == result.bestFreeDistance) && (offset < bestOffset))) {
+            result.bestArc = arc;
+            result.bestFreeDistance = freeDistances[arc];
+        }
+    }
+    result.bestSteeringMicros = steeringMicros[result.bestArc];
+    result.elapsedNsecs = TimeStamp::getMonotonic() - startTime;
+
+    stats.evaluations++;
+    if (result.timedOut)
+        stats.timeouts++;
+    stats.totalEvaluateNsecs += result.elapsedNsecs;
+    if (result.elapsedNsecs > stats.maxEvaluateNsecs)
+        stats.maxEvaluateNsecs = result.elapsedNsecs;
+
+    return result;
+}
+
+ArcEvaluator::Result ArcEvaluator::evaluate(const BinnedScan::Scan& scan, const float speed, const uint16_t preferredSteeringMicros) {
+    return evaluate(scan.distance, scan.binCount, speed, preferredSteeringMicros);
+}
+
+void ArcEvaluator::printStats() const {
+    const double checksPerSec = stats.totalEvaluateNsecs ? (stats.arcBinChecks * 1e9 / stats.totalEvaluateNsecs) : 0.0;
+    printf("ArcEvaluator: %zu arcs x %zu bins, tables built in %llu ms\n", config.arcCount, config.binCount,
+        (unsigned long long)(stats.buildNsecs / NSECS_TO_MSECS));
+    printf("  %llu evaluations, %llu timed out, mean %llu us, max %llu us, %.1f M arc-bin checks/s\n",
+        (unsigned long long)stats.evaluations, (unsigned long long)stats.timeouts,
+        (unsigned long long)(stats.getMeanEvaluateNsecs() / NSECS_TO_USECS), (unsigned long long)(stats.maxEvaluateNsecs / NSECS_TO_USECS),
+        checksPerSec / 1e6);
+}
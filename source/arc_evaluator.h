@@ -0,0 +1,148 @@
+#ifndef __ARC_EVALUATOR_H__
+#define __ARC_EVALUATOR_H__
+
+// Collision checking of constant curvature arcs against a BinnedScan, for picking a steering command
+// Each candidate arc is a steering pulse (same units as MausBoard::sendSetServos) turned into a curvature with a
+// bicycle model. The footprint swept along every arc is precomputed once into per angle bin lookup tables: a point in
+// bin b at distance d hits arc a if d is within [near, far] of that (bin, arc) entry, and the car gets there after at
+// least max(sMin, sNear + slope * (d - near)) meters of travel. Evaluating a scan is then a branch-free min over the arcs for each
+// bin close enough to matter, with the arcs contiguous so the inner loop runs on 4 arcs per SIMD vector (GCC vector
+// extensions, NEON on the Pi and SSE on x86) and streams through one interleaved table.
+//
+// Arcs are evaluated in blocks, closest to the preferred steering first, and the evaluation stops at the time budget
+// (arcs that weren't reached are left unevaluated).
+//
+// The vehicle frame origin is taken at the rear axle here (the point that follows the arc), bins are the lidar's
+// angles counter-clockwise from straight ahead like BinnedScan's.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+
+#include "binned_scan.h"
+#include "pose2d.h"
+
+class ArcEvaluator {
+public:
+    struct Config {
+        // Candidate arcs, evenly spaced steering pulses
+        uint16_t minSteeringMicros = 1000;
+        uint16_t maxSteeringMicros = 2000;
+        size_t arcCount = 201;
+
+        // Bicycle model
+        uint16_t steeringCenterMicros = 1500;
+        float steeringRadiansPerMicro = 0.4f / 500.0f; // Front wheel angle per microsecond from center, negative if longer pulses steer right
+        float wheelbase = 0.26f;                    // Meters
+
+        // Footprint rectangle around the rear axle, meters
+        float footprintFront = 0.38f;
+        float footprintRear = 0.08f;
+        float footprintHalfWidth = 0.145f;
+        float safetyMargin = 0.03f;
+        Pose2D lidarMount;                          // Lidar pose relative to the rear axle
+
+        float horizon = 3.0f;                       // Meters of travel checked along each arc
+        float minRange = 0.05f;                     // Closer points are ignored (the car itself)
+        size_t binCount = 720;                      // Must match the BinnedScan
+        float tableRangeStep = 0.02f;               // Meters, range sampling when building the tables
+
+        size_t arcsPerBlock = 32;
+        uint64_t timeBudgetNsecs = 2 * 1000000ull;
+    };
+
+    struct Result {
+        size_t bestArc;                             // Most free distance, ties go to the one closest to the preferred steering
+        uint16_t bestSteeringMicros;
+        float bestFreeDistance;
+        size_t evaluatedArcs;
+        bool timedOut;
+        uint64_t elapsedNsecs;
+    };
+
+    struct Stats {
+        uint64_t evaluations;
+        uint64_t timeouts;
+        uint64_t arcBinChecks;                      // Table entries tested
+        uint64_t totalEvaluateNsecs;
+        uint64_t maxEvaluateNsecs;
+        uint64_t buildNsecs;
+
+        uint64_t getMeanEvaluateNsecs() const { return evaluations ? (totalEvaluateNsecs / evaluations) : 0; }
+    };
+
+private:
+    // Past every real distance, for entries and bins that can't collide
+    static constexpr float FAR_AWAY = 1e9f;
+
+    static const size_t SIMD_WIDTH = 4;
+    typedef float FloatVector __attribute__((vector_size(16)));
+    typedef int32_t IntVector __attribute__((vector_size(16)));
+
+    const Config config;
+    const size_t arcStride;                         // arcCount rounded up to whole vectors
+
+    // Arcs
+    std::unique_ptr<uint16_t[]> steeringMicros;
+    std::unique_ptr<float[]> curvatures;
+
+    // Lookup tables, SIMD_WIDTH arcs per entry, [bin * arcStride / SIMD_WIDTH + arc / SIMD_WIDTH]
+    struct TableEntry {
+        FloatVector near;
+        FloatVector far;
+        FloatVector sMin;
+        FloatVector sNear;
+        FloatVector slope;
+    };
+    std::unique_ptr<TableEntry[]> table;
+
+    // Per bin, arcs [arcBegin, arcEnd) that can collide there and the furthest distance that can
+    std::unique_ptr<uint16_t[]> binArcBegin;
+    std::unique_ptr<uint16_t[]> binArcEnd;
+    std::unique_ptr<float[]> binMaxFar;
+
+    // Bins of the current scan that are close enough to hit something
+    std::unique_ptr<uint16_t[]> activeBins;
+    std::unique_ptr<float[]> activeDistances;
+    size_t activeCount = 0;
+
+    // Output, per arc
+    std::unique_ptr<float[]> freeDistances;
+    std::unique_ptr<float[]> timesToCollision;
+    std::unique_ptr<uint8_t[]> evaluated;
+
+    Stats stats = {};
+
+    float sweptRadius(const float radius) const;
+    bool sweptRanges(const float directionX, const float directionY, const float curvature, float& begin, float& end) const;
+    float collisionDistance(const float x, const float y, const float curvature) const;
+    void buildTables();
+    void evaluateBlock(const size_t begin, const size_t end);
+
+public:
+    // Builds the tables, which takes a while (1.5s on x86 for the defaults, several on a Pi), do it at startup
+    ArcEvaluator();
+    ArcEvaluator(const Config& config);
+
+    // Checks every arc against a scan. speed (m/s) is only used for the times to collision
+    Result evaluate(const BinnedScan::Scan& scan, const float speed, const uint16_t preferredSteeringMicros = 1500);
+
+    // Same, from binCount distances in meters (0 where there's no point)
+    Result evaluate(const float* distances, const size_t binCount, const float speed, const uint16_t preferredSteeringMicros = 1500);
+
+    size_t getArcCount() const { return config.arcCount; }
+    uint16_t getSteeringMicros(const size_t arc) const { return steeringMicros[arc]; }
+    float getCurvature(const size_t arc) const { return curvatures[arc]; }
+
+    // Results of the latest evaluate(). Free distance is meters of travel before the footprint hits a point (horizon if
+    // nothing), time to collision is that at the current speed (infinity if nothing or not moving forward)
+    bool isEvaluated(const size_t arc) const { return evaluated[arc] != 0; }
+    float getFreeDistance(const size_t arc) const { return freeDistances[arc]; }
+    float getTimeToCollision(const size_t arc) const { return timesToCollision[arc]; }
+
+    const Config& getConfig() const { return config; }
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+#endif
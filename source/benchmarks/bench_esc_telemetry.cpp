@@ -0,0 +1,107 @@
+// ESCTelemetryFramer cost per received byte (ns), against the firmware's old search: unwrap the 10 byte ring and run
+// the bit-serial CRC over it for every byte. Host numbers, the ESP32 is slower but the ratio is what the table buys.
+// A stream of frames with a burst of garbage every 50 or so. Fails if the framer misses more than 0.1% of the frames:
+// after garbage it hunts byte by byte, and a CRC match by chance can cost the frame after it.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+
+// esc_telemetry.h's ESCTelemetry reads from an Arduino Stream, only the framer is used here
+class Stream {
+public:
+    int available() { return 0; }
+    int read() { return 0; }
+};
+
+#include "esc_telemetry.h"
+#include "timestamp.h"
+
+// The firmware's ESCTelemetry::update() before the framer, one byte at a time
+struct BitSerialSearch {
+    uint8_t ring[ESC_TELEMETRY_BUF_SIZE] = {};
+    uint8_t ringPos = 0;
+    uint8_t buffer[ESC_TELEMETRY_BUF_SIZE];
+
+    static uint8_t getCRC8(const uint8_t* data, const uint8_t length) {
+        uint8_t crc = 0;
+        for (uint8_t i = 0; i < length; i++) {
+            uint8_t crcU = data[i] ^ crc;
+            for (uint8_t j = 0; j < 8; j++)
+                crcU = (crcU & 0x80) ? (0x7 ^ (crcU << 1)) : (crcU << 1);
+            crc = crcU;
+        }
+        return crc;
+    }
+
+    bool push(const uint8_t byte) {
+        ring[ringPos] = byte;
+        uint8_t unwrapped[ESC_TELEMETRY_BUF_SIZE];
+        for (uint8_t i = 0; i < ESC_TELEMETRY_BUF_SIZE; i++)
+            unwrapped[i] = ring[(ringPos + 1 + i) % ESC_TELEMETRY_BUF_SIZE];
+        ringPos = (ringPos + 1) % ESC_TELEMETRY_BUF_SIZE;
+
+        if (getCRC8(unwrapped, ESC_TELEMETRY_DATA_SIZE) != unwrapped[ESC_TELEMETRY_DATA_SIZE])
+            return false;
+        memcpy(buffer, unwrapped, ESC_TELEMETRY_BUF_SIZE);
+        return true;
+    }
+};
+
+int main() {
+    std::mt19937 random(26);
+    std::vector<uint8_t> stream;
+    std::vector<size_t> frameEnds;
+    while (stream.size() < 1000000) {
+        if ((random() % 50) == 0) {
+            for (int i = 0; i < 7; i++)
+                stream.push_back((uint8_t)random());
+        }
+        uint8_t frame[ESC_TELEMETRY_BUF_SIZE];
+        for (size_t i = 0; i < ESC_TELEMETRY_DATA_SIZE; i++)
+            frame[i] = (uint8_t)random();
+        frame[ESC_TELEMETRY_DATA_SIZE] = BitSerialSearch::getCRC8(frame, ESC_TELEMETRY_DATA_SIZE);
+        stream.insert(stream.end(), frame, frame + ESC_TELEMETRY_BUF_SIZE);
+        frameEnds.push_back(stream.size() - 1);
+    }
+
+    const int rounds = 10;
+    size_t framerFound = 0;
+    size_t framerMissed = 0;
+    uint64_t start = TimeStamp::getMonotonic();
+    for (int round = 0; round < rounds; round++) {
+        ESCTelemetryFramer framer;
+        size_t nextFrame = 0;
+        for (size_t i = 0; i < stream.size(); i++) {
+            const bool found = framer.push(stream[i]);
+            framerFound += found ? 1 : 0;
+            if (i == frameEnds[nextFrame]) {
+                framerMissed += found ? 0 : 1;
+                nextFrame++;
+            }
+        }
+    }
+    const double framerNsecs = (double)(TimeStamp::getMonotonic() - start) / (rounds * stream.size());
+
+    size_t bitSerialFound = 0;
+    start = TimeStamp::getMonotonic();
+    for (int round = 0; round < rounds; round++) {
+        BitSerialSearch search;
+        for (size_t i = 0; i < stream.size(); i++)
+            bitSerialFound += search.push(stream[i]) ? 1 : 0;
+    }
+    const double bitSerialNsecs = (double)(TimeStamp::getMonotonic() - start) / (rounds * stream.size());
+
+    printf("ESC telemetry: %zu bytes, %zu frames\n", stream.size(), frameEnds.size());
+    const size_t framerFalse = (framerFound - ((frameEnds.size() * rounds) - framerMissed)) / rounds;
+    printf("  framer      %6.2f ns/byte, %zu frames found, %zu missed, %zu false\n", framerNsecs, framerFound / rounds,
+        framerMissed / rounds, framerFalse);
+    printf("  bit-serial  %6.2f ns/byte, %zu frames found (including CRC matches inside frames)\n", bitSerialNsecs,
+        bitSerialFound / rounds);
+    if ((framerMissed / rounds) > (frameEnds.size() / 1000)) {
+        printf("FAIL: the framer missed frames\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+// ImuFusion cost per sample (ns) at the raw mode's 1kHz, in the firmware's batches of 8
+// A minute of samples: stopped for the bias to be learned, then driving with a slow yaw rate and vibration. The budget
+// is 1% of a core at 1kHz (10us a sample), which leaves room for the rest of the estimator thread on a Pi 4. Fails above
+// it, or if the yaw doesn't come out right.
+
+#include <stdio.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "imu_fusion.h"
+#include "pose2d.h"
+
+static const uint64_t MAX_SAMPLE_NSECS = 10 * NSECS_TO_USECS;
+static const size_t BATCH_SIZE = 8;
+
+int main() {
+    const float gyroRadiansPerCount = (float)(M_PI / 180.0) / 16.4f;
+    const float yawRate = 0.3f;
+    const int stoppedSamples = 10000;
+    const int samples = 60000;
+
+    std::mt19937 random(35);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::vector<MausBoard::RawImuSample> recording(samples);
+    for (int i = 0; i < samples; i++) {
+        const bool moving = i >= stoppedSamples;
+        const float vibration = moving ? 400.0f : 30.0f;
+        MausBoard::RawImuSample& sample = recording[i];
+        sample.timestamp = (1000 * (uint64_t)NSECS_TO_SECS) + (i * (uint64_t)NSECS_TO_MSECS);
+        sample.deviceMicros = i * 1000;
+        sample.gyroX = (int16_t)std::lround(-8 + noise(random));
+        sample.gyroY = (int16_t)std::lround(5 + noise(random));
+        sample.gyroZ = (int16_t)std::lround(20 + (moving ? (yawRate / gyroRadiansPerCount) : 0.0f) + noise(random));
+        sample.accelX = (int16_t)std::lround(vibration * noise(random));
+        sample.accelY = (int16_t)std::lround(vibration * noise(random));
+        sample.accelZ = (int16_t)std::lround(8192 + (vibration * noise(random)));
+    }
+
+    ImuFusion fusion;
+    MausBoard::EscTelemetry escTelemetry = {};
+    float startYaw = 0.0f;
+    for (int offset = 0; offset < samples; offset += BATCH_SIZE) {
+        if (offset == stoppedSamples) {
+            startYaw = fusion.getState().getYawRadians();
+            escTelemetry.ERPM = 2000;
+        }
+        fusion.addEscTelemetry(escTelemetry, (offset < stoppedSamples) ? 1500 : 1650);
+        fusion.update(&recording[offset], BATCH_SIZE);
+    }
+
+    const ImuFusion::Stats& stats = fusion.getStats();
+    const float drivenSecs = (samples - stoppedSamples) * 0.001f;
+    const float yawError = std::fabs(Pose2D::wrapAngle(fusion.getState().getYawRadians() - startYaw - (yawRate * drivenSecs)));
+    printf("ImuFusion: %llu samples in batches of %zu, mean %llu ns/sample, max %.1f us/batch (budget %llu ns/sample)\n",
+        (unsigned long long)stats.samples, BATCH_SIZE, (unsigned long long)stats.getMeanSampleNsecs(),
+        (double)stats.maxBatchNsecs / NSECS_TO_USECS, (unsigned long long)MAX_SAMPLE_NSECS);
+    printf("  yaw error after %.0f s driving %.4f rad, gyro bias z %.5f rad/s\n", drivenSecs, yawError,
+        fusion.getState().gyroBias[2]);
+    if (stats.getMeanSampleNsecs() > MAX_SAMPLE_NSECS) {
+        printf("FAIL: over the 1kHz budget\n");
+        return 1;
+    }
+    if (yawError > 0.05f) {
+        printf("FAIL: the yaw is off\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+// ObstacleTracker cost per scan on synthetic multi-car scenes
+// The car drives slowly through a 12 x 10 m room while 2, 4 and 8 other cars (0.45 x 0.2 m boxes) cross it at up to
+// 1.5 m/s, with LD19 like range noise. A last scene with a post in every other beam fills all MAX_CLUSTERS, the worst
+// case for segmentation. Fails if the moving cars aren't tracked or their speeds are off, so the timing is of a tracker
+// that works.
+
+#include <stdio.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "obstacle_tracker.h"
+
+static const size_t POINTS_PER_SCAN = 456;
+static const uint64_t SCAN_INTERVAL_NSECS = 100 * NSECS_TO_MSECS;
+
+struct Car {
+    float x;
+    float y;
+    float yaw;
+    float speed;
+};
+
+// Distance along a ray to a 0.45 x 0.2 m box, INFINITY on a miss
+static float raycastCar(const float originX, const float originY, const float dx, const float dy, const Car& car) {
+    const float c = std::cos(car.yaw);
+    const float s = std::sin(car.yaw);
+    const float localX = ((originX - car.x) * c) + ((originY - car.y) * s);
+    const float localY = ((originY - car.y) * c) - ((originX - car.x) * s);
+    const float localDx = (dx * c) + (dy * s);
+    const float localDy = (dy * c) - (dx * s);
+    const float halfSize[2] = {0.225f, 0.1f};
+    const float origin[2] = {localX, localY};
+    const float direction[2] = {localDx, localDy};
+
+    float enter = -INFINITY;
+    float exit = INFINITY;
+    for (int axis = 0; axis < 2; axis++) {
+        if (std::fabs(direction[axis]) < 1e-9f) {
+            if (std::fabs(origin[axis]) > halfSize[axis])
+                return INFINITY;
+            continue;
+        }
+        float near = (-halfSize[axis] - origin[axis]) / direction[axis];
+        float far = (halfSize[axis] - origin[axis]) / direction[axis];
+        if (near > far)
+            std::swap(near, far);
+        enter = std::max(enter, near);
+        exit = std::min(exit, far);
+    }
+    return ((enter <= exit) && (enter > 0.0f)) ? enter : INFINITY;
+}
+
+static float raycastRoom(const float originX, const float originY, const float dx, const float dy) {
+    float best = INFINITY;
+    if (dx > 0.0f) best = std::min(best, (6.0f - originX) / dx);
+    if (dx < 0.0f) best = std::min(best, (-6.0f - originX) / dx);
+    if (dy > 0.0f) best = std::min(best, (5.0f - originY) / dy);
+    if (dy < 0.0f) best = std::min(best, (-5.0f - originY) / dy);
+    return best;
+}
+
+static void simulateScan(std::vector<LD19::LidarPoint>& points, const Pose2D& pose, const std::vector<Car>& cars,
+    const float postSpacing, const uint64_t timestamp, std::mt19937& random) {
+    std::normal_distribution<float> noise(0.0f, 0.008f);
+    for (size_t i = 0; i < points.size(); i++) {
+        points[i].angle = (uint16_t)((i * 36000) / points.size());
+        points[i].intensity = 100;
+        points[i].timestamp = timestamp;
+        const float angle = pose.yaw + points[i].getAngleRadians();
+        const float dx = std::cos(angle);
+        const float dy = std::sin(angle);
+
+        float range = raycastRoom(pose.x, pose.y, dx, dy);
+        for (const Car& car : cars)
+            range = std::min(range, raycastCar(pose.x, pose.y, dx, dy, car));
+        // Every other point hits a post close by, every point its own cluster
+        if ((postSpacing > 0.0f) && ((i % 2) == 0))
+            range = std::min(range, postSpacing);
+        points[i].distance = (uint16_t)(std::max(range + noise(random), 0.0f) * 1000.0f);
+    }
+}
+
+// Returns false if the tracker didn't follow the cars
+static bool runScene(const size_t carCount, const float postSpacing) {
+    std::mt19937 random(carCount + 1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<Car> cars(carCount);
+    for (size_t i = 0; i < carCount; i++) {
+        // Spread around the room, away from the car's path along y = 0
+        const float angle = (2.0f * (float)M_PI * i) / carCount;
+        cars[i].x = 3.5f * std::cos(angle);
+        cars[i].y = ((i % 2) ? 1.5f : -1.5f) + (1.5f * std::sin(angle));
+        cars[i].yaw = 2.0f * (float)M_PI * uniform(random);
+        cars[i].speed = 0.5f + uniform(random);
+    }
+
+    ObstacleTracker tracker;
+    std::vector<LD19::LidarPoint> points(POINTS_PER_SCAN);
+    const int scans = 600;
+    const float dt = (float)SCAN_INTERVAL_NSECS / NSECS_TO_SECS;
+    float speedError = 0.0f;
+    size_t speedSamples = 0;
+    size_t missedCars = 0;
+    for (int scan = 0; scan < scans; scan++) {
+        const uint64_t timestamp = scan * SCAN_INTERVAL_NSECS;
+        const Pose2D pose(-2.0f + (0.005f * scan), 0.0f, 0.0f);
+        simulateScan(points, pose, cars, postSpacing, timestamp, random);
+        tracker.update(points.data(), points.size(), pose, timestamp);
+
+        // After settling, every car should have a confirmed track at its speed
+        if ((postSpacing == 0.0f) && (scan >= 20)) {
+            for (const Car& car : cars) {
+                bool found = false;
+                for (size_t i = 0; i < tracker.getTrackCount(); i++) {
+                    const ObstacleTracker::Track& track = tracker.getTrack(i);
+                    if (track.confirmed && (std::hypot(track.x - car.x, track.y - car.y) < 0.3f)) {
+                        speedError += std::fabs(track.getSpeed() - car.speed);
+                        speedSamples++;
+                        found = true;
+                        break;
+                    }
+                }
+                missedCars += found ? 0 : 1;
+            }
+        }
+
+        // Straight lines, bouncing off the walls
+        for (Car& car : cars) {
+            car.x += car.speed * std::cos(car.yaw) * dt;
+            car.y += car.speed * std::sin(car.yaw) * dt;
+            if (std::fabs(car.x) > 5.0f)
+                car.yaw = (float)M_PI - car.yaw;
+            if (std::fabs(car.y) > 4.0f)
+                car.yaw = -car.yaw;
+        }
+    }
+
+    const ObstacleTracker::Stats& stats = tracker.getStats();
+    const double meanUsecs = (double)(stats.totalSegmentNsecs + stats.totalFitNsecs + stats.totalTrackNsecs) / stats.scans / NSECS_TO_USECS;
+    if (postSpacing > 0.0f) {
+        printf("  posts: %.1f us per scan (max %.1f us), %zu clusters\n", meanUsecs, (double)stats.maxScanNsecs / NSECS_TO_USECS,
+            tracker.getClusterCount());
+        return true;
+    }
+
+    const float meanSpeedError = speedSamples ? (speedError / speedSamples) : INFINITY;
+    const float missedRatio = (float)missedCars / ((scans - 20) * carCount);
+    printf("  %zu cars: %.1f us per scan (max %.1f us), %.1f clusters per scan, %.1f%% missed, speed error %.3f m/s\n",
+        carCount, meanUsecs, (double)stats.maxScanNsecs / NSECS_TO_USECS, (double)stats.clusters / stats.scans,
+        100.0f * missedRatio, meanSpeedError);
+    // Cars pass behind each other and close to the walls, a few misses are expected
+    return (missedRatio < 0.25f) && (meanSpeedError < 0.2f);
+}
+
+int main() {
+    printf("ObstacleTracker: %zu point scans\n", POINTS_PER_SCAN);
+    bool passed = true;
+    for (size_t carCount : {2, 4, 8})
+        passed &= runScene(carCount, 0.0f);
+    passed &= runScene(0, 1.0f);
+    if (!passed) {
+        printf("FAIL: the cars weren't tracked\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+// OccupancyGrid integration time per scan (ms) over a full synthetic track at 5cm
+// An oval track, 50 x 24 m along the middle with walls 1.5 m either side, driven for two laps at about 3 m/s with the
+// LD19's 10Hz scans. Long enough for the grid to page tiles out behind the car. Fails if the mean doesn't keep up with
+// 10Hz (100 ms a scan), or if the map doesn't show the walls occupied and the middle of the track free.
+
+#include <stdio.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "occupancy_grid.h"
+
+static const size_t POINTS_PER_SCAN = 456;
+static const uint64_t MAX_SCAN_NSECS = 100 * NSECS_TO_MSECS;
+
+static const float TRACK_A = 25.0f;     // Semi-axes of the middle of the track
+static const float TRACK_B = 12.0f;
+static const float HALF_WIDTH = 1.5f;
+
+// Nearest hit of a ray from inside or outside an ellipse centered on the origin, 1e9 for none
+static float raycastEllipse(const float originX, const float originY, const float c, const float s, const float a, const float b) {
+    const float qa = ((c * c) / (a * a)) + ((s * s) / (b * b));
+    const float qb = ((originX * c) / (a * a)) + ((originY * s) / (b * b));
+    const float qc = ((originX * originX) / (a * a)) + ((originY * originY) / (b * b)) - 1.0f;
+    const float discriminant = (qb * qb) - (qa * qc);
+    if (discriminant < 0.0f)
+        return 1e9f;
+    const float root = std::sqrt(discriminant);
+    const float near = (-qb - root) / qa;
+    const float far = (-qb + root) / qa;
+    return (near > 0.0f) ? near : ((far > 0.0f) ? far : 1e9f);
+}
+
+static float raycast(const float originX, const float originY, const float angle) {
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+    return std::min(raycastEllipse(originX, originY, c, s, TRACK_A + HALF_WIDTH, TRACK_B + HALF_WIDTH),
+        raycastEllipse(originX, originY, c, s, TRACK_A - HALF_WIDTH, TRACK_B - HALF_WIDTH));
+}
+
+static void simulateScan(std::vector<LD19::LidarPoint>& points, const Pose2D& pose, std::mt19937& random) {
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    for (size_t i = 0; i < points.size(); i++) {
+        points[i].angle = (uint16_t)(i * 36000 / points.size());
+        const float range = raycast(pose.x, pose.y, pose.yaw + points[i].getAngleRadians()) + noise(random);
+        points[i].distance = (uint16_t)(std::min(range, 20.0f) * 1000.0f);
+    }
+}
+
+static Pose2D trajectory(const float t) {
+    return Pose2D(TRACK_A * std::cos(t), TRACK_B * std::sin(t),
+        Pose2D::wrapAngle(std::atan2(TRACK_B * std::cos(t), -TRACK_A * std::sin(t))));
+}
+
+// Highest log-odds of the cell and its neighbors, a wall point sampled on the ellipse can land a cell off the hits
+static int8_t getMaxLogOddsAround(const OccupancyGrid& grid, const float x, const float y) {
+    const int32_t cellX = grid.worldToCell(x);
+    const int32_t cellY = grid.worldToCell(y);
+    int8_t best = grid.getCellLogOdds(cellX, cellY);
+    for (int32_t dy = -1; dy <= 1; dy++) {
+        for (int32_t dx = -1; dx <= 1; dx++)
+            best = std::max(best, grid.getCellLogOdds(cellX + dx, cellY + dy));
+    }
+    return best;
+}
+
+int main() {
+    OccupancyGrid::Config config;
+    config.resolution = 0.05f;
+    OccupancyGrid grid(config);
+
+    // 0.3 m a scan along the middle of the track
+    std::mt19937 random(36);
+    std::vector<LD19::LidarPoint> points(POINTS_PER_SCAN);
+    const float meanRadius = 0.5f * (TRACK_A + TRACK_B);
+    const float step = 0.3f / meanRadius;
+    const int scans = (int)(2.0f * 2.0f * (float)M_PI / step);
+    for (int i = 0; i < scans; i++) {
+        const Pose2D pose = trajectory(i * step);
+        simulateScan(points, pose, random);
+        grid.integrateScan(points.data(), points.size(), pose);
+    }
+
+    // The walls and the middle around the last stretch, still in memory
+    int wrongCells = 0;
+    const float end = (scans - 1) * step;
+    for (int i = 0; i < 20; i++) {
+        const float t = end - (i * 0.01f);
+        const float x = std::cos(t);
+        const float y = std::sin(t);
+        if (getMaxLogOddsAround(grid, (TRACK_A + HALF_WIDTH) * x, (TRACK_B + HALF_WIDTH) * y) <= 0)
+            wrongCells++;
+        if (getMaxLogOddsAround(grid, (TRACK_A - HALF_WIDTH) * x, (TRACK_B - HALF_WIDTH) * y) <= 0)
+            wrongCells++;
+        if (grid.getLogOdds(TRACK_A * x, TRACK_B * y) >= 0)
+            wrongCells++;
+    }
+
+    const OccupancyGrid::Stats& stats = grid.getStats();
+    printf("OccupancyGrid: %d scans of %zu points at %.0f cm, %zu extra threads\n", scans, POINTS_PER_SCAN,
+        config.resolution * 100.0f, config.numThreads);
+    printf("  mean %.2f ms/scan, max %.2f ms/scan (budget %.0f ms at 10Hz), %.0f cell updates/scan\n",
+        (double)stats.getMeanIntegrateNsecs() / NSECS_TO_MSECS, (double)stats.maxIntegrateNsecs / NSECS_TO_MSECS,
+        (double)MAX_SCAN_NSECS / NSECS_TO_MSECS, (double)stats.cellUpdates / stats.scans);
+    printf("  %zu tiles in memory, %llu paged out, %llu dropped, %d of 60 cells wrong\n", grid.getTileCount(),
+        (unsigned long long)stats.tilesPagedOut, (unsigned long long)stats.tilesDropped, wrongCells);
+    if (stats.getMeanIntegrateNsecs() > MAX_SCAN_NSECS) {
+        printf("FAIL: can't keep up with 10Hz scans\n");
+        return 1;
+    }
+    if (wrongCells > 0) {
+        printf("FAIL: the map is wrong\n");
+        return 1;
+    }
+    return 0;
+}
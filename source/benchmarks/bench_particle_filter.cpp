@@ -0,0 +1,105 @@
+// Particle filter weighting throughput (particles x beams per second) on a synthetic track
+// A 20 x 14 m room with 4 round pillars is mapped from simulated scans, then the car drives an ellipse through it with
+// noisy odometry and stops for a while at the end (sub-millimeter odometry jitter both ways, like a parked car).
+// Fails if the estimate wanders off, so the figure isn't measured on a lost filter.
+
+#include <stdio.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "occupancy_grid.h"
+#include "particle_filter.h"
+
+static const size_t POINTS_PER_SCAN = 456;
+
+static float raycast(const float originX, const float originY, const float angle) {
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+    float best = 1e9f;
+    if (c > 0.0f) best = std::min(best, (10.0f - originX) / c);
+    if (c < 0.0f) best = std::min(best, (-10.0f - originX) / c);
+    if (s > 0.0f) best = std::min(best, (7.0f - originY) / s);
+    if (s < 0.0f) best = std::min(best, (-7.0f - originY) / s);
+
+    const float pillarX[4] = {3.0f, -4.0f, 0.0f, 5.0f};
+    const float pillarY[4] = {3.0f, -2.0f, -4.0f, -3.0f};
+    for (int i = 0; i < 4; i++) {
+        const float px = pillarX[i] - originX;
+        const float py = pillarY[i] - originY;
+        const float along = (px * c) + (py * s);
+        const float offSquared = (px * px) + (py * py) - (along * along);
+        if ((along > 0.0f) && (offSquared < 0.25f))
+            best = std::min(best, along - std::sqrt(0.25f - offSquared));
+    }
+    return best;
+}
+
+static void simulateScan(std::vector<LD19::LidarPoint>& points, const Pose2D& pose) {
+    for (size_t i = 0; i < points.size(); i++) {
+        points[i].angle = (uint16_t)(i * 36000 / points.size());
+        const float range = raycast(pose.x, pose.y, pose.yaw + points[i].getAngleRadians());
+        points[i].distance = (uint16_t)(std::min(range, 20.0f) * 1000.0f);
+    }
+}
+
+static Pose2D trajectory(const int step) {
+    const float t = step * 0.03f;
+    return Pose2D(6.0f * std::cos(t), 4.0f * std::sin(t), Pose2D::wrapAngle(std::atan2(4.0f * std::cos(t), -6.0f * std::sin(t))));
+}
+
+int main() {
+    OccupancyGrid grid;
+    std::vector<LD19::LidarPoint> points(POINTS_PER_SCAN);
+    for (int step = 0; step < 300; step++) {
+        simulateScan(points, trajectory(step));
+        grid.integrateScan(points.data(), points.size(), trajectory(step));
+    }
+
+    ParticleFilter::Config config;
+    config.maxParticles = 5000;
+    config.minParticles = config.maxParticles;  // Fixed count, KLD sampling would shrink it to the minimum here
+    config.deadlineNsecs = 1000 * NSECS_TO_MSECS; // Measure the particle count asked for, not what fits on this machine
+    ParticleFilter filter(config);
+    if (!filter.setMap(grid))
+        return 1;
+
+    std::mt19937 random(5);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    filter.initialize(trajectory(0), 0.3f, 0.2f);
+
+    const int driveSteps = 200;
+    const int parkedSteps = 100;
+    float maxError = 0.0f;
+    float maxYawError = 0.0f;
+    for (int step = 1; step < (driveSteps + parkedSteps); step++) {
+        const int poseStep = std::min(step, driveSteps - 1);
+        Pose2D delta = trajectory(std::min(step - 1, driveSteps - 1)).inverse().compose(trajectory(poseStep));
+        if (step < driveSteps) {
+            delta.x *= 1.0f + (0.1f * normal(random));
+            delta.yaw += 0.02f * normal(random);
+        } else {
+            // Parked, sub-millimeter odometry jitter either way
+            delta = Pose2D(0.0005f * normal(random), 0.0f, 0.0f);
+        }
+
+        filter.predict(delta);
+        simulateScan(points, trajectory(poseStep));
+        filter.update(points.data(), points.size());
+
+        if (step > 50) {
+            const ParticleFilter::Estimate& estimate = filter.getEstimate();
+            const Pose2D truth = trajectory(poseStep);
+            maxError = std::max(maxError, std::hypot(estimate.pose.x - truth.x, estimate.pose.y - truth.y));
+            maxYawError = std::max(maxYawError, std::fabs(Pose2D::wrapAngle(estimate.pose.yaw - truth.yaw)));
+        }
+    }
+
+    filter.printStats();
+    printf("  max error %.3f m, %.3f rad (driving and parked)\n", maxError, maxYawError);
+    if ((maxError > 0.3f) || (maxYawError > 0.1f)) {
+        printf("FAIL: the filter lost track\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+// PointIndex against a brute force search, on accumulated scans of a 20 x 14 m room
+// Times the build, nearest() with a scan matching radius and with an unbounded one (the whole map), and countWithin(),
+// and fails if any answer differs from the brute force one.
+
+#include <stdio.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "point_index.h"
+#include "timestamp.h"
+
+static float raycast(const float originX, const float originY, const float angle) {
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+    float best = INFINITY;
+    if (c > 0.0f) best = std::min(best, (10.0f - originX) / c);
+    if (c < 0.0f) best = std::min(best, (-10.0f - originX) / c);
+    if (s > 0.0f) best = std::min(best, (7.0f - originY) / s);
+    if (s < 0.0f) best = std::min(best, (-7.0f - originY) / s);
+
+    const float pillarX[4] = {3.0f, -4.0f, 0.0f, 5.0f};
+    const float pillarY[4] = {3.0f, -2.0f, -4.0f, -3.0f};
+    for (int i = 0; i < 4; i++) {
+        const float px = pillarX[i] - originX;
+        const float py = pillarY[i] - originY;
+        const float along = (px * c) + (py * s);
+        const float offSquared = (px * px) + (py * py) - (along * along);
+        if ((along > 0.0f) && (offSquared < 0.25f))
+            best = std::min(best, along - std::sqrt(0.25f - offSquared));
+    }
+    return best;
+}
+
+// Scans of 456 points taken along the x axis, in the world frame
+static void simulateScans(const size_t scans, std::vector<float>& xs, std::vector<float>& ys, std::mt19937& random) {
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    for (size_t scan = 0; scan < scans; scan++) {
+        const float originX = -6.0f + ((12.0f * scan) / scans);
+        for (size_t i = 0; i < 456; i++) {
+            const float angle = (2.0f * (float)M_PI * i) / 456;
+            const float range = raycast(originX, 0.0f, angle) + noise(random);
+            xs.push_back(originX + (range * std::cos(angle)));
+            ys.push_back(range * std::sin(angle));
+        }
+    }
+}
+
+static int32_t bruteNearest(const std::vector<float>& xs, const std::vector<float>& ys, const float x, const float y,
+    const float maxDistance, float& distance) {
+    float bestDistanceSquared = maxDistance * maxDistance;
+    int32_t best = PointIndex::NOT_FOUND;
+    for (size_t i = 0; i < xs.size(); i++) {
+        const float dx = xs[i] - x;
+        const float dy = ys[i] - y;
+        const float distanceSquared = (dx * dx) + (dy * dy);
+        if (distanceSquared < bestDistanceSquared) {
+            bestDistanceSquared = distanceSquared;
+            best = i;
+        }
+    }
+    distance = (best != PointIndex::NOT_FOUND) ? std::sqrt(bestDistanceSquared) : INFINITY;
+    return best;
+}
+
+static uint32_t bruteCount(const std::vector<float>& xs, const std::vector<float>& ys, const float x, const float y, const float radius) {
+    uint32_t found = 0;
+    for (size_t i = 0; i < xs.size(); i++) {
+        const float dx = xs[i] - x;
+        const float dy = ys[i] - y;
+        if (((dx * dx) + (dy * dy)) <= (radius * radius))
+            found++;
+    }
+    return found;
+}
+
+// Returns false if the index and the brute force search disagree
+static bool runCase(const size_t mapScans, const float maxDistance, std::mt19937& random) {
+    std::vector<float> mapX, mapY, queryX, queryY;
+    simulateScans(mapScans, mapX, mapY, random);
+    simulateScans(2, queryX, queryY, random);
+    // And some queries well outside the room
+    for (int i = 0; i < 64; i++) {
+        queryX.push_back(30.0f + i);
+        queryY.push_back(-20.0f);
+    }
+    const size_t queries = queryX.size();
+
+    PointIndex::Config config;
+    config.maxPoints = mapX.size();
+    PointIndex index(config);
+    const int builds = 20;
+    for (int i = 0; i < builds; i++)
+        index.build(mapX.data(), mapY.data(), mapX.size());
+
+    std::vector<int32_t> indices(queries);
+    std::vector<float> distances(queries);
+    std::vector<uint32_t> counts(queries);
+    uint64_t start = TimeStamp::getMonotonic();
+    index.nearest(queryX.data(), queryY.data(), queries, maxDistance, indices.data(), distances.data());
+    const double indexNearest = (double)(TimeStamp::getMonotonic() - start) / queries;
+    start = TimeStamp::getMonotonic();
+    index.countWithin(queryX.data(), queryY.data(), queries, 0.2f, counts.data());
+    const double indexCount = (double)(TimeStamp::getMonotonic() - start) / queries;
+
+    size_t mismatches = 0;
+    start = TimeStamp::getMonotonic();
+    for (size_t i = 0; i < queries; i++) {
+        float distance;
+        const int32_t best = bruteNearest(mapX, mapY, queryX[i], queryY[i], maxDistance, distance);
+        // Equally close points can come out either way, compare the distances
+        if ((best == PointIndex::NOT_FOUND) != (indices[i] == PointIndex::NOT_FOUND) || (distance != distances[i]))
+            mismatches++;
+    }
+    const double bruteNearestNsecs = (double)(TimeStamp::getMonotonic() - start) / queries;
+    start = TimeStamp::getMonotonic();
+    for (size_t i = 0; i < queries; i++) {
+        if (bruteCount(mapX, mapY, queryX[i], queryY[i], 0.2f) != counts[i])
+            mismatches++;
+    }
+    const double bruteCountNsecs = (double)(TimeStamp::getMonotonic() - start) / queries;
+
+    const PointIndex::Stats& stats = index.getStats();
+    printf("  %5zu points, maxDistance %5.1f m: build %6.1f us, nearest %7.0f ns (brute force %7.0f), countWithin %5.0f ns (brute force %7.0f)\n",
+        mapX.size(), maxDistance, (double)stats.totalBuildNsecs / stats.builds / NSECS_TO_USECS, indexNearest, bruteNearestNsecs,
+        indexCount, bruteCountNsecs);
+    if (mismatches > 0)
+        printf("  %zu of %zu queries differ from brute force\n", mismatches, 2 * queries);
+    return mismatches == 0;
+}
+
+int main() {
+    printf("PointIndex: ns per query, against brute force\n");
+    std::mt19937 random(3);
+    bool passed = true;
+    for (size_t mapScans : {1, 8, 32}) {
+        passed &= runCase(mapScans, 0.5f, random);
+        passed &= runCase(mapScans, 1000.0f, random);
+    }
+    if (!passed) {
+        printf("FAIL: the index missed points\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+// PoseEstimator cost per update (us), the predict and correct steps for one IMU or ESC input on the estimator thread
+// The car drives 30 s of circles at 2 m/s: DMP samples at 100 Hz with a gyro bias, ESC telemetry at 33 Hz. Inputs are
+// pushed in bursts the queue can hold, as fast as the estimator takes them. Fails if the estimate ends up off the
+// circle, so the figure is for a filter that works.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <cmath>
+
+#include "pose_estimator.h"
+
+int main() {
+    PoseEstimator estimator;
+    if (!estimator.start())
+        return 1;
+
+    const Drivetrain drivetrain;
+    const double speed = 2.0;
+    const double yawRate = 0.5;
+    const double gyroRadiansPerCount = (M_PI / 180.0) / 16.4;
+    const uint64_t start = 1000 * (uint64_t)NSECS_TO_SECS;
+    const uint64_t imuIntervalNsecs = 10 * NSECS_TO_MSECS;
+    const int samples = 3000;
+    for (int sample = 0; sample < samples; sample++) {
+        const uint64_t timestamp = start + (sample * imuIntervalNsecs);
+        const double yaw = yawRate * sample * ((double)imuIntervalNsecs / NSECS_TO_SECS);
+
+        MausBoard::ImuData imuData = {};
+        imuData.timestamp = timestamp;
+        imuData.qW = std::cos(yaw / 2.0);
+        imuData.qZ = std::sin(yaw / 2.0);
+        imuData.gyroZ = (int16_t)std::lround((yawRate / gyroRadiansPerCount) + 30);
+        estimator.addImuData(imuData);
+
+        if ((sample % 3) == 0) {
+            MausBoard::EscTelemetry escTelemetry = {};
+            escTelemetry.timestamp = timestamp + 1;
+            escTelemetry.ERPM = (uint16_t)std::lround(speed / drivetrain.reportedERPMToMetersPerSec(1));
+            estimator.addEscTelemetry(escTelemetry, 1700);
+        }
+
+        // Well under the queue's 256 inputs between pauses
+        if ((sample % 100) == 99)
+            usleep(2000);
+    }
+    usleep(100000);
+    estimator.stop();
+
+    PoseEstimator::Estimate estimate;
+    if (!estimator.getEstimate(estimate))
+        return 1;
+    const double seconds = (double)(estimate.timestamp - start) / NSECS_TO_SECS;
+    const double trueX = (speed / yawRate) * std::sin(yawRate * seconds);
+    const double trueY = (speed / yawRate) * (1.0 - std::cos(yawRate * seconds));
+    const double trueYaw = Pose2D::wrapAngle(yawRate * seconds);
+    const double error = std::hypot(estimate.pose.x - trueX, estimate.pose.y - trueY);
+    const double yawError = std::fabs(Pose2D::wrapAngle(estimate.pose.yaw - trueYaw));
+
+    const PoseEstimator::Stats& stats = estimator.getStats();
+    printf("PoseEstimator: %llu updates, mean %.2f us, max %.1f us, %llu inputs dropped\n", (unsigned long long)stats.updates,
+        (double)stats.getMeanUpdateNsecs() / NSECS_TO_USECS, (double)stats.maxUpdateNsecs / NSECS_TO_USECS,
+        (unsigned long long)stats.droppedInputs);
+    printf("  after %.1f s: error %.3f m, %.4f rad, speed %.2f m/s, gyro bias %.4f rad/s\n", seconds, error, yawError,
+        estimate.speed, estimate.gyroBias);
+    if ((error > 0.5) || (yawError > 0.05) || (stats.droppedInputs > 0)) {
+        printf("FAIL: the estimate is off the circle\n");
+        return 1;
+    }
+    return 0;
+}
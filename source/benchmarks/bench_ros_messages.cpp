@@ -0,0 +1,87 @@
+// RosSerializer cost per message: a raw LD19 revolution binned into a LaserScan, a BinnedScan revolution, DMP and
+// ImuFusion Imu messages, and parsing each back. The serializer's own stats time the writes, this times the calls
+
+#include <stdio.h>
+#include <vector>
+
+#include "ros_messages.h"
+
+static const uint64_t STAMP = 1760000000123456789ULL;
+
+template <typename Call>
+static double nsecsPerCall(const size_t iterations, Call call) {
+    const uint64_t start = TimeStamp::getMonotonic();
+    for (size_t i = 0; i < iterations; i++)
+        call();
+    return (double)(TimeStamp::getMonotonic() - start) / iterations;
+}
+
+int main() {
+    // A revolution like the LD19's at 10 Hz
+    std::vector<LD19::LidarPoint> points(456);
+    for (size_t i = 0; i < points.size(); i++) {
+        points[i].distance = (uint16_t)(500 + ((i * 7919) % 8000));
+        points[i].intensity = (uint8_t)(100 + (i % 100));
+        points[i].angle = (uint16_t)((i * 36000) / points.size());
+        points[i].timestamp = STAMP + (i * 219298);
+    }
+    BinnedScan binnedScan(720);
+    binnedScan.addPoints(points.data(), points.size());
+    LD19::LidarPoint wrap = points[0];
+    wrap.timestamp += 100 * NSECS_TO_MSECS;
+    binnedScan.addPoints(&wrap, 1);
+    static BinnedScan::Scan scan;
+    if (!binnedScan.getLatest(scan))
+        return 1;
+
+    MausBoard::ImuData imuData = {};
+    imuData.timestamp = STAMP;
+    imuData.qW = 1.0f;
+    imuData.gyroZ = 164;
+    imuData.accelZ = 8192;
+    ImuFusion::State state = {};
+    state.timestamp = STAMP;
+    state.orientation.w = 1.0f;
+    state.accel[2] = 9.81f;
+
+    RosSerializer serializer;
+    std::vector<uint8_t> scanBuffer(serializer.getMaxLaserScanSize());
+    std::vector<uint8_t> binnedBuffer(serializer.getMaxLaserScanSize());
+    std::vector<uint8_t> imuBuffer(serializer.getMaxImuSize());
+    static RosSerializer::LaserScan scanMessage;
+    static RosSerializer::Imu imuMessage;
+
+    const size_t scanIterations = 20000;
+    const size_t imuIterations = 500000;
+    size_t scanSize = 0;
+    size_t binnedSize = 0;
+    size_t imuSize = 0;
+    size_t parsed = 0;
+    const double rawScan = nsecsPerCall(scanIterations, [&]() {
+        scanSize = serializer.serializeLaserScan(points.data(), points.size(), scanBuffer.data(), scanBuffer.size()); });
+    const double binned = nsecsPerCall(scanIterations, [&]() {
+        binnedSize = serializer.serializeLaserScan(scan, binnedBuffer.data(), binnedBuffer.size()); });
+    const double dmpImu = nsecsPerCall(imuIterations, [&]() {
+        imuSize = serializer.serializeImu(imuData, imuBuffer.data(), imuBuffer.size()); });
+    const double fusionImu = nsecsPerCall(imuIterations, [&]() {
+        imuSize = serializer.serializeImu(state, imuBuffer.data(), imuBuffer.size()); });
+    const double parseScan = nsecsPerCall(scanIterations, [&]() {
+        parsed += RosSerializer::parseLaserScan(scanBuffer.data(), scanSize, scanMessage) ? 1 : 0; });
+    const double parseImu = nsecsPerCall(imuIterations, [&]() {
+        parsed += RosSerializer::parseImu(imuBuffer.data(), imuSize, imuMessage) ? 1 : 0; });
+
+    if ((scanSize == 0) || (binnedSize == 0) || (imuSize == 0) || (parsed != (scanIterations + imuIterations))) {
+        printf("FAIL: a message wasn't written or didn't parse back\n");
+        return 1;
+    }
+
+    printf("RosSerializer: us per message\n");
+    printf("  LaserScan from %zu points  %7.2f  (%zu bytes)\n", points.size(), rawScan / NSECS_TO_USECS, scanSize);
+    printf("  LaserScan from BinnedScan  %7.2f  (%zu bytes)\n", binned / NSECS_TO_USECS, binnedSize);
+    printf("  Imu from ImuData           %7.3f  (%zu bytes)\n", dmpImu / NSECS_TO_USECS, imuSize);
+    printf("  Imu from ImuFusion         %7.3f\n", fusionImu / NSECS_TO_USECS);
+    printf("  parseLaserScan             %7.2f\n", parseScan / NSECS_TO_USECS);
+    printf("  parseImu                   %7.3f\n", parseImu / NSECS_TO_USECS);
+    serializer.printStats();
+    return 0;
+}
@@ -0,0 +1,128 @@
+// ScanMatcher time per match (ms) on a synthetic room, with the accuracy checked against the known poses
+// The particle filter bench's 20 x 14 m room with 4 round pillars. Lidar odometry around a lap (each scan matched
+// against the previous one, guessing no motion), then single matches with a known offset up to the edge of the search
+// window. The time budget is lifted so the full search is measured. Fails above 20 ms a match on average, the budget
+// for a Pi 4 core at the LD19's 10Hz (a desktop core is several times faster, so mind the margin here), or if a pose is
+// off by more than a cell or a couple of angular steps.
+
+#include <stdio.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "scan_matcher.h"
+
+static const size_t POINTS_PER_SCAN = 456;
+static const uint64_t MAX_MATCH_NSECS = 20 * NSECS_TO_MSECS;
+
+static float raycast(const float originX, const float originY, const float angle) {
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+    float best = 1e9f;
+    if (c > 0.0f) best = std::min(best, (10.0f - originX) / c);
+    if (c < 0.0f) best = std::min(best, (-10.0f - originX) / c);
+    if (s > 0.0f) best = std::min(best, (7.0f - originY) / s);
+    if (s < 0.0f) best = std::min(best, (-7.0f - originY) / s);
+
+    const float pillarX[4] = {3.0f, -4.0f, 0.0f, 5.0f};
+    const float pillarY[4] = {3.0f, -2.0f, -4.0f, -3.0f};
+    for (int i = 0; i < 4; i++) {
+        const float px = pillarX[i] - originX;
+        const float py = pillarY[i] - originY;
+        const float along = (px * c) + (py * s);
+        const float offSquared = (px * px) + (py * py) - (along * along);
+        if ((along > 0.0f) && (offSquared < 0.25f))
+            best = std::min(best, along - std::sqrt(0.25f - offSquared));
+    }
+    return best;
+}
+
+// With 1cm of range noise, and the odd dropped return like the LD19's
+static void simulateScan(std::vector<LD19::LidarPoint>& points, const Pose2D& pose, std::mt19937& random) {
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    for (size_t i = 0; i < points.size(); i++) {
+        points[i].angle = (uint16_t)(i * 36000 / points.size());
+        const float range = raycast(pose.x, pose.y, pose.yaw + points[i].getAngleRadians()) + noise(random);
+        points[i].distance = ((random() % 50) == 0) ? 0 : (uint16_t)(std::min(range, 20.0f) * 1000.0f);
+    }
+}
+
+// Wider than the particle filter bench's ellipse, which runs through the pillar at (0, -4)
+static Pose2D trajectory(const int step) {
+    const float t = step * 0.03f;
+    return Pose2D(7.5f * std::cos(t), 5.5f * std::sin(t), Pose2D::wrapAngle(std::atan2(5.5f * std::cos(t), -7.5f * std::sin(t))));
+}
+
+int main() {
+    ScanMatcher::Config config;
+    config.timeBudgetNsecs = 1000 * NSECS_TO_MSECS;
+    ScanMatcher matcher(config);
+
+    std::mt19937 random(37);
+    std::vector<LD19::LidarPoint> points(POINTS_PER_SCAN);
+    const float maxError = config.resolution;
+    const float maxYawError = 2.0f * config.angularStep;
+
+    // Odometry, about 20cm and up to 3 degrees between scans. Errors per match, the drift over the lap is the sum
+    int failed = 0;
+    float worstError = 0.0f;
+    float worstYawError = 0.0f;
+    simulateScan(points, trajectory(0), random);
+    matcher.setReference(points.data(), points.size(), trajectory(0));
+    const int steps = 210;
+    for (int step = 1; step < steps; step++) {
+        simulateScan(points, trajectory(step), random);
+        const Pose2D previous = trajectory(step - 1);
+        const ScanMatcher::Result result = matcher.match(points.data(), points.size(), previous);
+        const Pose2D truth = trajectory(step);
+        const float error = std::hypot(result.pose.x - truth.x, result.pose.y - truth.y);
+        const float yawError = std::fabs(Pose2D::wrapAngle(result.pose.yaw - truth.yaw));
+        worstError = std::max(worstError, error);
+        worstYawError = std::max(worstYawError, yawError);
+        if (!result.valid || (error > maxError) || (yawError > maxYawError))
+            failed++;
+
+        // Chained on the true pose, so one bad match doesn't spoil the ones after it
+        matcher.setReference(points.data(), points.size(), truth);
+    }
+    const ScanMatcher::Stats odometryStats = matcher.getStats();
+
+    // Known offsets from one reference, out to 80% of the search window
+    const Pose2D reference(1.0f, -1.0f, 0.4f);
+    simulateScan(points, reference, random);
+    matcher.setReference(points.data(), points.size(), reference);
+    const int offsets = 50;
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    for (int i = 0; i < offsets; i++) {
+        const Pose2D offset(0.8f * config.linearWindow * unit(random), 0.8f * config.linearWindow * unit(random),
+            0.8f * config.angularWindow * unit(random));
+        const Pose2D truth = reference.compose(offset);
+        simulateScan(points, truth, random);
+        const ScanMatcher::Result result = matcher.match(points.data(), points.size(), reference);
+        const float error = std::hypot(result.pose.x - truth.x, result.pose.y - truth.y);
+        const float yawError = std::fabs(Pose2D::wrapAngle(result.pose.yaw - truth.yaw));
+        worstError = std::max(worstError, error);
+        worstYawError = std::max(worstYawError, yawError);
+        if (!result.valid || (error > maxError) || (yawError > maxYawError))
+            failed++;
+    }
+
+    const ScanMatcher::Stats& stats = matcher.getStats();
+    const uint64_t offsetNsecs = (stats.totalMatchNsecs - odometryStats.totalMatchNsecs) / offsets;
+    printf("ScanMatcher: %zu points, +-%.2f m +-%.2f rad window (budget %.0f ms/match)\n", POINTS_PER_SCAN,
+        config.linearWindow, config.angularWindow, (double)MAX_MATCH_NSECS / NSECS_TO_MSECS);
+    printf("  odometry      %6.2f ms/match (%d matches)\n", (double)odometryStats.getMeanMatchNsecs() / NSECS_TO_MSECS, steps - 1);
+    printf("  known offsets %6.2f ms/match (%d matches)\n", (double)offsetNsecs / NSECS_TO_MSECS, offsets);
+    printf("  max %.2f ms, reference %.2f ms, worst error %.3f m %.4f rad, %d off\n",
+        (double)stats.maxMatchNsecs / NSECS_TO_MSECS, (double)stats.totalReferenceNsecs / (steps + 1) / NSECS_TO_MSECS,
+        worstError, worstYawError, failed);
+    if (stats.getMeanMatchNsecs() > MAX_MATCH_NSECS) {
+        printf("FAIL: over the 10Hz budget\n");
+        return 1;
+    }
+    if (failed > 0) {
+        printf("FAIL: %d matches off\n", failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+// TimeStamp sources, ns per call (TimeStamp::printBenchmark()), then getFast() against getMonotonic() from a few
+// threads while the main thread calibrates again and again. Fails if getFast() strays from CLOCK_MONOTONIC or runs
+// backwards on a thread.
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "timestamp.h"
+
+static const uint64_t MAX_OFFSET_NSECS = 200 * NSECS_TO_USECS;
+
+static std::atomic<bool> running{true};
+static std::atomic<uint64_t> worstOffset{0};
+static std::atomic<uint64_t> backwards{0};
+
+static void compareLoop() {
+    uint64_t previous = 0;
+    while (running) {
+        const uint64_t before = TimeStamp::getMonotonic();
+        const uint64_t fast = TimeStamp::getFast();
+        const uint64_t after = TimeStamp::getMonotonic();
+
+        // Outside [before, after] by how much
+        const uint64_t offset = (fast < before) ? (before - fast) : ((fast > after) ? (fast - after) : 0);
+        uint64_t worst = worstOffset.load();
+        while ((offset > worst) && !worstOffset.compare_exchange_weak(worst, offset)) {}
+
+        // A new calibration can move it back by the offset it corrected, not more
+        if ((fast + MAX_OFFSET_NSECS) < previous)
+            backwards++;
+        previous = fast;
+    }
+}
+
+int main() {
+    TimeStamp::printBenchmark();
+    if (!TimeStamp::isFastCalibrated()) {
+        printf("No cycle counter, nothing else to check\n");
+        return 0;
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; i++)
+        threads.emplace_back(compareLoop);
+    for (int i = 0; i < 20; i++)
+        TimeStamp::calibrateFast(10 * NSECS_TO_MSECS);
+    running = false;
+    for (std::thread& thread : threads)
+        thread.join();
+
+    printf("getFast() vs getMonotonic() over 20 calibrations: worst %.1f us off, %llu times backwards\n",
+        (double)worstOffset.load() / NSECS_TO_USECS, (unsigned long long)backwards.load());
+    if ((worstOffset.load() > MAX_OFFSET_NSECS) || (backwards.load() > 0)) {
+        printf("FAIL: getFast() doesn't follow CLOCK_MONOTONIC\n");
+        return 1;
+    }
+    return 0;
+}
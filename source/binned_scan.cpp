@@ -0,0 +1,77 @@
+#include "binned_scan.h"
+
+#include <string.h>
+
+BinnedScan::BinnedScan(const size_t binCount, const Mode mode) :
+    binCount((binCount == 0) ? 1 : ((binCount > MAX_BINS) ? MAX_BINS : binCount)),
+    mode(mode) {
+    if (binCount > MAX_BINS)
+        printf("BinnedScan: %zu bins requested, using %zu\n", binCount, MAX_BINS);
+    clearWorking();
+}
+
+void BinnedScan::clearWorking() {
+    working.binCount = binCount;
+    working.binSize = (2.0f * (float)M_PI) / binCount;
+    working.validCount = 0;
+    working.startTimestamp = 0;
+    working.endTimestamp = 0;
+    memset(working.distance, 0, sizeof(working.distance));
+    memset(working.timestamp, 0, sizeof(working.timestamp));
+    memset(working.valid, 0, sizeof(working.valid));
+}
+
+void BinnedScan::publish() {
+    working.revolution = revolutions++;
+    published.add(working.endTimestamp, working);
+    if (scanCallback)
+        scanCallback(working);
+    clearWorking();
+}
+
+void BinnedScan::addPoints(const LD19::LidarPoint* points, const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const LD19::LidarPoint& point = points[i];
+
+        // The angle wrapping around means a new revolution (small steps back are just overlapping frames)
+        if (started && ((point.angle + 18000) < lastAngle))
+            publish();
+        lastAngle = point.angle;
+        started = true;
+
+        if (point.distance == 0)
+            continue;
+
+        // LD19 angles are clockwise, bins are counter-clockwise from straight ahead
+        const uint32_t vehicleAngle = (36000 - (uint32_t)point.angle) % 36000;
+        const uint32_t scaled = vehicleAngle * binCount;
+        const size_t bin = scaled / 36000;
+        const float distance = point.distance * 0.001f;
+
+        // Offset from the bin center, in 0.01 degrees
+        const float error = std::fabs(((float)(scaled % 36000) - 18000.0f) / binCount);
+
+        bool replace = true;
+        if (working.valid[bin])
+            replace = (mode == MODE_MIN) ? (distance < working.distance[bin]) : (error < binError[bin]);
+        else
+            working.validCount++;
+
+        if (replace) {
+            working.distance[bin] = distance;
+            working.timestamp[bin] = point.timestamp;
+            working.valid[bin] = 1;
+            binError[bin] = error;
+        }
+
+        if ((working.startTimestamp == 0) || (point.timestamp < working.startTimestamp))
+            working.startTimestamp = point.timestamp;
+        if (point.timestamp > working.endTimestamp)
+            working.endTimestamp = point.timestamp;
+    }
+}
+
+bool BinnedScan::getLatest(Scan& scan) const {
+    uint64_t timestamp;
+    return published.getLatest(timestamp, scan);
+}
@@ -0,0 +1,91 @@
+#ifndef __BINNED_SCAN_H__
+#define __BINNED_SCAN_H__
+
+// Fixed angular bin representation of LD19 revolutions
+// Points are dropped into binCount equal bins as frames arrive (overlapping frames just merge into the same bins,
+// skipped ones leave bins invalid). When the angle wraps the revolution gets published, readers always get the latest
+// complete one without locking (double buffered, see SensorHistory).
+//
+// Bins are in the vehicle frame (pose2d.h): bin 0 starts straight ahead and they go counter-clockwise, so the distance
+// at a heading is a single index. Arrays are contiguous for vectorized controllers (gap following, wall following...)
+
+#include <stdint.h>
+#include <stdio.h>
+#include <cmath>
+
+#include "fhl_ld19.h"
+#include "sensor_history.h"
+
+class BinnedScan {
+public:
+    static const size_t MAX_BINS = 1440;
+
+    enum Mode : uint8_t {
+        MODE_MIN = 0,       // Closest distance that landed in the bin (conservative, for obstacle avoidance)
+        MODE_NEAREST = 1    // Distance of the point closest to the bin's center angle
+    };
+
+    struct Scan {
+        uint64_t revolution;
+        uint64_t startTimestamp;    // Nanoseconds since epoch, first and last point of the revolution
+        uint64_t endTimestamp;
+        uint16_t binCount;
+        uint16_t validCount;
+        float binSize;              // Radians
+
+        float distance[MAX_BINS];   // Meters, 0 where invalid
+        uint64_t timestamp[MAX_BINS];
+        uint8_t valid[MAX_BINS];    // 1 if a point landed in the bin
+
+        // Center angle of a bin in radians [-pi, pi)
+        float getBinAngle(const size_t bin) const {
+            const float angle = ((float)bin + 0.5f) * binSize;
+            return (angle >= (float)M_PI) ? (angle - (2.0f * (float)M_PI)) : angle;
+        }
+
+        // Bin that covers an angle in radians (any range)
+        size_t getBinIndex(const float angle) const {
+            const float turns = angle * (float)(0.5 / M_PI);
+            const float fraction = turns - std::floor(turns);
+            const size_t bin = (size_t)(fraction * binCount);
+            return (bin < binCount) ? bin : 0;
+        }
+
+        // Distance at an angle, 0 if there's no valid point there
+        float getDistanceAt(const float angle) const { return distance[getBinIndex(angle)]; }
+    };
+
+private:
+    const uint16_t binCount;
+    const Mode mode;
+
+    // Revolution being built, only touched by the writer
+    Scan working;
+    float binError[MAX_BINS];       // Angular distance of the bin's point from the bin center (0.01 degrees)
+    uint16_t lastAngle = 0;
+    bool started = false;
+    uint64_t revolutions = 0;
+
+    SensorHistory<Scan, 2> published;
+
+    void clearWorking();
+    void publish();
+
+public:
+    // Called from the writer thread with every completed revolution (optional, don't block in it)
+    void (*scanCallback)(const Scan&) = nullptr;
+
+    // binCount of 720 gives 0.5 degree bins, the LD19 measures ~450 points per revolution at 10Hz
+    BinnedScan(const size_t binCount = 720, const Mode mode = MODE_MIN);
+
+    // Feed points in the order the LD19 delivers them (setBinnedScan() on the LD19 does this as frames arrive)
+    void addPoints(const LD19::LidarPoint* points, const size_t count);
+
+    // Latest complete revolution. Returns false if there isn't one yet
+    bool getLatest(Scan& scan) const;
+
+    uint64_t getRevolutionCount() const { return revolutions; }
+    size_t getBinCount() const { return binCount; }
+};
+
+#endif
@@ -1,138 +1,304 @@
 #include "controller.h"
 
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NBITS(x) ((((x) - 1) / BITS_PER_LONG) + 1)
+#define TEST_BIT(bit, array) ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+
 float Controller::map(const float in, const float inMin, const float inMax, const float outMin, const float outMax) {
+    if (inMax == inMin)
+        return outMin;
     return (in - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
 }
 
-bool Controller::isJoystickAvailable() {
-    struct stat buffer;
-    return (stat(DEFAULT_JOYSTICK.c_str(), &buffer) == 0); 
+bool Controller::isGamepad(const int fd) {
+    unsigned long keyBits[NBITS(KEY_MAX)] = {};
+    unsigned long absBits[NBITS(ABS_MAX)] = {};
+    if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits) < 0)
+        return false;
+    if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits) < 0)
+        return false;
+    return TEST_BIT(BUTTON_A, keyBits) && TEST_BIT(AXIS_STEERING, absBits);
+}
+
+bool Controller::tryOpen(const char* path) {
+    const int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    if (!isGamepad(fd)) {
+        close(fd);
+        return false;
+    }
+
+    deviceFd = fd;
+    return true;
 }
 
 bool Controller::tryConnect() {
-    // Reset to a safe state
-    disconnected();
+    if (deviceFd >= 0)
+        return true;
+
+    if (!devicePath.empty()) {
+        tryOpen(devicePath.c_str());
+    } else {
+        // Use the first gamepad we can find
+        DIR* dir = opendir(INPUT_DIRECTORY);
+        if (dir) {
+            struct dirent* entry;
+            while (deviceFd < 0 && (entry = readdir(dir)) != nullptr) {
+                if (strncmp(entry->d_name, "event", 5) != 0)
+                    continue;
+                char path[300];
+                snprintf(path, sizeof(path), "%s/%s", INPUT_DIRECTORY, entry->d_name);
+                tryOpen(path);
+            }
+            closedir(dir);
+        }
+    }
+
+    if (deviceFd < 0)
+        return false;
+
+    struct epoll_event epollEvent = {};
+    epollEvent.events = EPOLLIN;
+    epollEvent.data.fd = deviceFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, deviceFd, &epollEvent);
 
-    printf("Attempting to connect controller...\n");
+    printf("Controller connected\n");
 
-    // Re-open the joystick
-    joystick.openPath(DEFAULT_JOYSTICK, true);
+    resetState();
+    droppingEvents = false;
+    state.isConnected = true;
+    // Buttons already held down don't toggle anything
+    syncDevice(false);
+    publishState();
 
-    return joystick.isFound();
+    return true;
 }
 
 void Controller::disconnected() {
-    rightTriggerPos = 0.0f;
-    leftTriggerPos = 0.0f;
-    throttlePos = 0.0f;
-    steeringPos = 0.0f;
-
-    autonomousModeActive = false;
-    recordingModeActive = false;
-    isConnected = false;
-
-    aButtonPressed = false;
-    bButtonPressed = false;
-    xButtonPressed = false;
-    yButtonPressed = false;
-
-    dPadUpPressed = false;
-    dPadDownPressed = false;    
-    dPadLeftPressed = false;
-    dPadRightPressed = false;
-}
-
-void Controller::poll() {
-    // Check if joystick is connected    
-    uint64_t timestamp = TimeStamp::get();
-    if ((timestamp - lastConnectedCheckTimestamp) > MIN_CONNECTED_CHECK_NSECS) {
-        lastConnectedCheckTimestamp = timestamp;
-        if (!isJoystickAvailable() || !joystick.isFound()) {
-            // Try to connect the joystick if it isn't connected/found
-            isConnected = tryConnect();
+    if (deviceFd >= 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, deviceFd, nullptr);
+        close(deviceFd);
+        deviceFd = -1;
+        printf("Controller disconnected\n");
+    }
+
+    // Reset to a safe state
+    resetState();
+    publishState();
+}
+
+void Controller::resetState() {
+    memset(&state, 0, sizeof(state));
+    memset(&steeringInfo, 0, sizeof(steeringInfo));
+    memset(&rightTriggerInfo, 0, sizeof(rightTriggerInfo));
+    memset(&leftTriggerInfo, 0, sizeof(leftTriggerInfo));
+}
+
+void Controller::publishState() {
+    state.timestamp = TimeStamp::getMonotonic();
+    {
+        std::lock_guard<std::mutex> lock(publishedStateMutex);
+        publishedState = state;
+    }
+
+    if (stateCallback)
+        stateCallback(state);
+}
+
+void Controller::syncDevice(const bool toggles) {
+    // Read the axis ranges and current positions straight from the device
+    ioctl(deviceFd, EVIOCGABS(AXIS_STEERING), &steeringInfo);
+    ioctl(deviceFd, EVIOCGABS(AXIS_RIGHT_TRIGGER), &rightTriggerInfo);
+    ioctl(deviceFd, EVIOCGABS(AXIS_LEFT_TRIGGER), &leftTriggerInfo);
+    struct input_absinfo dPadXInfo = {};
+    struct input_absinfo dPadYInfo = {};
+    ioctl(deviceFd, EVIOCGABS(AXIS_DPAD_X), &dPadXInfo);
+    ioctl(deviceFd, EVIOCGABS(AXIS_DPAD_Y), &dPadYInfo);
+
+    handleAxis(AXIS_STEERING, steeringInfo.value);
+    handleAxis(AXIS_RIGHT_TRIGGER, rightTriggerInfo.value);
+    handleAxis(AXIS_LEFT_TRIGGER, leftTriggerInfo.value);
+    handleAxis(AXIS_DPAD_X, dPadXInfo.value);
+    handleAxis(AXIS_DPAD_Y, dPadYInfo.value);
+
+    // And which buttons are down right now
+    unsigned long keyState[NBITS(KEY_MAX)] = {};
+    if (ioctl(deviceFd, EVIOCGKEY(sizeof(keyState)), keyState) < 0)
+        return;
+    for (const uint16_t button : {BUTTON_A, BUTTON_B, BUTTON_X, BUTTON_Y})
+        handleButton(button, TEST_BIT(button, keyState), toggles);
+}
+
+void Controller::handleAxis(const uint16_t code, const int32_t value) {
+    if (code == AXIS_STEERING)
+        state.steeringPos = map(value, steeringInfo.minimum, steeringInfo.maximum, -1.0f, 1.0f);
+
+    if (code == AXIS_RIGHT_TRIGGER)
+        state.rightTriggerPos = map(value, rightTriggerInfo.minimum, rightTriggerInfo.maximum, 0.0f, 1.0f);
+
+    if (code == AXIS_LEFT_TRIGGER)
+        state.leftTriggerPos = map(value, leftTriggerInfo.minimum, leftTriggerInfo.maximum, 0.0f, 1.0f);
+
+    if (code == AXIS_DPAD_X) {
+        state.dPadLeftPressed = (value < 0);
+        state.dPadRightPressed = (value > 0);
+    }
+
+    if (code == AXIS_DPAD_Y) {
+        state.dPadUpPressed = (value < 0);
+        state.dPadDownPressed = (value > 0);
+    }
+
+    // Combine left and right trigger
+    state.throttlePos = (state.rightTriggerPos - state.leftTriggerPos);
+
+    // Cancel autonomous mode if the left trigger is pressed a certain amount
+    if (state.leftTriggerPos >= autonomousModeCancelLeftTriggerMinimum)
+        state.autonomousModeActive = false;
+}
+
+void Controller::handleButton(const uint16_t code, const bool pressed, const bool toggles) {
+    if (code == BUTTON_A) {
+        // Toggle autonomous mode
+        if (toggles && !state.aButtonPressed && pressed)
+            state.autonomousModeActive = !state.autonomousModeActive;
+        state.aButtonPressed = pressed;
+    }
+
+    if (code == BUTTON_B)
+        state.bButtonPressed = pressed;
+
+    if (code == BUTTON_X)
+        state.xButtonPressed = pressed;
+
+    if (code == BUTTON_Y) {
+        // Toggle recording mode
+        if (toggles && !state.yButtonPressed && pressed)
+            state.recordingModeActive = !state.recordingModeActive;
+        state.yButtonPressed = pressed;
+    }
+}
+
+void Controller::handleEvent(const struct input_event& event) {
+    if (droppingEvents) {
+        // The rest of the frame is incomplete, read the device state instead. A press that shows up here (its event
+        // was dropped) still toggles, a press and release that both got dropped is lost
+        if ((event.type == EV_SYN) && (event.code == SYN_REPORT)) {
+            droppingEvents = false;
+            syncDevice(true);
+            publishState();
         }
+        return;
     }
 
-    if (joystick.isFound()) {
-        if (!isConnected)
-            isConnected = true;
-
-        JoystickEvent event;
-        if (joystick.sample(&event)) {
-            if (event.isButton()) {
-                bool aButtonPressedPrevious = aButtonPressed;
-                bool bButtonPressedPrevious = bButtonPressed;
-                bool xButtonPressedPrevious = xButtonPressed;
-                bool yButtonPressedPrevious = yButtonPressed;
-
-                if (event.number == 0)
-                    aButtonPressed = (event.value > 0);
-                if (event.number == 1)
-                    bButtonPressed = (event.value > 0);
-                if (event.number == 3)
-                    xButtonPressed = (event.value > 0);
-                if (event.number == 4)
-                    yButtonPressed = (event.value > 0);
-
-                // Toggle autonomous mode
-                if (!aButtonPressedPrevious && aButtonPressed)
-                    autonomousModeActive = !autonomousModeActive;
-
-                // Toggle recording mode
-                if (!yButtonPressedPrevious && yButtonPressed)
-                    recordingModeActive = !recordingModeActive;
-            }
-            if (event.isAxis()) {
-                // Left stick x axis
-                if (event.number == 0) {
-                    steeringPos = map(event.value, JoystickEvent::MIN_AXES_VALUE, JoystickEvent::MAX_AXES_VALUE, -1.0f, 1.0f);
-                }
-                
-                // Right trigger
-                if (event.number == 4) {
-                    rightTriggerPos = map(event.value, JoystickEvent::MIN_AXES_VALUE, JoystickEvent::MAX_AXES_VALUE, 0.0f, 1.0f);
-                }
-
-                // Left trigger
-                if (event.number == 5) {
-                    leftTriggerPos = map(event.value, JoystickEvent::MIN_AXES_VALUE, JoystickEvent::MAX_AXES_VALUE, 0.0f, 1.0f);
-                }
-
-                // DPad L/R
-                if (event.number == 6) {
-                    dPadLeftPressed = (event.value < 0);
-                    dPadRightPressed = (event.value > 0);
-                }
-
-                // DPad U/D
-                if (event.number == 7) {
-                    dPadUpPressed = (event.value < 0);
-                    dPadDownPressed = (event.value > 0);
-                }
-
-                // Combine left and right trigger
-                throttlePos = (rightTriggerPos - leftTriggerPos);
-
-                // Cancel autonomous mode if the left trigger is pressed a certain amount
-                if (leftTriggerPos >= autonomousModeCancelLeftTriggerMinimum) {
-                    autonomousModeActive = false;
-                }
-            }
+    if (event.type == EV_ABS) {
+        handleAxis(event.code, event.value);
+    } else if (event.type == EV_KEY) {
+        handleButton(event.code, event.value != 0);
+    } else if (event.type == EV_SYN) {
+        if (event.code == SYN_REPORT) {
+            // End of a frame of events, publish it as one state
+            publishState();
+        } else if (event.code == SYN_DROPPED) {
+            // The kernel buffer overflowed, events were lost
+            droppingEvents = true;
         }
-    } else {
-        disconnected();
     }
 }
 
+void Controller::drainDevice() {
+    struct input_event events[64];
+    while (deviceFd >= 0) {
+        const ssize_t len = read(deviceFd, events, sizeof(events));
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                disconnected();
+            return;
+        }
+        if (len == 0) {
+            disconnected();
+            return;
+        }
+
+        const size_t count = len / sizeof(struct input_event);
+        for (size_t i = 0; i < count; i++)
+            handleEvent(events[i]);
+    }
+}
+
+void Controller::drainInotify() {
+    // We only care that something changed in INPUT_DIRECTORY, not what
+    uint8_t buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (read(inotifyFd, buffer, sizeof(buffer)) > 0) {}
+}
+
 void Controller::pollLoop() {
+    tryConnect();
+
+    struct epoll_event epollEvents[4];
     while (isPolling) {
-        poll();
-        usleep(POLLING_LOOP_DELAY_USECS);
+        const int count = epoll_wait(epollFd, epollEvents, 4, -1);
+        for (int i = 0; i < count; i++) {
+            const int fd = epollEvents[i].data.fd;
+
+            if (fd == stopEventFd)
+                return;
+
+            if (fd == inotifyFd) {
+                drainInotify();
+                // New device nodes show up before their permissions are set, so this retries on IN_ATTRIB too
+                tryConnect();
+            }
+
+            if (fd == deviceFd) {
+                if (epollEvents[i].events & EPOLLIN)
+                    drainDevice();
+                else if (epollEvents[i].events & (EPOLLHUP | EPOLLERR))
+                    disconnected();
+            }
+        }
     }
 }
 
+Controller::State Controller::getState() {
+    std::lock_guard<std::mutex> lock(publishedStateMutex);
+    return publishedState;
+}
+
 bool Controller::startPolling() {
     if (!isPolling) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        stopEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (epollFd < 0 || stopEventFd < 0 || inotifyFd < 0) {
+            printf("Unable to set up controller polling: %s\n", strerror(errno));
+            closePollingFds();
+            return false;
+        }
+
+        if (inotify_add_watch(inotifyFd, INPUT_DIRECTORY, IN_CREATE | IN_ATTRIB | IN_DELETE) < 0)
+            printf("Unable to watch %s, controller hotplug disabled\n", INPUT_DIRECTORY);
+
+        struct epoll_event epollEvent = {};
+        epollEvent.events = EPOLLIN;
+        epollEvent.data.fd = stopEventFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, stopEventFd, &epollEvent);
+        epollEvent.data.fd = inotifyFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, inotifyFd, &epollEvent);
+
         isPolling = true;
         pollingThread = std::thread(&Controller::pollLoop, this);
         return true;
@@ -145,10 +311,28 @@ bool Controller::startPolling() {
 bool Controller::stopPolling() {
     if (isPolling) {
         isPolling = false;
+
+        // Wake up the polling thread
+        const uint64_t one = 1;
+        write(stopEventFd, &one, sizeof(one));
         pollingThread.join();
+
         disconnected();
+        closePollingFds();
 
         return true;
     }
     return false;
-}
\ No newline at end of file
+}
+
+void Controller::closePollingFds() {
+    if (epollFd >= 0)
+        close(epollFd);
+    if (stopEventFd >= 0)
+        close(stopEventFd);
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+    epollFd = -1;
+    stopEventFd = -1;
+    inotifyFd = -1;
+}
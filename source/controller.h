@@ -1,66 +1,122 @@
 #ifndef __CONTROLLER_H__
 #define __CONTROLLER_H__
 
-// Hey, whats up. This code is pretty gross. Please don't look too hard.
-// If you have your own joystick handling code, please just use that. It is probably better than this. 
+// Gamepad handling on top of Linux evdev (/dev/input/event*)
+// The polling thread sleeps until the device has events, drains everything that is pending and publishes a single
+// consistent State at each SYN_REPORT. Connects and disconnects are picked up through inotify on /dev/input.
+// If the kernel's event buffer overflows (SYN_DROPPED), the events up to the next SYN_REPORT are discarded and the
+// buttons and axes are read back from the device, so a lost release can't leave a button stuck down.
+// Axis and button codes match an Xbox style controller over bluetooth (triggers on ABS_GAS / ABS_BRAKE).
 
-#include <sys/stat.h>
-#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <mutex>
 #include <thread>
 #include <unistd.h>
+#include <linux/input.h>
 
-#include "joystick.h"
 #include "timestamp.h"
 
 class Controller {
+public:
+    struct State {
+        uint64_t timestamp; // Monotonic nanoseconds of the last update
+
+        float rightTriggerPos;  // 0 to 1
+        float leftTriggerPos;   // 0 to 1
+        float throttlePos;      // -1 to 1 (right trigger - left trigger)
+        float steeringPos;      // -1 to 1
+
+        bool autonomousModeActive;
+        bool recordingModeActive;
+        bool isConnected;
+
+        bool aButtonPressed;
+        bool bButtonPressed;
+        bool xButtonPressed;
+        bool yButtonPressed;
+
+        bool dPadUpPressed;
+        bool dPadDownPressed;
+        bool dPadLeftPressed;
+        bool dPadRightPressed;
+    };
+
 private:
-    const std::string DEFAULT_JOYSTICK = "/dev/input/js0";
+    const char* INPUT_DIRECTORY = "/dev/input";
 
-    // Controls how often to check if the joystick is found/connected
-    static const uint64_t MIN_CONNECTED_CHECK_NSECS = 5 * (uint64_t)NSECS_TO_SECS; // 5 seconds
-    uint64_t lastConnectedCheckTimestamp = 0;
+    // Input codes
+    static const uint16_t AXIS_STEERING = ABS_X;
+    static const uint16_t AXIS_RIGHT_TRIGGER = ABS_GAS;
+    static const uint16_t AXIS_LEFT_TRIGGER = ABS_BRAKE;
+    static const uint16_t AXIS_DPAD_X = ABS_HAT0X;
+    static const uint16_t AXIS_DPAD_Y = ABS_HAT0Y;
+    static const uint16_t BUTTON_A = BTN_SOUTH;
+    static const uint16_t BUTTON_B = BTN_EAST;
+    static const uint16_t BUTTON_X = BTN_NORTH;
+    static const uint16_t BUTTON_Y = BTN_WEST;
 
     // Minimum left trigger (braking) amount to cancel autonomous mode
     const float autonomousModeCancelLeftTriggerMinimum = 0.1f;
 
-    // Actual joystick instance for polling
-    Joystick joystick;
+    // Device to use, empty to use the first gamepad found in INPUT_DIRECTORY
+    std::string devicePath;
+
+    // File descriptors
+    int deviceFd = -1;
+    int inotifyFd = -1;
+    int stopEventFd = -1;
+    int epollFd = -1;
+
+    // Discarding events after a SYN_DROPPED, until the next SYN_REPORT
+    bool droppingEvents = false;
+
+    // Axis ranges reported by the device
+    struct input_absinfo steeringInfo;
+    struct input_absinfo rightTriggerInfo;
+    struct input_absinfo leftTriggerInfo;
+
+    // Working state, only touched by the polling thread
+    State state;
+
+    // Last published state
+    State publishedState;
+    std::mutex publishedStateMutex;
 
-    static const uint32_t POLLING_LOOP_DELAY_USECS = 10000;
     bool isPolling = false;
     std::thread pollingThread;
 
     float map(const float in, const float inMin, const float inMax, const float outMin, const float outMax);
-    bool isJoystickAvailable();
+    bool isGamepad(const int fd);
     bool tryConnect();
+    bool tryOpen(const char* path);
     void disconnected();
-    void poll();
+    void resetState();
+    void publishState();
+    void handleEvent(const struct input_event& event);
+    void handleAxis(const uint16_t code, const int32_t value);
+    void handleButton(const uint16_t code, const bool pressed, const bool toggles = true);
+    void syncDevice(const bool toggles);
+    void drainDevice();
+    void drainInotify();
     void pollLoop();
+    void closePollingFds();
+
 public:
-    std::atomic<float> rightTriggerPos;
-    std::atomic<float> leftTriggerPos;
-    std::atomic<float> throttlePos;
-    std::atomic<float> steeringPos;
-
-    std::atomic<bool> autonomousModeActive;
-    std::atomic<bool> recordingModeActive;
-    std::atomic<bool> isConnected;
-
-    std::atomic<bool> aButtonPressed;
-    std::atomic<bool> bButtonPressed;
-    std::atomic<bool> xButtonPressed;
-    std::atomic<bool> yButtonPressed;
-
-    std::atomic<bool> dPadUpPressed;
-    std::atomic<bool> dPadDownPressed;
-    std::atomic<bool> dPadLeftPressed;
-    std::atomic<bool> dPadRightPressed;
-
-    Controller() : isConnected(false) { disconnected(); }
+    // Called from the polling thread each time a new state is published (optional)
+    // Use this for anything latency sensitive, like cutting the throttle when autonomous mode is cancelled
+    void (*stateCallback)(const State&) = nullptr;
+
+    Controller() { resetState(); publishedState = state; }
+    Controller(const std::string& devicePath) : devicePath(devicePath) { resetState(); publishedState = state; }
     ~Controller() { stopPolling(); }
 
+    // Returns a copy of the latest state
+    State getState();
+
     bool startPolling();
     bool stopPolling();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,22 @@
+#ifndef __DRIVETRAIN_H__
+#define __DRIVETRAIN_H__
+
+// Converts ESC telemetry ERPM into ground speed
+// Defaults are a 4 pole motor in a typical 1/10 chassis, measure your own car
+
+#include <cmath>
+
+struct Drivetrain {
+    float motorPoles = 4.0f;            // Number of magnetic poles in the motor
+    float gearRatio = 9.0f;             // Motor turns per wheel turn (pinion/spur and diff combined)
+    float wheelDiameterMeters = 0.11f;
+
+    // Takes ERPM as reported by MausBoard::EscTelemetry::getERPM() (ERPM / 100) and returns unsigned meters per second
+    float reportedERPMToMetersPerSec(const float reportedERPM) const {
+        const float motorRPM = (reportedERPM * 100.0f) / (motorPoles / 2.0f);
+        const float wheelRPM = motorRPM / gearRatio;
+        return wheelRPM * ((float)M_PI * wheelDiameterMeters) / 60.0f;
+    }
+};
+
+#endif
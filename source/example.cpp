@@ -1,6 +1,7 @@
 #include "maus_board.h"
 #include "fhl_ld19.h"
 #include "controller.h"
+#include "periodic_timer.h"
 
 void imuDataCallback(const MausBoard::ImuData& imuData) {
     // Every 10 milliseconds
@@ -25,20 +26,29 @@ void escTelemetryCallback(const MausBoard::EscTelemetry& escTelemetry) {
     // NOTE! Do not block here. Run longer tasks in a seperate thread.
 }
 
-void ld19FullScanCallback(std::vector<LD19::LidarPoint> points) {
+void loopStatsCallback(const MausBoard::LoopStats& loopStats) {
+    // Every second
+    printf("BOARD LOOP, Mean: %d us Max: %d us FIFO overflows: %d\n", loopStats.loopMeanMicros, loopStats.loopMaxMicros, loopStats.fifoOverflows);
+}
+
+void ld19ScanCallback(const LD19::LidarPoint* points, const size_t count) {
     // Every 100 milliseconds
-    printf("FULL SCAN: %d points\n", points.size());
+    printf("FULL SCAN: %zu points\n", count);
 
+    // NOTE! The points are the driver's own buffer, only valid during this call. Copy what you need to keep.
     // NOTE! Do not block here. Run longer tasks in a seperate thread.
 }
 
 int main() {
     // Create an instance and set the callbacks
     MausBoard board(&imuDataCallback, &escTelemetryCallback);
+    board.loopStatsCallback = &loopStatsCallback; // Optional
     board.startReading(); // Read data in a separate thread until stopReading() 
 
-    // Create an instance and set the callback
-    LD19 ld19(&ld19FullScanCallback);
+    // Create an instance and set the callback. This one doesn't allocate per scan, LD19(&callback) with a
+    // std::vector<LD19::LidarPoint> callback gets a copy of every scan instead
+    LD19 ld19(nullptr);
+    ld19.setScanCallback(&ld19ScanCallback);
     ld19.startReading(); // Read data in a separate thread until stopReading()
 
     // Set the LED colors (blue, red)
@@ -58,15 +68,23 @@ int main() {
     const float throttleScaler = 0.5f; // Max throttle value from -0.5 to 0.5
     const float steeringScaler = -0.9f; // Max steering value from -0.9 to 0.9 (negative because its reversed on my vehicle)
 
+    // Run the control loop at 100Hz. The timer uses absolute deadlines so the rate doesn't drift with the work done each loop
+    PeriodicTimer controlTimer(10 * NSECS_TO_MSECS);
+
+    // Optional (needs root): SCHED_FIFO priority 80 pinned to core 3, and lock memory to avoid page faults
+    // Driver threads can be given real-time priority too, e.g. board.setRealtime(70, 2)
+    // controlTimer.configureRealtime(80, 3, true);
+
     // Keep reading forever
     while (true) {
         // Grab the current joystick inputs and send them to the servos after scaling
-        const float currentThrottleOutput = controller.throttlePos.load() * throttleScaler;
-        const float currentSteeringOutput = controller.steeringPos.load() * steeringScaler;
+        const Controller::State controllerState = controller.getState();
+        const float currentThrottleOutput = controllerState.throttlePos * throttleScaler;
+        const float currentSteeringOutput = controllerState.steeringPos * steeringScaler;
         board.sendSetServos((currentSteeringOutput * 500.0f) + 1500, (currentThrottleOutput * 500.0f) + 1500);
 
-        // Sleep for 10 milliseconds
-        usleep(10000);
+        // Sleep until the next 10 millisecond deadline
+        controlTimer.waitNextPeriod();
     }
 
     // Ideally if upon exit you should call board.stopReading() and ld19.stopReading()
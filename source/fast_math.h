@@ -0,0 +1,35 @@
+#ifndef __FAST_MATH_H__
+#define __FAST_MATH_H__
+
+// Branch-free approximations for inner loops that run over whole scans
+// Written so the compiler can vectorize loops that call them (no calls into libm, no branches)
+
+#include <stdint.h>
+#include <cmath>
+
+class FastMath {
+public:
+    // sin and cos at the same time, max error about 4e-6 for angles within +-50 radians (better closer to 0)
+    static inline void sinCos(const float angle, float& sinOut, float& cosOut) {
+        const float halfPi = 1.57079632679f;
+
+        // Reduce to [-pi/4, pi/4] around the nearest multiple of pi/2
+        const float quadrantF = std::nearbyint(angle * (1.0f / halfPi));
+        const int32_t quadrant = (int32_t)quadrantF;
+        const float r = (angle - (quadrantF * 1.57079625129f)) - (quadrantF * 7.54978995489e-8f);
+        const float r2 = r * r;
+
+        // Taylor series are accurate enough over such a small range
+        const float s = r * (1.0f + r2 * (-1.6666667e-1f + r2 * (8.3333333e-3f + r2 * -1.9841270e-4f)));
+        const float c = 1.0f + r2 * (-0.5f + r2 * (4.1666667e-2f + r2 * (-1.3888889e-3f + r2 * 2.4801587e-5f)));
+
+        // Rotate the result into the right quadrant
+        const bool swap = (quadrant & 1) != 0;
+        const float sinSign = (quadrant & 2) ? -1.0f : 1.0f;
+        const float cosSign = ((quadrant + 1) & 2) ? -1.0f : 1.0f;
+        sinOut = (swap ? c : s) * sinSign;
+        cosOut = (swap ? s : c) * cosSign;
+    }
+};
+
+#endif
@@ -1,5 +1,9 @@
 #include "fhl_ld19.h"
 
+#include <algorithm>
+
+#include "binned_scan.h"
+
 const uint8_t LD19::crcTable[] = {
     0x00, 0x4D, 0x9A, 0xD7, 0x79, 0x34, 0xE3, 0xAE, 0xF2, 0xBF, 0x68, 0x25, 0x8B, 0xC6, 0x11, 0x5C,
     0xA9, 0xE4, 0x33, 0x7E, 0xD0, 0x9D, 0x4A, 0x07, 0x5B, 0x16, 0xC1, 0x8C, 0x22, 0x6F, 0xB8, 0xF5,
@@ -26,10 +30,59 @@ uint8_t LD19::calCRC8(const uint8_t *p, const size_t len) {
     return crc;
 }
 
+void LD19::flushSector() {
+    if (sectorPointsCount > 0) {
+        scanTrace.clear();
+        scanTrace.set(TraceStamps::STAGE_BYTES_RECEIVED, lastReadTimestamp);
+        scanTrace.mark(TraceStamps::STAGE_DECODED);
+
+        sectorCallback(sectorPoints, sectorPointsCount);
+        sectorPointsCount = 0;
+    }
+}
+
+void LD19::streamSector(const LidarPoint* framePoints, const float angleStep) {
+    // No sector size, just pass the frame through
+    if (sectorSize == 0) {
+        memcpy(sectorPoints, framePoints, sizeof(LidarPoint) * POINTS_PER_FRAME);
+        sectorPointsCount = POINTS_PER_FRAME;
+        flushSector();
+        return;
+    }
+
+    for (uint8_t pointIndex = 0; pointIndex < POINTS_PER_FRAME; pointIndex++) {
+        // Send the sector off as soon as a point lands in the next one
+        const int32_t pointSector = framePoints[pointIndex].angle / sectorSize;
+        if (pointSector != currentSector || sectorPointsCount == MAX_SECTOR_POINTS) {
+            flushSector();
+            currentSector = pointSector;
+        }
+        sectorPoints[sectorPointsCount++] = framePoints[pointIndex];
+    }
+
+    // If the next point is going to be in the next sector, this one is done. No need to wait for another frame
+    const uint16_t nextAngle = (uint16_t)(framePoints[POINTS_PER_FRAME - 1].angle + angleStep) % 36000;
+    if ((int32_t)(nextAngle / sectorSize) != currentSector)
+        flushSector();
+}
+
+void LD19::setSectorCallback(void (*sectorCallback)(const LidarPoint*, const size_t), const uint16_t sectorDegrees) {
+    this->sectorCallback = sectorCallback;
+    sectorSize = (sectorDegrees >= 360) ? 0 : sectorDegrees * 100;
+    sectorPointsCount = 0;
+    currentSector = -1;
+}
+
 void LD19::parse(uint8_t *data, const size_t len) {
+    // In chunks, so any amount of input fits in the parse buffer next to the remainder
+    for (size_t offset = 0; offset < len; offset += UART_BUFFER_SIZE)
+        parseChunk(&data[offset], std::min(len - offset, (size_t)UART_BUFFER_SIZE));
+}
+
+void LD19::parseChunk(const uint8_t* data, const size_t len) {
     // Construct the current datablock including the remainder
     const size_t bufferLen = len + dataRemainderLen;
-    uint8_t buffer[bufferLen];
+    uint8_t* buffer = parseBuffer;
     memcpy(buffer, dataRemainder, dataRemainderLen);
     memcpy(buffer + dataRemainderLen, data, len);
 
@@ -53,8 +106,9 @@ void LD19::parse(uint8_t *data, const size_t len) {
                         currentFrame->endAngle += 36000;                
 
                     float angleStep = (float)(currentFrame->endAngle - currentFrame->startAngle) / (float)(POINTS_PER_FRAME - 1);
+                    LidarPoint framePoints[POINTS_PER_FRAME];
                     for (uint8_t pointIndex = 0; pointIndex < POINTS_PER_FRAME; pointIndex++) {
-                        LidarPoint point;
+                        LidarPoint& point = framePoints[pointIndex];
                         point.distance = currentFrame->points[pointIndex].distance;
                         point.intensity = currentFrame->points[pointIndex].intensity;
 
@@ -64,10 +118,18 @@ void LD19::parse(uint8_t *data, const size_t len) {
                         // Calculate the timestamp for the point (assume the last point is from the current timestamp)
                         double timestampOffsetSecs = ((double)(angleStep * ((POINTS_PER_FRAME - 1) - pointIndex)) / 100.0) / (double)(currentFrame->speed);
                         point.timestamp = timestamp - (uint64_t)(timestampOffsetSecs * 1000000000);
-
-                        // Collect point
-                        pointBuffer.push_back(point);
                     }
+
+                    // Collect points for the full scan
+                    if (fullScanCallback || scanCallback)
+                        addScanPoints(framePoints);
+
+                    // Stream them out straight away
+                    if (sectorCallback)
+                        streamSector(framePoints, angleStep);
+
+                    if (binnedScan)
+                        binnedScan->addPoints(framePoints, POINTS_PER_FRAME);
                     
                     // Advance bufferPos
                     bufferPos += sizeof(RawFrame);
@@ -99,26 +161,30 @@ void LD19::parse(uint8_t *data, const size_t len) {
     if (dataRemainderLen > 0) {
         memcpy(dataRemainder, buffer + dataRemainderBegin, dataRemainderLen);
     }
+}
 
-    // Check pointBuffer for a full scan
-    size_t lastScanStartIndex = 0;
-    uint16_t lastAngle = 0;
-    for (size_t i = 0; i < pointBuffer.size(); i++) {
-        // Criteria for a scan (point angle goes from ~360 to 0)
-        if (i > 0 && lastAngle > pointBuffer[i].angle) {
-            // Call the full scan callback with the points vector
-            std::vector<LidarPoint> scanPoints(pointBuffer.begin() + lastScanStartIndex, pointBuffer.begin() + i);
-            fullScanCallback(scanPoints);
-
-            lastScanStartIndex = i;
-        }
-        lastAngle = pointBuffer[i].angle;
-    }
-    if (lastScanStartIndex > 0) {
-        pointBuffer.erase(pointBuffer.begin(), pointBuffer.begin() + lastScanStartIndex);
+void LD19::addScanPoints(const LidarPoint* framePoints) {
+    for (uint8_t pointIndex = 0; pointIndex < POINTS_PER_FRAME; pointIndex++) {
+        // Criteria for a scan (point angle goes from ~360 to 0), or out of room
+        if ((scanPointsCount > 0) && ((scanPoints[scanPointsCount - 1].angle > framePoints[pointIndex].angle) || (scanPointsCount == MAX_SCAN_POINTS)))
+            emitScan();
+        scanPoints[scanPointsCount++] = framePoints[pointIndex];
     }
 }
 
+void LD19::emitScan() {
+    scanTrace.clear();
+    scanTrace.set(TraceStamps::STAGE_BYTES_RECEIVED, lastReadTimestamp);
+    scanTrace.mark(TraceStamps::STAGE_DECODED);
+
+    if (scanCallback)
+        scanCallback(scanPoints, scanPointsCount);
+    if (fullScanCallback)
+        fullScanCallback(std::vector<LidarPoint>(scanPoints, scanPoints + scanPointsCount));
+
+    scanPointsCount = 0;
+}
+
 void LD19::readLoop() {
     // Read forever
     if (uartFileStream != -1) {
@@ -127,6 +193,7 @@ void LD19::readLoop() {
             // Read and parse data
             int len = read(uartFileStream, uartBuffer, UART_BUFFER_SIZE);
             if (len > 0) {
+                lastReadTimestamp = TimeStamp::getMonotonic();
                 parse(uartBuffer, len);
             }
         }
@@ -139,9 +206,9 @@ void LD19::readLoop() {
 bool LD19::startReading() {
     if (!readingUart) {
         // Open the UART
-        uartFileStream = open(DEFAULT_SERIAL_FHL_LD19, O_RDONLY);
+        uartFileStream = open(device.c_str(), O_RDONLY);
         if (uartFileStream == -1) {
-            printf("Unable to open UART\n");
+            printf("Unable to open UART %s\n", device.c_str());
             return false;
         }
 
@@ -175,3 +242,11 @@ bool LD19::stopReading() {
     }
     return false;
 }
+
+bool LD19::setRealtime(const int priority, const int cpuCore) {
+    if (readingUart)
+        return Realtime::configureThread(readingThread.native_handle(), priority, cpuCore);
+
+    printf("Cannot set real-time scheduling. UART is not being read\n");
+    return false;
+}
@@ -7,16 +7,22 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <vector>
+#include <string>
 #include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
 #include <thread>
 #include <string.h>
+#include <cmath>
 
 #include "timestamp.h"
+#include "realtime.h"
+#include "latency_trace.h"
 
 #define DEFAULT_SERIAL_FHL_LD19 "/dev/serial0"
 
+class BinnedScan;
+
 class LD19 {
 public:
     struct __attribute__((__packed__)) LidarPoint {
@@ -24,6 +30,11 @@ public:
         uint8_t intensity;  // Docs say for an object at 6M, this value should be around 200
         uint16_t angle;     // 0.01 degrees
         uint64_t timestamp; // Nanoseconds since epoch
+
+        // The LD19 spins clockwise, these convert to the vehicle frame in pose2d.h (x forward, y left, counter-clockwise)
+        float getAngleRadians() const { return -(float)angle * (float)(M_PI / 18000.0); }
+        float getXMeters() const { return (distance / 1000.0f) * std::cos(getAngleRadians()); }
+        float getYMeters() const { return (distance / 1000.0f) * std::sin(getAngleRadians()); }
     };
 
 private:
@@ -51,16 +62,42 @@ private:
     uint8_t dataRemainder[DATA_REMAINDER_SIZE];
     uint16_t dataRemainderLen = 0;
 
+    // The remainder plus the chunk being parsed (input is parsed UART_BUFFER_SIZE bytes at a time)
+    static const size_t UART_BUFFER_SIZE = 256;
+    uint8_t parseBuffer[DATA_REMAINDER_SIZE + UART_BUFFER_SIZE];
+    void parseChunk(const uint8_t* data, const size_t len);
+
     uint8_t calCRC8(const uint8_t *p, const size_t len);
 
-    // This callback gets called each time we parse out a full scan worth of points
+    // This callback gets called each time we parse out a full scan worth of points (allocates a vector per scan, see
+    // setScanCallback() for the allocation free version)
     void (*fullScanCallback)(std::vector<LidarPoint>);
+    void (*scanCallback)(const LidarPoint*, const size_t) = nullptr;
+
+    // Points of the scan in progress, until the angle wraps around (a revolution is ~450 points)
+    static const size_t MAX_SCAN_POINTS = 2048;
+    LidarPoint scanPoints[MAX_SCAN_POINTS];
+    size_t scanPointsCount = 0;
+
+    void addScanPoints(const LidarPoint* framePoints);
+    void emitScan();
+
+    // Sector streaming, see setSectorCallback()
+    static const size_t MAX_SECTOR_POINTS = 512;
+    void (*sectorCallback)(const LidarPoint*, const size_t) = nullptr;
+    uint16_t sectorSize = 0; // 0.01 degrees, 0 means every frame
+    LidarPoint sectorPoints[MAX_SECTOR_POINTS];
+    size_t sectorPointsCount = 0;
+    int32_t currentSector = -1;
+
+    void streamSector(const LidarPoint* framePoints, const float angleStep);
+    void flushSector();
 
-    // Temporary storage for points until we get a full scan
-    std::vector<LidarPoint> pointBuffer;
+    // Fixed angular bins, see setBinnedScan()
+    BinnedScan* binnedScan = nullptr;
 
     // UART related members
-    static const size_t UART_BUFFER_SIZE = 256;
+    std::string device;
     bool readingUart = false;
     int uartFileStream = -1;
     std::thread readingThread;
@@ -70,17 +107,41 @@ private:
     uint64_t timestampReferenceLidar = 0;
     uint64_t timestampLidarFramePrevious = 0;
 
+    // Latency tracing
+    uint64_t lastReadTimestamp = 0; // Monotonic
+    TraceStamps scanTrace;
+
     // Reads the UART continuously
     void readLoop();
 
 public:
-    LD19(void (*fullScanCallback)(std::vector<LidarPoint>)) : fullScanCallback(fullScanCallback) {}
+    // fullScanCallback can be nullptr if only sector streaming is used. Give each lidar its own device when using several
+    LD19(void (*fullScanCallback)(std::vector<LidarPoint>), const char* device = DEFAULT_SERIAL_FHL_LD19) : fullScanCallback(fullScanCallback), device(device) {}
     ~LD19() { stopReading(); }
 
+    // Parses raw bytes from the lidar. Nothing here allocates unless the vector fullScanCallback is set
     void parse(uint8_t *data, const size_t len);
 
+    // Full scans as a pointer to the driver's own buffer, only valid during the call (optional, alongside or instead
+    // of fullScanCallback). No allocations, unlike the vector callback
+    void setScanCallback(void (*scanCallback)(const LidarPoint* points, const size_t count)) { this->scanCallback = scanCallback; }
+
+    // Streams points as soon as they are decoded instead of waiting for the angle to wrap around (optional)
+    // A sectorDegrees of 0 calls back with every 12 point frame, otherwise points are grouped into fixed sectors
+    // (e.g. 30 gives 0-30, 30-60, ...). Each point keeps its own timestamp. Works alongside the full scan callback
+    void setSectorCallback(void (*sectorCallback)(const LidarPoint* points, const size_t count), const uint16_t sectorDegrees = 0);
+
+    // Bins every frame into binnedScan as it arrives (optional, nullptr to stop). See binned_scan.h
+    void setBinnedScan(BinnedScan* binnedScan) { this->binnedScan = binnedScan; }
+
+    // Trace stamps of the scan currently being passed to the callback (only valid inside the callback)
+    const TraceStamps& getScanTrace() const { return scanTrace; }
+
     bool startReading();
     bool stopReading();
+
+    // Gives the reading thread SCHED_FIFO priority and pins it to a CPU core (see realtime.h). Call after startReading()
+    bool setRealtime(const int priority, const int cpuCore);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include "imu_fusion.h"
+
+#include <cmath>
+
+#include "timestamp.h"
+
+#define GRAVITY_METERS_PER_SEC2 9.80665f
+
+ImuFusion::ImuFusion() : ImuFusion(Config()) {}
+
+ImuFusion::ImuFusion(const Config& config) :
+    config(config),
+    gyroRadiansPerCount((float)(M_PI / 180.0) / config.gyroCountsPerDegPerSec),
+    accelMetersPerSec2PerCount(GRAVITY_METERS_PER_SEC2 / config.accelCountsPerG) {}
+
+void ImuFusion::addEscTelemetry(const MausBoard::EscTelemetry& escTelemetry, const uint16_t throttleMicros) {
+    const int throttleOffset = (int)throttleMicros - (int)config.throttleNeutralMicros;
+    setStationary((escTelemetry.ERPM == 0) && (std::abs(throttleOffset) <= config.throttleDeadbandMicros));
+}
+
+void ImuFusion::reset() {
+    initialized = false;
+    integralError[0] = integralError[1] = integralError[2] = 0.0f;
+    windowSamples = 0;
+    state.orientation = Quaternion();
+}
+
+void ImuFusion::initialize(const float ax, const float ay, const float az) {
+    // Start level with the accelerometer's gravity, yaw 0
+    const float roll = std::atan2(ay, az);
+    const float pitch = std::atan2(-ax, std::sqrt((ay * ay) + (az * az)));
+
+    const float cr = std::cos(roll * 0.5f);
+    const float sr = std::sin(roll * 0.5f);
+    const float cp = std::cos(pitch * 0.5f);
+    const float sp = std::sin(pitch * 0.5f);
+    state.orientation = Quaternion(cr * cp, sr * cp, cr * sp, -sr * sp);
+
+    initialized = true;
+}
+
+void ImuFusion::updateStillness(const float* values, const float dt) {
+    if (!stationary) {
+        windowSamples = 0;
+        state.still = false;
+        return;
+    }
+
+    if (windowSamples == 0) {
+        for (int i = 0; i < 6; i++) {
+            windowReference[i] = values[i];
+            windowSum[i] = 0.0f;
+            windowSumSquares[i] = 0.0f;
+        }
+        windowSecs = 0.0f;
+    }
+    for (int i = 0; i < 6; i++) {
+        const float deviation = values[i] - windowReference[i];
+        windowSum[i] += deviation;
+        windowSumSquares[i] += deviation * deviation;
+    }
+    windowSamples++;
+    windowSecs += dt;
+    if (windowSecs < config.stillWindowSecs)
+        return;
+
+    // Only a window that was still from start to end is learned from, a coasting turn or someone picking the car up
+    // shows in the mean rate or the noise
+    float mean[6];
+    float variance[6];
+    for (int i = 0; i < 6; i++) {
+        const float meanDeviation = windowSum[i] / windowSamples;
+        mean[i] = windowReference[i] + meanDeviation;
+        variance[i] = (windowSumSquares[i] / windowSamples) - (meanDeviation * meanDeviation);
+    }
+    const float gyroMeanSquared = (mean[0] * mean[0]) + (mean[1] * mean[1]) + (mean[2] * mean[2]);
+    const float gyroVariance = variance[0] + variance[1] + variance[2];
+    const float accelVariance = variance[3] + variance[4] + variance[5];
+    state.still = (gyroMeanSquared < (config.stillGyroLimit * config.stillGyroLimit)) &&
+        (gyroVariance < (config.stillGyroNoiseLimit * config.stillGyroNoiseLimit)) &&
+        (accelVariance < (config.stillAccelNoiseLimit * config.stillAccelNoiseLimit));
+
+    if (state.still) {
+        const float alpha = windowSecs / (config.biasTimeConstantSecs + windowSecs);
+        state.gyroBias[0] += (mean[0] - state.gyroBias[0]) * alpha;
+        state.gyroBias[1] += (mean[1] - state.gyroBias[1]) * alpha;
+        state.gyroBias[2] += (mean[2] - state.gyroBias[2]) * alpha;
+        stats.biasUpdates += windowSamples;
+        stats.stillWindows++;
+    } else {
+        stats.movingWindows++;
+    }
+    windowSamples = 0;
+}
+
+void ImuFusion::step(float gx, float gy, float gz, const float ax, const float ay, const float az, const float dt) {
+    const float values[6] = {gx, gy, gz, ax, ay, az};
+    updateStillness(values, dt);
+
+    gx -= state.gyroBias[0];
+    gy -= state.gyroBias[1];
+    gz -= state.gyroBias[2];
+    state.gyro[0] = gx;
+    state.gyro[1] = gy;
+    state.gyro[2] = gz;
+
+    float qw = state.orientation.w;
+    float qx = state.orientation.x;
+    float qy = state.orientation.y;
+    float qz = state.orientation.z;
+
+    // Accelerometer correction, only when it's measuring (mostly) gravity
+    const float accelSquared = (ax * ax) + (ay * ay) + (az * az);
+    const float accelG = std::sqrt(accelSquared) * (1.0f / GRAVITY_METERS_PER_SEC2);
+    if (std::fabs(accelG - 1.0f) < config.accelToleranceG) {
+        const float invNorm = 1.0f / std::sqrt(accelSquared);
+        const float nx = ax * invNorm;
+        const float ny = ay * invNorm;
+        const float nz = az * invNorm;
+
+        // Gravity direction according to the current orientation
+        const float vx = 2.0f * ((qx * qz) - (qw * qy));
+        const float vy = 2.0f * ((qw * qx) + (qy * qz));
+        const float vz = (qw * qw) - (qx * qx) - (qy * qy) + (qz * qz);
+
+        // Error is the cross product between measured and estimated gravity
+        const float ex = (ny * vz) - (nz * vy);
+        const float ey = (nz * vx) - (nx * vz);
+        const float ez = (nx * vy) - (ny * vx);
+
+        integralError[0] += config.ki * ex * dt;
+        integralError[1] += config.ki * ey * dt;
+        integralError[2] += config.ki * ez * dt;
+
+        gx += (config.kp * ex) + integralError[0];
+        gy += (config.kp * ey) + integralError[1];
+        gz += (config.kp * ez) + integralError[2];
+    } else {
+        stats.accelRejected++;
+    }
+
+    // Integrate q' = 0.5 * q * (0, g)
+    const float halfDt = 0.5f * dt;
+    gx *= halfDt;
+    gy *= halfDt;
+    gz *= halfDt;
+    const float pw = qw;
+    const float px = qx;
+    const float py = qy;
+    qw += (-px * gx) - (py * gy) - (qz * gz);
+    qx += (pw * gx) + (py * gz) - (qz * gy);
+    qy += (pw * gy) - (px * gz) + (qz * gx);
+    qz += (pw * gz) + (px * gy) - (py * gx);
+
+    const float invNorm = 1.0f / std::sqrt((qw * qw) + (qx * qx) + (qy * qy) + (qz * qz));
+    state.orientation = Quaternion(qw * invNorm, qx * invNorm, qy * invNorm, qz * invNorm);
+}
+
+void ImuFusion::updateBatch(const MausBoard::RawImuSample* samples, const size_t sampleCount) {
+    // Convert to physical units up front, this loop has no dependencies between samples
+    for (size_t i = 0; i < sampleCount; i++) {
+        gyroX[i] = samples[i].gyroX * gyroRadiansPerCount;
+        gyroY[i] = samples[i].gyroY * gyroRadiansPerCount;
+        gyroZ[i] = samples[i].gyroZ * gyroRadiansPerCount;
+        accelX[i] = samples[i].accelX * accelMetersPerSec2PerCount;
+        accelY[i] = samples[i].accelY * accelMetersPerSec2PerCount;
+        accelZ[i] = samples[i].accelZ * accelMetersPerSec2PerCount;
+    }
+
+    for (size_t i = 0; i < sampleCount; i++) {
+        if (!initialized) {
+            initialize(accelX[i], accelY[i], accelZ[i]);
+            lastDeviceMicros = samples[i].deviceMicros;
+        }
+
+        // Board micros wrap every ~71 minutes, the unsigned difference handles that. Big gaps aren't integrated
+        float dt = (uint32_t)(samples[i].deviceMicros - lastDeviceMicros) * 1e-6f;
+        if (dt > 0.05f) {
+            dt = 0.0f;
+            windowSamples = 0;
+        }
+        lastDeviceMicros = samples[i].deviceMicros;
+
+        step(gyroX[i], gyroY[i], gyroZ[i], accelX[i], accelY[i], accelZ[i], dt);
+    }
+
+    const size_t last = sampleCount - 1;
+    state.timestamp = samples[last].timestamp;
+    state.accel[0] = accelX[last];
+    state.accel[1] = accelY[last];
+    state.accel[2] = accelZ[last];
+    state.stationary = stationary;
+}
+
+void ImuFusion::update(const MausBoard::RawImuSample* samples, const size_t sampleCount) {
+    if (sampleCount == 0)
+        return;
+
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    for (size_t offset = 0; offset < sampleCount; offset += MAX_BATCH) {
+        const size_t remaining = sampleCount - offset;
+        updateBatch(&samples[offset], (remaining < MAX_BATCH) ? remaining : MAX_BATCH);
+    }
+
+    const uint64_t elapsed = TimeStamp::getMonotonic() - startTime;
+    stats.samples += sampleCount;
+    stats.batches++;
+    stats.totalUpdateNsecs += elapsed;
+    if (elapsed > stats.maxBatchNsecs)
+        stats.maxBatchNsecs = elapsed;
+}
+
+MausBoard::ImuData ImuFusion::getImuData() const {
+    const float gyroCountsPerRadian = 1.0f / gyroRadiansPerCount;
+    const float accelCountsPerMetersPerSec2 = 1.0f / accelMetersPerSec2PerCount;
+
+    MausBoard::ImuData imuData;
+    imuData.timestamp = state.timestamp;
+    imuData.qX = state.orientation.x;
+    imuData.qY = state.orientation.y;
+    imuData.qZ = state.orientation.z;
+    imuData.qW = state.orientation.w;
+    imuData.gyroX = state.gyro[0] * gyroCountsPerRadian;
+    imuData.gyroY = state.gyro[1] * gyroCountsPerRadian;
+    imuData.gyroZ = state.gyro[2] * gyroCountsPerRadian;
+    imuData.accelX = state.accel[0] * accelCountsPerMetersPerSec2;
+    imuData.accelY = state.accel[1] * accelCountsPerMetersPerSec2;
+    imuData.accelZ = state.accel[2] * accelCountsPerMetersPerSec2;
+    return imuData;
+}
+
+void ImuFusion::printStats() const {
+    printf("ImuFusion: %llu samples in %llu batches, mean %llu ns/sample, max %llu ns/batch, %llu accel rejected, %llu bias updates\n",
+        (unsigned long long)stats.samples, (unsigned long long)stats.batches, (unsigned long long)stats.getMeanSampleNsecs(),
+        (unsigned long long)stats.maxBatchNsecs, (unsigned long long)stats.accelRejected, (unsigned long long)stats.biasUpdates);
+    printf("  %llu still windows, %llu stopped but moving\n", (unsigned long long)stats.stillWindows,
+        (unsigned long long)stats.movingWindows);
+    printf("  gyro bias %.5f %.5f %.5f rad/s, yaw %.3f rad\n",
+        state.gyroBias[0], state.gyroBias[1], state.gyroBias[2], state.getYawRadians());
+}
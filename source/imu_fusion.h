@@ -0,0 +1,129 @@
+#ifndef __IMU_FUSION_H__
+#define __IMU_FUSION_H__
+
+// Mahony orientation filter for the raw gyro/accel stream (MausBoard::IMU_MODE_RAW)
+// Replaces the DMP so orientation is available at the raw sample rate (up to 1kHz) in physical units.
+// The gyro bias is learned online while the car is stopped (ESC ERPM 0 and throttle at neutral) and has been still for
+// a whole window, since the ESC also reports 0 ERPM while coasting.
+//
+// Not threaded, call update() straight from MausBoard::rawImuCallback, or with samples replayed from a recording.
+// Everything is fixed size and allocation free, a batch of 8 samples takes a few microseconds on a Pi 4 core.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "maus_board.h"
+#include "quaternion.h"
+
+class ImuFusion {
+public:
+    struct Config {
+        // Matches the ranges set by the firmware in raw mode
+        float gyroCountsPerDegPerSec = 16.4f;
+        float accelCountsPerG = 8192.0f;
+
+        // Mahony gains, kp pulls towards the accelerometer's gravity, ki slowly removes what's left of the bias
+        float kp = 1.0f;
+        float ki = 0.02f;
+
+        // Accelerometer is only trusted when its magnitude is this close to 1G (not accelerating or bumping)
+        float accelToleranceG = 0.15f;
+
+        // Bias learning while stopped: the bias follows the mean gyro of each still window with this time constant
+        float biasTimeConstantSecs = 2.0f;
+
+        // A window is still when the mean rate and the gyro/accel noise over it stay under these limits. Raise
+        // stillGyroLimit for an MPU with a bigger zero rate offset, a coasting turn slower than it can be learned
+        float stillWindowSecs = 0.5f;
+        float stillGyroLimit = 0.03f;       // rad/s, mean over the window
+        float stillGyroNoiseLimit = 0.01f;  // rad/s, standard deviation
+        float stillAccelNoiseLimit = 0.1f;  // m/s^2, standard deviation
+
+        // ESC throttle pulse that means stopped, and how far from it still counts as stopped
+        uint16_t throttleNeutralMicros = 1500;
+        uint16_t throttleDeadbandMicros = 25;
+    };
+
+    struct State {
+        uint64_t timestamp; // Nanoseconds since epoch of the last sample
+        Quaternion orientation;
+        float gyro[3];      // rad/s, bias removed
+        float accel[3];     // m/s^2
+        float gyroBias[3];  // rad/s
+        bool stationary;    // Stopped according to the ESC
+        bool still;         // And the last window was still, the bias is being learned
+
+        float getYawRadians() const { return orientation.getYawRadians(); }
+    };
+
+    struct Stats {
+        uint64_t samples;
+        uint64_t accelRejected;     // Samples where the accelerometer correction was skipped
+        uint64_t biasUpdates;       // Samples used to learn the gyro bias
+        uint64_t stillWindows;
+        uint64_t movingWindows;     // Stopped according to the ESC but not still
+        uint64_t batches;
+        uint64_t totalUpdateNsecs;
+        uint64_t maxBatchNsecs;
+
+        uint64_t getMeanSampleNsecs() const { return samples ? (totalUpdateNsecs / samples) : 0; }
+    };
+
+private:
+    static const size_t MAX_BATCH = 64;
+
+    const Config config;
+    const float gyroRadiansPerCount;
+    const float accelMetersPerSec2PerCount;
+
+    State state = {};
+    Stats stats = {};
+    float integralError[3] = {};
+    uint32_t lastDeviceMicros = 0;
+    bool initialized = false;
+    bool stationary = false;
+
+    // Stillness window: sums of the deviations from its first sample (gyro xyz, accel xyz), so the variance doesn't
+    // drown in 1G
+    float windowReference[6];
+    float windowSum[6];
+    float windowSumSquares[6];
+    float windowSecs = 0.0f;
+    uint32_t windowSamples = 0;
+
+    // Unit conversion scratch (SoA so the conversion loop vectorizes)
+    float gyroX[MAX_BATCH], gyroY[MAX_BATCH], gyroZ[MAX_BATCH];
+    float accelX[MAX_BATCH], accelY[MAX_BATCH], accelZ[MAX_BATCH];
+
+    void initialize(const float ax, const float ay, const float az);
+    void updateStillness(const float* values, const float dt);
+    void step(const float gx, const float gy, const float gz, const float ax, const float ay, const float az, const float dt);
+    void updateBatch(const MausBoard::RawImuSample* samples, const size_t sampleCount);
+
+public:
+    ImuFusion();
+    ImuFusion(const Config& config);
+
+    // Tell the filter whether the car is stopped (enables bias learning)
+    void setStationary(const bool stationary) { this->stationary = stationary; }
+
+    // Same as setStationary, from ESC telemetry and the throttle that was being commanded (see MausBoard::getLastThrottleMicros())
+    void addEscTelemetry(const MausBoard::EscTelemetry& escTelemetry, const uint16_t throttleMicros);
+
+    // Runs the filter over a batch of samples (in time order)
+    void update(const MausBoard::RawImuSample* samples, const size_t sampleCount);
+
+    // Starts over, keeping the learned gyro bias
+    void reset();
+
+    const State& getState() const { return state; }
+    const Stats& getStats() const { return stats; }
+
+    // The current state as an ImuData in the DMP conventions (gyro and accel in counts), so PoseEstimator and ScanDeskew
+    // can use the raw mode without changes
+    MausBoard::ImuData getImuData() const;
+
+    void printStats() const;
+};
+
+#endif
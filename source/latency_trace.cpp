@@ -0,0 +1,90 @@
+#include "latency_trace.h"
+
+#include <algorithm>
+
+const char* TraceStamps::stageNames[] = {
+    "bytes received",
+    "decoded",
+    "processed",
+    "send called",
+    "write returned",
+    "tx drained"
+};
+
+void LatencyTracer::record(const TraceStamps& trace) {
+    std::lock_guard<std::mutex> lock(recordsMutex);
+    records[recordsPos] = trace;
+    recordsPos = (recordsPos + 1) % MAX_RECORDS;
+    if (recordsCount < MAX_RECORDS)
+        recordsCount++;
+}
+
+void LatencyTracer::clear() {
+    std::lock_guard<std::mutex> lock(recordsMutex);
+    recordsPos = 0;
+    recordsCount = 0;
+}
+
+static void printPercentiles(const char* label, uint64_t* deltas, const size_t count) {
+    if (count == 0)
+        return;
+
+    std::sort(deltas, deltas + count);
+    const auto percentile = [&](const size_t p) { return (double)deltas[((count - 1) * p) / 100] / NSECS_TO_USECS; };
+    printf("  %-36s n=%-5zu p50 %9.1f us  p90 %9.1f us  p99 %9.1f us  max %9.1f us\n",
+        label, count, percentile(50), percentile(90), percentile(99), (double)deltas[count - 1] / NSECS_TO_USECS);
+}
+
+void LatencyTracer::printReport() {
+    size_t count;
+    {
+        std::lock_guard<std::mutex> lock(recordsMutex);
+        count = recordsCount;
+        memcpy(snapshot, records, sizeof(TraceStamps) * count);
+    }
+
+    printf("Latency report for %s (%zu traces)\n", name, count);
+
+    uint64_t deltas[MAX_RECORDS];
+    char label[64];
+
+    // Consecutive stages (skipping any stage that wasn't reached)
+    for (size_t from = 0; from < TraceStamps::NUM_STAGES; from++) {
+        for (size_t to = from + 1; to < TraceStamps::NUM_STAGES; to++) {
+            size_t deltaCount = 0;
+            for (size_t i = 0; i < count; i++) {
+                const uint64_t* stamps = snapshot[i].stamps;
+                if (stamps[from] == 0 || stamps[to] == 0 || stamps[to] < stamps[from])
+                    continue;
+
+                // Only use this pair if nothing between them was reached
+                bool adjacent = true;
+                for (size_t between = from + 1; between < to; between++)
+                    adjacent = adjacent && (stamps[between] == 0);
+                if (adjacent)
+                    deltas[deltaCount++] = stamps[to] - stamps[from];
+            }
+
+            snprintf(label, sizeof(label), "%s -> %s", TraceStamps::stageNames[from], TraceStamps::stageNames[to]);
+            printPercentiles(label, deltas, deltaCount);
+        }
+    }
+
+    // First to last stage reached
+    size_t deltaCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint64_t* stamps = snapshot[i].stamps;
+        uint64_t first = 0;
+        uint64_t last = 0;
+        for (size_t stage = 0; stage < TraceStamps::NUM_STAGES; stage++) {
+            if (stamps[stage] == 0)
+                continue;
+            if (first == 0)
+                first = stamps[stage];
+            last = stamps[stage];
+        }
+        if (last > first)
+            deltas[deltaCount++] = last - first;
+    }
+    printPercentiles("total", deltas, deltaCount);
+}
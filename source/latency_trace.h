@@ -0,0 +1,69 @@
+#ifndef __LATENCY_TRACE_H__
+#define __LATENCY_TRACE_H__
+
+// Latency tracing for the sensor -> actuator path
+// A TraceStamps travels alongside the data and each stage stamps the monotonic time it was reached.
+// Finished TraceStamps get recorded in a LatencyTracer, which keeps the most recent ones and reports per stage percentiles.
+//
+// Example (lidar -> servos):
+//   In the scan callback:   TraceStamps trace = ld19.getScanTrace();
+//   After processing:       trace.mark(TraceStamps::STAGE_PROCESSED);
+//   Send the command:       board.sendSetServos(steering, throttle, &trace);
+//   Then:                   tracer.record(trace);
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+
+#include "timestamp.h"
+
+struct TraceStamps {
+    enum Stage : uint8_t {
+        STAGE_BYTES_RECEIVED = 0,   // read() returned the bytes that completed the data
+        STAGE_DECODED,              // Driver finished parsing, right before the callback
+        STAGE_PROCESSED,            // Consumer finished its processing
+        STAGE_SEND_CALLED,          // Command send was called
+        STAGE_WRITE_RETURNED,       // write() returned (bytes are in the kernel TX queue)
+        STAGE_TX_DRAINED,           // tcdrain() returned (bytes have left the UART)
+        NUM_STAGES
+    };
+
+    static const char* stageNames[NUM_STAGES];
+
+    // CLOCK_MONOTONIC nanoseconds, 0 means the stage was not reached
+    uint64_t stamps[NUM_STAGES];
+
+    void clear() { memset(stamps, 0, sizeof(stamps)); }
+    void mark(const Stage stage) { stamps[stage] = TimeStamp::getMonotonic(); }
+    void set(const Stage stage, const uint64_t timestamp) { stamps[stage] = timestamp; }
+};
+
+class LatencyTracer {
+private:
+    static const size_t MAX_RECORDS = 1024;
+
+    const char* name;
+
+    // Circular buffer of the most recent traces
+    TraceStamps records[MAX_RECORDS];
+    size_t recordsPos = 0;
+    size_t recordsCount = 0;
+    std::mutex recordsMutex;
+
+    // Copy used by printReport() so record() isn't blocked while sorting
+    TraceStamps snapshot[MAX_RECORDS];
+
+public:
+    LatencyTracer(const char* name) : name(name) {}
+
+    // Copies a finished trace into the buffer, overwriting the oldest one if full
+    void record(const TraceStamps& trace);
+
+    // Prints p50/p90/p99/max for every pair of consecutive stages that were reached, and for the whole path
+    void printReport();
+
+    void clear();
+};
+
+#endif
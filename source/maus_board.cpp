@@ -37,20 +37,20 @@ MausBoard::ImuData MausBoard::ImuData::fromFifoPacket(const uint8_t* fifoPacket,
 
     if (fifoPacketSize >= 42) {
         // Parse quaternion
-        imuData.qW = (float)((fifoPacket[0] << 8) | fifoPacket[1]) / 16384.0f;
-        imuData.qX = (float)((fifoPacket[4] << 8) | fifoPacket[5]) / 16384.0f;
-        imuData.qY = (float)((fifoPacket[8] << 8) | fifoPacket[9]) / 16384.0f;
-        imuData.qZ = (float)((fifoPacket[12] << 8) | fifoPacket[13]) / 16384.0f;
+        imuData.qW = (float)(int16_t)((fifoPacket[0] << 8) | fifoPacket[1]) / 16384.0f;
+        imuData.qX = (float)(int16_t)((fifoPacket[4] << 8) | fifoPacket[5]) / 16384.0f;
+        imuData.qY = (float)(int16_t)((fifoPacket[8] << 8) | fifoPacket[9]) / 16384.0f;
+        imuData.qZ = (float)(int16_t)((fifoPacket[12] << 8) | fifoPacket[13]) / 16384.0f;
 
         // Parse gryo
-        imuData.gyroX = (float)((fifoPacket[16] << 8) | fifoPacket[17]);
-        imuData.gyroY = (float)((fifoPacket[20] << 8) | fifoPacket[21]);
-        imuData.gyroZ = (float)((fifoPacket[24] << 8) | fifoPacket[25]);
+        imuData.gyroX = (float)(int16_t)((fifoPacket[16] << 8) | fifoPacket[17]);
+        imuData.gyroY = (float)(int16_t)((fifoPacket[20] << 8) | fifoPacket[21]);
+        imuData.gyroZ = (float)(int16_t)((fifoPacket[24] << 8) | fifoPacket[25]);
 
         // Parse accel
-        imuData.accelX = (float)((fifoPacket[28] << 8) | fifoPacket[29]);
-        imuData.accelY = (float)((fifoPacket[32] << 8) | fifoPacket[33]);
-        imuData.accelZ = (float)((fifoPacket[36] << 8) | fifoPacket[37]);
+        imuData.accelX = (float)(int16_t)((fifoPacket[28] << 8) | fifoPacket[29]);
+        imuData.accelY = (float)(int16_t)((fifoPacket[32] << 8) | fifoPacket[33]);
+        imuData.accelZ = (float)(int16_t)((fifoPacket[36] << 8) | fifoPacket[37]);
     }
 
     return imuData;
@@ -86,6 +86,23 @@ MausBoard::ImuData MausBoard::ImuData::fromBytes(const char* bytes) {
     return parsedImuData;
 }
 
+void MausBoard::RawImuSample::writeBytes(std::ofstream& of) const {
+    of.write((char*)&timestamp, sizeof(uint64_t));
+    of.write((char*)&deviceMicros, sizeof(uint32_t));
+    of.write((char*)&accelX, sizeof(int16_t));
+    of.write((char*)&accelY, sizeof(int16_t));
+    of.write((char*)&accelZ, sizeof(int16_t));
+    of.write((char*)&gyroX, sizeof(int16_t));
+    of.write((char*)&gyroY, sizeof(int16_t));
+    of.write((char*)&gyroZ, sizeof(int16_t));
+}
+
+MausBoard::RawImuSample MausBoard::RawImuSample::fromBytes(const char* bytes) {
+    RawImuSample parsedSample;
+    memcpy(&parsedSample, bytes, sizeBytes());
+    return parsedSample;
+}
+
 MausBoard::EscTelemetry MausBoard::EscTelemetry::fromRawData(const uint8_t* rawData, const uint8_t rawDataSize) {
     EscTelemetry escTelemetry;
 
@@ -101,13 +118,39 @@ MausBoard::EscTelemetry MausBoard::EscTelemetry::fromRawData(const uint8_t* rawD
     return escTelemetry;
 }
 
+// Same as the firmware's loopStatsBucketLimitsMicros (loop_stats.h), tests/test_loop_stats checks they match
+const uint32_t MausBoard::LoopStats::bucketLimitsMicros[] = {50, 100, 200, 500, 1000, 2000, 5000};
+
+MausBoard::LoopStats MausBoard::LoopStats::fromRawData(const uint8_t* rawData, const uint8_t rawDataSize) {
+    LoopStats loopStats = {};
+
+    const size_t numValues = 4 + NUM_BUCKETS + 5;
+    if (rawDataSize >= numValues * 4) {
+        uint32_t values[numValues];
+        memcpy(values, rawData, numValues * 4);
+
+        loopStats.loopCount = values[0];
+        loopStats.loopMinMicros = values[1];
+        loopStats.loopMeanMicros = values[2];
+        loopStats.loopMaxMicros = values[3];
+        memcpy(loopStats.buckets, &values[4], NUM_BUCKETS * 4);
+        loopStats.fifoOverflows = values[4 + NUM_BUCKETS];
+        loopStats.escCrcRejects = values[4 + NUM_BUCKETS + 1];
+        loopStats.failsafeActivations = values[4 + NUM_BUCKETS + 2];
+        loopStats.bytesIn = values[4 + NUM_BUCKETS + 3];
+        loopStats.bytesOut = values[4 + NUM_BUCKETS + 4];
+    }
+
+    return loopStats;
+}
+
 void MausBoard::parsePayload(const uint8_t* payload, const uint8_t payloadSize) {
     if (payloadSize >= 1) {
         const uint8_t commandId = payload[0];
 
         if (commandId == CommandIds::CMD_ECHO_REQUEST) {
             // Send the payload back
-            uint8_t responsePayload[payloadSize];
+            uint8_t responsePayload[UINT8_MAX];
             memcpy(responsePayload, payload, payloadSize);
             responsePayload[0] = CommandIds::CMD_ECHO_RESPONSE;
             sendMessage(responsePayload, payloadSize);
@@ -122,6 +165,11 @@ void MausBoard::parsePayload(const uint8_t* payload, const uint8_t payloadSize)
             // Parse the data and call the callback
             ImuData imuData = ImuData::fromFifoPacket(&payload[1], payloadSize - 1);
             imuData.timestamp = TimeStamp::get();
+
+            imuTrace.clear();
+            imuTrace.set(TraceStamps::STAGE_BYTES_RECEIVED, lastReadTimestamp);
+            imuTrace.mark(TraceStamps::STAGE_DECODED);
+
             imuDataCallback(imuData);
         }
 
@@ -131,6 +179,36 @@ void MausBoard::parsePayload(const uint8_t* payload, const uint8_t payloadSize)
             escTelemetry.timestamp = TimeStamp::get();
             escTelemetryCallback(escTelemetry);
         }
+
+        if (commandId == CommandIds::CMD_IMU_RAW_DUMP) {
+            if (rawImuCallback && payloadSize >= 2) {
+                const size_t sampleCount = std::min<size_t>(payload[1], std::min<size_t>((size_t)MAX_RAW_IMU_SAMPLES, (payloadSize - 2) / 16));
+                if (sampleCount > 0) {
+                    // Map the board micros to host time, the newest sample was taken about when the bytes arrived
+                    const uint64_t now = TimeStamp::get();
+                    uint32_t newestMicros;
+                    memcpy(&newestMicros, &payload[2 + ((sampleCount - 1) * 16)], 4);
+
+                    for (size_t i = 0; i < sampleCount; i++) {
+                        const uint8_t* rawSample = &payload[2 + (i * 16)];
+                        RawImuSample& sample = rawImuSamples[i];
+                        memcpy(&sample.deviceMicros, rawSample, 4);
+                        memcpy(&sample.accelX, rawSample + 4, 12); // accel x/y/z and gyro x/y/z are contiguous (packed)
+                        sample.timestamp = now - ((uint64_t)(uint32_t)(newestMicros - sample.deviceMicros) * 1000);
+                    }
+
+                    rawImuCallback(rawImuSamples, sampleCount);
+                }
+            }
+        }
+
+        if (commandId == CommandIds::CMD_LOOP_STATS) {
+            if (loopStatsCallback) {
+                LoopStats loopStats = LoopStats::fromRawData(&payload[1], payloadSize - 1);
+                loopStats.timestamp = TimeStamp::get();
+                loopStatsCallback(loopStats);
+            }
+        }
     }
 }
 
@@ -196,6 +274,21 @@ void MausBoard::parseMessageBuffer() {
     }
 }
 
+void MausBoard::parse(const uint8_t* data, const size_t len) {
+    // In small chunks: the message buffer only holds MAX_MESSAGE_SIZE bytes, so the start of a message split across
+    // chunks is still there when the rest arrives as long as the message plus a chunk fits (the board's largest, a raw
+    // IMU batch, is 135 bytes). A whole 256 byte UART read at once would overwrite it
+    for (size_t offset = 0; offset < len; offset += PARSE_CHUNK_SIZE) {
+        const size_t chunkLen = std::min(len - offset, (size_t)PARSE_CHUNK_SIZE);
+        for (size_t i = 0; i < chunkLen; i++) {
+            messageBuffer[messageBufferPos] = data[offset + i];
+            messageBufferPos = (messageBufferPos + 1) % MAX_MESSAGE_SIZE;
+        }
+
+        parseMessageBuffer();
+    }
+}
+
 void MausBoard::readLoop() {
     // Read forever
     if (uartFileStream != -1) {
@@ -204,32 +297,38 @@ void MausBoard::readLoop() {
             // Read and parse data
             int len = read(uartFileStream, uartBuffer, UART_BUFFER_SIZE);
             if (len > 0) {
-                for (int16_t i = 0; i < len; i++) {
-                    messageBuffer[messageBufferPos] = uartBuffer[i];
-                    messageBufferPos = (messageBufferPos + 1) % MAX_MESSAGE_SIZE;
-                }
-
-                parseMessageBuffer();
+                lastReadTimestamp = TimeStamp::getMonotonic();
+                parse(uartBuffer, len);
             }
         }
     }
 
-    // Close the UART
+    // Close the UART, under the send lock so no sender writes to a closed descriptor
+    std::lock_guard<std::mutex> lock(sendMutex);
     close(uartFileStream);
+    uartFileStream = -1;
 }
 
 void MausBoard::sendMessage(const uint8_t* payload, const uint8_t payloadSize) {
+    // Header and payload in one buffer, so another thread's message can't end up between them
+    uint8_t message[5 + UINT8_MAX];
+    memcpy(message, magicBytesMessage, 2);
+    message[2] = 0;
+    message[3] = payloadSize;
+    message[4] = calCRC8(payload, payloadSize);
+    memcpy(&message[5], payload, payloadSize);
+    const size_t messageSize = 5 + payloadSize;
+
+    std::lock_guard<std::mutex> lock(sendMutex);
     if (uartFileStream != -1) {
-        // Build header
-        uint8_t header[5];
-        memcpy(header, magicBytesMessage, 2);
-        header[2] = 0;
-        header[3] = payloadSize;
-        header[4] = calCRC8(payload, payloadSize);
-
-        // Write the header and payload
-        write(uartFileStream, header, 5);
-        write(uartFileStream, payload, payloadSize);
+        size_t written = 0;
+        while (written < messageSize) {
+            const ssize_t result = write(uartFileStream, &message[written], messageSize - written);
+            if (result > 0)
+                written += result;
+            else if ((result < 0) && (errno != EINTR))
+                break;
+        }
     }
 }
 
@@ -266,14 +365,16 @@ bool MausBoard::stopReading() {
     if (readingUart) {
         readingUart = false;
         readingThread.join();
-        uartFileStream = -1;
 
         return true;
     }
     return false;
 }
 
-void MausBoard::sendSetServos(const uint16_t steering, const uint16_t throttle) {
+void MausBoard::sendSetServos(const uint16_t steering, const uint16_t throttle, TraceStamps* trace) {
+    if (trace)
+        trace->mark(TraceStamps::STAGE_SEND_CALLED);
+
     // Build the payload
     uint8_t payload[1 + 4];
     payload[0] = CommandIds::CMD_SET_SERVOS;
@@ -282,14 +383,41 @@ void MausBoard::sendSetServos(const uint16_t steering, const uint16_t throttle)
 
     // Send it
     sendMessage(payload, 1 + 4);
+    lastThrottleMicros.store(throttle, std::memory_order_relaxed);
+
+    if (trace) {
+        trace->mark(TraceStamps::STAGE_WRITE_RETURNED);
+        {
+            std::lock_guard<std::mutex> lock(sendMutex);
+            if (uartFileStream != -1)
+                tcdrain(uartFileStream);
+        }
+        trace->mark(TraceStamps::STAGE_TX_DRAINED);
+    }
+}
+
+void MausBoard::sendSetImuMode(const ImuMode mode, const uint16_t rateHz) {
+    // Build the payload
+    uint8_t payload[1 + 3];
+    payload[0] = CommandIds::CMD_SET_IMU_MODE;
+    payload[1] = mode;
+    memcpy(&payload[2], &rateHz, 2);
+
+    // Send it
+    sendMessage(payload, 1 + 3);
 }
 
 void MausBoard::sentSetRGB(const std::vector<uint32_t>& colors) {
+    sentSetRGB(colors.data(), colors.size());
+}
+
+void MausBoard::sentSetRGB(const uint32_t* colors, const size_t count) {
     // Build the payload 
-    const uint8_t payloadSize = 1 + (colors.size() * 4);
-    uint8_t payload[payloadSize];
+    const size_t colorCount = std::min(count, (size_t)MAX_RGB_COLORS);
+    const uint8_t payloadSize = 1 + (colorCount * 4);
+    uint8_t payload[1 + (MAX_RGB_COLORS * 4)];
     payload[0] = CommandIds::CMD_SET_RGB;
-    for (size_t i = 0; i < colors.size(); i++) {
+    for (size_t i = 0; i < colorCount; i++) {
         const uint8_t payloadIndex = 1 + (i * 4);
         memcpy(&payload[payloadIndex], &colors[i], 4);
     }
@@ -300,11 +428,19 @@ void MausBoard::sentSetRGB(const std::vector<uint32_t>& colors) {
 
 void MausBoard::sendEcho(const uint8_t* data, const uint8_t dataSize) {
     // Build the payload
-    const uint8_t payloadSize = 1 + dataSize;
-    uint8_t payload[payloadSize];
+    const uint8_t payloadSize = 1 + std::min<size_t>(dataSize, UINT8_MAX - 1);
+    uint8_t payload[UINT8_MAX];
     payload[0] = CommandIds::CMD_ECHO_REQUEST;
-    memcpy(&payload[1], data, dataSize);
+    memcpy(&payload[1], data, payloadSize - 1);
 
     // Send it
     sendMessage(payload, payloadSize);
+}
+
+bool MausBoard::setRealtime(const int priority, const int cpuCore) {
+    if (readingUart)
+        return Realtime::configureThread(readingThread.native_handle(), priority, cpuCore);
+
+    printf("Cannot set real-time scheduling. UART is not being read\n");
+    return false;
 }
\ No newline at end of file
@@ -9,13 +9,19 @@
 #include <vector>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <fstream>
 #include <termios.h>
 #include <thread>
 #include <string.h>
 #include <cmath>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
 
 #include "timestamp.h"
+#include "realtime.h"
+#include "latency_trace.h"
 
 #define DEFAULT_SERIAL_MAUS_BOARD "/dev/ttyAMA2"
 
@@ -74,6 +80,61 @@ public:
 		float getERPM() const { return ERPM; }
     }; // 18 bytes
 
+    // Raw MPU6050 sample streamed in IMU_MODE_RAW (see ImuFusion for turning these into orientation)
+    struct __attribute__((__packed__)) RawImuSample {
+        uint64_t timestamp; // Nanoseconds since epoch, estimated from the board micros
+        uint32_t deviceMicros; // Board micros() when the sample was taken
+
+        // 8192 per G (+-4G range)
+        int16_t accelX;
+        int16_t accelY;
+        int16_t accelZ;
+
+        // 16.4 per degree/sec (+-2000 deg/s range)
+        int16_t gyroX;
+        int16_t gyroY;
+        int16_t gyroZ;
+
+        // Writes the RawImuSample object to a stream
+        void writeBytes(std::ofstream& of) const;
+
+        // Builds a RawImuSample object from raw bytes
+        static RawImuSample fromBytes(const char* bytes);
+
+        static size_t sizeBytes() { return 8 + 4 + 6 + 6; }
+    }; // 24 bytes
+
+    enum ImuMode : uint8_t {
+        IMU_MODE_DMP = 0, // Quaternions from the DMP through imuDataCallback (default)
+        IMU_MODE_RAW = 1  // Raw gyro/accel batches through rawImuCallback
+    };
+
+    // Diagnostics periodically sent by the board (see ESP32_firmware/main/loop_stats.h)
+    struct LoopStats {
+        static const size_t NUM_BUCKETS = 8;
+
+        // Upper limit (exclusive, microseconds) of each bucket, the last bucket holds everything else
+        static const uint32_t bucketLimitsMicros[NUM_BUCKETS - 1];
+
+        uint64_t timestamp; // Nanoseconds since epoch
+
+        // Loop timing since the previous report
+        uint32_t loopCount;
+        uint32_t loopMinMicros;
+        uint32_t loopMeanMicros;
+        uint32_t loopMaxMicros;
+        uint32_t buckets[NUM_BUCKETS];
+
+        // Totals since the board booted
+        uint32_t fifoOverflows;
+        uint32_t escCrcRejects;
+        uint32_t failsafeActivations;
+        uint32_t bytesIn;
+        uint32_t bytesOut;
+
+        static LoopStats fromRawData(const uint8_t* rawData, const uint8_t rawDataSize);
+    };
+
 private:
     static const uint8_t crcTable[256];
 
@@ -88,13 +149,21 @@ private:
         CMD_SET_SERVOS = 0x02,
         CMD_IMU_DUMP = 0x03,
         CMD_ENCODER_DUMP = 0x04, // UNIMPLEMENTED
-        CMD_ESC_TELEMETRY_DUMP = 0x05
+        CMD_ESC_TELEMETRY_DUMP = 0x05,
+        CMD_LOOP_STATS = 0x06,
+        CMD_SET_IMU_MODE = 0x07,
+        CMD_IMU_RAW_DUMP = 0x08
     };
 
+    static const size_t MAX_RAW_IMU_SAMPLES = 16;
+    static const size_t MAX_RGB_COLORS = 16;
+    RawImuSample rawImuSamples[MAX_RAW_IMU_SAMPLES];
+
     // Message buffer
     static const size_t MAX_MESSAGE_SIZE = 5 + 255;
     uint8_t messageBuffer[MAX_MESSAGE_SIZE];
     uint16_t messageBufferPos = 0;
+    static const size_t PARSE_CHUNK_SIZE = 64;
 
     // Callbacks
     void (*imuDataCallback)(const ImuData&);
@@ -106,6 +175,13 @@ private:
     int uartFileStream = -1;
     std::thread readingThread;
 
+    // Last throttle sent with sendSetServos (needed to tell the direction of the unsigned ERPM)
+    std::atomic<uint16_t> lastThrottleMicros{1500};
+
+    // Latency tracing
+    uint64_t lastReadTimestamp = 0; // Monotonic
+    TraceStamps imuTrace;
+
     // Parses a successfully received payload
     void parsePayload(const uint8_t* payload, const uint8_t payloadSize);
 
@@ -115,6 +191,10 @@ private:
     // Reads the UART continuously
     void readLoop();
 
+    // The send functions are called from several threads (control loop, SensorPublisher commands, BridgeServer, echo
+    // responses on the reading thread), each message goes out in one write() under this
+    std::mutex sendMutex;
+
     // Send a message internally
     void sendMessage(const uint8_t* payload, const uint8_t payloadSize);
 
@@ -122,17 +202,43 @@ public:
     // Public debug callback (DEPRECATED)
     void (*echoResponseCallback)(const uint8_t* payload, const uint8_t payloadSize) = nullptr;
 
+    // Optional callback for board diagnostics (about once a second)
+    void (*loopStatsCallback)(const LoopStats&) = nullptr;
+
+    // Optional callback for raw IMU batches, only called after sendSetImuMode(IMU_MODE_RAW, ...)
+    void (*rawImuCallback)(const RawImuSample* samples, const size_t sampleCount) = nullptr;
+
     MausBoard(void (*imuDataCallback)(const ImuData&), void (*escTelemetryCallback)(const EscTelemetry&)) : imuDataCallback(imuDataCallback), escTelemetryCallback(escTelemetryCallback) {}
     ~MausBoard() { stopReading(); }
 
     bool startReading();
     bool stopReading();
 
+    // Parses raw bytes from the board, what the reading thread does with every UART read (e.g. for replaying a
+    // capture). Doesn't allocate
+    void parse(const uint8_t* data, const size_t len);
+
+    // Gives the reading thread SCHED_FIFO priority and pins it to a CPU core (see realtime.h). Call after startReading()
+    bool setRealtime(const int priority, const int cpuCore);
+
+    // Trace stamps of the ImuData currently being passed to the callback (only valid inside the callback)
+    const TraceStamps& getImuTrace() const { return imuTrace; }
+
     // Send servo and throttle values in servo pulse microseconds (1000 = -100%, 1500 = 0%, 2000 = 100%)
-    void sendSetServos(const uint16_t steering, const uint16_t throttle);
+    // If a trace is given, the send stages get stamped and this blocks until the bytes have left the UART
+    void sendSetServos(const uint16_t steering, const uint16_t throttle, TraceStamps* trace = nullptr);
+
+    // Throttle pulse from the most recent sendSetServos call (1500 until the first one)
+    uint16_t getLastThrottleMicros() const { return lastThrottleMicros.load(std::memory_order_relaxed); }
+
+    // Switch the board between DMP quaternions and raw gyro/accel at rateHz (4 - 1000, raw mode only). The board
+    // samples every 1000 / rateHz whole milliseconds, e.g. 300 runs at 333Hz
+    // Going back to IMU_MODE_DMP re-initializes the DMP, keep the car still for its calibration
+    void sendSetImuMode(const ImuMode mode, const uint16_t rateHz = 1000);
 
     // Send a std::vector of uint32_t colors (max of 16) the PCB has 2 LEDs onboard
     void sentSetRGB(const std::vector<uint32_t>& colors);
+    void sentSetRGB(const uint32_t* colors, const size_t count);
 
     // Comms debug (DEPRECATED)
     void sendEcho(const uint8_t* data, const uint8_t dataSize);
@@ -0,0 +1,301 @@
+#include "maus_c.h"
+
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "maus_board.h"
+#include "fhl_ld19.h"
+#include "spsc_queue.h"
+#include "shm_ring.h"
+
+static_assert(sizeof(maus_imu_data_t) == sizeof(MausBoard::ImuData), "maus_imu_data_t doesn't match MausBoard::ImuData");
+static_assert(sizeof(maus_esc_telemetry_t) == sizeof(MausBoard::EscTelemetry), "maus_esc_telemetry_t doesn't match MausBoard::EscTelemetry");
+static_assert(sizeof(maus_raw_imu_sample_t) == sizeof(MausBoard::RawImuSample), "maus_raw_imu_sample_t doesn't match MausBoard::RawImuSample");
+static_assert(sizeof(maus_lidar_point_t) == sizeof(LD19::LidarPoint), "maus_lidar_point_t doesn't match LD19::LidarPoint");
+
+// Waits up to timeoutMs for the queue to have something and pops it
+template <typename Queue, typename T>
+static int popWaiting(Queue& queue, const ShmNotifier& notifier, T& item, const int timeoutMs) {
+    if (queue.pop(item))
+        return 1;
+    if (timeoutMs == 0)
+        return 0;
+
+    // Forever is a second at a time
+    const uint64_t timeoutNsecs = (timeoutMs < 0) ? NSECS_TO_SECS : ((uint64_t)timeoutMs * NSECS_TO_MSECS);
+    while (!notifier.waitUntil([&]() { return queue.size() > 0; }, timeoutNsecs)) {
+        if (timeoutMs > 0)
+            return 0;
+    }
+    return queue.pop(item) ? 1 : 0;
+}
+
+struct maus_board {
+    MausBoard board;
+
+    // Filled by the reading thread, the notifiers only make a syscall when someone waits
+    SpscQueue<MausBoard::ImuData, 1024> imuQueue;
+    SpscQueue<MausBoard::EscTelemetry, 256> escQueue;
+    SpscQueue<MausBoard::RawImuSample, 4096> rawImuQueue;
+    ShmNotifier imuNotifier;
+    ShmNotifier escNotifier;
+    ShmNotifier rawImuNotifier;
+
+    std::atomic<uint64_t> imuDropped{0};
+    std::atomic<uint64_t> escDropped{0};
+    std::atomic<uint64_t> rawImuDropped{0};
+
+    maus_board();
+};
+
+struct maus_lidar {
+    static const size_t MAX_SCAN_POINTS = 2048;
+
+    struct ScanSlot {
+        uint64_t sequence;
+        uint64_t timestamp;
+        size_t count;
+        LD19::LidarPoint points[MAX_SCAN_POINTS];
+        float x[MAX_SCAN_POINTS];
+        float y[MAX_SCAN_POINTS];
+    };
+
+    LD19 lidar;
+
+    // Three slots: the latest scan, the one borrowed by the caller and the one being filled are never the same
+    ScanSlot slots[3];
+    std::mutex slotMutex;
+    std::condition_variable slotCondition;
+    int latestSlot = -1;
+    int borrowedSlot = -1;
+    bool latestTaken = false;
+    uint64_t revolutions = 0;
+
+    std::atomic<uint64_t> scansDropped{0};
+    std::atomic<uint64_t> scanPointsDropped{0};
+
+    maus_lidar();
+};
+
+// The driver callbacks have no context, they go to the one instance of each
+static std::mutex instanceMutex;
+static std::atomic<maus_board*> activeBoard{nullptr};
+static std::atomic<maus_lidar*> activeLidar{nullptr};
+
+static void boardImuCallback(const MausBoard::ImuData& imuData) {
+    maus_board* board = activeBoard.load(std::memory_order_acquire);
+    if (!board)
+        return;
+    if (board->imuQueue.push(imuData))
+        board->imuNotifier.notify();
+    else
+        board->imuDropped++;
+}
+
+static void boardEscCallback(const MausBoard::EscTelemetry& escTelemetry) {
+    maus_board* board = activeBoard.load(std::memory_order_acquire);
+    if (!board)
+        return;
+    if (board->escQueue.push(escTelemetry))
+        board->escNotifier.notify();
+    else
+        board->escDropped++;
+}
+
+static void boardRawImuCallback(const MausBoard::RawImuSample* samples, const size_t sampleCount) {
+    maus_board* board = activeBoard.load(std::memory_order_acquire);
+    if (!board)
+        return;
+    for (size_t i = 0; i < sampleCount; i++) {
+        if (!board->rawImuQueue.push(samples[i]))
+            board->rawImuDropped++;
+    }
+    board->rawImuNotifier.notify();
+}
+
+static void lidarScanCallback(const LD19::LidarPoint* points, const size_t count) {
+    maus_lidar* lidar = activeLidar.load(std::memory_order_acquire);
+    if (!lidar)
+        return;
+
+    // Only this thread changes latestSlot, so the free slot stays free while it's filled without the lock
+    int slotIndex = 0;
+    {
+        std::lock_guard<std::mutex> lock(lidar->slotMutex);
+        while ((slotIndex == lidar->latestSlot) || (slotIndex == lidar->borrowedSlot))
+            slotIndex++;
+    }
+
+    maus_lidar::ScanSlot& slot = lidar->slots[slotIndex];
+    slot.count = std::min(count, (size_t)maus_lidar::MAX_SCAN_POINTS);
+    lidar->scanPointsDropped += count - slot.count;
+    slot.timestamp = (slot.count > 0) ? points[slot.count - 1].timestamp : 0;
+    for (size_t i = 0; i < slot.count; i++) {
+        const LD19::LidarPoint& point = points[i];
+        slot.points[i] = point;
+        slot.x[i] = (point.distance != 0) ? point.getXMeters() : 0.0f;
+        slot.y[i] = (point.distance != 0) ? point.getYMeters() : 0.0f;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(lidar->slotMutex);
+        if ((lidar->latestSlot >= 0) && !lidar->latestTaken)
+            lidar->scansDropped++;
+        slot.sequence = lidar->revolutions++;
+        lidar->latestSlot = slotIndex;
+        lidar->latestTaken = false;
+    }
+    lidar->slotCondition.notify_all();
+}
+
+maus_board::maus_board() : board(boardImuCallback, boardEscCallback) {
+    board.rawImuCallback = boardRawImuCallback;
+}
+
+maus_lidar::maus_lidar() : lidar(nullptr) {
+    lidar.setScanCallback(lidarScanCallback);
+}
+
+uint32_t maus_api_version(void) {
+    return MAUS_C_API_VERSION;
+}
+
+maus_board_t* maus_board_create(void) {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    if (activeBoard.load()) {
+        printf("maus_board_create: there's already a board\n");
+        return nullptr;
+    }
+    maus_board* board = new maus_board();
+    activeBoard.store(board, std::memory_order_release);
+    return board;
+}
+
+void maus_board_destroy(maus_board_t* board) {
+    if (!board)
+        return;
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    // The callbacks only come from the reading thread, nothing uses the board once it's joined
+    board->board.stopReading();
+    activeBoard.store(nullptr, std::memory_order_release);
+    delete board;
+}
+
+int maus_board_start(maus_board_t* board) {
+    return board->board.startReading() ? 1 : 0;
+}
+
+int maus_board_stop(maus_board_t* board) {
+    return board->board.stopReading() ? 1 : 0;
+}
+
+int maus_board_next_imu(maus_board_t* board, maus_imu_data_t* imuData, const int timeoutMs) {
+    MausBoard::ImuData item;
+    if (!popWaiting(board->imuQueue, board->imuNotifier, item, timeoutMs))
+        return 0;
+    memcpy(imuData, &item, sizeof(item));
+    return 1;
+}
+
+int maus_board_next_esc(maus_board_t* board, maus_esc_telemetry_t* escTelemetry, const int timeoutMs) {
+    MausBoard::EscTelemetry item;
+    if (!popWaiting(board->escQueue, board->escNotifier, item, timeoutMs))
+        return 0;
+    memcpy(escTelemetry, &item, sizeof(item));
+    return 1;
+}
+
+int maus_board_next_raw_imu(maus_board_t* board, maus_raw_imu_sample_t* sample, const int timeoutMs) {
+    MausBoard::RawImuSample item;
+    if (!popWaiting(board->rawImuQueue, board->rawImuNotifier, item, timeoutMs))
+        return 0;
+    memcpy(sample, &item, sizeof(item));
+    return 1;
+}
+
+void maus_board_set_servos(maus_board_t* board, const uint16_t steering, const uint16_t throttle) {
+    board->board.sendSetServos(steering, throttle);
+}
+
+void maus_board_set_rgb(maus_board_t* board, const uint32_t* colors, const size_t count) {
+    board->board.sentSetRGB(colors, count);
+}
+
+void maus_board_set_imu_mode(maus_board_t* board, const uint8_t mode, const uint16_t rateHz) {
+    board->board.sendSetImuMode((MausBoard::ImuMode)mode, rateHz);
+}
+
+maus_lidar_t* maus_lidar_create(void) {
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    if (activeLidar.load()) {
+        printf("maus_lidar_create: there's already a lidar\n");
+        return nullptr;
+    }
+    maus_lidar* lidar = new maus_lidar();
+    activeLidar.store(lidar, std::memory_order_release);
+    return lidar;
+}
+
+void maus_lidar_destroy(maus_lidar_t* lidar) {
+    if (!lidar)
+        return;
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    lidar->lidar.stopReading();
+    activeLidar.store(nullptr, std::memory_order_release);
+    delete lidar;
+}
+
+int maus_lidar_start(maus_lidar_t* lidar) {
+    return lidar->lidar.startReading() ? 1 : 0;
+}
+
+int maus_lidar_stop(maus_lidar_t* lidar) {
+    return lidar->lidar.stopReading() ? 1 : 0;
+}
+
+void maus_lidar_feed(maus_lidar_t* lidar, const uint8_t* data, const size_t length) {
+    lidar->lidar.parse((uint8_t*)data, length);
+}
+
+int maus_lidar_next_scan(maus_lidar_t* lidar, maus_scan_t* scan, const int timeoutMs) {
+    std::unique_lock<std::mutex> lock(lidar->slotMutex);
+    lidar->borrowedSlot = -1;
+
+    const auto ready = [&]() { return (lidar->latestSlot >= 0) && !lidar->latestTaken; };
+    if (timeoutMs < 0)
+        lidar->slotCondition.wait(lock, ready);
+    else if (!lidar->slotCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready))
+        return 0;
+
+    lidar->borrowedSlot = lidar->latestSlot;
+    lidar->latestTaken = true;
+
+    const maus_lidar::ScanSlot& slot = lidar->slots[lidar->borrowedSlot];
+    scan->sequence = slot.sequence;
+    scan->timestamp = slot.timestamp;
+    scan->count = slot.count;
+    scan->points = (const maus_lidar_point_t*)slot.points;
+    scan->x = slot.x;
+    scan->y = slot.y;
+    return 1;
+}
+
+void maus_lidar_release_scan(maus_lidar_t* lidar) {
+    std::lock_guard<std::mutex> lock(lidar->slotMutex);
+    lidar->borrowedSlot = -1;
+}
+
+void maus_get_dropped(const maus_board_t* board, const maus_lidar_t* lidar, maus_dropped_t* dropped) {
+    memset(dropped, 0, sizeof(*dropped));
+    if (board) {
+        dropped->imuDropped = board->imuDropped.load();
+        dropped->escDropped = board->escDropped.load();
+        dropped->rawImuDropped = board->rawImuDropped.load();
+    }
+    if (lidar) {
+        dropped->scansDropped = lidar->scansDropped.load();
+        dropped->scanPointsDropped = lidar->scanPointsDropped.load();
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef __MAUS_C_H__
+#define __MAUS_C_H__
+
+// Plain C API around MausBoard and LD19, for Python (ctypes, see python/maus.py) and other languages
+// Build it with 'make libmaus.so'.
+//
+// Pull based instead of callbacks: the drivers' reading threads queue everything, and the caller takes it with the
+// maus_*_next_* calls whenever it wants (blocking with a timeout, or polling with a timeout of 0).
+//
+// Scans are borrowed, not copied: maus_lidar_next_scan() hands out pointers to contiguous arrays the library owns
+// (packed points, plus x/y in meters), which stay valid and unchanged until the next maus_lidar_next_scan() or
+// maus_lidar_release_scan() call. Numpy can view them directly (numpy.ctypeslib.as_array, numpy.frombuffer).
+//
+// The driver callbacks don't carry a context pointer, so there can only be one board and one lidar per process.
+// Calls on a handle are meant to come from one thread at a time (the reading threads are internal).
+//
+// Functions returning int return 1 on success (or when something was returned) and 0 otherwise.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAUS_C_API_VERSION 1
+
+// Wait forever in the maus_*_next_* calls
+#define MAUS_WAIT_FOREVER -1
+
+// Same layouts as MausBoard::ImuData, MausBoard::EscTelemetry, MausBoard::RawImuSample and LD19::LidarPoint
+typedef struct __attribute__((__packed__)) {
+    uint64_t timestamp;         // Nanoseconds since epoch
+    float qX, qY, qZ, qW;
+    float gyroX, gyroY, gyroZ;
+    float accelX, accelY, accelZ;
+} maus_imu_data_t;              // 48 bytes
+
+typedef struct __attribute__((__packed__)) {
+    uint64_t timestamp;         // Nanoseconds since epoch
+    uint8_t temperature;        // Celsius
+    uint16_t voltage;           // Volts * 100
+    uint16_t current;           // Amps * 100
+    uint16_t consumption;       // mAh
+    uint16_t erpm;              // Electrical RPM / 100
+} maus_esc_telemetry_t;         // 17 bytes
+
+typedef struct __attribute__((__packed__)) {
+    uint64_t timestamp;         // Nanoseconds since epoch
+    uint32_t deviceMicros;
+    int16_t accelX, accelY, accelZ;
+    int16_t gyroX, gyroY, gyroZ;
+} maus_raw_imu_sample_t;        // 24 bytes
+
+typedef struct __attribute__((__packed__)) {
+    uint16_t distance;          // Millimeters
+    uint8_t intensity;
+    uint16_t angle;             // 0.01 degrees, clockwise
+    uint64_t timestamp;         // Nanoseconds since epoch
+} maus_lidar_point_t;           // 13 bytes
+
+typedef struct {
+    uint64_t sequence;          // Revolutions since the lidar was created, gaps mean scans were dropped
+    uint64_t timestamp;         // Nanoseconds since epoch, last point
+    size_t count;
+
+    // Borrowed, count elements each
+    const maus_lidar_point_t* points;
+    const float* x;             // Meters, vehicle frame (x forward, y left), 0 for zero distance points
+    const float* y;
+} maus_scan_t;
+
+typedef struct {
+    uint64_t imuDropped;        // Not taken before their queue filled up
+    uint64_t escDropped;
+    uint64_t rawImuDropped;
+    uint64_t scansDropped;      // Replaced by a newer scan before being taken
+    uint64_t scanPointsDropped; // Points past the per scan limit
+} maus_dropped_t;
+
+typedef struct maus_board maus_board_t;
+typedef struct maus_lidar maus_lidar_t;
+
+uint32_t maus_api_version(void);
+
+// Board on DEFAULT_SERIAL_MAUS_BOARD. create returns NULL if a board already exists
+maus_board_t* maus_board_create(void);
+void maus_board_destroy(maus_board_t* board);
+int maus_board_start(maus_board_t* board);
+int maus_board_stop(maus_board_t* board);
+
+// Oldest queued item, waiting up to timeoutMs (0 polls, MAUS_WAIT_FOREVER waits forever)
+int maus_board_next_imu(maus_board_t* board, maus_imu_data_t* imuData, const int timeoutMs);
+int maus_board_next_esc(maus_board_t* board, maus_esc_telemetry_t* escTelemetry, const int timeoutMs);
+int maus_board_next_raw_imu(maus_board_t* board, maus_raw_imu_sample_t* sample, const int timeoutMs);
+
+void maus_board_set_servos(maus_board_t* board, const uint16_t steering, const uint16_t throttle);
+void maus_board_set_rgb(maus_board_t* board, const uint32_t* colors, const size_t count);
+// mode 0 = DMP, 1 = raw (see MausBoard::ImuMode)
+void maus_board_set_imu_mode(maus_board_t* board, const uint8_t mode, const uint16_t rateHz);
+
+// Lidar on DEFAULT_SERIAL_FHL_LD19. create returns NULL if a lidar already exists
+maus_lidar_t* maus_lidar_create(void);
+void maus_lidar_destroy(maus_lidar_t* lidar);
+int maus_lidar_start(maus_lidar_t* lidar);
+int maus_lidar_stop(maus_lidar_t* lidar);
+
+// Parses raw LD19 bytes as if they came from the UART (replaying a capture without the lidar, don't start() it)
+void maus_lidar_feed(maus_lidar_t* lidar, const uint8_t* data, const size_t length);
+
+// Newest scan not returned before, waiting up to timeoutMs. Releases the previously borrowed scan
+int maus_lidar_next_scan(maus_lidar_t* lidar, maus_scan_t* scan, const int timeoutMs);
+
+// Done with the borrowed scan (optional, lets the reading thread reuse its buffers sooner)
+void maus_lidar_release_scan(maus_lidar_t* lidar);
+
+// Both handles can be NULL
+void maus_get_dropped(const maus_board_t* board, const maus_lidar_t* lidar, maus_dropped_t* dropped);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,371 @@
+#include "obstacle_tracker.h"
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+#include "fast_math.h"
+#include "timestamp.h"
+
+ObstacleTracker::ObstacleTracker() : ObstacleTracker(Config()) {}
+
+ObstacleTracker::ObstacleTracker(const Config& config) : config(config) {}
+
+void ObstacleTracker::segment() {
+    clusterCount = 0;
+    if (count == 0)
+        return;
+
+    const float noise = 3.0f * config.rangeNoise;
+
+    // Is point b a continuation of point a?
+    auto isConnected = [&](const size_t a, const size_t b) {
+        const float angleStep = std::fabs(Pose2D::wrapAngle(angles[b] - angles[a]));
+        if (angleStep >= config.breakpointLambda)
+            return false;
+
+        // Adaptive breakpoint: how far apart two points on a surface at the worst allowed incidence angle can be
+        const float maxGap = (ranges[a] * std::sin(angleStep) / std::sin(config.breakpointLambda - angleStep)) + noise;
+        const float dx = xs[b] - xs[a];
+        const float dy = ys[b] - ys[a];
+        return ((dx * dx) + (dy * dy)) <= (maxGap * maxGap);
+    };
+
+    size_t begin = 0;
+    for (size_t i = 1; i <= count; i++) {
+        if ((i < count) && isConnected(i - 1, i))
+            continue;
+
+        if (clusterCount < MAX_CLUSTERS) {
+            Cluster& cluster = clusters[clusterCount++];
+            cluster.begin = begin;
+            cluster.count = i - begin;
+        }
+        begin = i;
+    }
+
+    // The scan is a loop, an object straddling the start is split in two. Only when the last cluster was kept, once
+    // MAX_CLUSTERS is reached the clusters at the end of the scan are dropped and the last stored one is elsewhere
+    const Cluster& last = clusters[clusterCount - 1];
+    if ((clusterCount > 1) && ((size_t)(last.begin + last.count) == count) && isConnected(count - 1, 0)) {
+        clusters[clusterCount - 1].count += clusters[0].count;
+        memmove(&clusters[0], &clusters[1], (clusterCount - 1) * sizeof(Cluster));
+        clusterCount--;
+    }
+
+    // Drop the specks
+    size_t kept = 0;
+    for (size_t i = 0; i < clusterCount; i++) {
+        if (clusters[i].count >= config.minClusterPoints)
+            clusters[kept++] = clusters[i];
+    }
+    clusterCount = kept;
+}
+
+void ObstacleTracker::fitBox(Cluster& cluster, const Pose2D& pose) {
+    // Walls and other big things only get an axis aligned box, the L-shape search is for object sized clusters
+    float minX = INFINITY, maxX = -INFINITY, minY = INFINITY, maxY = -INFINITY;
+    for (size_t n = 0; n < cluster.count; n++) {
+        const size_t i = (cluster.begin + n) % count;
+        minX = std::min(minX, xs[i]);
+        maxX = std::max(maxX, xs[i]);
+        minY = std::min(minY, ys[i]);
+        maxY = std::max(maxY, ys[i]);
+    }
+    const float sizeX = maxX - minX;
+    const float sizeY = maxY - minY;
+    if (((sizeX * sizeX) + (sizeY * sizeY)) > (2.0f * config.maxObjectLength * config.maxObjectLength)) {
+        pose.transformPoint(0.5f * (minX + maxX), 0.5f * (minY + maxY), cluster.centerX, cluster.centerY);
+        cluster.length = std::max(sizeX, sizeY);
+        cluster.width = std::min(sizeX, sizeY);
+        cluster.yaw = Pose2D::wrapAngle(pose.yaw + ((sizeY > sizeX) ? (float)(M_PI / 2.0) : 0.0f));
+        cluster.tracked = false;
+        return;
+    }
+
+    // L-shape fit: try box orientations over 90 degrees, score how close the points are to the nearest box edges
+    float bestScore = -1.0f;
+    float bestAngle = 0.0f;
+    float bestMin1 = 0.0f, bestMax1 = 0.0f, bestMin2 = 0.0f, bestMax2 = 0.0f;
+
+    for (float angle = 0.0f; angle < (float)(M_PI / 2.0); angle += config.fitAngleStep) {
+        float s, c;
+        FastMath::sinCos(angle, s, c);
+
+        float min1 = INFINITY, max1 = -INFINITY, min2 = INFINITY, max2 = -INFINITY;
+        for (size_t n = 0; n < cluster.count; n++) {
+            const size_t i = (cluster.begin + n) % count;
+            const float projection1 = (xs[i] * c) + (ys[i] * s);
+            const float projection2 = (ys[i] * c) - (xs[i] * s);
+            min1 = std::min(min1, projection1);
+            max1 = std::max(max1, projection1);
+            min2 = std::min(min2, projection2);
+            max2 = std::max(max2, projection2);
+        }
+
+        float score = 0.0f;
+        for (size_t n = 0; n < cluster.count; n++) {
+            const size_t i = (cluster.begin + n) % count;
+            const float projection1 = (xs[i] * c) + (ys[i] * s);
+            const float projection2 = (ys[i] * c) - (xs[i] * s);
+            const float distance1 = std::min(max1 - projection1, projection1 - min1);
+            const float distance2 = std::min(max2 - projection2, projection2 - min2);
+            score += 1.0f / std::max(std::min(distance1, distance2), config.minCloseness);
+        }
+
+        if (score > bestScore) {
+            bestScore = score;
+            bestAngle = angle;
+            bestMin1 = min1;
+            bestMax1 = max1;
+            bestMin2 = min2;
+            bestMax2 = max2;
+        }
+    }
+
+    // Box center back in the vehicle frame, then the world frame
+    const float s = std::sin(bestAngle);
+    const float c = std::cos(bestAngle);
+    const float center1 = 0.5f * (bestMin1 + bestMax1);
+    const float center2 = 0.5f * (bestMin2 + bestMax2);
+    pose.transformPoint((center1 * c) - (center2 * s), (center1 * s) + (center2 * c), cluster.centerX, cluster.centerY);
+
+    // Length is the longer side
+    float length = bestMax1 - bestMin1;
+    float width = bestMax2 - bestMin2;
+    float yaw = bestAngle;
+    if (width > length) {
+        std::swap(length, width);
+        yaw += (float)(M_PI / 2.0);
+    }
+    cluster.length = length;
+    cluster.width = width;
+    cluster.yaw = Pose2D::wrapAngle(yaw + pose.yaw);
+    cluster.tracked = length <= config.maxObjectLength;
+}
+
+void ObstacleTracker::predictTracks(const float dt) {
+    const float q = config.accelerationNoise * config.accelerationNoise;
+    const float dt2 = dt * dt;
+    const float qPosition = 0.25f * dt2 * dt2 * q;
+    const float qCross = 0.5f * dt2 * dt * q;
+    const float qVelocity = dt2 * q;
+
+    for (size_t t = 0; t < trackCount; t++) {
+        Track& track = tracks[t];
+        track.x += track.vx * dt;
+        track.y += track.vy * dt;
+
+        // P = F * P * F^T + Q, with F = [I dt*I; 0 I] done per axis (x: 0, 2 and y: 1, 3)
+        float (&P)[4][4] = covariances[t];
+        float FP[4][4];
+        for (size_t j = 0; j < 4; j++) {
+            FP[0][j] = P[0][j] + (dt * P[2][j]);
+            FP[1][j] = P[1][j] + (dt * P[3][j]);
+            FP[2][j] = P[2][j];
+            FP[3][j] = P[3][j];
+        }
+        for (size_t i = 0; i < 4; i++) {
+            P[i][0] = FP[i][0] + (dt * FP[i][2]);
+            P[i][1] = FP[i][1] + (dt * FP[i][3]);
+            P[i][2] = FP[i][2];
+            P[i][3] = FP[i][3];
+        }
+        P[0][0] += qPosition;
+        P[1][1] += qPosition;
+        P[0][2] += qCross;
+        P[2][0] += qCross;
+        P[1][3] += qCross;
+        P[3][1] += qCross;
+        P[2][2] += qVelocity;
+        P[3][3] += qVelocity;
+    }
+}
+
+void ObstacleTracker::correctTrack(const size_t t, const Cluster& cluster) {
+    Track& track = tracks[t];
+    float (&P)[4][4] = covariances[t];
+
+    // Position measurement, S = H * P * H^T + R is the top left 2x2 block plus R
+    const float r = config.measurementNoise * config.measurementNoise;
+    const float s00 = P[0][0] + r;
+    const float s01 = P[0][1];
+    const float s10 = P[1][0];
+    const float s11 = P[1][1] + r;
+    const float invDeterminant = 1.0f / ((s00 * s11) - (s01 * s10));
+    const float i00 = s11 * invDeterminant;
+    const float i01 = -s01 * invDeterminant;
+    const float i10 = -s10 * invDeterminant;
+    const float i11 = s00 * invDeterminant;
+
+    // K = P * H^T * S^-1 (4x2)
+    float K[4][2];
+    for (size_t i = 0; i < 4; i++) {
+        K[i][0] = (P[i][0] * i00) + (P[i][1] * i10);
+        K[i][1] = (P[i][0] * i01) + (P[i][1] * i11);
+    }
+
+    const float innovationX = cluster.centerX - track.x;
+    const float innovationY = cluster.centerY - track.y;
+    track.x += (K[0][0] * innovationX) + (K[0][1] * innovationY);
+    track.y += (K[1][0] * innovationX) + (K[1][1] * innovationY);
+    track.vx += (K[2][0] * innovationX) + (K[2][1] * innovationY);
+    track.vy += (K[3][0] * innovationX) + (K[3][1] * innovationY);
+
+    // P = (I - K * H) * P
+    float updated[4][4];
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < 4; j++)
+            updated[i][j] = P[i][j] - (K[i][0] * P[0][j]) - (K[i][1] * P[1][j]);
+    }
+    memcpy(P, updated, sizeof(updated));
+
+    track.length = cluster.length;
+    track.width = cluster.width;
+    track.yaw = cluster.yaw;
+    track.hits++;
+    track.misses = 0;
+    if (track.hits >= config.confirmHits)
+        track.confirmed = true;
+}
+
+void ObstacleTracker::associate() {
+    // Every track / box pair inside the gate, closest first
+    const float gateSquared = config.gateDistance * config.gateDistance;
+    size_t pairCount = 0;
+    for (size_t t = 0; t < trackCount; t++) {
+        for (size_t c = 0; c < clusterCount; c++) {
+            if (!clusters[c].tracked)
+                continue;
+            const float dx = clusters[c].centerX - tracks[t].x;
+            const float dy = clusters[c].centerY - tracks[t].y;
+            const float distanceSquared = (dx * dx) + (dy * dy);
+            if (distanceSquared <= gateSquared)
+                pairs[pairCount++] = {distanceSquared, (uint16_t)t, (uint16_t)c};
+        }
+    }
+    std::sort(pairs, pairs + pairCount, [](const Pair& a, const Pair& b) { return a.distanceSquared < b.distanceSquared; });
+
+    memset(trackAssigned, 0, sizeof(trackAssigned));
+    memset(clusterAssigned, 0, sizeof(clusterAssigned));
+    for (size_t p = 0; p < pairCount; p++) {
+        const Pair& pair = pairs[p];
+        if (trackAssigned[pair.track] || clusterAssigned[pair.cluster])
+            continue;
+        trackAssigned[pair.track] = true;
+        clusterAssigned[pair.cluster] = true;
+        correctTrack(pair.track, clusters[pair.cluster]);
+    }
+
+    // Tracks that went unseen for too long are dropped
+    size_t kept = 0;
+    for (size_t t = 0; t < trackCount; t++) {
+        if (!trackAssigned[t])
+            tracks[t].misses++;
+        if (tracks[t].misses <= config.maxMisses) {
+            tracks[kept] = tracks[t];
+            memcpy(covariances[kept], covariances[t], sizeof(covariances[t]));
+            kept++;
+        }
+    }
+    trackCount = kept;
+
+    // New tracks for the boxes nobody claimed
+    for (size_t c = 0; (c < clusterCount) && (trackCount < MAX_TRACKS); c++) {
+        if (!clusters[c].tracked || clusterAssigned[c])
+            continue;
+
+        Track& track = tracks[trackCount];
+        track.id = nextTrackId++;
+        track.x = clusters[c].centerX;
+        track.y = clusters[c].centerY;
+        track.vx = 0.0f;
+        track.vy = 0.0f;
+        track.length = clusters[c].length;
+        track.width = clusters[c].width;
+        track.yaw = clusters[c].yaw;
+        track.hits = 1;
+        track.misses = 0;
+        track.confirmed = config.confirmHits <= 1;
+
+        // Position is known to the measurement noise, velocity could be anything a car can do
+        float (&P)[4][4] = covariances[trackCount];
+        memset(P, 0, sizeof(P));
+        P[0][0] = P[1][1] = config.measurementNoise * config.measurementNoise;
+        P[2][2] = P[3][3] = 4.0f;
+        trackCount++;
+    }
+}
+
+void ObstacleTracker::process(const Pose2D& pose, const uint64_t timestamp) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    segment();
+    const uint64_t segmentedTime = TimeStamp::getMonotonic();
+
+    for (size_t c = 0; c < clusterCount; c++)
+        fitBox(clusters[c], pose);
+    const uint64_t fittedTime = TimeStamp::getMonotonic();
+
+    float dt = (lastTimestamp && (timestamp > lastTimestamp)) ? ((timestamp - lastTimestamp) * 1e-9f) : 0.0f;
+    if (dt > 1.0f)
+        dt = 1.0f;
+    lastTimestamp = timestamp;
+    predictTracks(dt);
+    associate();
+    const uint64_t endTime = TimeStamp::getMonotonic();
+
+    stats.scans++;
+    stats.clusters += clusterCount;
+    stats.totalSegmentNsecs += segmentedTime - startTime;
+    stats.totalFitNsecs += fittedTime - segmentedTime;
+    stats.totalTrackNsecs += endTime - fittedTime;
+    stats.maxScanNsecs = std::max(stats.maxScanNsecs, endTime - startTime);
+}
+
+void ObstacleTracker::update(const LD19::LidarPoint* points, const size_t count, const Pose2D& pose, const uint64_t timestamp) {
+    const float maxRangeMillimeters = config.maxRange * 1000.0f;
+    const float lidarAngleScale = -(float)(M_PI / 18000.0);
+
+    this->count = 0;
+    for (size_t i = 0; (i < count) && (this->count < MAX_POINTS); i++) {
+        if ((points[i].distance == 0) || (points[i].distance > maxRangeMillimeters))
+            continue;
+
+        const size_t n = this->count++;
+        angles[n] = points[i].angle * lidarAngleScale;
+        ranges[n] = points[i].distance * 0.001f;
+        float s, c;
+        FastMath::sinCos(angles[n], s, c);
+        xs[n] = ranges[n] * c;
+        ys[n] = ranges[n] * s;
+    }
+
+    process(pose, timestamp);
+}
+
+void ObstacleTracker::update(const float* angles, const float* ranges, const float* xs, const float* ys, const size_t count,
+    const Pose2D& pose, const uint64_t timestamp) {
+    this->count = 0;
+    for (size_t i = 0; (i < count) && (this->count < MAX_POINTS); i++) {
+        if (!(ranges[i] > 0.0f) || (ranges[i] > config.maxRange))
+            continue;
+
+        const size_t n = this->count++;
+        this->angles[n] = angles[i];
+        this->ranges[n] = ranges[i];
+        this->xs[n] = xs[i];
+        this->ys[n] = ys[i];
+    }
+
+    process(pose, timestamp);
+}
+
+void ObstacleTracker::printStats() const {
+    const double scans = stats.scans ? (double)stats.scans : 1.0;
+    printf("ObstacleTracker: %llu scans, %.1f clusters/scan, %zu tracks\n",
+        (unsigned long long)stats.scans, stats.clusters / scans, trackCount);
+    printf("  mean segment %.1f us, fit %.1f us, track %.1f us, max total %.1f us\n",
+        stats.totalSegmentNsecs / scans / NSECS_TO_USECS, stats.totalFitNsecs / scans / NSECS_TO_USECS,
+        stats.totalTrackNsecs / scans / NSECS_TO_USECS, (double)stats.maxScanNsecs / NSECS_TO_USECS);
+}
@@ -0,0 +1,145 @@
+#ifndef __OBSTACLE_TRACKER_H__
+#define __OBSTACLE_TRACKER_H__
+
+// Obstacle layer: scan segmentation, box fitting and multi-object tracking (e.g. the other cars on track)
+// 1. Segmentation: one pass over the angle ordered points, a new cluster starts wherever the gap to the previous point
+//    is bigger than an adaptive breakpoint distance that grows with range (Borges & Aldon)
+// 2. Each cluster gets an oriented box from a search based L-shape fit (Zhang et al., closeness criterion)
+// 3. Boxes are associated to tracks by gated nearest neighbour, and each track runs a constant velocity Kalman filter
+//    on its box center, giving the velocity of the object
+// Everything is fixed capacity, nothing is allocated per scan.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "fhl_ld19.h"
+#include "pose2d.h"
+
+class ObstacleTracker {
+public:
+    static const size_t MAX_POINTS = 1024;
+    static const size_t MAX_CLUSTERS = 128;
+    static const size_t MAX_TRACKS = 32;
+
+    struct Config {
+        // Segmentation
+        float breakpointLambda = 0.17f;     // Radians, worst case incidence angle of a surface still counted as continuous
+        float rangeNoise = 0.015f;          // Meters (LD19 is about +-10mm)
+        size_t minClusterPoints = 3;
+        float maxRange = 8.0f;              // Meters, points further away are ignored
+
+        // Box fitting
+        float fitAngleStep = 0.05f;         // Radians, over [0, pi/2)
+        float minCloseness = 0.01f;         // Meters, d0 in the closeness criterion
+
+        // Objects bigger than this are walls and not tracked
+        float maxObjectLength = 1.0f;       // Meters
+
+        // Tracking
+        float gateDistance = 0.5f;          // Meters, max distance between a track's prediction and a box
+        float accelerationNoise = 4.0f;     // m/s^2, process noise of the constant velocity model
+        float measurementNoise = 0.05f;     // Meters
+        uint16_t confirmHits = 3;           // Associations before a track is confirmed
+        uint16_t maxMisses = 5;             // Scans without an association before a track is dropped
+    };
+
+    struct Cluster {
+        uint16_t begin;                     // Points [begin, end) of the filtered scan (end can wrap past the last point)
+        uint16_t count;
+
+        // Fitted box in the world frame
+        float centerX;
+        float centerY;
+        float length;                       // Along yaw
+        float width;
+        float yaw;
+        bool tracked;                       // Small enough to be an object
+    };
+
+    struct Track {
+        uint32_t id;
+        float x;                            // World frame, meters
+        float y;
+        float vx;                           // m/s
+        float vy;
+        float length;
+        float width;
+        float yaw;                          // Box orientation
+        uint16_t hits;
+        uint16_t misses;
+        bool confirmed;
+
+        float getSpeed() const { return std::sqrt((vx * vx) + (vy * vy)); }
+    };
+
+    struct Stats {
+        uint64_t scans;
+        uint64_t clusters;
+        uint64_t totalSegmentNsecs;
+        uint64_t totalFitNsecs;
+        uint64_t totalTrackNsecs;
+        uint64_t maxScanNsecs;
+    };
+
+private:
+    const Config config;
+
+    // Scan (structure of arrays), vehicle frame
+    float angles[MAX_POINTS];
+    float ranges[MAX_POINTS];
+    float xs[MAX_POINTS];
+    float ys[MAX_POINTS];
+    size_t count = 0;
+
+    Cluster clusters[MAX_CLUSTERS];
+    size_t clusterCount = 0;
+
+    Track tracks[MAX_TRACKS];
+    float covariances[MAX_TRACKS][4][4];
+    size_t trackCount = 0;
+    uint32_t nextTrackId = 1;
+    uint64_t lastTimestamp = 0;
+
+    // Association scratch
+    struct Pair {
+        float distanceSquared;
+        uint16_t track;
+        uint16_t cluster;
+    };
+    Pair pairs[MAX_TRACKS * MAX_CLUSTERS];
+    bool clusterAssigned[MAX_CLUSTERS];
+    bool trackAssigned[MAX_TRACKS];
+
+    Stats stats = {};
+
+    void segment();
+    void fitBox(Cluster& cluster, const Pose2D& pose);
+    void predictTracks(const float dt);
+    void correctTrack(const size_t track, const Cluster& cluster);
+    void associate();
+    void process(const Pose2D& pose, const uint64_t timestamp);
+
+public:
+    ObstacleTracker();
+    ObstacleTracker(const Config& config);
+
+    // Processes a scan taken at pose (world frame, identity tracks in the vehicle frame). timestamp is the scan's time
+    // in nanoseconds, used for the track velocities
+    void update(const LD19::LidarPoint* points, const size_t count, const Pose2D& pose, const uint64_t timestamp);
+
+    // Same, from angle ordered structure of arrays (e.g. ScanFilter's output)
+    void update(const float* angles, const float* ranges, const float* xs, const float* ys, const size_t count,
+        const Pose2D& pose, const uint64_t timestamp);
+
+    size_t getClusterCount() const { return clusterCount; }
+    const Cluster& getCluster(const size_t index) const { return clusters[index]; }
+
+    // Tracks (including unconfirmed ones, check Track::confirmed)
+    size_t getTrackCount() const { return trackCount; }
+    const Track& getTrack(const size_t index) const { return tracks[index]; }
+
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+#endif
@@ -0,0 +1,378 @@
+#include "occupancy_grid.h"
+
+#include <string.h>
+
+#include "timestamp.h"
+
+OccupancyGrid::OccupancyGrid() : OccupancyGrid(Config()) {}
+
+OccupancyGrid::OccupancyGrid(const Config& config) :
+    config(config),
+    invResolution(1.0f / config.resolution),
+    tiles(new Tile[config.maxTiles]),
+    touchedTiles(new int32_t[config.maxTiles]),
+    workers(config.numThreads) {
+
+    size_t hashSize = 1;
+    while (hashSize < (config.maxTiles * 2))
+        hashSize <<= 1;
+    hashSlots.reset(new int32_t[hashSize]);
+    hashMask = hashSize - 1;
+    rebuildHash();
+}
+
+size_t OccupancyGrid::hashTile(const int32_t tileX, const int32_t tileY) {
+    return ((uint32_t)tileX * 73856093u) ^ ((uint32_t)tileY * 19349663u);
+}
+
+int32_t OccupancyGrid::findTile(const int32_t tileX, const int32_t tileY) const {
+    size_t slot = hashTile(tileX, tileY) & hashMask;
+    while (true) {
+        const int32_t tileIndex = hashSlots[slot];
+        if (tileIndex == EMPTY_SLOT)
+            return EMPTY_SLOT;
+        if ((tiles[tileIndex].tileX == tileX) && (tiles[tileIndex].tileY == tileY))
+            return tileIndex;
+        slot = (slot + 1) & hashMask;
+    }
+}
+
+void OccupancyGrid::rebuildHash() {
+    for (size_t slot = 0; slot <= hashMask; slot++)
+        hashSlots[slot] = EMPTY_SLOT;
+
+    for (size_t tileIndex = 0; tileIndex < tileCount; tileIndex++) {
+        size_t slot = hashTile(tiles[tileIndex].tileX, tiles[tileIndex].tileY) & hashMask;
+        while (hashSlots[slot] != EMPTY_SLOT)
+            slot = (slot + 1) & hashMask;
+        hashSlots[slot] = tileIndex;
+    }
+}
+
+void OccupancyGrid::pageOutTile(const size_t tileIndex) {
+    if (tilePagedOutCallback)
+        tilePagedOutCallback(tiles[tileIndex]);
+    stats.tilesPagedOut++;
+
+    // Keep the pool packed by moving the last tile into the hole (the caller rebuilds the hash)
+    const size_t lastIndex = tileCount - 1;
+    if (tileIndex != lastIndex) {
+        Tile& hole = tiles[tileIndex];
+        const Tile& last = tiles[lastIndex];
+        hole.tileX = last.tileX;
+        hole.tileY = last.tileY;
+        hole.lastTouchedScan = last.lastTouchedScan;
+        for (size_t cell = 0; cell < TILE_CELLS; cell++)
+            hole.cells[cell].store(last.cells[cell].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        if (hole.lastTouchedScan == scanNumber) {
+            for (size_t i = 0; i < touchedTileCount; i++) {
+                if (touchedTiles[i] == (int32_t)lastIndex)
+                    touchedTiles[i] = tileIndex;
+            }
+        }
+    }
+    tileCount--;
+}
+
+bool OccupancyGrid::evictFarthestTile(const Pose2D& pose) {
+    const float tileMeters = TILE_SIZE * config.resolution;
+
+    int32_t farthestIndex = EMPTY_SLOT;
+    float farthestDistanceSquared = -1.0f;
+    for (size_t tileIndex = 0; tileIndex < tileCount; tileIndex++) {
+        const Tile& tile = tiles[tileIndex];
+        if (tile.lastTouchedScan == scanNumber)
+            continue;
+
+        const float dx = ((tile.tileX + 0.5f) * tileMeters) - pose.x;
+        const float dy = ((tile.tileY + 0.5f) * tileMeters) - pose.y;
+        const float distanceSquared = (dx * dx) + (dy * dy);
+        if (distanceSquared > farthestDistanceSquared) {
+            farthestDistanceSquared = distanceSquared;
+            farthestIndex = tileIndex;
+        }
+    }
+
+    if (farthestIndex == EMPTY_SLOT)
+        return false;
+
+    pageOutTile(farthestIndex);
+    rebuildHash();
+    return true;
+}
+
+void OccupancyGrid::pageOutDistantTiles(const Pose2D& pose) {
+    const float tileMeters = TILE_SIZE * config.resolution;
+    const float limitSquared = config.pageOutDistance * config.pageOutDistance;
+
+    bool pagedOut = false;
+    for (size_t tileIndex = tileCount; tileIndex-- > 0;) {
+        const Tile& tile = tiles[tileIndex];
+        if (tile.lastTouchedScan == scanNumber)
+            continue;
+
+        const float dx = ((tile.tileX + 0.5f) * tileMeters) - pose.x;
+        const float dy = ((tile.tileY + 0.5f) * tileMeters) - pose.y;
+        if (((dx * dx) + (dy * dy)) > limitSquared) {
+            pageOutTile(tileIndex);
+            pagedOut = true;
+        }
+    }
+
+    if (pagedOut)
+        rebuildHash();
+}
+
+int32_t OccupancyGrid::getOrCreateTile(const int32_t tileX, const int32_t tileY, const Pose2D& pose) {
+    const int32_t existing = findTile(tileX, tileY);
+    if (existing != EMPTY_SLOT)
+        return existing;
+
+    if ((tileCount == config.maxTiles) && !evictFarthestTile(pose))
+        return EMPTY_SLOT;
+
+    const int32_t tileIndex = tileCount++;
+    Tile& tile = tiles[tileIndex];
+    tile.tileX = tileX;
+    tile.tileY = tileY;
+    tile.lastTouchedScan = 0;
+    for (size_t cell = 0; cell < TILE_CELLS; cell++)
+        tile.cells[cell].store(0, std::memory_order_relaxed);
+
+    size_t slot = hashTile(tileX, tileY) & hashMask;
+    while (hashSlots[slot] != EMPTY_SLOT)
+        slot = (slot + 1) & hashMask;
+    hashSlots[slot] = tileIndex;
+
+    return tileIndex;
+}
+
+bool OccupancyGrid::loadTile(const int32_t tileX, const int32_t tileY, const int8_t* cells) {
+    int32_t tileIndex = findTile(tileX, tileY);
+    if (tileIndex == EMPTY_SLOT) {
+        if (tileCount == config.maxTiles)
+            return false;
+        tileIndex = getOrCreateTile(tileX, tileY, Pose2D());
+    }
+
+    Tile& tile = tiles[tileIndex];
+    for (size_t cell = 0; cell < TILE_CELLS; cell++)
+        tile.cells[cell].store(cells[cell], std::memory_order_relaxed);
+    return true;
+}
+
+void OccupancyGrid::touchTile(const int32_t tileIndex) {
+    Tile& tile = tiles[tileIndex];
+    if (tile.lastTouchedScan != scanNumber) {
+        tile.lastTouchedScan = scanNumber;
+        touchedTiles[touchedTileCount++] = tileIndex;
+    }
+}
+
+void OccupancyGrid::prepareRayTiles(const float endX, const float endY, const Pose2D& pose) {
+    // Walk the ray at tile resolution so every tile it crosses exists before the parallel part
+    const float startTileX = originX / TILE_SIZE;
+    const float startTileY = originY / TILE_SIZE;
+    const float dx = (endX / TILE_SIZE) - startTileX;
+    const float dy = (endY / TILE_SIZE) - startTileY;
+
+    int32_t tileX = (int32_t)std::floor(startTileX);
+    int32_t tileY = (int32_t)std::floor(startTileY);
+    const int32_t endTileX = (int32_t)std::floor(endX / TILE_SIZE);
+    const int32_t endTileY = (int32_t)std::floor(endY / TILE_SIZE);
+    const int32_t stepX = (dx >= 0.0f) ? 1 : -1;
+    const int32_t stepY = (dy >= 0.0f) ? 1 : -1;
+    const float tDeltaX = (dx != 0.0f) ? std::fabs(1.0f / dx) : INFINITY;
+    const float tDeltaY = (dy != 0.0f) ? std::fabs(1.0f / dy) : INFINITY;
+    float tMaxX = (dx != 0.0f) ? (((dx > 0.0f) ? (tileX + 1 - startTileX) : (startTileX - tileX)) * tDeltaX) : INFINITY;
+    float tMaxY = (dy != 0.0f) ? (((dy > 0.0f) ? (tileY + 1 - startTileY) : (startTileY - tileY)) * tDeltaY) : INFINITY;
+
+    const int32_t steps = std::abs(endTileX - tileX) + std::abs(endTileY - tileY);
+    for (int32_t step = 0; step <= steps; step++) {
+        const int32_t tileIndex = getOrCreateTile(tileX, tileY, pose);
+        if (tileIndex != EMPTY_SLOT)
+            touchTile(tileIndex);
+        else
+            stats.tilesDropped++;
+
+        if (tMaxX < tMaxY) {
+            tMaxX += tDeltaX;
+            tileX += stepX;
+        } else {
+            tMaxY += tDeltaY;
+            tileY += stepY;
+        }
+    }
+}
+
+void OccupancyGrid::updateCell(Tile* tile, const int32_t cellX, const int32_t cellY, const int8_t delta) {
+    std::atomic<int8_t>& cell = tile->cells[((cellY & TILE_MASK) << TILE_SHIFT) | (cellX & TILE_MASK)];
+
+    // Saturating add, other threads may be updating the same cell
+    int8_t current = cell.load(std::memory_order_relaxed);
+    while (true) {
+        int next = (int)current + delta;
+        if (next < config.minLogOdds)
+            next = config.minLogOdds;
+        if (next > config.maxLogOdds)
+            next = config.maxLogOdds;
+        if ((next == current) || cell.compare_exchange_weak(current, (int8_t)next, std::memory_order_relaxed))
+            return;
+    }
+}
+
+void OccupancyGrid::traceRays(const size_t begin, const size_t end) {
+    uint64_t updates = 0;
+
+    for (size_t ray = begin; ray < end; ray++) {
+        const float dx = rayEndX[ray] - originX;
+        const float dy = rayEndY[ray] - originY;
+
+        // Amanatides & Woo grid traversal
+        int32_t cellX = (int32_t)std::floor(originX);
+        int32_t cellY = (int32_t)std::floor(originY);
+        const int32_t endCellX = (int32_t)std::floor(rayEndX[ray]);
+        const int32_t endCellY = (int32_t)std::floor(rayEndY[ray]);
+        const int32_t stepX = (dx >= 0.0f) ? 1 : -1;
+        const int32_t stepY = (dy >= 0.0f) ? 1 : -1;
+        const float tDeltaX = (dx != 0.0f) ? std::fabs(1.0f / dx) : INFINITY;
+        const float tDeltaY = (dy != 0.0f) ? std::fabs(1.0f / dy) : INFINITY;
+        float tMaxX = (dx != 0.0f) ? (((dx > 0.0f) ? (cellX + 1 - originX) : (originX - cellX)) * tDeltaX) : INFINITY;
+        float tMaxY = (dy != 0.0f) ? (((dy > 0.0f) ? (cellY + 1 - originY) : (originY - cellY)) * tDeltaY) : INFINITY;
+
+        // Cache the tile, most steps stay inside the same one
+        Tile* tile = nullptr;
+        int32_t currentTileX = cellX >> TILE_SHIFT;
+        int32_t currentTileY = cellY >> TILE_SHIFT;
+        int32_t tileIndex = findTile(currentTileX, currentTileY);
+        tile = (tileIndex != EMPTY_SLOT) ? &tiles[tileIndex] : nullptr;
+
+        const int32_t steps = std::abs(endCellX - cellX) + std::abs(endCellY - cellY);
+        for (int32_t step = 0; step <= steps; step++) {
+            if (((cellX >> TILE_SHIFT) != currentTileX) || ((cellY >> TILE_SHIFT) != currentTileY)) {
+                currentTileX = cellX >> TILE_SHIFT;
+                currentTileY = cellY >> TILE_SHIFT;
+                tileIndex = findTile(currentTileX, currentTileY);
+                tile = (tileIndex != EMPTY_SLOT) ? &tiles[tileIndex] : nullptr;
+            }
+
+            // Everything up to the end is free, the end is the hit (unless the ray was cut at max range)
+            if (tile) {
+                const bool isHit = (step == steps) && rayHit[ray];
+                updateCell(tile, cellX, cellY, isHit ? config.hitLogOdds : config.missLogOdds);
+                updates++;
+            }
+
+            if (tMaxX < tMaxY) {
+                tMaxX += tDeltaX;
+                cellX += stepX;
+            } else {
+                tMaxY += tDeltaY;
+                cellY += stepY;
+            }
+        }
+    }
+
+    cellUpdates.fetch_add(updates, std::memory_order_relaxed);
+}
+
+void OccupancyGrid::traceRaysJob(void* context, const size_t begin, const size_t end) {
+    static_cast<OccupancyGrid*>(context)->traceRays(begin, end);
+}
+
+void OccupancyGrid::beginScan(const Pose2D& pose) {
+    scanNumber++;
+    touchedTileCount = 0;
+    rayCount = 0;
+
+    sensorPose = pose.compose(config.lidarMount);
+    originX = sensorPose.x * invResolution;
+    originY = sensorPose.y * invResolution;
+}
+
+void OccupancyGrid::addRay(const float x, const float y, const Pose2D& pose) {
+    if ((rayCount == MAX_RAYS) || std::isnan(x) || std::isnan(y))
+        return;
+
+    float rayX = x;
+    float rayY = y;
+    bool hit = true;
+    const float rangeSquared = (x * x) + (y * y);
+    if (rangeSquared > (config.maxRange * config.maxRange)) {
+        // Only the free space up to max range
+        const float scale = config.maxRange / std::sqrt(rangeSquared);
+        rayX *= scale;
+        rayY *= scale;
+        hit = false;
+    }
+
+    float worldX;
+    float worldY;
+    sensorPose.transformPoint(rayX, rayY, worldX, worldY);
+
+    rayEndX[rayCount] = worldX * invResolution;
+    rayEndY[rayCount] = worldY * invResolution;
+    rayHit[rayCount] = hit;
+    prepareRayTiles(rayEndX[rayCount], rayEndY[rayCount], pose);
+    rayCount++;
+}
+
+void OccupancyGrid::endScan(const Pose2D& pose, const uint64_t startTime) {
+    cellUpdates.store(0, std::memory_order_relaxed);
+    workers.run(traceRaysJob, this, rayCount, 16);
+
+    pageOutDistantTiles(pose);
+
+    const uint64_t elapsed = TimeStamp::getMonotonic() - startTime;
+    stats.scans++;
+    stats.rays += rayCount;
+    stats.cellUpdates += cellUpdates.load(std::memory_order_relaxed);
+    stats.totalIntegrateNsecs += elapsed;
+    if (elapsed > stats.maxIntegrateNsecs)
+        stats.maxIntegrateNsecs = elapsed;
+}
+
+void OccupancyGrid::integrateScan(const LD19::LidarPoint* points, const size_t count, const Pose2D& pose) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    beginScan(pose);
+    for (size_t i = 0; i < count; i++) {
+        if (points[i].distance > 0)
+            addRay(points[i].getXMeters(), points[i].getYMeters(), pose);
+    }
+    endScan(pose, startTime);
+}
+
+void OccupancyGrid::integrateScan(const float* xs, const float* ys, const size_t count, const Pose2D& pose) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    beginScan(pose);
+    for (size_t i = 0; i < count; i++)
+        addRay(xs[i], ys[i], pose);
+    endScan(pose, startTime);
+}
+
+int8_t OccupancyGrid::getCellLogOdds(const int32_t cellX, const int32_t cellY) const {
+    const int32_t tileIndex = findTile(cellX >> TILE_SHIFT, cellY >> TILE_SHIFT);
+    if (tileIndex == EMPTY_SLOT)
+        return 0;
+    return tiles[tileIndex].cells[((cellY & TILE_MASK) << TILE_SHIFT) | (cellX & TILE_MASK)].load(std::memory_order_relaxed);
+}
+
+int8_t OccupancyGrid::getLogOdds(const float x, const float y) const {
+    return getCellLogOdds(worldToCell(x), worldToCell(y));
+}
+
+float OccupancyGrid::getProbability(const float x, const float y) const {
+    const float logOdds = getLogOdds(x, y) / LOG_ODDS_SCALE;
+    return 1.0f - (1.0f / (1.0f + std::exp(logOdds)));
+}
+
+void OccupancyGrid::printStats() const {
+    printf("OccupancyGrid: %llu scans, %llu rays, %llu cell updates, mean %llu us/scan, max %llu us/scan\n",
+        (unsigned long long)stats.scans, (unsigned long long)stats.rays, (unsigned long long)stats.cellUpdates,
+        (unsigned long long)(stats.getMeanIntegrateNsecs() / NSECS_TO_USECS), (unsigned long long)(stats.maxIntegrateNsecs / NSECS_TO_USECS));
+    printf("  %zu / %zu tiles in use, %llu paged out, %llu ray tiles dropped\n",
+        tileCount, config.maxTiles, (unsigned long long)stats.tilesPagedOut, (unsigned long long)stats.tilesDropped);
+}
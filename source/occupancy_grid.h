@@ -0,0 +1,157 @@
+#ifndef __OCCUPANCY_GRID_H__
+#define __OCCUPANCY_GRID_H__
+
+// Occupancy grid built incrementally from LD19 scans
+// The map is split into 64x64 cell tiles of int8 log-odds, allocated from a fixed pool as the car drives into new
+// areas and found through a small open addressing hash. Each scan only touches the tiles its rays cross, the rays are
+// traced in parallel on a WorkerPool (cells are updated with atomic saturating adds).
+// Memory is bounded by the pool: tiles far from the car are paged out, optionally through a callback so they can be
+// saved and loaded back later.
+//
+// World frame is whatever frame the poses are given in (e.g. PoseEstimator's), x/y in meters.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+
+#include "fhl_ld19.h"
+#include "pose2d.h"
+#include "worker_pool.h"
+
+class OccupancyGrid {
+public:
+    static const int TILE_SHIFT = 6;
+    static const int TILE_SIZE = 1 << TILE_SHIFT; // Cells per side
+    static const int TILE_MASK = TILE_SIZE - 1;
+    static const size_t TILE_CELLS = TILE_SIZE * TILE_SIZE;
+    static const size_t MAX_RAYS = 1024;
+
+    // Log-odds are stored as int8, LOG_ODDS_SCALE counts per natural log-odds unit. 0 is unknown
+    static constexpr float LOG_ODDS_SCALE = 16.0f;
+
+    struct Config {
+        float resolution = 0.05f;           // Meters per cell
+        size_t maxTiles = 1024;             // 4MB of cells, ~10000m^2 at 5cm
+        float pageOutDistance = 40.0f;      // Meters from the car before a tile gets paged out
+
+        float maxRange = 12.0f;             // Meters, longer rays only mark free space up to this
+        Pose2D lidarMount;                  // Lidar pose in the vehicle frame
+
+        int8_t hitLogOdds = 14;             // ~0.7 probability
+        int8_t missLogOdds = -6;            // ~0.4 probability
+        int8_t minLogOdds = -100;
+        int8_t maxLogOdds = 100;
+
+        size_t numThreads = 2;              // Extra ray tracing threads, the calling thread also traces
+    };
+
+    struct Tile {
+        int32_t tileX;                      // Tile coordinates (cell >> TILE_SHIFT)
+        int32_t tileY;
+        uint32_t lastTouchedScan;
+        std::atomic<int8_t> cells[TILE_CELLS]; // Row major, [localY * TILE_SIZE + localX]
+    };
+
+    struct Stats {
+        uint64_t scans;
+        uint64_t rays;
+        uint64_t cellUpdates;
+        uint64_t tilesPagedOut;
+        uint64_t tilesDropped;              // Tiles a ray needed but couldn't get (pool full of tiles in use)
+        uint64_t totalIntegrateNsecs;
+        uint64_t maxIntegrateNsecs;
+
+        uint64_t getMeanIntegrateNsecs() const { return scans ? (totalIntegrateNsecs / scans) : 0; }
+    };
+
+private:
+    static const int32_t EMPTY_SLOT = -1;
+
+    const Config config;
+    const float invResolution;
+
+    // Tile pool and a hash from tile coordinates to pool index (twice the pool size, linear probing)
+    std::unique_ptr<Tile[]> tiles;
+    size_t tileCount = 0;
+    std::unique_ptr<int32_t[]> hashSlots;
+    size_t hashMask = 0;
+
+    // Tiles touched by the latest scan
+    std::unique_ptr<int32_t[]> touchedTiles;
+    size_t touchedTileCount = 0;
+    uint32_t scanNumber = 0;
+
+    // Rays of the current scan in cell coordinates (structure of arrays)
+    Pose2D sensorPose;
+    float originX = 0.0f;
+    float originY = 0.0f;
+    float rayEndX[MAX_RAYS];
+    float rayEndY[MAX_RAYS];
+    bool rayHit[MAX_RAYS];
+    size_t rayCount = 0;
+    std::atomic<uint64_t> cellUpdates{0};
+
+    WorkerPool workers;
+    Stats stats = {};
+
+    static size_t hashTile(const int32_t tileX, const int32_t tileY);
+    int32_t findTile(const int32_t tileX, const int32_t tileY) const;
+    int32_t getOrCreateTile(const int32_t tileX, const int32_t tileY, const Pose2D& pose);
+    void rebuildHash();
+    bool evictFarthestTile(const Pose2D& pose);
+    void pageOutTile(const size_t tileIndex);
+    void pageOutDistantTiles(const Pose2D& pose);
+
+    void beginScan(const Pose2D& pose);
+    void addRay(const float x, const float y, const Pose2D& pose);
+    void endScan(const Pose2D& pose, const uint64_t startTime);
+    void touchTile(const int32_t tileIndex);
+    void prepareRayTiles(const float endX, const float endY, const Pose2D& pose);
+    void traceRays(const size_t begin, const size_t end);
+    static void traceRaysJob(void* context, const size_t begin, const size_t end);
+
+    void updateCell(Tile* tile, const int32_t cellX, const int32_t cellY, const int8_t delta);
+
+public:
+    // Called with each tile that gets paged out (optional, e.g. to save it to disk and loadTile() it later)
+    void (*tilePagedOutCallback)(const Tile& tile) = nullptr;
+
+    OccupancyGrid();
+    OccupancyGrid(const Config& config);
+
+    // Adds a scan taken at pose (the vehicle's pose in the world frame)
+    void integrateScan(const LD19::LidarPoint* points, const size_t count, const Pose2D& pose);
+
+    // Same, with points already converted to meters in the lidar frame (e.g. ScanDeskew output). NaN points are skipped
+    void integrateScan(const float* xs, const float* ys, const size_t count, const Pose2D& pose);
+
+    // Log-odds at a world position (0 for unknown)
+    int8_t getLogOdds(const float x, const float y) const;
+    int8_t getCellLogOdds(const int32_t cellX, const int32_t cellY) const;
+
+    // Occupancy probability at a world position (0.5 for unknown)
+    float getProbability(const float x, const float y) const;
+
+    int32_t worldToCell(const float meters) const { return (int32_t)std::floor(meters * invResolution); }
+    float cellToWorld(const int32_t cell) const { return ((float)cell + 0.5f) * config.resolution; }
+
+    // Tiles that the latest scan updated
+    size_t getTouchedTileCount() const { return touchedTileCount; }
+    const Tile& getTouchedTile(const size_t index) const { return tiles[touchedTiles[index]]; }
+
+    size_t getTileCount() const { return tileCount; }
+    const Tile& getTile(const size_t index) const { return tiles[index]; }
+
+    // Puts a previously paged out tile back. Returns false if there's no room
+    bool loadTile(const int32_t tileX, const int32_t tileY, const int8_t* cells);
+
+    // Pins the ray tracing threads, see WorkerPool::setRealtime()
+    bool setRealtime(const int priority, const int firstCpuCore) { return workers.setRealtime(priority, firstCpuCore); }
+
+    const Config& getConfig() const { return config; }
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+#endif
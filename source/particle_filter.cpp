@@ -0,0 +1,462 @@
+#include "particle_filter.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "fast_math.h"
+#include "timestamp.h"
+
+ParticleFilter::ParticleFilter() : ParticleFilter(Config()) {}
+
+ParticleFilter::ParticleFilter(const Config& config) :
+    config(config),
+    particleX(new float[config.maxParticles]),
+    particleY(new float[config.maxParticles]),
+    particleYaw(new float[config.maxParticles]),
+    particleWeight(new float[config.maxParticles]),
+    particleLogLikelihood(new float[config.maxParticles]),
+    nextX(new float[config.maxParticles]),
+    nextY(new float[config.maxParticles]),
+    nextYaw(new float[config.maxParticles]),
+    cumulativeWeight(new float[config.maxParticles]),
+    deadlineParticles(config.maxParticles),
+    random(config.seed),
+    workers(config.numThreads) {
+
+    size_t binSlots = 1;
+    while (binSlots < (config.maxParticles * 2))
+        binSlots <<= 1;
+    binKeys.reset(new uint64_t[binSlots]);
+    binStamps.reset(new uint32_t[binSlots]);
+    memset(binStamps.get(), 0, binSlots * sizeof(uint32_t));
+    binMask = binSlots - 1;
+}
+
+bool ParticleFilter::setMap(const OccupancyGrid& grid) {
+    if (grid.getTileCount() == 0) {
+        printf("Cannot build the likelihood field. The map is empty\n");
+        return false;
+    }
+
+    // Bounding box of the map's tiles
+    int32_t minTileX = INT32_MAX, minTileY = INT32_MAX, maxTileX = INT32_MIN, maxTileY = INT32_MIN;
+    for (size_t tileIndex = 0; tileIndex < grid.getTileCount(); tileIndex++) {
+        const OccupancyGrid::Tile& tile = grid.getTile(tileIndex);
+        minTileX = std::min(minTileX, tile.tileX);
+        minTileY = std::min(minTileY, tile.tileY);
+        maxTileX = std::max(maxTileX, tile.tileX);
+        maxTileY = std::max(maxTileY, tile.tileY);
+    }
+
+    fieldResolution = grid.getConfig().resolution;
+    fieldInvResolution = 1.0f / fieldResolution;
+    fieldWidth = (maxTileX - minTileX + 1) * OccupancyGrid::TILE_SIZE;
+    fieldHeight = (maxTileY - minTileY + 1) * OccupancyGrid::TILE_SIZE;
+    fieldOriginX = minTileX * OccupancyGrid::TILE_SIZE * fieldResolution;
+    fieldOriginY = minTileY * OccupancyGrid::TILE_SIZE * fieldResolution;
+
+    const size_t cells = (size_t)fieldWidth * fieldHeight;
+    field.reset(new float[cells + 1]);
+    freeCells.reset(new uint8_t[cells]);
+
+    // Squared distance (in cells) to the nearest obstacle, Felzenszwalb & Huttenlocher's 1D transform on columns then rows
+    const float infinity = 1e20f;
+    std::vector<float> squaredDistance(cells, infinity);
+    memset(freeCells.get(), 0, cells);
+    for (size_t tileIndex = 0; tileIndex < grid.getTileCount(); tileIndex++) {
+        const OccupancyGrid::Tile& tile = grid.getTile(tileIndex);
+        const int32_t baseX = (tile.tileX - minTileX) * OccupancyGrid::TILE_SIZE;
+        const int32_t baseY = (tile.tileY - minTileY) * OccupancyGrid::TILE_SIZE;
+        for (int localY = 0; localY < OccupancyGrid::TILE_SIZE; localY++) {
+            for (int localX = 0; localX < OccupancyGrid::TILE_SIZE; localX++) {
+                const int8_t logOdds = tile.cells[(localY << OccupancyGrid::TILE_SHIFT) | localX].load(std::memory_order_relaxed);
+                const size_t cell = ((size_t)(baseY + localY) * fieldWidth) + baseX + localX;
+                if (logOdds > config.occupiedLogOdds)
+                    squaredDistance[cell] = 0.0f;
+                freeCells[cell] = logOdds < config.freeLogOdds;
+            }
+        }
+    }
+
+    const int32_t longest = std::max(fieldWidth, fieldHeight);
+    std::vector<float> f(longest), d(longest), z(longest + 1);
+    std::vector<int32_t> v(longest);
+    auto transform1D = [&](const int32_t n) {
+        int32_t k = 0;
+        v[0] = 0;
+        z[0] = -infinity;
+        z[1] = infinity;
+        for (int32_t q = 1; q < n; q++) {
+            float s = ((f[q] + (q * q)) - (f[v[k]] + (v[k] * v[k]))) / (2.0f * (q - v[k]));
+            while (s <= z[k]) {
+                k--;
+                s = ((f[q] + (q * q)) - (f[v[k]] + (v[k] * v[k]))) / (2.0f * (q - v[k]));
+            }
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = infinity;
+        }
+        k = 0;
+        for (int32_t q = 0; q < n; q++) {
+            while (z[k + 1] < q)
+                k++;
+            d[q] = ((q - v[k]) * (q - v[k])) + f[v[k]];
+        }
+    };
+    for (int32_t x = 0; x < fieldWidth; x++) {
+        for (int32_t y = 0; y < fieldHeight; y++)
+            f[y] = squaredDistance[((size_t)y * fieldWidth) + x];
+        transform1D(fieldHeight);
+        for (int32_t y = 0; y < fieldHeight; y++)
+            squaredDistance[((size_t)y * fieldWidth) + x] = d[y];
+    }
+    for (int32_t y = 0; y < fieldHeight; y++) {
+        float* row = &squaredDistance[(size_t)y * fieldWidth];
+        std::copy(row, row + fieldWidth, f.begin());
+        transform1D(fieldWidth);
+        std::copy(d.begin(), d.begin() + fieldWidth, row);
+    }
+
+    // Likelihood field model: a gaussian around obstacles plus a uniform floor for random returns
+    const float randomLikelihood = config.zRandom / config.maxRange;
+    const float maxDistanceCells = config.maxDistance * fieldInvResolution;
+    const float gaussianScale = -(fieldResolution * fieldResolution) / (2.0f * config.sigmaHit * config.sigmaHit);
+    for (size_t cell = 0; cell < cells; cell++) {
+        const float distanceSquared = std::min(squaredDistance[cell], maxDistanceCells * maxDistanceCells);
+        field[cell] = std::log((config.zHit * std::exp(distanceSquared * gaussianScale)) + randomLikelihood);
+    }
+    outsideLogLikelihood = std::log((config.zHit * std::exp(maxDistanceCells * maxDistanceCells * gaussianScale)) + randomLikelihood);
+    field[cells] = outsideLogLikelihood;
+
+    return true;
+}
+
+void ParticleFilter::initialize(const Pose2D& pose, const float stdXY, const float stdYaw) {
+    particleCount = config.maxParticles;
+    for (size_t i = 0; i < particleCount; i++) {
+        particleX[i] = pose.x + (normal(random) * stdXY);
+        particleY[i] = pose.y + (normal(random) * stdXY);
+        particleYaw[i] = Pose2D::wrapAngle(pose.yaw + (normal(random) * stdYaw));
+        particleWeight[i] = 1.0f / particleCount;
+    }
+    computeEstimate();
+}
+
+bool ParticleFilter::initializeGlobal(const size_t count) {
+    if (!field) {
+        printf("Cannot initialize globally. No map has been set\n");
+        return false;
+    }
+
+    // Rejection sample the free cells
+    const size_t target = std::min(count, config.maxParticles);
+    const size_t maxAttempts = target * 1000;
+    particleCount = 0;
+    for (size_t attempt = 0; (attempt < maxAttempts) && (particleCount < target); attempt++) {
+        const float x = uniform(random) * fieldWidth;
+        const float y = uniform(random) * fieldHeight;
+        if (!freeCells[((size_t)y * fieldWidth) + (size_t)x])
+            continue;
+
+        particleX[particleCount] = fieldOriginX + (x * fieldResolution);
+        particleY[particleCount] = fieldOriginY + (y * fieldResolution);
+        particleYaw[particleCount] = (uniform(random) * 2.0f - 1.0f) * (float)M_PI;
+        particleCount++;
+    }
+
+    if (particleCount == 0) {
+        printf("Cannot initialize globally. The map has no free space\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < particleCount; i++)
+        particleWeight[i] = 1.0f / particleCount;
+    computeEstimate();
+    return true;
+}
+
+void ParticleFilter::predict(const Pose2D& odometryDelta) {
+    // Odometry motion model: rotate, translate, rotate. Reversing is a negative translation, not a half turn
+    float translation = std::sqrt((odometryDelta.x * odometryDelta.x) + (odometryDelta.y * odometryDelta.y));
+    float rotation1 = (translation > 0.001f) ? std::atan2(odometryDelta.y, odometryDelta.x) : 0.0f;
+    if ((translation > 0.001f) && (odometryDelta.x < 0.0f)) {
+        translation = -translation;
+        rotation1 = Pose2D::wrapAngle(rotation1 + (float)M_PI);
+    }
+    const float rotation2 = Pose2D::wrapAngle(odometryDelta.yaw - rotation1);
+
+    const float absTranslation = std::fabs(translation);
+    const float rotation1Std = (config.rotationFromRotation * std::fabs(rotation1)) + (config.rotationFromTranslation * absTranslation);
+    const float rotation2Std = (config.rotationFromRotation * std::fabs(rotation2)) + (config.rotationFromTranslation * absTranslation);
+    const float translationStd = (config.translationFromTranslation * absTranslation) +
+        (config.translationFromRotation * (std::fabs(rotation1) + std::fabs(rotation2)));
+
+    for (size_t i = 0; i < particleCount; i++) {
+        const float noisyRotation1 = rotation1 + (normal(random) * rotation1Std);
+        const float noisyTranslation = translation + (normal(random) * translationStd);
+        const float noisyRotation2 = rotation2 + (normal(random) * rotation2Std);
+
+        float s, c;
+        FastMath::sinCos(particleYaw[i] + noisyRotation1, s, c);
+        particleX[i] += noisyTranslation * c;
+        particleY[i] += noisyTranslation * s;
+        particleYaw[i] = Pose2D::wrapAngle(particleYaw[i] + noisyRotation1 + noisyRotation2);
+    }
+}
+
+void ParticleFilter::weighParticles(const size_t begin, const size_t end) {
+    const float* field = this->field.get();
+    const uint32_t width = fieldWidth;
+    const uint32_t height = fieldHeight;
+    const UIntVector widths = {width, width, width, width};
+    const UIntVector heights = {height, height, height, height};
+    const IntVector lanes = {0, 1, 2, 3};
+    const IntVector beamCounts = {(int32_t)beamCount, (int32_t)beamCount, (int32_t)beamCount, (int32_t)beamCount};
+    const int32_t outsideCell = (int32_t)(width * height);
+    const size_t beamVectors = (beamCount + SIMD_WIDTH - 1) / SIMD_WIDTH;
+
+    for (size_t i = begin; i < end; i++) {
+        float s, c;
+        FastMath::sinCos(particleYaw[i], s, c);
+        const float originX = (particleX[i] - fieldOriginX) * fieldInvResolution;
+        const float originY = (particleY[i] - fieldOriginY) * fieldInvResolution;
+        const float scaledC = c * fieldInvResolution;
+        const float scaledS = s * fieldInvResolution;
+        const FloatVector originXs = {originX, originX, originX, originX};
+        const FloatVector originYs = {originY, originY, originY, originY};
+        const FloatVector scaledCs = {scaledC, scaledC, scaledC, scaledC};
+        const FloatVector scaledSs = {scaledS, scaledS, scaledS, scaledS};
+
+        // 4 beams per vector: transform into field cells and bounds check together, beams off the map point at the
+        // extra cell past the end. The lookups are one by one (there's no gather on NEON). Lanes past beamCount (the
+        // padding of the last vector) add nothing
+        FloatVector logLikelihoods = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (size_t v = 0; v < beamVectors; v++) {
+            FloatVector beamXs, beamYs;
+            memcpy(&beamXs, &beamX[v * SIMD_WIDTH], sizeof(FloatVector));
+            memcpy(&beamYs, &beamY[v * SIMD_WIDTH], sizeof(FloatVector));
+
+            const IntVector cellX = __builtin_convertvector(originXs + (scaledCs * beamXs) - (scaledSs * beamYs), IntVector);
+            const IntVector cellY = __builtin_convertvector(originYs + (scaledSs * beamXs) + (scaledCs * beamYs), IntVector);
+            const IntVector inside = ((UIntVector)cellX < widths) & ((UIntVector)cellY < heights);
+            const IntVector used = (lanes + (int32_t)(v * SIMD_WIDTH)) < beamCounts;
+            const IntVector cells = inside ? ((cellY * (int32_t)width) + cellX) : outsideCell;
+
+            const FloatVector values = {field[cells[0]], field[cells[1]], field[cells[2]], field[cells[3]]};
+            logLikelihoods += used ? values : 0.0f;
+        }
+        particleLogLikelihood[i] = logLikelihoods[0] + logLikelihoods[1] + logLikelihoods[2] + logLikelihoods[3];
+    }
+}
+
+void ParticleFilter::weighParticlesJob(void* context, const size_t begin, const size_t end) {
+    static_cast<ParticleFilter*>(context)->weighParticles(begin, end);
+}
+
+bool ParticleFilter::addToBin(const float x, const float y, const float yaw) {
+    const int64_t binX = (int64_t)std::floor(x / config.kldBinSize);
+    const int64_t binY = (int64_t)std::floor(y / config.kldBinSize);
+    const int64_t binYaw = (int64_t)std::floor(yaw / config.kldBinYaw);
+    const uint64_t key = ((uint64_t)(binX & 0xFFFFFF) << 40) | ((uint64_t)(binY & 0xFFFFFF) << 16) | (uint64_t)(binYaw & 0xFFFF);
+
+    size_t slot = ((key * 0x9E3779B97F4A7C15ull) >> 40) & binMask;
+    while (binStamps[slot] == binStamp) {
+        if (binKeys[slot] == key)
+            return false;
+        slot = (slot + 1) & binMask;
+    }
+    binStamps[slot] = binStamp;
+    binKeys[slot] = key;
+    return true;
+}
+
+size_t ParticleFilter::kldRequiredParticles(const size_t occupiedBins) const {
+    if (occupiedBins <= 1)
+        return config.minParticles;
+
+    // Fox, "KLD-Sampling: Adaptive Particle Filters"
+    const float k = (float)(occupiedBins - 1);
+    const float a = 2.0f / (9.0f * k);
+    const float b = 1.0f - a + (std::sqrt(a) * config.kldZ);
+    return (size_t)std::ceil((k / (2.0f * config.kldEpsilon)) * b * b * b);
+}
+
+void ParticleFilter::resample() {
+    float total = 0.0f;
+    for (size_t i = 0; i < particleCount; i++) {
+        total += particleWeight[i];
+        cumulativeWeight[i] = total;
+    }
+
+    binStamp++;
+    size_t occupiedBins = 0;
+    const size_t limit = std::max(config.minParticles, std::min(config.maxParticles, deadlineParticles));
+
+    // Draw until there are enough particles for the spread of the bins they fall in
+    size_t drawn = 0;
+    while (drawn < limit) {
+        const float target = uniform(random) * total;
+        const size_t source = std::min((size_t)(std::upper_bound(cumulativeWeight.get(), cumulativeWeight.get() + particleCount, target) -
+            cumulativeWeight.get()), particleCount - 1);
+
+        nextX[drawn] = particleX[source];
+        nextY[drawn] = particleY[source];
+        nextYaw[drawn] = particleYaw[source];
+        drawn++;
+
+        if (addToBin(particleX[source], particleY[source], particleYaw[source]))
+            occupiedBins++;
+        if ((drawn >= config.minParticles) && (drawn >= kldRequiredParticles(occupiedBins)))
+            break;
+    }
+
+    particleX.swap(nextX);
+    particleY.swap(nextY);
+    particleYaw.swap(nextYaw);
+    particleCount = drawn;
+    for (size_t i = 0; i < particleCount; i++)
+        particleWeight[i] = 1.0f / particleCount;
+
+    stats.resamples++;
+}
+
+void ParticleFilter::computeEstimate() {
+    float total = 0.0f, meanX = 0.0f, meanY = 0.0f, sumSin = 0.0f, sumCos = 0.0f;
+    for (size_t i = 0; i < particleCount; i++) {
+        const float weight = particleWeight[i];
+        float s, c;
+        FastMath::sinCos(particleYaw[i], s, c);
+        total += weight;
+        meanX += weight * particleX[i];
+        meanY += weight * particleY[i];
+        sumSin += weight * s;
+        sumCos += weight * c;
+    }
+    if (total <= 0.0f)
+        return;
+    meanX /= total;
+    meanY /= total;
+    const float meanYaw = std::atan2(sumSin, sumCos);
+
+    float varianceX = 0.0f, varianceY = 0.0f, varianceYaw = 0.0f;
+    for (size_t i = 0; i < particleCount; i++) {
+        const float weight = particleWeight[i];
+        const float dx = particleX[i] - meanX;
+        const float dy = particleY[i] - meanY;
+        const float dyaw = Pose2D::wrapAngle(particleYaw[i] - meanYaw);
+        varianceX += weight * dx * dx;
+        varianceY += weight * dy * dy;
+        varianceYaw += weight * dyaw * dyaw;
+    }
+
+    estimate.pose = Pose2D(meanX, meanY, meanYaw);
+    estimate.stdX = std::sqrt(varianceX / total);
+    estimate.stdY = std::sqrt(varianceY / total);
+    estimate.stdYaw = std::sqrt(varianceYaw / total);
+    estimate.particleCount = particleCount;
+}
+
+void ParticleFilter::runUpdate() {
+    if (!field || (particleCount == 0) || (beamCount == 0))
+        return;
+
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    workers.run(weighParticlesJob, this, particleCount, 64);
+
+    const uint64_t weightingNsecs = TimeStamp::getMonotonic() - startTime;
+    stats.totalWeightingNsecs += weightingNsecs;
+    stats.beamEvaluations += (uint64_t)particleCount * beamCount;
+
+    // Next scan's particle cap, leave a quarter of the deadline for everything else
+    const float measured = (float)weightingNsecs / particleCount;
+    nsecsPerParticle = (nsecsPerParticle == 0.0f) ? measured : ((0.8f * nsecsPerParticle) + (0.2f * measured));
+    deadlineParticles = (size_t)((config.deadlineNsecs * 0.75f) / nsecsPerParticle);
+
+    // Weights, relative to the best particle so exp() can't underflow them all
+    float maxLogLikelihood = -INFINITY;
+    for (size_t i = 0; i < particleCount; i++)
+        maxLogLikelihood = std::max(maxLogLikelihood, particleLogLikelihood[i]);
+    float total = 0.0f;
+    for (size_t i = 0; i < particleCount; i++) {
+        particleWeight[i] *= std::exp((particleLogLikelihood[i] - maxLogLikelihood) * config.scanLikelihoodScale);
+        total += particleWeight[i];
+    }
+    float sumSquared = 0.0f;
+    for (size_t i = 0; i < particleCount; i++) {
+        particleWeight[i] /= total;
+        sumSquared += particleWeight[i] * particleWeight[i];
+    }
+
+    computeEstimate();
+
+    // Resample when the weights have degenerated, or the particle count is over the deadline cap
+    const float effectiveParticles = 1.0f / sumSquared;
+    if ((effectiveParticles < (config.resampleThreshold * particleCount)) || (particleCount > deadlineParticles))
+        resample();
+
+    const uint64_t elapsed = TimeStamp::getMonotonic() - startTime;
+    stats.scans++;
+    stats.totalUpdateNsecs += elapsed;
+    if (elapsed > stats.maxUpdateNsecs)
+        stats.maxUpdateNsecs = elapsed;
+}
+
+void ParticleFilter::update(const LD19::LidarPoint* points, const size_t count) {
+    const size_t wanted = std::min(config.beamCount, MAX_BEAMS);
+    const float maxRangeMillimeters = config.maxRange * 1000.0f;
+
+    size_t validCount = 0;
+    for (size_t i = 0; i < count; i++)
+        validCount += (points[i].distance > 0) && (points[i].distance <= maxRangeMillimeters);
+
+    // Evenly spaced subset of the valid points
+    beamCount = 0;
+    size_t validIndex = 0;
+    for (size_t i = 0; (i < count) && (beamCount < wanted); i++) {
+        if ((points[i].distance == 0) || (points[i].distance > maxRangeMillimeters))
+            continue;
+        if (((validIndex++ * wanted) % validCount) < wanted) {
+            config.lidarMount.transformPoint(points[i].getXMeters(), points[i].getYMeters(), beamX[beamCount], beamY[beamCount]);
+            beamCount++;
+        }
+    }
+
+    runUpdate();
+}
+
+void ParticleFilter::update(const float* xs, const float* ys, const size_t count) {
+    const size_t wanted = std::min(config.beamCount, MAX_BEAMS);
+    const float maxRangeSquared = config.maxRange * config.maxRange;
+    auto isValid = [&](const size_t i) {
+        const float rangeSquared = (xs[i] * xs[i]) + (ys[i] * ys[i]);
+        return !std::isnan(rangeSquared) && (rangeSquared > 0.0f) && (rangeSquared <= maxRangeSquared);
+    };
+
+    size_t validCount = 0;
+    for (size_t i = 0; i < count; i++)
+        validCount += isValid(i);
+
+    beamCount = 0;
+    size_t validIndex = 0;
+    for (size_t i = 0; (i < count) && (beamCount < wanted); i++) {
+        if (!isValid(i))
+            continue;
+        if (((validIndex++ * wanted) % validCount) < wanted) {
+            config.lidarMount.transformPoint(xs[i], ys[i], beamX[beamCount], beamY[beamCount]);
+            beamCount++;
+        }
+    }
+
+    runUpdate();
+}
+
+void ParticleFilter::printStats() const {
+    printf("ParticleFilter: %llu scans, %llu resamples, mean %llu us/scan, max %llu us/scan, %zu particles (deadline cap %zu)\n",
+        (unsigned long long)stats.scans, (unsigned long long)stats.resamples,
+        (unsigned long long)(stats.scans ? (stats.totalUpdateNsecs / stats.scans / NSECS_TO_USECS) : 0),
+        (unsigned long long)(stats.maxUpdateNsecs / NSECS_TO_USECS), particleCount, deadlineParticles);
+    printf("  %.1f M particle x beam evaluations per second\n", stats.getBeamEvaluationsPerSec() / 1e6);
+}
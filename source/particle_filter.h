@@ -0,0 +1,178 @@
+#ifndef __PARTICLE_FILTER_H__
+#define __PARTICLE_FILTER_H__
+
+// Monte Carlo localization against a prebuilt map (e.g. an OccupancyGrid recorded on a previous lap)
+// The map is turned into a likelihood field once (distance transform to the nearest obstacle), so weighting a
+// particle is one table lookup per beam. Particles are stored as structure of arrays and weighted in parallel on a
+// WorkerPool, each particle's beams 4 at a time with GCC vector extensions (NEON on the Pi, SSE on x86). The particle
+// count adapts with KLD sampling, capped by what fits in the per-scan deadline.
+//
+// Per scan:
+//   filter.predict(odometryDelta);  // Motion since the last scan in the vehicle frame, e.g. from PoseEstimator
+//   filter.update(points, count);
+//   filter.getEstimate();
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+#include <random>
+
+#include "fhl_ld19.h"
+#include "pose2d.h"
+#include "occupancy_grid.h"
+#include "worker_pool.h"
+
+class ParticleFilter {
+public:
+    static const size_t MAX_BEAMS = 256;
+
+    struct Config {
+        size_t maxParticles = 20000;
+        size_t minParticles = 200;
+        size_t beamCount = 60;                  // Beams used per scan, evenly subsampled
+
+        // Likelihood field model
+        float sigmaHit = 0.1f;                  // Meters
+        float maxDistance = 1.0f;               // Meters, distance transform is clamped to this
+        float zHit = 0.9f;
+        float zRandom = 0.1f;
+        float scanLikelihoodScale = 0.25f;      // Beams aren't independent, this tempers a scan so it can't collapse the particles
+        float maxRange = 12.0f;                 // Meters, longer beams are ignored
+        Pose2D lidarMount;                      // Lidar pose in the vehicle frame
+
+        // Map cells above this are obstacles, below freeLogOdds they're somewhere the car can be
+        int8_t occupiedLogOdds = 20;
+        int8_t freeLogOdds = -20;
+
+        // Odometry motion noise (Probabilistic Robotics alphas)
+        float rotationFromRotation = 0.2f;
+        float rotationFromTranslation = 0.1f;   // rad/m
+        float translationFromTranslation = 0.1f;
+        float translationFromRotation = 0.05f;  // m/rad
+
+        // KLD sampling, bins are binSize x binSize x binYaw
+        float kldEpsilon = 0.05f;
+        float kldZ = 2.33f;                     // Upper 1% quantile of the standard normal
+        float kldBinSize = 0.25f;               // Meters
+        float kldBinYaw = 0.175f;               // Radians (10 degrees)
+
+        float resampleThreshold = 0.5f;         // Resample when the effective sample size drops below this fraction
+        uint64_t deadlineNsecs = 30 * 1000000ull; // Per scan sensor update budget
+        size_t numThreads = 3;                  // Extra weighting threads, the calling thread also works
+        uint32_t seed = 1;
+    };
+
+    struct Estimate {
+        Pose2D pose;
+        float stdX;                             // Meters
+        float stdY;
+        float stdYaw;                           // Radians
+        size_t particleCount;
+    };
+
+    struct Stats {
+        uint64_t scans;
+        uint64_t resamples;
+        uint64_t beamEvaluations;               // Particles x beams
+        uint64_t totalUpdateNsecs;
+        uint64_t maxUpdateNsecs;
+        uint64_t totalWeightingNsecs;
+
+        // The benchmark figure, particle x beam evaluations per second of weighting
+        double getBeamEvaluationsPerSec() const { return totalWeightingNsecs ? (beamEvaluations * 1e9 / totalWeightingNsecs) : 0.0; }
+    };
+
+private:
+    static const size_t SIMD_WIDTH = 4;
+    typedef float FloatVector __attribute__((vector_size(16)));
+    typedef int32_t IntVector __attribute__((vector_size(16)));
+    typedef uint32_t UIntVector __attribute__((vector_size(16)));
+
+    const Config config;
+
+    // Likelihood field, log likelihood per cell (row major) and one more cell past the end for off the map
+    std::unique_ptr<float[]> field;
+    std::unique_ptr<uint8_t[]> freeCells;
+    int32_t fieldWidth = 0;
+    int32_t fieldHeight = 0;
+    float fieldOriginX = 0.0f;
+    float fieldOriginY = 0.0f;
+    float fieldResolution = 0.05f;
+    float fieldInvResolution = 20.0f;
+    float outsideLogLikelihood = 0.0f;
+
+    // Particles (structure of arrays), double buffered for resampling
+    std::unique_ptr<float[]> particleX;
+    std::unique_ptr<float[]> particleY;
+    std::unique_ptr<float[]> particleYaw;
+    std::unique_ptr<float[]> particleWeight;
+    std::unique_ptr<float[]> particleLogLikelihood;
+    std::unique_ptr<float[]> nextX;
+    std::unique_ptr<float[]> nextY;
+    std::unique_ptr<float[]> nextYaw;
+    std::unique_ptr<float[]> cumulativeWeight;
+    size_t particleCount = 0;
+
+    // Adaptive particle cap from the measured weighting cost
+    size_t deadlineParticles;
+    float nsecsPerParticle = 0.0f;
+
+    // KLD histogram (open addressing, a slot is empty unless its stamp matches the current resample)
+    std::unique_ptr<uint64_t[]> binKeys;
+    std::unique_ptr<uint32_t[]> binStamps;
+    size_t binMask = 0;
+    uint32_t binStamp = 0;
+
+    // Subsampled beams of the current scan in the vehicle frame, zero padded to whole vectors
+    float beamX[MAX_BEAMS + SIMD_WIDTH] = {};
+    float beamY[MAX_BEAMS + SIMD_WIDTH] = {};
+    size_t beamCount = 0;
+
+    std::mt19937 random;
+    std::normal_distribution<float> normal{0.0f, 1.0f};
+    std::uniform_real_distribution<float> uniform{0.0f, 1.0f};
+
+    WorkerPool workers;
+    Estimate estimate = {};
+    Stats stats = {};
+
+    void weighParticles(const size_t begin, const size_t end);
+    static void weighParticlesJob(void* context, const size_t begin, const size_t end);
+
+    bool addToBin(const float x, const float y, const float yaw);
+    size_t kldRequiredParticles(const size_t occupiedBins) const;
+    void resample();
+    void computeEstimate();
+    void runUpdate();
+
+public:
+    ParticleFilter();
+    ParticleFilter(const Config& config);
+
+    // Builds the likelihood field from the map's obstacles. Returns false if the map is empty
+    bool setMap(const OccupancyGrid& grid);
+
+    // Particles around a known pose, or spread over all the free space of the map. Global initialization needs a lot of
+    // particles to have one close to the truth (tens of thousands for a room sized track), KLD sampling shrinks the
+    // count once they converge
+    void initialize(const Pose2D& pose, const float stdXY, const float stdYaw);
+    bool initializeGlobal(const size_t count);
+
+    // Moves the particles by the odometry since the last call (vehicle frame), with noise
+    void predict(const Pose2D& odometryDelta);
+
+    // Weighs the particles against a scan (raw, or lidar frame points in meters e.g. from ScanDeskew) and resamples
+    void update(const LD19::LidarPoint* points, const size_t count);
+    void update(const float* xs, const float* ys, const size_t count);
+
+    const Estimate& getEstimate() const { return estimate; }
+    size_t getParticleCount() const { return particleCount; }
+
+    // Pins the weighting threads, see WorkerPool::setRealtime()
+    bool setRealtime(const int priority, const int firstCpuCore) { return workers.setRealtime(priority, firstCpuCore); }
+
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "periodic_timer.h"
+
+const uint64_t PeriodicTimer::jitterBucketLimitsNsecs[] = {10000, 25000, 50000, 100000, 250000, 500000, 1000000};
+
+uint64_t PeriodicTimer::Stats::getMeanJitterNsecs() const {
+    const uint64_t wakeups = periods - overruns;
+    return wakeups ? (totalJitterNsecs / wakeups) : 0;
+}
+
+bool PeriodicTimer::configureRealtime(const int priority, const int cpuCore, const bool lockMemory) {
+    bool success = Realtime::configureThread(pthread_self(), priority, cpuCore);
+    if (lockMemory)
+        success = Realtime::lockMemory() && success;
+    return success;
+}
+
+void PeriodicTimer::start() {
+    nextDeadlineNsecs = TimeStamp::getMonotonic() + periodNsecs;
+}
+
+bool PeriodicTimer::waitNextPeriod() {
+    if (nextDeadlineNsecs == 0)
+        start();
+
+    stats.periods++;
+
+    uint64_t now = TimeStamp::getMonotonic();
+    if (now >= nextDeadlineNsecs) {
+        // Overran the period, count every deadline we blew through and realign to the next one in the future
+        const uint64_t missed = ((now - nextDeadlineNsecs) / periodNsecs) + 1;
+        stats.overruns++;
+        stats.missedDeadlines += missed;
+        nextDeadlineNsecs += missed * periodNsecs;
+        return false;
+    }
+
+    struct timespec deadline;
+    deadline.tv_sec = nextDeadlineNsecs / NSECS_TO_SECS;
+    deadline.tv_nsec = nextDeadlineNsecs % NSECS_TO_SECS;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {}
+
+    // Wakeup jitter
+    now = TimeStamp::getMonotonic();
+    const uint64_t jitterNsecs = (now > nextDeadlineNsecs) ? (now - nextDeadlineNsecs) : 0;
+    stats.totalJitterNsecs += jitterNsecs;
+    if (jitterNsecs > stats.maxJitterNsecs)
+        stats.maxJitterNsecs = jitterNsecs;
+
+    size_t bucket = 0;
+    while (bucket < (NUM_JITTER_BUCKETS - 1) && jitterNsecs >= jitterBucketLimitsNsecs[bucket])
+        bucket++;
+    stats.jitterBuckets[bucket]++;
+
+    nextDeadlineNsecs += periodNsecs;
+    return true;
+}
+
+void PeriodicTimer::printStats() const {
+    printf("Periods: %llu, overruns: %llu, missed deadlines: %llu, jitter mean: %llu us, max: %llu us\n",
+        (unsigned long long)stats.periods, (unsigned long long)stats.overruns, (unsigned long long)stats.missedDeadlines,
+        (unsigned long long)(stats.getMeanJitterNsecs() / NSECS_TO_USECS), (unsigned long long)(stats.maxJitterNsecs / NSECS_TO_USECS));
+
+    for (size_t bucket = 0; bucket < NUM_JITTER_BUCKETS; bucket++) {
+        if (bucket < (NUM_JITTER_BUCKETS - 1))
+            printf("  < %4llu us: %llu\n", (unsigned long long)(jitterBucketLimitsNsecs[bucket] / NSECS_TO_USECS), (unsigned long long)stats.jitterBuckets[bucket]);
+        else
+            printf(" >= %4llu us: %llu\n", (unsigned long long)(jitterBucketLimitsNsecs[bucket - 1] / NSECS_TO_USECS), (unsigned long long)stats.jitterBuckets[bucket]);
+    }
+}
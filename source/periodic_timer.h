@@ -0,0 +1,62 @@
+#ifndef __PERIODIC_TIMER_H__
+#define __PERIODIC_TIMER_H__
+
+// Runs a loop at a fixed rate using absolute deadlines on CLOCK_MONOTONIC, so the period doesn't drift with the
+// amount of work done in each iteration. Keeps track of missed deadlines and wakeup jitter.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "realtime.h"
+#include "timestamp.h"
+
+class PeriodicTimer {
+public:
+    static const size_t NUM_JITTER_BUCKETS = 8;
+
+    // Upper limit (exclusive, nanoseconds) of each jitter bucket. The last bucket holds everything else
+    static const uint64_t jitterBucketLimitsNsecs[NUM_JITTER_BUCKETS - 1];
+
+    struct Stats {
+        uint64_t periods;           // Number of times waitNextPeriod() was called
+        uint64_t overruns;          // Number of times waitNextPeriod() was called after its deadline
+        uint64_t missedDeadlines;   // Number of deadlines skipped because of overruns
+        uint64_t maxJitterNsecs;    // Worst wakeup latency
+        uint64_t totalJitterNsecs;  // For calculating the mean
+        uint64_t jitterBuckets[NUM_JITTER_BUCKETS];
+
+        uint64_t getMeanJitterNsecs() const;
+    };
+
+private:
+    const uint64_t periodNsecs;
+
+    // Next absolute deadline on CLOCK_MONOTONIC
+    uint64_t nextDeadlineNsecs = 0;
+
+    Stats stats = {};
+
+public:
+    PeriodicTimer(const uint64_t periodNsecs) : periodNsecs(periodNsecs) {}
+
+    // Optionally give the calling thread SCHED_FIFO priority, pin it to a core and lock memory (see realtime.h)
+    bool configureRealtime(const int priority, const int cpuCore, const bool lockMemory);
+
+    // Sets the first deadline one period from now. Called automatically by the first waitNextPeriod()
+    void start();
+
+    // Sleeps until the next deadline. Returns false if one or more deadlines were already missed, in which case it
+    // returns immediately and skips ahead to the next deadline that is still in the future
+    bool waitNextPeriod();
+
+    uint64_t getPeriodNsecs() const { return periodNsecs; }
+
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = {}; }
+    void printStats() const;
+};
+
+#endif
@@ -0,0 +1,243 @@
+#include "point_index.h"
+
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+#include "timestamp.h"
+
+PointIndex::PointIndex() : PointIndex(Config()) {}
+
+PointIndex::PointIndex(const Config& config) :
+    config(config),
+    invCellSize(1.0f / config.cellSize),
+    stagedX(new float[config.maxPoints]),
+    stagedY(new float[config.maxPoints]),
+    stagedIndex(new uint32_t[config.maxPoints]),
+    stagedBucket(new uint32_t[config.maxPoints]),
+    sortedX(new float[config.maxPoints]),
+    sortedY(new float[config.maxPoints]),
+    sortedCell(new uint64_t[config.maxPoints]),
+    sortedIndex(new uint32_t[config.maxPoints]) {
+
+    // At least twice as many buckets as points
+    maxBuckets = 16;
+    while (maxBuckets < (2 * config.maxPoints))
+        maxBuckets *= 2;
+    bucketStart.reset(new uint32_t[maxBuckets + 1]);
+    bucketFill.reset(new uint32_t[maxBuckets]);
+
+    bucketMask = 0;
+    bucketStart[0] = 0;
+    bucketStart[1] = 0;
+}
+
+void PointIndex::stagePoint(const float x, const float y, const uint32_t index) {
+    if (count >= config.maxPoints)
+        return;
+    stagedX[count] = x;
+    stagedY[count] = y;
+    stagedIndex[count] = index;
+    count++;
+}
+
+void PointIndex::finishBuild(const uint64_t startTime) {
+    // Bucket count scales with the points so the build stays O(n)
+    size_t bucketCount = 16;
+    while ((bucketCount < (2 * count)) && (bucketCount < maxBuckets))
+        bucketCount *= 2;
+    bucketMask = bucketCount - 1;
+
+    // Counting sort by bucket
+    memset(bucketStart.get(), 0, (bucketCount + 1) * sizeof(uint32_t));
+    minCellX = INT32_MAX;
+    maxCellX = INT32_MIN;
+    minCellY = INT32_MAX;
+    maxCellY = INT32_MIN;
+    for (size_t i = 0; i < count; i++) {
+        const int32_t cellX = toCell(stagedX[i]);
+        const int32_t cellY = toCell(stagedY[i]);
+        minCellX = std::min(minCellX, cellX);
+        maxCellX = std::max(maxCellX, cellX);
+        minCellY = std::min(minCellY, cellY);
+        maxCellY = std::max(maxCellY, cellY);
+
+        const size_t bucket = hashCell(cellX, cellY);
+        stagedBucket[i] = bucket;
+        bucketStart[bucket + 1]++;
+    }
+    for (size_t bucket = 0; bucket < bucketCount; bucket++)
+        bucketStart[bucket + 1] += bucketStart[bucket];
+    memcpy(bucketFill.get(), bucketStart.get(), bucketCount * sizeof(uint32_t));
+
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t slot = bucketFill[stagedBucket[i]]++;
+        sortedX[slot] = stagedX[i];
+        sortedY[slot] = stagedY[i];
+        sortedCell[slot] = cellKey(toCell(stagedX[i]), toCell(stagedY[i]));
+        sortedIndex[slot] = stagedIndex[i];
+    }
+
+    const uint64_t elapsed = TimeStamp::getMonotonic() - startTime;
+    stats.builds++;
+    stats.pointsIndexed += count;
+    stats.totalBuildNsecs += elapsed;
+    if (elapsed > stats.maxBuildNsecs)
+        stats.maxBuildNsecs = elapsed;
+}
+
+size_t PointIndex::build(const float* xs, const float* ys, const size_t count) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    this->count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!std::isnan(xs[i]) && !std::isnan(ys[i]))
+            stagePoint(xs[i], ys[i], i);
+    }
+    finishBuild(startTime);
+    return this->count;
+}
+
+size_t PointIndex::build(const LD19::LidarPoint* points, const size_t count) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    this->count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (points[i].distance > 0)
+            stagePoint(points[i].getXMeters(), points[i].getYMeters(), i);
+    }
+    finishBuild(startTime);
+    return this->count;
+}
+
+void PointIndex::searchCell(const int32_t cellX, const int32_t cellY, const float x, const float y,
+    float& bestDistanceSquared, int32_t& best) const {
+    const uint64_t key = cellKey(cellX, cellY);
+    const size_t bucket = hashCell(cellX, cellY);
+    for (uint32_t slot = bucketStart[bucket]; slot < bucketStart[bucket + 1]; slot++) {
+        if (sortedCell[slot] != key)
+            continue;
+        const float dx = sortedX[slot] - x;
+        const float dy = sortedY[slot] - y;
+        const float distanceSquared = (dx * dx) + (dy * dy);
+        if (distanceSquared < bestDistanceSquared) {
+            bestDistanceSquared = distanceSquared;
+            best = sortedIndex[slot];
+        }
+    }
+}
+
+int32_t PointIndex::nearest(const float x, const float y, const float maxDistance, float* distance) const {
+    float bestDistanceSquared = maxDistance * maxDistance;
+    int32_t best = NOT_FOUND;
+    if (count == 0) {
+        if (distance)
+            *distance = INFINITY;
+        return NOT_FOUND;
+    }
+
+    const int32_t cellX = toCell(x);
+    const int32_t cellY = toCell(y);
+
+    // Rings before the nearest and past the furthest populated cell are empty, whatever maxDistance allows
+    const int32_t minRing = std::max(std::max(std::max(minCellX - cellX, cellX - maxCellX),
+        std::max(minCellY - cellY, cellY - maxCellY)), 0);
+    const int32_t extentRing = std::max(std::max(std::abs(cellX - minCellX), std::abs(cellX - maxCellX)),
+        std::max(std::abs(cellY - minCellY), std::abs(cellY - maxCellY)));
+    const int32_t maxRing = (int32_t)std::min(std::ceil(maxDistance * invCellSize), (float)extentRing);
+
+    // How far the query is from the edge of its own cell, ring k's cells are at least (k - 1) cells further
+    const float fractionX = (x * invCellSize) - cellX;
+    const float fractionY = (y * invCellSize) - cellY;
+    const float edgeDistance = std::min(std::min(fractionX, 1.0f - fractionX), std::min(fractionY, 1.0f - fractionY)) * config.cellSize;
+
+    // Rings of cells outwards until they can't hold anything closer
+    for (int32_t ring = minRing; ring <= maxRing; ring++) {
+        if (ring > 0) {
+            const float ringDistance = edgeDistance + ((ring - 1) * config.cellSize);
+            if ((ringDistance * ringDistance) >= bestDistanceSquared)
+                break;
+        }
+
+        if (ring == 0) {
+            searchCell(cellX, cellY, x, y, bestDistanceSquared, best);
+            continue;
+        }
+
+        // Each side of the ring, clipped to the populated cells
+        const int32_t beginX = std::max(cellX - ring, minCellX);
+        const int32_t endX = std::min(cellX + ring, maxCellX);
+        for (int32_t sideX = beginX; sideX <= endX; sideX++) {
+            if ((cellY - ring) >= minCellY)
+                searchCell(sideX, cellY - ring, x, y, bestDistanceSquared, best);
+            if ((cellY + ring) <= maxCellY)
+                searchCell(sideX, cellY + ring, x, y, bestDistanceSquared, best);
+        }
+        const int32_t beginY = std::max(cellY - ring + 1, minCellY);
+        const int32_t endY = std::min(cellY + ring - 1, maxCellY);
+        for (int32_t sideY = beginY; sideY <= endY; sideY++) {
+            if ((cellX - ring) >= minCellX)
+                searchCell(cellX - ring, sideY, x, y, bestDistanceSquared, best);
+            if ((cellX + ring) <= maxCellX)
+                searchCell(cellX + ring, sideY, x, y, bestDistanceSquared, best);
+        }
+    }
+
+    if (distance)
+        *distance = (best != NOT_FOUND) ? std::sqrt(bestDistanceSquared) : INFINITY;
+    return best;
+}
+
+size_t PointIndex::radius(const float x, const float y, const float radius, uint32_t* indices, const size_t maxIndices) const {
+    const float radiusSquared = radius * radius;
+    const int32_t beginX = std::max(toCell(x - radius), minCellX);
+    const int32_t endX = std::min(toCell(x + radius), maxCellX);
+    const int32_t beginY = std::max(toCell(y - radius), minCellY);
+    const int32_t endY = std::min(toCell(y + radius), maxCellY);
+
+    size_t found = 0;
+    for (int32_t cellY = beginY; cellY <= endY; cellY++) {
+        for (int32_t cellX = beginX; cellX <= endX; cellX++) {
+            const uint64_t key = cellKey(cellX, cellY);
+            const size_t bucket = hashCell(cellX, cellY);
+            for (uint32_t slot = bucketStart[bucket]; slot < bucketStart[bucket + 1]; slot++) {
+                const float dx = sortedX[slot] - x;
+                const float dy = sortedY[slot] - y;
+                if ((sortedCell[slot] != key) || (((dx * dx) + (dy * dy)) > radiusSquared))
+                    continue;
+                if (found < maxIndices)
+                    indices[found] = sortedIndex[slot];
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+void PointIndex::nearest(const float* xs, const float* ys, const size_t count, const float maxDistance, int32_t* indices, float* distances) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    for (size_t i = 0; i < count; i++)
+        indices[i] = nearest(xs[i], ys[i], maxDistance, distances ? &distances[i] : nullptr);
+
+    stats.batchQueries += count;
+    stats.totalBatchNsecs += TimeStamp::getMonotonic() - startTime;
+}
+
+void PointIndex::countWithin(const float* xs, const float* ys, const size_t count, const float radius, uint32_t* counts) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    for (size_t i = 0; i < count; i++)
+        counts[i] = this->radius(xs[i], ys[i], radius, nullptr, 0);
+
+    stats.batchQueries += count;
+    stats.totalBatchNsecs += TimeStamp::getMonotonic() - startTime;
+}
+
+void PointIndex::printStats() const {
+    printf("PointIndex: %llu builds, %.0f points/build, mean %.1f us/build, max %.1f us/build, %.0f ns/batched query\n",
+        (unsigned long long)stats.builds, stats.builds ? ((double)stats.pointsIndexed / stats.builds) : 0.0,
+        stats.builds ? ((double)stats.totalBuildNsecs / stats.builds / NSECS_TO_USECS) : 0.0,
+        (double)stats.maxBuildNsecs / NSECS_TO_USECS,
+        stats.batchQueries ? ((double)stats.totalBatchNsecs / stats.batchQueries) : 0.0);
+}
@@ -0,0 +1,101 @@
+#ifndef __POINT_INDEX_H__
+#define __POINT_INDEX_H__
+
+// Spatial index for nearest neighbour and radius queries over a scan (or a few accumulated ones)
+// Points are bucketed into a flat grid hash and counting sorted by bucket, so a build is O(n) and every bucket's points
+// are contiguous. Queries only look at the cells around them (a bucket can hold several cells, points are checked
+// against their cell). All the memory is allocated once for maxPoints and reused by every build.
+//
+// Query results are indices into the arrays the index was built from.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+
+#include "fhl_ld19.h"
+
+class PointIndex {
+public:
+    static const int32_t NOT_FOUND = -1;
+
+    struct Config {
+        float cellSize = 0.1f;              // Meters, around the typical query radius
+        size_t maxPoints = 16384;           // Enough for a few dozen accumulated LD19 scans
+    };
+
+    struct Stats {
+        uint64_t builds;
+        uint64_t pointsIndexed;
+        uint64_t totalBuildNsecs;
+        uint64_t maxBuildNsecs;
+        uint64_t batchQueries;              // Points queried through the batched calls
+        uint64_t totalBatchNsecs;
+    };
+
+private:
+    const Config config;
+    const float invCellSize;
+
+    // Points of the build in progress
+    std::unique_ptr<float[]> stagedX;
+    std::unique_ptr<float[]> stagedY;
+    std::unique_ptr<uint32_t[]> stagedIndex;
+    std::unique_ptr<uint32_t[]> stagedBucket;
+
+    // Points sorted by bucket
+    std::unique_ptr<float[]> sortedX;
+    std::unique_ptr<float[]> sortedY;
+    std::unique_ptr<uint64_t[]> sortedCell;
+    std::unique_ptr<uint32_t[]> sortedIndex;
+    size_t count = 0;
+
+    // Bucket b's points are [bucketStart[b], bucketStart[b + 1])
+    std::unique_ptr<uint32_t[]> bucketStart;
+    std::unique_ptr<uint32_t[]> bucketFill;
+    size_t maxBuckets;
+    size_t bucketMask = 0;
+
+    // Cells with points in them are within [minCell, maxCell], queries don't look outside
+    int32_t minCellX = 0;
+    int32_t maxCellX = -1;
+    int32_t minCellY = 0;
+    int32_t maxCellY = -1;
+
+    Stats stats = {};
+
+    int32_t toCell(const float meters) const { return (int32_t)std::floor(meters * invCellSize); }
+    static uint64_t cellKey(const int32_t cellX, const int32_t cellY) { return ((uint64_t)(uint32_t)cellX << 32) | (uint32_t)cellY; }
+    size_t hashCell(const int32_t cellX, const int32_t cellY) const { return (((uint32_t)cellX * 73856093u) ^ ((uint32_t)cellY * 19349663u)) & bucketMask; }
+
+    void stagePoint(const float x, const float y, const uint32_t index);
+    void finishBuild(const uint64_t startTime);
+    void searchCell(const int32_t cellX, const int32_t cellY, const float x, const float y, float& bestDistanceSquared, int32_t& best) const;
+
+public:
+    PointIndex();
+    PointIndex(const Config& config);
+
+    // Rebuilds the index from points in meters (NaN points are skipped), or from an LD19 scan in the lidar frame (zero
+    // distance points are skipped). Points past maxPoints are dropped. Returns the number of points indexed
+    size_t build(const float* xs, const float* ys, const size_t count);
+    size_t build(const LD19::LidarPoint* points, const size_t count);
+
+    // Closest point within maxDistance, or NOT_FOUND. distance gets its distance if given. A large maxDistance only
+    // costs as much as the extent of the indexed points
+    int32_t nearest(const float x, const float y, const float maxDistance, float* distance = nullptr) const;
+
+    // Up to maxIndices points within radius, in no particular order. Returns how many were found (can be more than
+    // maxIndices, only the first maxIndices are stored)
+    size_t radius(const float x, const float y, const float radius, uint32_t* indices, const size_t maxIndices) const;
+
+    // Batched versions, e.g. every point of a new scan against the index of the previous one. distances is optional
+    void nearest(const float* xs, const float* ys, const size_t count, const float maxDistance, int32_t* indices, float* distances = nullptr);
+    void countWithin(const float* xs, const float* ys, const size_t count, const float radius, uint32_t* counts);
+
+    size_t getCount() const { return count; }
+
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+#endif
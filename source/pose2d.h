@@ -0,0 +1,45 @@
+#ifndef __POSE2D_H__
+#define __POSE2D_H__
+
+// Planar pose and the vehicle frame conventions used throughout
+// Vehicle frame: x forward, y left, yaw counter-clockwise (radians)
+
+#include <cmath>
+
+struct Pose2D {
+    float x = 0.0f;    // Meters
+    float y = 0.0f;    // Meters
+    float yaw = 0.0f;  // Radians
+
+    Pose2D() {}
+    Pose2D(const float x, const float y, const float yaw) : x(x), y(y), yaw(yaw) {}
+
+    // Transforms a point from this pose's frame into the parent frame
+    void transformPoint(const float inX, const float inY, float& outX, float& outY) const {
+        const float c = std::cos(yaw);
+        const float s = std::sin(yaw);
+        outX = x + (c * inX) - (s * inY);
+        outY = y + (s * inX) + (c * inY);
+    }
+
+    // this * other
+    Pose2D compose(const Pose2D& other) const {
+        Pose2D result;
+        transformPoint(other.x, other.y, result.x, result.y);
+        result.yaw = wrapAngle(yaw + other.yaw);
+        return result;
+    }
+
+    Pose2D inverse() const {
+        const float c = std::cos(yaw);
+        const float s = std::sin(yaw);
+        return Pose2D(-(c * x) - (s * y), (s * x) - (c * y), -yaw);
+    }
+
+    // Wraps an angle to [-pi, pi)
+    static float wrapAngle(const float angle) {
+        return angle - (2.0f * (float)M_PI) * std::floor((angle + (float)M_PI) / (2.0f * (float)M_PI));
+    }
+};
+
+#endif
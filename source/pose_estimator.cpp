@@ -0,0 +1,228 @@
+#include "pose_estimator.h"
+
+#include <string.h>
+
+PoseEstimator::PoseEstimator() : PoseEstimator(Config()) {}
+
+PoseEstimator::PoseEstimator(const Config& config) : config(config), droppedInputs(0), running(false) {
+    sem_init(&inputsAvailable, 0, 0);
+    memset(state, 0, sizeof(state));
+    memset(covariance, 0, sizeof(covariance));
+}
+
+PoseEstimator::~PoseEstimator() {
+    stop();
+    sem_destroy(&inputsAvailable);
+}
+
+void PoseEstimator::pushInput(const Input& input) {
+    if (inputs.push(input))
+        sem_post(&inputsAvailable);
+    else
+        droppedInputs++;
+}
+
+void PoseEstimator::addImuData(const MausBoard::ImuData& imuData) {
+    Input input;
+    input.type = Input::INPUT_IMU;
+    input.timestamp = imuData.timestamp;
+    input.a = imuData.getYawRadians();
+    input.b = imuData.gyroZ * config.gyroRadiansPerCount;
+    pushInput(input);
+}
+
+void PoseEstimator::addEscTelemetry(const MausBoard::EscTelemetry& escTelemetry, const uint16_t throttleMicros) {
+    const float speed = config.drivetrain.reportedERPMToMetersPerSec(escTelemetry.getERPM());
+    const bool reversing = throttleMicros < (config.throttleNeutralMicros - config.throttleDeadbandMicros);
+
+    Input input;
+    input.type = Input::INPUT_ESC;
+    input.timestamp = escTelemetry.timestamp;
+    input.a = reversing ? -speed : speed;
+    // ERPM is only reported under throttle, so 0 doesn't necessarily mean stopped
+    input.b = (escTelemetry.ERPM > 0) ? 1.0f : 0.0f;
+    pushInput(input);
+}
+
+void PoseEstimator::predict(const uint64_t timestamp) {
+    if (timestamp <= stateTimestamp)
+        return;
+
+    // Don't integrate across big gaps (e.g. the IMU stalled)
+    float dt = (float)(timestamp - stateTimestamp) * 1e-9f;
+    if (dt > 0.1f)
+        dt = 0.1f;
+    stateTimestamp = timestamp;
+
+    const float yaw = state[STATE_YAW];
+    const float speed = state[STATE_SPEED];
+    const float c = std::cos(yaw);
+    const float s = std::sin(yaw);
+
+    // Motion model, the gyro is treated as a control input
+    state[STATE_X] += speed * c * dt;
+    state[STATE_Y] += speed * s * dt;
+    state[STATE_YAW] = Pose2D::wrapAngle(yaw + ((lastGyro - state[STATE_GYRO_BIAS]) * dt));
+
+    // Jacobian
+    float F[STATE_SIZE][STATE_SIZE] = {};
+    for (size_t i = 0; i < STATE_SIZE; i++)
+        F[i][i] = 1.0f;
+    F[STATE_X][STATE_YAW] = -speed * s * dt;
+    F[STATE_X][STATE_SPEED] = c * dt;
+    F[STATE_Y][STATE_YAW] = speed * c * dt;
+    F[STATE_Y][STATE_SPEED] = s * dt;
+    F[STATE_YAW][STATE_GYRO_BIAS] = -dt;
+
+    // P = F * P * F^T + Q
+    float FP[STATE_SIZE][STATE_SIZE];
+    for (size_t i = 0; i < STATE_SIZE; i++) {
+        for (size_t j = 0; j < STATE_SIZE; j++) {
+            float sum = 0.0f;
+            for (size_t k = 0; k < STATE_SIZE; k++)
+                sum += F[i][k] * covariance[k][j];
+            FP[i][j] = sum;
+        }
+    }
+    for (size_t i = 0; i < STATE_SIZE; i++) {
+        for (size_t j = 0; j < STATE_SIZE; j++) {
+            float sum = 0.0f;
+            for (size_t k = 0; k < STATE_SIZE; k++)
+                sum += FP[i][k] * F[j][k];
+            covariance[i][j] = sum;
+        }
+    }
+
+    covariance[STATE_YAW][STATE_YAW] += (config.gyroNoise * dt) * (config.gyroNoise * dt);
+    covariance[STATE_SPEED][STATE_SPEED] += config.speedDrift * config.speedDrift * dt;
+    covariance[STATE_GYRO_BIAS][STATE_GYRO_BIAS] += config.gyroBiasDrift * config.gyroBiasDrift * dt;
+}
+
+void PoseEstimator::update(const size_t stateIndex, const float innovation, const float variance) {
+    // Scalar measurement of a single state, so H is a unit row and everything collapses to vectors
+    const float innovationVariance = covariance[stateIndex][stateIndex] + variance;
+    if (innovationVariance <= 0.0f)
+        return;
+
+    float gain[STATE_SIZE];
+    float row[STATE_SIZE];
+    for (size_t i = 0; i < STATE_SIZE; i++) {
+        gain[i] = covariance[i][stateIndex] / innovationVariance;
+        row[i] = covariance[stateIndex][i];
+    }
+
+    for (size_t i = 0; i < STATE_SIZE; i++) {
+        state[i] += gain[i] * innovation;
+        for (size_t j = 0; j < STATE_SIZE; j++)
+            covariance[i][j] -= gain[i] * row[j];
+    }
+    state[STATE_YAW] = Pose2D::wrapAngle(state[STATE_YAW]);
+}
+
+void PoseEstimator::process(const Input& input) {
+    if (input.type == Input::INPUT_IMU) {
+        if (!initialized) {
+            // Start at the origin facing along x
+            yawOffset = input.a;
+            memset(state, 0, sizeof(state));
+            memset(covariance, 0, sizeof(covariance));
+            covariance[STATE_YAW][STATE_YAW] = config.yawMeasurementNoise * config.yawMeasurementNoise;
+            covariance[STATE_SPEED][STATE_SPEED] = 1.0f;
+            covariance[STATE_GYRO_BIAS][STATE_GYRO_BIAS] = 0.01f;
+            stateTimestamp = input.timestamp;
+            lastGyro = input.b;
+            initialized = true;
+            return;
+        }
+
+        // Gyro is held from the previous sample over the interval
+        predict(input.timestamp);
+        lastGyro = input.b;
+
+        const float measuredYaw = Pose2D::wrapAngle(input.a - yawOffset);
+        update(STATE_YAW, Pose2D::wrapAngle(measuredYaw - state[STATE_YAW]), config.yawMeasurementNoise * config.yawMeasurementNoise);
+    } else if (input.type == Input::INPUT_ESC) {
+        if (!initialized)
+            return;
+
+        predict(input.timestamp);
+
+        const float noise = (input.b > 0.0f) ? config.speedMeasurementNoise : config.coastingSpeedNoise;
+        update(STATE_SPEED, input.a - state[STATE_SPEED], noise * noise);
+    }
+}
+
+void PoseEstimator::publish() {
+    Estimate estimate;
+    estimate.timestamp = stateTimestamp;
+    estimate.pose = Pose2D(state[STATE_X], state[STATE_Y], state[STATE_YAW]);
+    estimate.speed = state[STATE_SPEED];
+    estimate.yawRate = lastGyro - state[STATE_GYRO_BIAS];
+    estimate.gyroBias = state[STATE_GYRO_BIAS];
+    estimate.varianceX = covariance[STATE_X][STATE_X];
+    estimate.varianceY = covariance[STATE_Y][STATE_Y];
+    estimate.varianceYaw = covariance[STATE_YAW][STATE_YAW];
+    estimates.add(estimate.timestamp, estimate);
+
+    if (estimateCallback)
+        estimateCallback(estimate);
+}
+
+void PoseEstimator::estimatorLoop() {
+    while (running) {
+        sem_wait(&inputsAvailable);
+
+        Input input;
+        while (inputs.pop(input)) {
+            const uint64_t startTimestamp = TimeStamp::getMonotonic();
+
+            process(input);
+
+            // Pose goes out at IMU rate
+            if (input.type == Input::INPUT_IMU && initialized) {
+                publish();
+
+                const uint64_t now = TimeStamp::get();
+                if (now > input.timestamp && (now - input.timestamp) > stats.maxLatencyNsecs)
+                    stats.maxLatencyNsecs = now - input.timestamp;
+            }
+
+            const uint64_t updateNsecs = TimeStamp::getMonotonic() - startTimestamp;
+            stats.updates++;
+            stats.totalUpdateNsecs += updateNsecs;
+            if (updateNsecs > stats.maxUpdateNsecs)
+                stats.maxUpdateNsecs = updateNsecs;
+            stats.droppedInputs = droppedInputs;
+        }
+    }
+}
+
+bool PoseEstimator::start() {
+    if (!running) {
+        running = true;
+        estimatorThread = std::thread(&PoseEstimator::estimatorLoop, this);
+        return true;
+    } else {
+        printf("Cannot start pose estimator. Already running\n");
+        return false;
+    }
+}
+
+bool PoseEstimator::stop() {
+    if (running) {
+        running = false;
+        sem_post(&inputsAvailable);
+        estimatorThread.join();
+        return true;
+    }
+    return false;
+}
+
+bool PoseEstimator::getEstimate(Estimate& estimate) const {
+    uint64_t timestamp;
+    return estimates.getLatest(timestamp, estimate);
+}
+
+bool PoseEstimator::getEstimateAt(const uint64_t timestamp, Estimate& estimate) const {
+    return estimates.sample(timestamp, estimate);
+}
@@ -0,0 +1,146 @@
+#ifndef __POSE_ESTIMATOR_H__
+#define __POSE_ESTIMATOR_H__
+
+// Extended Kalman filter for the car's planar pose
+// State: x, y, yaw, speed and gyro z bias. Predicts with the gyro at IMU rate, corrects yaw with the DMP quaternion and
+// speed with ESC ERPM (signed by the throttle that was commanded, since ERPM is unsigned).
+// Runs on its own thread, the driver callbacks only push into a lock-free queue. All matrices are fixed size.
+//
+// Pose is relative to where the estimator started: x forward, y left, yaw counter-clockwise (see pose2d.h)
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <semaphore.h>
+
+#include "maus_board.h"
+#include "drivetrain.h"
+#include "pose2d.h"
+#include "sensor_history.h"
+#include "spsc_queue.h"
+
+class PoseEstimator {
+public:
+    struct Config {
+        Drivetrain drivetrain;
+
+        // DMP default gyro range is +-2000 deg/s (16.4 counts per deg/s)
+        float gyroRadiansPerCount = (float)(M_PI / 180.0) / 16.4f;
+
+        // ESC throttle pulse that means stopped, and how far from it still counts as stopped
+        uint16_t throttleNeutralMicros = 1500;
+        uint16_t throttleDeadbandMicros = 25;
+
+        // Noise (standard deviations)
+        float gyroNoise = 0.02f;            // rad/s
+        float gyroBiasDrift = 0.001f;       // rad/s per sqrt(s)
+        float speedDrift = 2.0f;            // m/s per sqrt(s)
+        float yawMeasurementNoise = 0.02f;  // rad
+        float speedMeasurementNoise = 0.1f; // m/s
+        float coastingSpeedNoise = 1.0f;    // m/s, used when ERPM is 0 (we're probably stopped, but could be coasting)
+    };
+
+    struct Estimate {
+        uint64_t timestamp; // Nanoseconds since epoch
+        Pose2D pose;
+        float speed;        // m/s, negative when reversing
+        float yawRate;      // rad/s, bias corrected
+        float gyroBias;     // rad/s
+        float varianceX;
+        float varianceY;
+        float varianceYaw;
+    };
+
+    struct Stats {
+        uint64_t updates;
+        uint64_t droppedInputs;     // Inputs lost because the queue was full
+        uint64_t totalUpdateNsecs;
+        uint64_t maxUpdateNsecs;
+        uint64_t maxLatencyNsecs;   // Measurement timestamp to estimate published
+
+        uint64_t getMeanUpdateNsecs() const { return updates ? (totalUpdateNsecs / updates) : 0; }
+    };
+
+private:
+    static const size_t STATE_SIZE = 5;
+    enum StateIndex { STATE_X = 0, STATE_Y, STATE_YAW, STATE_SPEED, STATE_GYRO_BIAS };
+
+    struct Input {
+        enum Type : uint8_t { INPUT_IMU, INPUT_ESC } type;
+        uint64_t timestamp;
+        float a; // IMU: quaternion yaw, ESC: signed speed
+        float b; // IMU: gyro z (rad/s), ESC: 1 if the speed measurement is trustworthy
+    };
+
+    const Config config;
+
+    // Filter state, only touched by the estimator thread
+    float state[STATE_SIZE];
+    float covariance[STATE_SIZE][STATE_SIZE];
+    uint64_t stateTimestamp = 0;
+    bool initialized = false;
+    float yawOffset = 0.0f; // First quaternion yaw, so we start at yaw 0
+    float lastGyro = 0.0f;
+
+    // Inputs from the driver thread
+    SpscQueue<Input, 256> inputs;
+    sem_t inputsAvailable;
+    std::atomic<uint64_t> droppedInputs;
+
+    // Published estimates
+    SensorHistory<Estimate, 256> estimates;
+
+    Stats stats = {};
+
+    std::atomic<bool> running;
+    std::thread estimatorThread;
+
+    void pushInput(const Input& input);
+    void predict(const uint64_t timestamp);
+    void update(const size_t stateIndex, const float innovation, const float variance);
+    void process(const Input& input);
+    void publish();
+    void estimatorLoop();
+
+public:
+    // Called from the estimator thread with every new estimate (optional, don't block in it)
+    void (*estimateCallback)(const Estimate&) = nullptr;
+
+    PoseEstimator();
+    PoseEstimator(const Config& config);
+    ~PoseEstimator();
+
+    // Feed from the MausBoard callbacks. These never block
+    void addImuData(const MausBoard::ImuData& imuData);
+    // throttleMicros is the throttle that was being commanded, see MausBoard::getLastThrottleMicros()
+    void addEscTelemetry(const MausBoard::EscTelemetry& escTelemetry, const uint16_t throttleMicros);
+
+    bool start();
+    bool stop();
+
+    // Latest estimate. Returns false if there isn't one yet
+    bool getEstimate(Estimate& estimate) const;
+
+    // Estimate interpolated at a timestamp (from the last 256 estimates)
+    bool getEstimateAt(const uint64_t timestamp, Estimate& estimate) const;
+
+    // Only read from the estimateCallback, or after stop()
+    const Stats& getStats() const { return stats; }
+};
+
+// Interpolation for SensorHistory
+template <>
+struct HistoryInterpolator<PoseEstimator::Estimate> {
+    static PoseEstimator::Estimate interpolate(const PoseEstimator::Estimate& a, const PoseEstimator::Estimate& b, const float t) {
+        PoseEstimator::Estimate result = (t < 0.5f) ? a : b;
+        result.timestamp = a.timestamp + (uint64_t)((b.timestamp - a.timestamp) * (double)t);
+        result.pose.x = a.pose.x + ((b.pose.x - a.pose.x) * t);
+        result.pose.y = a.pose.y + ((b.pose.y - a.pose.y) * t);
+        result.pose.yaw = Pose2D::wrapAngle(a.pose.yaw + (Pose2D::wrapAngle(b.pose.yaw - a.pose.yaw) * t));
+        result.speed = a.speed + ((b.speed - a.speed) * t);
+        return result;
+    }
+};
+
+#endif
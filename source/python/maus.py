@@ -0,0 +1,185 @@
+# ctypes wrapper for libmaus.so (see maus_c.h), build it with 'make libmaus.so' in source/
+#
+#   lidar = maus.Lidar()
+#   lidar.start()
+#   scan = lidar.next_scan()
+#   np.hypot(scan.x, scan.y).min()     # numpy views of the library's buffers, nothing copied
+#
+# Scan arrays are only valid until the next next_scan() or release_scan() on the same lidar, copy them (scan.x.copy())
+# to keep them longer.
+
+import ctypes
+import os
+
+import numpy as np
+
+WAIT_FOREVER = -1
+
+IMU_MODE_DMP = 0
+IMU_MODE_RAW = 1
+
+
+class ImuData(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [("timestamp", ctypes.c_uint64),
+                ("qX", ctypes.c_float), ("qY", ctypes.c_float), ("qZ", ctypes.c_float), ("qW", ctypes.c_float),
+                ("gyroX", ctypes.c_float), ("gyroY", ctypes.c_float), ("gyroZ", ctypes.c_float),
+                ("accelX", ctypes.c_float), ("accelY", ctypes.c_float), ("accelZ", ctypes.c_float)]
+
+
+class EscTelemetry(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [("timestamp", ctypes.c_uint64), ("temperature", ctypes.c_uint8), ("voltage", ctypes.c_uint16),
+                ("current", ctypes.c_uint16), ("consumption", ctypes.c_uint16), ("erpm", ctypes.c_uint16)]
+
+
+class RawImuSample(ctypes.Structure):
+    _pack_ = 1
+    _fields_ = [("timestamp", ctypes.c_uint64), ("deviceMicros", ctypes.c_uint32),
+                ("accelX", ctypes.c_int16), ("accelY", ctypes.c_int16), ("accelZ", ctypes.c_int16),
+                ("gyroX", ctypes.c_int16), ("gyroY", ctypes.c_int16), ("gyroZ", ctypes.c_int16)]
+
+
+class _Scan(ctypes.Structure):
+    _fields_ = [("sequence", ctypes.c_uint64), ("timestamp", ctypes.c_uint64), ("count", ctypes.c_size_t),
+                ("points", ctypes.c_void_p), ("x", ctypes.c_void_p), ("y", ctypes.c_void_p)]
+
+
+class Dropped(ctypes.Structure):
+    _fields_ = [("imuDropped", ctypes.c_uint64), ("escDropped", ctypes.c_uint64), ("rawImuDropped", ctypes.c_uint64),
+                ("scansDropped", ctypes.c_uint64), ("scanPointsDropped", ctypes.c_uint64)]
+
+
+# maus_lidar_point_t, packed
+POINT_DTYPE = np.dtype({"names": ["distance", "intensity", "angle", "timestamp"],
+                        "formats": ["<u2", "u1", "<u2", "<u8"],
+                        "offsets": [0, 2, 3, 5],
+                        "itemsize": 13})
+
+API_VERSION = 1
+
+_lib = ctypes.CDLL(os.environ.get("MAUS_LIBRARY", os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "libmaus.so")))
+
+if _lib.maus_api_version() != API_VERSION:
+    raise ImportError("libmaus.so has API version %d, expected %d" % (_lib.maus_api_version(), API_VERSION))
+
+_lib.maus_board_create.restype = ctypes.c_void_p
+_lib.maus_board_destroy.argtypes = [ctypes.c_void_p]
+_lib.maus_board_start.argtypes = [ctypes.c_void_p]
+_lib.maus_board_stop.argtypes = [ctypes.c_void_p]
+_lib.maus_board_next_imu.argtypes = [ctypes.c_void_p, ctypes.POINTER(ImuData), ctypes.c_int]
+_lib.maus_board_next_esc.argtypes = [ctypes.c_void_p, ctypes.POINTER(EscTelemetry), ctypes.c_int]
+_lib.maus_board_next_raw_imu.argtypes = [ctypes.c_void_p, ctypes.POINTER(RawImuSample), ctypes.c_int]
+_lib.maus_board_set_servos.argtypes = [ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint16]
+_lib.maus_board_set_rgb.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint32), ctypes.c_size_t]
+_lib.maus_board_set_imu_mode.argtypes = [ctypes.c_void_p, ctypes.c_uint8, ctypes.c_uint16]
+_lib.maus_lidar_create.restype = ctypes.c_void_p
+_lib.maus_lidar_destroy.argtypes = [ctypes.c_void_p]
+_lib.maus_lidar_start.argtypes = [ctypes.c_void_p]
+_lib.maus_lidar_stop.argtypes = [ctypes.c_void_p]
+_lib.maus_lidar_feed.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+_lib.maus_lidar_next_scan.argtypes = [ctypes.c_void_p, ctypes.POINTER(_Scan), ctypes.c_int]
+_lib.maus_lidar_release_scan.argtypes = [ctypes.c_void_p]
+_lib.maus_get_dropped.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.POINTER(Dropped)]
+
+
+def _view(address, ctype, count):
+    return (ctype * count).from_address(address) if count > 0 else (ctype * 0)()
+
+
+class Scan:
+    # points is a structured array (POINT_DTYPE), x and y float32 meters in the vehicle frame, all borrowed
+    def __init__(self, scan):
+        self.sequence = scan.sequence
+        self.timestamp = scan.timestamp
+        self.count = scan.count
+        self.points = np.frombuffer(_view(scan.points, ctypes.c_uint8, scan.count * POINT_DTYPE.itemsize), dtype=POINT_DTYPE)
+        self.x = np.frombuffer(_view(scan.x, ctypes.c_float, scan.count), dtype=np.float32)
+        self.y = np.frombuffer(_view(scan.y, ctypes.c_float, scan.count), dtype=np.float32)
+
+
+class Board:
+    def __init__(self):
+        self._handle = _lib.maus_board_create()
+        if not self._handle:
+            raise RuntimeError("There's already a board in this process")
+
+    def close(self):
+        if self._handle:
+            _lib.maus_board_destroy(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
+
+    def start(self):
+        return bool(_lib.maus_board_start(self._handle))
+
+    def stop(self):
+        return bool(_lib.maus_board_stop(self._handle))
+
+    # Oldest queued item, or None after timeout_ms (0 polls)
+    def next_imu(self, timeout_ms=WAIT_FOREVER):
+        item = ImuData()
+        return item if _lib.maus_board_next_imu(self._handle, ctypes.byref(item), timeout_ms) else None
+
+    def next_esc(self, timeout_ms=WAIT_FOREVER):
+        item = EscTelemetry()
+        return item if _lib.maus_board_next_esc(self._handle, ctypes.byref(item), timeout_ms) else None
+
+    def next_raw_imu(self, timeout_ms=WAIT_FOREVER):
+        item = RawImuSample()
+        return item if _lib.maus_board_next_raw_imu(self._handle, ctypes.byref(item), timeout_ms) else None
+
+    def set_servos(self, steering, throttle):
+        _lib.maus_board_set_servos(self._handle, steering, throttle)
+
+    def set_rgb(self, colors):
+        array = (ctypes.c_uint32 * len(colors))(*colors)
+        _lib.maus_board_set_rgb(self._handle, array, len(colors))
+
+    def set_imu_mode(self, mode, rate_hz=1000):
+        _lib.maus_board_set_imu_mode(self._handle, mode, rate_hz)
+
+    def get_dropped(self):
+        dropped = Dropped()
+        _lib.maus_get_dropped(self._handle, None, ctypes.byref(dropped))
+        return dropped
+
+
+class Lidar:
+    def __init__(self):
+        self._handle = _lib.maus_lidar_create()
+        if not self._handle:
+            raise RuntimeError("There's already a lidar in this process")
+
+    def close(self):
+        if self._handle:
+            _lib.maus_lidar_destroy(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
+
+    def start(self):
+        return bool(_lib.maus_lidar_start(self._handle))
+
+    def stop(self):
+        return bool(_lib.maus_lidar_stop(self._handle))
+
+    # Raw LD19 bytes from a capture, instead of start()
+    def feed(self, data):
+        _lib.maus_lidar_feed(self._handle, data, len(data))
+
+    # Newest scan not seen before, or None after timeout_ms. Invalidates the previous Scan's arrays
+    def next_scan(self, timeout_ms=WAIT_FOREVER):
+        scan = _Scan()
+        return Scan(scan) if _lib.maus_lidar_next_scan(self._handle, ctypes.byref(scan), timeout_ms) else None
+
+    def release_scan(self):
+        _lib.maus_lidar_release_scan(self._handle)
+
+    def get_dropped(self):
+        dropped = Dropped()
+        _lib.maus_get_dropped(None, self._handle, ctypes.byref(dropped))
+        return dropped
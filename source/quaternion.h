@@ -0,0 +1,64 @@
+#ifndef __QUATERNION_H__
+#define __QUATERNION_H__
+
+// Minimal unit quaternion for orientation (w, x, y, z)
+
+#include <cmath>
+
+struct Quaternion {
+    float w = 1.0f;
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+
+    Quaternion() {}
+    Quaternion(const float w, const float x, const float y, const float z) : w(w), x(x), y(y), z(z) {}
+
+    Quaternion operator*(const Quaternion& q) const {
+        return Quaternion(
+            (w * q.w) - (x * q.x) - (y * q.y) - (z * q.z),
+            (w * q.x) + (x * q.w) + (y * q.z) - (z * q.y),
+            (w * q.y) - (x * q.z) + (y * q.w) + (z * q.x),
+            (w * q.z) + (x * q.y) - (y * q.x) + (z * q.w));
+    }
+
+    Quaternion conjugate() const { return Quaternion(w, -x, -y, -z); }
+
+    Quaternion normalized() const {
+        const float norm = std::sqrt((w * w) + (x * x) + (y * y) + (z * z));
+        if (norm <= 0.0f)
+            return Quaternion();
+        const float invNorm = 1.0f / norm;
+        return Quaternion(w * invNorm, x * invNorm, y * invNorm, z * invNorm);
+    }
+
+    // Yaw in radians (rotation about z)
+    float getYawRadians() const {
+        return std::atan2(2.0f * ((w * z) + (x * y)), 1.0f - (2.0f * ((y * y) + (z * z))));
+    }
+
+    // Spherical interpolation from a (t = 0) to b (t = 1), always taking the short way around
+    static Quaternion slerp(const Quaternion& a, const Quaternion& b, const float t) {
+        float cosTheta = (a.w * b.w) + (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
+        const float sign = (cosTheta < 0.0f) ? -1.0f : 1.0f;
+        cosTheta *= sign;
+
+        float weightA = 1.0f - t;
+        float weightB = t * sign;
+        if (cosTheta < 0.9995f) {
+            // Far enough apart that the proper formula is stable
+            const float theta = std::acos(cosTheta);
+            const float invSinTheta = 1.0f / std::sin(theta);
+            weightA = std::sin((1.0f - t) * theta) * invSinTheta;
+            weightB = std::sin(t * theta) * invSinTheta * sign;
+        }
+
+        return Quaternion(
+            (weightA * a.w) + (weightB * b.w),
+            (weightA * a.x) + (weightB * b.x),
+            (weightA * a.y) + (weightB * b.y),
+            (weightA * a.z) + (weightB * b.z)).normalized();
+    }
+};
+
+#endif
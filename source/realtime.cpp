@@ -0,0 +1,48 @@
+#include "realtime.h"
+
+bool Realtime::setPriority(pthread_t thread, const int priority) {
+    if (priority <= 0)
+        return true;
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+
+    const int result = pthread_setschedparam(thread, SCHED_FIFO, &param);
+    if (result != 0) {
+        printf("Unable to set SCHED_FIFO priority %d: %s\n", priority, strerror(result));
+        return false;
+    }
+    return true;
+}
+
+bool Realtime::setCpuCore(pthread_t thread, const int cpuCore) {
+    if (cpuCore < 0)
+        return true;
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpuCore, &cpuSet);
+
+    const int result = pthread_setaffinity_np(thread, sizeof(cpuSet), &cpuSet);
+    if (result != 0) {
+        printf("Unable to pin thread to CPU %d: %s\n", cpuCore, strerror(result));
+        return false;
+    }
+    return true;
+}
+
+bool Realtime::configureThread(pthread_t thread, const int priority, const int cpuCore) {
+    // Try both even if the first one fails
+    const bool prioritySet = setPriority(thread, priority);
+    const bool cpuCoreSet = setCpuCore(thread, cpuCore);
+    return prioritySet && cpuCoreSet;
+}
+
+bool Realtime::lockMemory() {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        printf("Unable to lock memory: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
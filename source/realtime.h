@@ -0,0 +1,29 @@
+#ifndef __REALTIME_H__
+#define __REALTIME_H__
+
+// Helpers for giving threads real-time scheduling on Linux
+// These need root (or CAP_SYS_NICE and CAP_IPC_LOCK), they print a message and return false otherwise
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+class Realtime {
+public:
+    // Switches a thread to SCHED_FIFO at the given priority (1 - 99). A priority of 0 leaves the thread alone
+    static bool setPriority(pthread_t thread, const int priority);
+
+    // Pins a thread to a single CPU core. A core of -1 leaves the thread alone
+    static bool setCpuCore(pthread_t thread, const int cpuCore);
+
+    // Both of the above
+    static bool configureThread(pthread_t thread, const int priority, const int cpuCore);
+
+    // Locks all current and future pages into RAM so page faults can't stall a real-time thread
+    static bool lockMemory();
+};
+
+#endif
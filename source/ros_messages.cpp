@@ -0,0 +1,315 @@
+#include "ros_messages.h"
+
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+#include "timestamp.h"
+
+// CDR offsets are aligned relative to the end of the 4 byte encapsulation header
+static const size_t CDR_START = 4;
+
+static size_t cdrAlign(const size_t position, const size_t alignment) {
+    return CDR_START + ((((position - CDR_START) + alignment - 1) / alignment) * alignment);
+}
+
+// Writes without checks, the message size is checked once before writing
+struct CdrWriter {
+    uint8_t* out;
+    size_t position;
+
+    CdrWriter(uint8_t* out) : out(out), position(CDR_START) {
+        // CDR_LE encapsulation
+        out[0] = 0x00;
+        out[1] = 0x01;
+        out[2] = 0x00;
+        out[3] = 0x00;
+    }
+
+    void align(const size_t alignment) {
+        const size_t aligned = cdrAlign(position, alignment);
+        memset(&out[position], 0, aligned - position);
+        position = aligned;
+    }
+
+    template <typename T>
+    void write(const T value) {
+        align(sizeof(T));
+        memcpy(&out[position], &value, sizeof(T));
+        position += sizeof(T);
+    }
+
+    template <typename T>
+    void writeArray(const T* values, const size_t count) {
+        align(sizeof(T));
+        if (count > 0)
+            memcpy(&out[position], values, count * sizeof(T));
+        position += count * sizeof(T);
+    }
+
+    template <typename T>
+    void writeSequence(const T* values, const size_t count) {
+        write<uint32_t>(count);
+        writeArray(values, count);
+    }
+
+    void writeHeader(const uint64_t timestamp, const std::string& frameId) {
+        write<int32_t>(timestamp / NSECS_TO_SECS);
+        write<uint32_t>(timestamp % NSECS_TO_SECS);
+        write<uint32_t>(frameId.size() + 1);
+        memcpy(&out[position], frameId.c_str(), frameId.size() + 1);
+        position += frameId.size() + 1;
+    }
+};
+
+struct CdrReader {
+    const uint8_t* data;
+    size_t length;
+    size_t position;
+    bool valid;
+
+    CdrReader(const uint8_t* data, const size_t length) : data(data), length(length), position(CDR_START),
+        valid((length >= CDR_START) && (data[0] == 0x00) && (data[1] == 0x01)) {}
+
+    bool readBytes(void* value, const size_t size, const size_t alignment) {
+        const size_t aligned = cdrAlign(position, alignment);
+        if (!valid || (aligned > length) || (size > (length - aligned))) {
+            valid = false;
+            return false;
+        }
+        memcpy(value, &data[aligned], size);
+        position = aligned + size;
+        return true;
+    }
+
+    template <typename T>
+    T read() {
+        T value = 0;
+        readBytes(&value, sizeof(T), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void readArray(T* values, const size_t count) { readBytes(values, count * sizeof(T), sizeof(T)); }
+
+    template <typename T>
+    uint32_t readSequence(T* values, const size_t maxCount) {
+        const uint32_t count = read<uint32_t>();
+        if (count > maxCount) {
+            valid = false;
+            return 0;
+        }
+        readArray(values, count);
+        return count;
+    }
+
+    void readHeader(RosSerializer::Header& header) {
+        header.stampSec = read<int32_t>();
+        header.stampNanosec = read<uint32_t>();
+        const uint32_t size = read<uint32_t>();
+        if (!valid || (size == 0) || (size > (length - position))) {
+            valid = false;
+            return;
+        }
+        // Longer frame ids are truncated
+        const size_t kept = std::min((size_t)size - 1, (size_t)RosSerializer::MAX_FRAME_ID - 1);
+        memcpy(header.frameId, &data[position], kept);
+        header.frameId[kept] = '\0';
+        position += size;
+    }
+};
+
+RosSerializer::RosSerializer() : RosSerializer(Config()) {}
+
+RosSerializer::RosSerializer(const Config& config) :
+    config(config),
+    binRanges(new float[std::max((size_t)MAX_RANGES, (size_t)BinnedScan::MAX_BINS)]),
+    binIntensities(new float[MAX_RANGES]) {
+    if ((config.binCount == 0) || (config.binCount > MAX_RANGES))
+        printf("RosSerializer: %zu bins requested, using %zu\n", config.binCount, std::min(std::max(config.binCount, (size_t)1), (size_t)MAX_RANGES));
+}
+
+size_t RosSerializer::laserScanSize(const std::string& frameId, const size_t rangeCount, const size_t intensityCount) const {
+    size_t size = CDR_START + 8;                    // stamp
+    size += 4 + frameId.size() + 1;                 // frame_id
+    size = cdrAlign(size, 4) + (7 * 4);             // angle_min ... range_max
+    size += 4 + (rangeCount * 4);                   // ranges
+    size += 4 + (intensityCount * 4);               // intensities
+    return size;
+}
+
+size_t RosSerializer::getMaxLaserScanSize() const {
+    const size_t binCount = std::min(std::max(config.binCount, (size_t)1), (size_t)MAX_RANGES);
+    return std::max(laserScanSize(config.scanFrameId, binCount, binCount), laserScanSize(config.scanFrameId, BinnedScan::MAX_BINS, 0));
+}
+
+size_t RosSerializer::getMaxImuSize() const {
+    size_t size = CDR_START + 8 + 4 + config.imuFrameId.size() + 1;
+    size = cdrAlign(size, 8);
+    return size + ((4 + 9 + 3 + 9 + 3 + 9) * 8);
+}
+
+size_t RosSerializer::writeLaserScan(uint8_t* out, const uint64_t timestamp, const float binSize, const float scanTime,
+    const float* ranges, const size_t rangeCount, const float* intensities, const size_t intensityCount) const {
+    const float angleMin = -0.5f * binSize;
+    const float angleIncrement = -binSize;
+
+    CdrWriter writer(out);
+    writer.writeHeader(timestamp, config.scanFrameId);
+    writer.write<float>(angleMin);
+    writer.write<float>(angleMin + ((float)(rangeCount - 1) * angleIncrement));
+    writer.write<float>(angleIncrement);
+    writer.write<float>(scanTime / rangeCount);
+    writer.write<float>(scanTime);
+    writer.write<float>(config.rangeMin);
+    writer.write<float>(config.rangeMax);
+    writer.writeSequence(ranges, rangeCount);
+    writer.writeSequence(intensities, intensityCount);
+    return writer.position;
+}
+
+void RosSerializer::addScanTime(const uint64_t startTime, const size_t size) {
+    const uint64_t elapsed = TimeStamp::getMonotonic() - startTime;
+    stats.laserScans++;
+    stats.bytesWritten += size;
+    stats.totalScanNsecs += elapsed;
+    if (elapsed > stats.maxScanNsecs)
+        stats.maxScanNsecs = elapsed;
+}
+
+size_t RosSerializer::serializeLaserScan(const LD19::LidarPoint* points, const size_t count, uint8_t* out, const size_t capacity) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+    const size_t binCount = std::min(std::max(config.binCount, (size_t)1), (size_t)MAX_RANGES);
+    const size_t size = laserScanSize(config.scanFrameId, binCount, binCount);
+    if (size > capacity) {
+        stats.bufferTooSmall++;
+        return 0;
+    }
+
+    // Bin i covers LD19 angles [i, i + 1) * binSize, i.e. the clockwise measurement order
+    for (size_t i = 0; i < binCount; i++) {
+        binRanges[i] = INFINITY;
+        binIntensities[i] = 0.0f;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const LD19::LidarPoint& point = points[i];
+        if (point.distance == 0)
+            continue;
+        const size_t bin = (((uint32_t)point.angle * binCount) / 36000) % binCount;
+        const float distance = point.distance * 0.001f;
+        if (distance < binRanges[bin]) {
+            binRanges[bin] = distance;
+            binIntensities[bin] = point.intensity;
+        }
+    }
+
+    const uint64_t timestamp = (count > 0) ? points[0].timestamp : 0;
+    const float scanTime = (count > 1) ? ((float)(points[count - 1].timestamp - points[0].timestamp) / NSECS_TO_SECS) : 0.0f;
+    writeLaserScan(out, timestamp, (2.0f * (float)M_PI) / binCount, scanTime, binRanges.get(), binCount, binIntensities.get(), binCount);
+
+    addScanTime(startTime, size);
+    return size;
+}
+
+size_t RosSerializer::serializeLaserScan(const BinnedScan::Scan& scan, uint8_t* out, const size_t capacity) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+    const size_t binCount = scan.binCount;
+    const size_t size = laserScanSize(config.scanFrameId, binCount, 0);
+    if ((binCount == 0) || (size > capacity)) {
+        stats.bufferTooSmall++;
+        return 0;
+    }
+
+    // BinnedScan bins go counter-clockwise from straight ahead, clockwise bin i is its bin binCount - 1 - i
+    for (size_t i = 0; i < binCount; i++) {
+        const size_t bin = binCount - 1 - i;
+        binRanges[i] = scan.valid[bin] ? scan.distance[bin] : INFINITY;
+    }
+
+    const float scanTime = (float)(scan.endTimestamp - scan.startTimestamp) / NSECS_TO_SECS;
+    writeLaserScan(out, scan.startTimestamp, scan.binSize, scanTime, binRanges.get(), binCount, nullptr, 0);
+
+    addScanTime(startTime, size);
+    return size;
+}
+
+size_t RosSerializer::writeImu(uint8_t* out, const size_t capacity, const uint64_t timestamp, const double* orientation,
+    const double* angularVelocity, const double* linearAcceleration) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+    const size_t size = getMaxImuSize();
+    if (size > capacity) {
+        stats.bufferTooSmall++;
+        return 0;
+    }
+
+    CdrWriter writer(out);
+    writer.writeHeader(timestamp, config.imuFrameId);
+    writer.writeArray(orientation, 4);
+    writer.writeArray(config.orientationCovariance, 9);
+    writer.writeArray(angularVelocity, 3);
+    writer.writeArray(config.angularVelocityCovariance, 9);
+    writer.writeArray(linearAcceleration, 3);
+    writer.writeArray(config.linearAccelerationCovariance, 9);
+
+    const uint64_t elapsed = TimeStamp::getMonotonic() - startTime;
+    stats.imuMessages++;
+    stats.bytesWritten += size;
+    stats.totalImuNsecs += elapsed;
+    if (elapsed > stats.maxImuNsecs)
+        stats.maxImuNsecs = elapsed;
+    return size;
+}
+
+size_t RosSerializer::serializeImu(const MausBoard::ImuData& imuData, uint8_t* out, const size_t capacity) {
+    const double orientation[4] = {imuData.qX, imuData.qY, imuData.qZ, imuData.qW};
+    const double angularVelocity[3] = {imuData.gyroX * config.dmpGyroRadiansPerCount, imuData.gyroY * config.dmpGyroRadiansPerCount,
+        imuData.gyroZ * config.dmpGyroRadiansPerCount};
+    const double linearAcceleration[3] = {imuData.accelX * config.dmpAccelMetersPerSec2PerCount,
+        imuData.accelY * config.dmpAccelMetersPerSec2PerCount, imuData.accelZ * config.dmpAccelMetersPerSec2PerCount};
+    return writeImu(out, capacity, imuData.timestamp, orientation, angularVelocity, linearAcceleration);
+}
+
+size_t RosSerializer::serializeImu(const ImuFusion::State& state, uint8_t* out, const size_t capacity) {
+    const double orientation[4] = {state.orientation.x, state.orientation.y, state.orientation.z, state.orientation.w};
+    const double angularVelocity[3] = {state.gyro[0], state.gyro[1], state.gyro[2]};
+    const double linearAcceleration[3] = {state.accel[0], state.accel[1], state.accel[2]};
+    return writeImu(out, capacity, state.timestamp, orientation, angularVelocity, linearAcceleration);
+}
+
+bool RosSerializer::parseLaserScan(const uint8_t* data, const size_t length, LaserScan& message) {
+    CdrReader reader(data, length);
+    reader.readHeader(message.header);
+    message.angleMin = reader.read<float>();
+    message.angleMax = reader.read<float>();
+    message.angleIncrement = reader.read<float>();
+    message.timeIncrement = reader.read<float>();
+    message.scanTime = reader.read<float>();
+    message.rangeMin = reader.read<float>();
+    message.rangeMax = reader.read<float>();
+    message.rangeCount = reader.readSequence(message.ranges, MAX_RANGES);
+    message.intensityCount = reader.readSequence(message.intensities, MAX_RANGES);
+    return reader.valid;
+}
+
+bool RosSerializer::parseImu(const uint8_t* data, const size_t length, Imu& message) {
+    CdrReader reader(data, length);
+    reader.readHeader(message.header);
+    reader.readArray(message.orientation, 4);
+    reader.readArray(message.orientationCovariance, 9);
+    reader.readArray(message.angularVelocity, 3);
+    reader.readArray(message.angularVelocityCovariance, 9);
+    reader.readArray(message.linearAcceleration, 3);
+    reader.readArray(message.linearAccelerationCovariance, 9);
+    return reader.valid;
+}
+
+void RosSerializer::printStats() const {
+    printf("RosSerializer: %llu scans (mean %.1f us, max %.1f us), %llu IMU (mean %.2f us, max %.2f us), %.1f kB, %llu too big for their buffer\n",
+        (unsigned long long)stats.laserScans,
+        stats.laserScans ? ((double)stats.totalScanNsecs / stats.laserScans / NSECS_TO_USECS) : 0.0,
+        (double)stats.maxScanNsecs / NSECS_TO_USECS,
+        (unsigned long long)stats.imuMessages,
+        stats.imuMessages ? ((double)stats.totalImuNsecs / stats.imuMessages / NSECS_TO_USECS) : 0.0,
+        (double)stats.maxImuNsecs / NSECS_TO_USECS,
+        stats.bytesWritten / 1000.0, (unsigned long long)stats.bufferTooSmall);
+}
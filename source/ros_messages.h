@@ -0,0 +1,143 @@
+#ifndef __ROS_MESSAGES_H__
+#define __ROS_MESSAGES_H__
+
+// Serializes scans and IMU data into ROS 2 sensor_msgs/LaserScan and sensor_msgs/Imu messages, without ROS
+// The output is the standard CDR little endian encoding (4 byte encapsulation header, then the fields aligned to their
+// size), byte for byte what rclcpp publishes as a serialized message or rosbag2 stores. Something on the ROS side (a
+// rclcpp generic publisher, a bag writer...) can forward the buffers as they are, so ROS stays out of this process.
+//
+// Messages are written straight from the driver data into a buffer the caller owns (reuse one per stream, sized with
+// getMaxLaserScanSize()/getMaxImuSize()), no message objects in between. The parse functions are the reverse, into
+// plain structs, for checking round trips and for bridges that need the fields back.
+//
+// Scans use fixed angular bins in measurement order: the LD19 spins clockwise, so range i is at
+// angle_min + i * angle_increment with angle_min = -binSize / 2 and angle_increment = -binSize (x forward, y left,
+// REP 103), and time_increment is positive. Bins without a point are +inf (no return, REP 117).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+#include <string>
+
+#include "maus_board.h"
+#include "fhl_ld19.h"
+#include "binned_scan.h"
+#include "imu_fusion.h"
+
+class RosSerializer {
+public:
+    static const size_t MAX_RANGES = 4096;
+    static const size_t MAX_FRAME_ID = 64;
+
+    struct Config {
+        std::string scanFrameId = "laser";
+        std::string imuFrameId = "imu_link";
+
+        // Bins per revolution for raw LD19 scans (BinnedScan scans keep their own)
+        size_t binCount = 720;
+        float rangeMin = 0.02f;             // Meters, the LD19's specs
+        float rangeMax = 12.0f;
+
+        // Row major 3x3, -1 in the first element means unknown (e.g. orientationCovariance[0] = -1 for no orientation)
+        double orientationCovariance[9] = {0.0025, 0, 0, 0, 0.0025, 0, 0, 0, 0.0025};
+        double angularVelocityCovariance[9] = {0.0004, 0, 0, 0, 0.0004, 0, 0, 0, 0.0004};
+        double linearAccelerationCovariance[9] = {0.01, 0, 0, 0, 0.01, 0, 0, 0, 0.01};
+
+        // DMP ImuData comes in sensor counts (+-2000 deg/s and +-4G ranges)
+        double dmpGyroRadiansPerCount = (M_PI / 180.0) / 16.4;
+        double dmpAccelMetersPerSec2PerCount = 9.80665 / 8192.0;
+    };
+
+    struct Stats {
+        uint64_t laserScans;
+        uint64_t imuMessages;
+        uint64_t bytesWritten;
+        uint64_t bufferTooSmall;            // Messages not written, the buffer was smaller than needed
+        uint64_t totalScanNsecs;
+        uint64_t maxScanNsecs;
+        uint64_t totalImuNsecs;
+        uint64_t maxImuNsecs;
+    };
+
+    // Parsed messages, field names as in the .msg files
+    struct Header {
+        int32_t stampSec;
+        uint32_t stampNanosec;
+        char frameId[MAX_FRAME_ID];
+
+        uint64_t getTimestamp() const { return ((uint64_t)stampSec * NSECS_TO_SECS) + stampNanosec; }
+    };
+
+    struct LaserScan {
+        Header header;
+        float angleMin;
+        float angleMax;
+        float angleIncrement;
+        float timeIncrement;
+        float scanTime;
+        float rangeMin;
+        float rangeMax;
+        uint32_t rangeCount;
+        float ranges[MAX_RANGES];
+        uint32_t intensityCount;
+        float intensities[MAX_RANGES];
+    };
+
+    struct Imu {
+        Header header;
+        double orientation[4];              // x, y, z, w
+        double orientationCovariance[9];
+        double angularVelocity[3];
+        double angularVelocityCovariance[9];
+        double linearAcceleration[3];
+        double linearAccelerationCovariance[9];
+    };
+
+private:
+    const Config config;
+
+    // Bins for raw scans, copied into the message once filled
+    std::unique_ptr<float[]> binRanges;
+    std::unique_ptr<float[]> binIntensities;
+
+    Stats stats = {};
+
+    size_t laserScanSize(const std::string& frameId, const size_t rangeCount, const size_t intensityCount) const;
+    size_t writeLaserScan(uint8_t* out, const uint64_t timestamp, const float binSize, const float scanTime,
+        const float* ranges, const size_t rangeCount, const float* intensities, const size_t intensityCount) const;
+    size_t writeImu(uint8_t* out, const size_t capacity, const uint64_t timestamp, const double* orientation,
+        const double* angularVelocity, const double* linearAcceleration);
+    void addScanTime(const uint64_t startTime, const size_t size);
+
+public:
+    RosSerializer();
+    RosSerializer(const Config& config);
+
+    // Buffer sizes that fit any message from this serializer
+    size_t getMaxLaserScanSize() const;
+    size_t getMaxImuSize() const;
+
+    // Each returns the message size, or 0 if it doesn't fit in capacity
+
+    // One LD19 revolution (e.g. from fullScanCallback), binned into config.binCount bins keeping the closest point.
+    // Intensities are the LD19's 0-255
+    size_t serializeLaserScan(const LD19::LidarPoint* points, const size_t count, uint8_t* out, const size_t capacity);
+
+    // A BinnedScan revolution, in its bins. BinnedScan doesn't keep intensities so they're left empty
+    size_t serializeLaserScan(const BinnedScan::Scan& scan, uint8_t* out, const size_t capacity);
+
+    // DMP output, converted with the dmp* scales
+    size_t serializeImu(const MausBoard::ImuData& imuData, uint8_t* out, const size_t capacity);
+
+    // ImuFusion output, already in SI units
+    size_t serializeImu(const ImuFusion::State& state, uint8_t* out, const size_t capacity);
+
+    // Reverse of the above, returns false if the data isn't a valid message (or has more than MAX_RANGES ranges)
+    static bool parseLaserScan(const uint8_t* data, const size_t length, LaserScan& message);
+    static bool parseImu(const uint8_t* data, const size_t length, Imu& message);
+
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+#endif
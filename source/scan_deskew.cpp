@@ -0,0 +1,80 @@
+#include "scan_deskew.h"
+
+#include "fast_math.h"
+#include "pose2d.h"
+
+void ScanDeskew::addImuData(const MausBoard::ImuData& imuData) {
+    const float rawYaw = imuData.getYawRadians();
+
+    // Unwrap so interpolating across +-pi works
+    const float yaw = (yawHistory.size() > 0) ? (lastYaw + Pose2D::wrapAngle(rawYaw - lastRawYaw)) : rawYaw;
+    lastRawYaw = rawYaw;
+    lastYaw = yaw;
+
+    yawHistory.add(imuData.timestamp, yaw);
+}
+
+void ScanDeskew::addEscTelemetry(const MausBoard::EscTelemetry& escTelemetry, const float commandedThrottle) {
+    const float speed = drivetrain.reportedERPMToMetersPerSec(escTelemetry.getERPM());
+    speedHistory.add(escTelemetry.timestamp, (commandedThrottle < 0.0f) ? -speed : speed);
+}
+
+size_t ScanDeskew::deskew(const LD19::LidarPoint* points, const size_t count, float* xs, float* ys) {
+    const size_t n = (count < MAX_POINTS) ? count : MAX_POINTS;
+    if (n == 0)
+        return 0;
+
+    // Pose inputs at every point (no yaw or speed yet means no motion). If the history got lapped part way through
+    // the batch, the rest of the points hold the last sample: a jump to 0 would swing the end of the scan around
+    for (size_t i = 0; i < n; i++)
+        pointTimestamps[i] = points[i].timestamp;
+    const size_t yawCount = yawHistory.sampleBatch(pointTimestamps, n, pointYaws);
+    for (size_t i = yawCount; i < n; i++)
+        pointYaws[i] = (yawCount > 0) ? pointYaws[yawCount - 1] : 0.0f;
+    const size_t speedCount = speedHistory.sampleBatch(pointTimestamps, n, pointSpeeds);
+    for (size_t i = speedCount; i < n; i++)
+        pointSpeeds[i] = (speedCount > 0) ? pointSpeeds[speedCount - 1] : 0.0f;
+
+    // Everything is relative to the last point
+    const uint64_t endTimestamp = points[n - 1].timestamp;
+    const float endYaw = pointYaws[n - 1];
+    for (size_t i = 0; i < n; i++) {
+        pointTimes[i] = -(float)(int64_t)(endTimestamp - points[i].timestamp) * 1e-9f;
+        pointYaws[i] -= endYaw;
+    }
+
+    // Integrate the vehicle position backwards from the end of the scan (this part is sequential)
+    poseX[n - 1] = 0.0f;
+    poseY[n - 1] = 0.0f;
+    for (size_t i = n - 1; i > 0; i--) {
+        const float dt = pointTimes[i] - pointTimes[i - 1];
+        const float yaw = 0.5f * (pointYaws[i] + pointYaws[i - 1]);
+        const float distance = 0.5f * (pointSpeeds[i] + pointSpeeds[i - 1]) * dt;
+        float s, c;
+        FastMath::sinCos(yaw, s, c);
+        poseX[i - 1] = poseX[i] - (distance * c);
+        poseY[i - 1] = poseY[i] - (distance * s);
+    }
+
+    // Re-project each point (no branches, so this loop can be vectorized)
+    const float nan = std::nanf("");
+    const float lidarAngleScale = -(float)(M_PI / 18000.0);
+    for (size_t i = 0; i < n; i++) {
+        const float range = points[i].distance * 0.001f;
+
+        float sinAngle, cosAngle;
+        FastMath::sinCos((float)points[i].angle * lidarAngleScale, sinAngle, cosAngle);
+        const float localX = range * cosAngle;
+        const float localY = range * sinAngle;
+
+        float sinYaw, cosYaw;
+        FastMath::sinCos(pointYaws[i], sinYaw, cosYaw);
+        const float x = poseX[i] + (cosYaw * localX) - (sinYaw * localY);
+        const float y = poseY[i] + (sinYaw * localX) + (cosYaw * localY);
+
+        xs[i] = (points[i].distance == 0) ? nan : x;
+        ys[i] = (points[i].distance == 0) ? nan : y;
+    }
+
+    return n;
+}
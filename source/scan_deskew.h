@@ -0,0 +1,54 @@
+#ifndef __SCAN_DESKEW_H__
+#define __SCAN_DESKEW_H__
+
+// Motion compensation for LD19 scans
+// The car keeps moving during the ~100ms it takes to sweep a scan. This interpolates the car's pose at each point's
+// timestamp (yaw from the IMU, speed from ESC ERPM) and re-projects every point into the vehicle frame at the time of
+// the last point in the scan. Works on fixed size buffers, nothing is allocated per scan.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "maus_board.h"
+#include "fhl_ld19.h"
+#include "drivetrain.h"
+#include "sensor_history.h"
+
+class ScanDeskew {
+public:
+    static const size_t MAX_POINTS = 1024;
+
+private:
+    static const size_t HISTORY_SIZE = 256;
+
+    Drivetrain drivetrain;
+
+    // Yaw is unwrapped so it can be interpolated. Each history is written by one driver thread
+    SensorHistory<float, HISTORY_SIZE> yawHistory;
+    SensorHistory<float, HISTORY_SIZE> speedHistory;
+    float lastRawYaw = 0.0f;
+    float lastYaw = 0.0f;
+
+    // Per point scratch buffers (structure of arrays)
+    uint64_t pointTimestamps[MAX_POINTS];
+    float pointTimes[MAX_POINTS];   // Seconds relative to the last point
+    float pointYaws[MAX_POINTS];    // Radians relative to the last point
+    float pointSpeeds[MAX_POINTS];  // Meters per second
+    float poseX[MAX_POINTS];        // Vehicle position when the point was measured, in the output frame
+    float poseY[MAX_POINTS];
+
+public:
+    ScanDeskew(const Drivetrain& drivetrain = Drivetrain()) : drivetrain(drivetrain) {}
+
+    // Feed these from the MausBoard callbacks (don't call either one from more than one thread). commandedThrottle is the throttle last sent to the ESC (anything < 0
+    // is treated as reverse) since ERPM is unsigned
+    void addImuData(const MausBoard::ImuData& imuData);
+    void addEscTelemetry(const MausBoard::EscTelemetry& escTelemetry, const float commandedThrottle);
+
+    // Writes the motion compensated position of each point (meters, vehicle frame at the last point's timestamp) to
+    // xs and ys, which need room for count points. Points must be in time order, like the LD19 callbacks deliver them.
+    // Points with a distance of 0 come out as NaN. Returns the number of points written (at most MAX_POINTS)
+    size_t deskew(const LD19::LidarPoint* points, const size_t count, float* xs, float* ys);
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include "scan_filter.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "fast_math.h"
+#include "timestamp.h"
+
+const char* ScanFilter::stageNames[] = {
+    "gate",
+    "median",
+    "isolated",
+    "downsample"
+};
+
+ScanFilter::ScanFilter() : ScanFilter(Config()) {}
+
+ScanFilter::ScanFilter(const Config& config) : config(config) {
+    memset(voxelStamps, 0, sizeof(voxelStamps));
+}
+
+void ScanFilter::compact() {
+    // Branch-free stream compaction, every point is written and the write position only moves past the kept ones
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        angles[kept] = angles[i];
+        ranges[kept] = ranges[i];
+        xs[kept] = xs[i];
+        ys[kept] = ys[i];
+        intensities[kept] = intensities[i];
+        timestamps[kept] = timestamps[i];
+        kept += keep[i];
+    }
+    count = kept;
+}
+
+void ScanFilter::gate() {
+    const float minRange = config.minRange;
+    const float maxRange = config.maxRange;
+    const uint8_t minIntensity = config.minIntensity;
+    for (size_t i = 0; i < count; i++)
+        keep[i] = (ranges[i] >= minRange) & (ranges[i] <= maxRange) & (intensities[i] >= minIntensity);
+    compact();
+}
+
+// Neighbours are one float apart, so the loads are unaligned (memcpy compiles to a plain vector load)
+ScanFilter::FloatVector ScanFilter::loadVector(const float* values) {
+    FloatVector vector;
+    memcpy(&vector, values, sizeof(vector));
+    return vector;
+}
+
+void ScanFilter::median() {
+    if (count < config.medianWindow)
+        return;
+
+    memcpy(filteredRanges, ranges, count * sizeof(float));
+    if (config.medianWindow == 3) {
+        size_t i = 1;
+        for (; (i + SIMD_WIDTH) < count; i += SIMD_WIDTH) {
+            const FloatVector a = loadVector(&ranges[i - 1]);
+            const FloatVector b = loadVector(&ranges[i]);
+            const FloatVector c = loadVector(&ranges[i + 1]);
+            const FloatVector filtered = maxVector(minVector(a, b), minVector(maxVector(a, b), c));
+            memcpy(&filteredRanges[i], &filtered, sizeof(filtered));
+        }
+        for (; (i + 1) < count; i++) {
+            const float a = ranges[i - 1];
+            const float b = ranges[i];
+            const float c = ranges[i + 1];
+            filteredRanges[i] = std::max(std::min(a, b), std::min(std::max(a, b), c));
+        }
+    } else if (config.medianWindow == 5) {
+        // Median of 5: the smaller of the two pair minimums and the larger of the two pair maximums can't be it, that
+        // leaves the median of 3
+        size_t i = 2;
+        for (; (i + SIMD_WIDTH + 1) < count; i += SIMD_WIDTH) {
+            const FloatVector a = loadVector(&ranges[i - 2]);
+            const FloatVector b = loadVector(&ranges[i - 1]);
+            const FloatVector c = loadVector(&ranges[i]);
+            const FloatVector d = loadVector(&ranges[i + 1]);
+            const FloatVector e = loadVector(&ranges[i + 2]);
+            const FloatVector lower = maxVector(minVector(a, b), minVector(d, e));
+            const FloatVector upper = minVector(maxVector(a, b), maxVector(d, e));
+            const FloatVector filtered = maxVector(minVector(lower, c), minVector(maxVector(lower, c), upper));
+            memcpy(&filteredRanges[i], &filtered, sizeof(filtered));
+        }
+        for (; (i + 2) < count; i++) {
+            const float lower = std::max(std::min(ranges[i - 2], ranges[i - 1]), std::min(ranges[i + 1], ranges[i + 2]));
+            const float upper = std::min(std::max(ranges[i - 2], ranges[i - 1]), std::max(ranges[i + 1], ranges[i + 2]));
+            const float c = ranges[i];
+            filteredRanges[i] = std::max(std::min(lower, c), std::min(std::max(lower, c), upper));
+        }
+    }
+
+    // Move the points along their rays to the new range. A point at the origin (minRange 0) has no ray, it stays
+    // where it is
+    const FloatVector zeros = {0.0f, 0.0f, 0.0f, 0.0f};
+    const FloatVector ones = {1.0f, 1.0f, 1.0f, 1.0f};
+    size_t i = 0;
+    for (; (i + SIMD_WIDTH) <= count; i += SIMD_WIDTH) {
+        const FloatVector range = loadVector(&ranges[i]);
+        const IntVector onRay = range > zeros;
+        const FloatVector filtered = onRay ? loadVector(&filteredRanges[i]) : range;
+        const FloatVector scale = filtered / (onRay ? range : ones);
+        const FloatVector x = loadVector(&xs[i]) * scale;
+        const FloatVector y = loadVector(&ys[i]) * scale;
+        memcpy(&xs[i], &x, sizeof(x));
+        memcpy(&ys[i], &y, sizeof(y));
+        memcpy(&ranges[i], &filtered, sizeof(filtered));
+    }
+    for (; i < count; i++) {
+        if (ranges[i] > 0.0f) {
+            const float scale = filteredRanges[i] / ranges[i];
+            xs[i] *= scale;
+            ys[i] *= scale;
+            ranges[i] = filteredRanges[i];
+        }
+    }
+}
+
+void ScanFilter::rejectIsolated() {
+    if (count < 3)
+        return;
+
+    auto isClose = [&](const size_t i, const size_t previous, const size_t next) -> uint8_t {
+        const float threshold = config.isolatedDistance + (config.isolatedRangeFactor * ranges[i]);
+        const float previousX = xs[i] - xs[previous];
+        const float previousY = ys[i] - ys[previous];
+        const float nextX = xs[i] - xs[next];
+        const float nextY = ys[i] - ys[next];
+        const float closest = std::min((previousX * previousX) + (previousY * previousY), (nextX * nextX) + (nextY * nextY));
+        return closest <= (threshold * threshold);
+    };
+
+    // The scan is a loop, the first and last points are neighbours
+    keep[0] = isClose(0, count - 1, 1);
+
+    const float distance = config.isolatedDistance;
+    const float rangeFactor = config.isolatedRangeFactor;
+    const FloatVector distances = {distance, distance, distance, distance};
+    const FloatVector rangeFactors = {rangeFactor, rangeFactor, rangeFactor, rangeFactor};
+    const IntVector ones = {1, 1, 1, 1};
+    size_t i = 1;
+    for (; (i + SIMD_WIDTH) < count; i += SIMD_WIDTH) {
+        const FloatVector x = loadVector(&xs[i]);
+        const FloatVector y = loadVector(&ys[i]);
+        const FloatVector threshold = distances + (rangeFactors * loadVector(&ranges[i]));
+        const FloatVector previousX = x - loadVector(&xs[i - 1]);
+        const FloatVector previousY = y - loadVector(&ys[i - 1]);
+        const FloatVector nextX = x - loadVector(&xs[i + 1]);
+        const FloatVector nextY = y - loadVector(&ys[i + 1]);
+        const FloatVector closest = minVector((previousX * previousX) + (previousY * previousY), (nextX * nextX) + (nextY * nextY));
+        const ByteVector close = __builtin_convertvector((closest <= (threshold * threshold)) & ones, ByteVector);
+        memcpy(&keep[i], &close, sizeof(close));
+    }
+    for (; (i + 1) < count; i++)
+        keep[i] = isClose(i, i - 1, i + 1);
+    keep[count - 1] = isClose(count - 1, count - 2, 0);
+
+    compact();
+}
+
+void ScanFilter::downsample() {
+    if (config.voxelSize > 0.0f) {
+        // First point in each voxel wins, the hash is cleared by bumping the stamp
+        const float invVoxelSize = 1.0f / config.voxelSize;
+        voxelStamp++;
+        for (size_t i = 0; i < count; i++) {
+            const int32_t voxelX = (int32_t)std::floor(xs[i] * invVoxelSize);
+            const int32_t voxelY = (int32_t)std::floor(ys[i] * invVoxelSize);
+            const uint64_t key = ((uint64_t)(uint32_t)voxelX << 32) | (uint32_t)voxelY;
+
+            size_t slot = ((key * 0x9E3779B97F4A7C15ull) >> 40) % VOXEL_SLOTS;
+            keep[i] = 1;
+            while (voxelStamps[slot] == voxelStamp) {
+                if (voxelKeys[slot] == key) {
+                    keep[i] = 0;
+                    break;
+                }
+                slot = (slot + 1) % VOXEL_SLOTS;
+            }
+            if (keep[i]) {
+                voxelStamps[slot] = voxelStamp;
+                voxelKeys[slot] = key;
+            }
+        }
+        compact();
+    }
+
+    if ((config.targetPoints > 0) && (count > config.targetPoints)) {
+        // Evenly spaced in angle order
+        const size_t target = config.targetPoints;
+        for (size_t i = 0; i < count; i++)
+            keep[i] = ((i * target) % count) < target;
+        compact();
+    }
+}
+
+void ScanFilter::runStage(const Stage stage, void (ScanFilter::*function)()) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+    stats.pointsIn[stage] += count;
+
+    (this->*function)();
+
+    const uint64_t elapsed = TimeStamp::getMonotonic() - startTime;
+    stats.pointsOut[stage] += count;
+    stats.totalNsecs[stage] += elapsed;
+    if (elapsed > stats.maxNsecs[stage])
+        stats.maxNsecs[stage] = elapsed;
+}
+
+size_t ScanFilter::filter(const LD19::LidarPoint* points, const size_t count, const float* xs, const float* ys) {
+    this->count = std::min(count, MAX_POINTS);
+
+    const float lidarAngleScale = -(float)(M_PI / 18000.0);
+    for (size_t i = 0; i < this->count; i++) {
+        angles[i] = (float)points[i].angle * lidarAngleScale;
+        intensities[i] = points[i].intensity;
+        timestamps[i] = points[i].timestamp;
+    }
+
+    if (xs && ys) {
+        for (size_t i = 0; i < this->count; i++) {
+            this->xs[i] = xs[i];
+            this->ys[i] = ys[i];
+            ranges[i] = std::sqrt((xs[i] * xs[i]) + (ys[i] * ys[i])); // NaN for dropped points, the gate removes them
+        }
+    } else {
+        for (size_t i = 0; i < this->count; i++) {
+            ranges[i] = points[i].distance * 0.001f;
+            float s, c;
+            FastMath::sinCos(angles[i], s, c);
+            this->xs[i] = ranges[i] * c;
+            this->ys[i] = ranges[i] * s;
+        }
+    }
+
+    runStage(STAGE_GATE, &ScanFilter::gate);
+    if (config.medianWindow >= 3)
+        runStage(STAGE_MEDIAN, &ScanFilter::median);
+    if (config.isolatedDistance > 0.0f)
+        runStage(STAGE_ISOLATED, &ScanFilter::rejectIsolated);
+    if ((config.voxelSize > 0.0f) || (config.targetPoints > 0))
+        runStage(STAGE_DOWNSAMPLE, &ScanFilter::downsample);
+
+    stats.scans++;
+    return this->count;
+}
+
+void ScanFilter::printStats() const {
+    printf("ScanFilter: %llu scans\n", (unsigned long long)stats.scans);
+    for (size_t stage = 0; stage < NUM_STAGES; stage++) {
+        if (stats.pointsIn[stage] == 0)
+            continue;
+        printf("  %-10s mean %6.1f us, max %6.1f us, %5.1f%% of points kept\n", stageNames[stage],
+            (double)stats.totalNsecs[stage] / stats.scans / NSECS_TO_USECS, (double)stats.maxNsecs[stage] / NSECS_TO_USECS,
+            100.0 * stats.pointsOut[stage] / stats.pointsIn[stage]);
+    }
+}
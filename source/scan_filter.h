@@ -0,0 +1,123 @@
+#ifndef __SCAN_FILTER_H__
+#define __SCAN_FILTER_H__
+
+// In place filter chain for LD19 scans
+// A scan is loaded into structure of arrays buffers, then each enabled stage runs in order:
+//   1. Range and intensity gating (drops zero distance returns and weak, noisy ones)
+//   2. Angular median filter on the ranges
+//   3. Isolated point rejection (mixed pixels at edges have no close neighbours)
+//   4. Downsampling (voxel grid and/or even angular decimation) to a target point count
+// Each stage computes a keep mask (branch-free, except the voxel hash) and then compacts every array. Nothing is allocated per scan,
+// and every stage is timed. The median and isolated point stages run 4 points per vector (GCC vector extensions, SSE or
+// NEON), gating, the voxel hash and the compaction are scalar.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "fhl_ld19.h"
+
+class ScanFilter {
+public:
+    static const size_t MAX_POINTS = 1024;
+
+    enum Stage : uint8_t {
+        STAGE_GATE = 0,
+        STAGE_MEDIAN,
+        STAGE_ISOLATED,
+        STAGE_DOWNSAMPLE,
+        NUM_STAGES
+    };
+
+    static const char* stageNames[NUM_STAGES];
+
+    struct Config {
+        // Gating
+        float minRange = 0.05f;             // Meters
+        float maxRange = 12.0f;
+        uint8_t minIntensity = 10;
+
+        // Median filter window on the ranges (0 off, 3 or 5)
+        size_t medianWindow = 3;
+
+        // A point is kept if either neighbour is closer than this, plus rangeFactor * its range (points spread out
+        // with distance). 0 turns the stage off
+        float isolatedDistance = 0.1f;      // Meters
+        float isolatedRangeFactor = 0.02f;
+
+        // Downsampling. voxelSize 0 skips the voxel grid, targetPoints 0 skips the decimation
+        float voxelSize = 0.0f;             // Meters
+        size_t targetPoints = 0;
+    };
+
+    struct Stats {
+        uint64_t scans;
+        uint64_t pointsIn[NUM_STAGES];
+        uint64_t pointsOut[NUM_STAGES];
+        uint64_t totalNsecs[NUM_STAGES];
+        uint64_t maxNsecs[NUM_STAGES];
+    };
+
+private:
+    static const size_t VOXEL_SLOTS = 2 * MAX_POINTS;
+
+    static const size_t SIMD_WIDTH = 4;
+    typedef float FloatVector __attribute__((vector_size(16)));
+    typedef int32_t IntVector __attribute__((vector_size(16)));
+    typedef uint8_t ByteVector __attribute__((vector_size(4)));
+
+    static FloatVector loadVector(const float* values);
+    static FloatVector minVector(const FloatVector a, const FloatVector b) { return (b < a) ? b : a; }
+    static FloatVector maxVector(const FloatVector a, const FloatVector b) { return (a < b) ? b : a; }
+
+    const Config config;
+
+    // Scan (structure of arrays), vehicle frame
+    float angles[MAX_POINTS];           // Radians
+    float ranges[MAX_POINTS];           // Meters
+    float xs[MAX_POINTS];
+    float ys[MAX_POINTS];
+    uint8_t intensities[MAX_POINTS];
+    uint64_t timestamps[MAX_POINTS];
+    size_t count = 0;
+
+    // Scratch
+    uint8_t keep[MAX_POINTS];
+    float filteredRanges[MAX_POINTS];
+    uint64_t voxelKeys[VOXEL_SLOTS];
+    uint32_t voxelStamps[VOXEL_SLOTS];
+    uint32_t voxelStamp = 0;
+
+    Stats stats = {};
+
+    void compact();
+    void updateCartesian();
+
+    void gate();
+    void median();
+    void rejectIsolated();
+    void downsample();
+
+    void runStage(const Stage stage, void (ScanFilter::*function)());
+
+public:
+    ScanFilter();
+    ScanFilter(const Config& config);
+
+    // Loads a scan and runs the chain. xs/ys optionally replace the point positions (lidar frame meters, e.g. from
+    // ScanDeskew), the LD19 angles still decide the order. Returns the number of points left
+    size_t filter(const LD19::LidarPoint* points, const size_t count, const float* xs = nullptr, const float* ys = nullptr);
+
+    // Filtered scan, valid until the next filter() call
+    size_t getCount() const { return count; }
+    const float* getAngles() const { return angles; }
+    const float* getRanges() const { return ranges; }
+    const float* getXs() const { return xs; }
+    const float* getYs() const { return ys; }
+    const uint8_t* getIntensities() const { return intensities; }
+    const uint64_t* getTimestamps() const { return timestamps; }
+
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+#endif
@@ -0,0 +1,342 @@
+#include "scan_matcher.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "timestamp.h"
+
+ScanMatcher::ScanMatcher() : ScanMatcher(Config()) {}
+
+ScanMatcher::ScanMatcher(const Config& config) :
+    config(config),
+    invResolution(1.0f / config.resolution),
+    fineTable(new uint8_t[TABLE_SIZE * TABLE_SIZE]),
+    coarseTable(new uint8_t[TABLE_SIZE * TABLE_SIZE]) {
+
+    // Gaussian blur kernel, cut off at 2 sigma
+    kernelRadius = (int)std::ceil((2.0f * config.kernelSigma) * invResolution);
+    if (kernelRadius > MAX_KERNEL_RADIUS)
+        kernelRadius = MAX_KERNEL_RADIUS;
+    const int kernelSize = (2 * kernelRadius) + 1;
+    for (int y = -kernelRadius; y <= kernelRadius; y++) {
+        for (int x = -kernelRadius; x <= kernelRadius; x++) {
+            const float distanceSquared = ((x * x) + (y * y)) * config.resolution * config.resolution;
+            const float value = 255.0f * std::exp(-distanceSquared / (2.0f * config.kernelSigma * config.kernelSigma));
+            kernel[((y + kernelRadius) * kernelSize) + (x + kernelRadius)] = (uint8_t)value;
+        }
+    }
+
+    const int32_t window = (int32_t)std::ceil(config.linearWindow * invResolution);
+    const int32_t coarseSteps = (((2 * window) + 1) + config.coarseFactor - 1) / config.coarseFactor;
+    const int32_t angleSteps = (2 * (int32_t)std::ceil(config.angularWindow / config.angularStep)) + 1;
+    maxCandidates = (size_t)angleSteps * coarseSteps * coarseSteps;
+    candidates.reset(new Candidate[maxCandidates]);
+
+    memset(fineTable.get(), 0, TABLE_SIZE * TABLE_SIZE);
+    memset(coarseTable.get(), 0, TABLE_SIZE * TABLE_SIZE);
+}
+
+size_t ScanMatcher::loadPoints(const float* xs, const float* ys, const size_t count) {
+    const float maxRangeSquared = config.maxRange * config.maxRange;
+
+    queryCount = 0;
+    for (size_t i = 0; (i < count) && (queryCount < MAX_POINTS); i++) {
+        if (std::isnan(xs[i]) || std::isnan(ys[i]))
+            continue;
+        const float rangeSquared = (xs[i] * xs[i]) + (ys[i] * ys[i]);
+        if ((rangeSquared == 0.0f) || (rangeSquared > maxRangeSquared))
+            continue;
+
+        config.lidarMount.transformPoint(xs[i], ys[i], queryX[queryCount], queryY[queryCount]);
+        queryCount++;
+    }
+    return queryCount;
+}
+
+size_t ScanMatcher::loadPoints(const LD19::LidarPoint* points, const size_t count) {
+    const float maxRangeMillimeters = config.maxRange * 1000.0f;
+
+    queryCount = 0;
+    for (size_t i = 0; (i < count) && (queryCount < MAX_POINTS); i++) {
+        if ((points[i].distance == 0) || (points[i].distance > maxRangeMillimeters))
+            continue;
+
+        config.lidarMount.transformPoint(points[i].getXMeters(), points[i].getYMeters(), queryX[queryCount], queryY[queryCount]);
+        queryCount++;
+    }
+    return queryCount;
+}
+
+void ScanMatcher::beginReference(const Pose2D& center) {
+    tableOriginX = center.x - ((TABLE_SIZE / 2) * config.resolution);
+    tableOriginY = center.y - ((TABLE_SIZE / 2) * config.resolution);
+    memset(fineTable.get(), 0, TABLE_SIZE * TABLE_SIZE);
+}
+
+void ScanMatcher::stampPoint(const float worldX, const float worldY) {
+    const int32_t centerX = (int32_t)std::floor((worldX - tableOriginX) * invResolution);
+    const int32_t centerY = (int32_t)std::floor((worldY - tableOriginY) * invResolution);
+    if ((centerX < kernelRadius) || (centerY < kernelRadius) ||
+        (centerX >= ((int32_t)TABLE_SIZE - kernelRadius)) || (centerY >= ((int32_t)TABLE_SIZE - kernelRadius)))
+        return;
+
+    // Max, not sum, so dense walls don't outweigh everything else
+    const int kernelSize = (2 * kernelRadius) + 1;
+    for (int y = 0; y < kernelSize; y++) {
+        uint8_t* row = &fineTable[((centerY - kernelRadius + y) * TABLE_SIZE) + (centerX - kernelRadius)];
+        const uint8_t* kernelRow = &kernel[y * kernelSize];
+        for (int x = 0; x < kernelSize; x++)
+            row[x] = std::max(row[x], kernelRow[x]);
+    }
+}
+
+void ScanMatcher::finishReference(const uint64_t startTime) {
+    const int factor = config.coarseFactor;
+
+    // Sliding max over [x, x + F), then over [y, y + F). Rows are processed in order so the second pass can be in place
+    for (size_t y = 0; y < TABLE_SIZE; y++) {
+        const uint8_t* fineRow = &fineTable[y * TABLE_SIZE];
+        uint8_t* coarseRow = &coarseTable[y * TABLE_SIZE];
+        for (size_t x = 0; x < TABLE_SIZE; x++) {
+            uint8_t value = 0;
+            const size_t end = std::min(x + factor, TABLE_SIZE);
+            for (size_t i = x; i < end; i++)
+                value = std::max(value, fineRow[i]);
+            coarseRow[x] = value;
+        }
+    }
+    for (size_t y = 0; y < TABLE_SIZE; y++) {
+        uint8_t* coarseRow = &coarseTable[y * TABLE_SIZE];
+        const size_t end = std::min(y + factor, TABLE_SIZE);
+        for (size_t i = y + 1; i < end; i++) {
+            const uint8_t* otherRow = &coarseTable[i * TABLE_SIZE];
+            for (size_t x = 0; x < TABLE_SIZE; x++)
+                coarseRow[x] = std::max(coarseRow[x], otherRow[x]);
+        }
+    }
+
+    hasReference = true;
+    stats.totalReferenceNsecs += TimeStamp::getMonotonic() - startTime;
+}
+
+void ScanMatcher::setReference(const float* xs, const float* ys, const size_t count, const Pose2D& pose) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    loadPoints(xs, ys, count);
+    beginReference(pose);
+    for (size_t i = 0; i < queryCount; i++) {
+        float worldX, worldY;
+        pose.transformPoint(queryX[i], queryY[i], worldX, worldY);
+        stampPoint(worldX, worldY);
+    }
+    finishReference(startTime);
+}
+
+void ScanMatcher::setReference(const LD19::LidarPoint* points, const size_t count, const Pose2D& pose) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    loadPoints(points, count);
+    beginReference(pose);
+    for (size_t i = 0; i < queryCount; i++) {
+        float worldX, worldY;
+        pose.transformPoint(queryX[i], queryY[i], worldX, worldY);
+        stampPoint(worldX, worldY);
+    }
+    finishReference(startTime);
+}
+
+void ScanMatcher::setReference(const OccupancyGrid& grid, const Pose2D& pose) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+
+    beginReference(pose);
+
+    const float gridResolution = grid.getConfig().resolution;
+    const float tileMeters = OccupancyGrid::TILE_SIZE * gridResolution;
+    const float tableMeters = TABLE_SIZE * config.resolution;
+    for (size_t tileIndex = 0; tileIndex < grid.getTileCount(); tileIndex++) {
+        const OccupancyGrid::Tile& tile = grid.getTile(tileIndex);
+
+        // Skip tiles that don't overlap the table
+        const float tileMinX = tile.tileX * tileMeters;
+        const float tileMinY = tile.tileY * tileMeters;
+        if (((tileMinX + tileMeters) < tableOriginX) || (tileMinX > (tableOriginX + tableMeters)) ||
+            ((tileMinY + tileMeters) < tableOriginY) || (tileMinY > (tableOriginY + tableMeters)))
+            continue;
+
+        for (int localY = 0; localY < OccupancyGrid::TILE_SIZE; localY++) {
+            for (int localX = 0; localX < OccupancyGrid::TILE_SIZE; localX++) {
+                const int8_t logOdds = tile.cells[(localY << OccupancyGrid::TILE_SHIFT) | localX].load(std::memory_order_relaxed);
+                if (logOdds > config.mapOccupiedLogOdds)
+                    stampPoint(tileMinX + ((localX + 0.5f) * gridResolution), tileMinY + ((localY + 0.5f) * gridResolution));
+            }
+        }
+    }
+
+    finishReference(startTime);
+}
+
+void ScanMatcher::rotatePoints(const float x, const float y, const float yaw) {
+    const float c = std::cos(yaw);
+    const float s = std::sin(yaw);
+    const float offsetX = (x - tableOriginX) * invResolution;
+    const float offsetY = (y - tableOriginY) * invResolution;
+    const float scaledC = c * invResolution;
+    const float scaledS = s * invResolution;
+
+    // No branches, this loop vectorizes
+    for (size_t i = 0; i < queryCount; i++) {
+        cellX[i] = (int32_t)std::floor(offsetX + (scaledC * queryX[i]) - (scaledS * queryY[i]));
+        cellY[i] = (int32_t)std::floor(offsetY + (scaledS * queryX[i]) + (scaledC * queryY[i]));
+    }
+}
+
+uint32_t ScanMatcher::scoreAt(const uint8_t* table, const int32_t offsetX, const int32_t offsetY) const {
+    uint32_t score = 0;
+    for (size_t i = 0; i < queryCount; i++) {
+        const uint32_t x = (uint32_t)(cellX[i] + offsetX);
+        const uint32_t y = (uint32_t)(cellY[i] + offsetY);
+        if ((x < TABLE_SIZE) && (y < TABLE_SIZE))
+            score += table[(y * TABLE_SIZE) + x];
+    }
+    return score;
+}
+
+float ScanMatcher::parabolaPeak(const uint32_t before, const uint32_t peak, const uint32_t after) {
+    // Offset of the vertex from the middle sample, in samples
+    const float curvature = (float)before - (2.0f * peak) + (float)after;
+    if (curvature >= 0.0f)
+        return 0.0f;
+    const float offset = 0.5f * ((float)before - (float)after) / curvature;
+    return std::max(-0.5f, std::min(0.5f, offset));
+}
+
+ScanMatcher::Result ScanMatcher::search(const Pose2D& guess) {
+    const uint64_t startTime = TimeStamp::getMonotonic();
+    const uint64_t deadline = startTime + config.timeBudgetNsecs;
+
+    Result result = {};
+    result.pose = guess;
+
+    if (!hasReference || (queryCount < config.minPoints))
+        return result;
+
+    const int32_t window = (int32_t)std::ceil(config.linearWindow * invResolution);
+    const int32_t angleSteps = (int32_t)std::ceil(config.angularWindow / config.angularStep);
+    const int32_t factor = config.coarseFactor;
+
+    // Coarse pass, every rotation (closest to the guess first) at coarse translations
+    size_t candidateCount = 0;
+    for (int32_t step = 0; step <= (2 * angleSteps); step++) {
+        const int32_t angleIndex = (step & 1) ? ((step + 1) / 2) : -(step / 2);
+        rotatePoints(guess.x, guess.y, guess.yaw + (angleIndex * config.angularStep));
+
+        for (int32_t offsetY = -window; offsetY <= window; offsetY += factor) {
+            for (int32_t offsetX = -window; offsetX <= window; offsetX += factor) {
+                Candidate& candidate = candidates[candidateCount++];
+                candidate.angleIndex = angleIndex;
+                candidate.offsetX = offsetX;
+                candidate.offsetY = offsetY;
+                candidate.score = scoreAt(coarseTable.get(), offsetX, offsetY);
+            }
+        }
+
+        if (TimeStamp::getMonotonic() > deadline) {
+            result.timedOut = true;
+            break;
+        }
+    }
+
+    // Best first, ties go to the one closest to the guess
+    std::sort(candidates.get(), candidates.get() + candidateCount, [](const Candidate& a, const Candidate& b) {
+        if (a.score != b.score)
+            return a.score > b.score;
+        if (std::abs(a.angleIndex) != std::abs(b.angleIndex))
+            return std::abs(a.angleIndex) < std::abs(b.angleIndex);
+        return (std::abs(a.offsetX) + std::abs(a.offsetY)) < (std::abs(b.offsetX) + std::abs(b.offsetY));
+    });
+
+    // Fine pass, a coarse score is an upper bound for the fine scores it covers
+    uint32_t bestScore = 0;
+    int32_t bestAngleIndex = 0;
+    int32_t bestOffsetX = 0;
+    int32_t bestOffsetY = 0;
+    int32_t rotatedAngleIndex = INT32_MAX;
+    for (size_t i = 0; i < candidateCount; i++) {
+        const Candidate& candidate = candidates[i];
+        if (candidate.score <= bestScore)
+            break;
+        if ((i > 0) && (TimeStamp::getMonotonic() > deadline)) {
+            result.timedOut = true;
+            break;
+        }
+
+        if (candidate.angleIndex != rotatedAngleIndex) {
+            rotatePoints(guess.x, guess.y, guess.yaw + (candidate.angleIndex * config.angularStep));
+            rotatedAngleIndex = candidate.angleIndex;
+        }
+
+        const int32_t endY = std::min(candidate.offsetY + factor, window + 1);
+        const int32_t endX = std::min(candidate.offsetX + factor, window + 1);
+        for (int32_t offsetY = candidate.offsetY; offsetY < endY; offsetY++) {
+            for (int32_t offsetX = candidate.offsetX; offsetX < endX; offsetX++) {
+                const uint32_t score = scoreAt(fineTable.get(), offsetX, offsetY);
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestAngleIndex = candidate.angleIndex;
+                    bestOffsetX = offsetX;
+                    bestOffsetY = offsetY;
+                }
+            }
+        }
+        result.candidatesEvaluated++;
+    }
+
+    // Sub-cell refinement, fit a parabola through the neighbours of the best score in each dimension
+    float refineX = 0.0f;
+    float refineY = 0.0f;
+    float refineAngle = 0.0f;
+    if (bestScore > 0) {
+        rotatePoints(guess.x, guess.y, guess.yaw + (bestAngleIndex * config.angularStep));
+        refineX = parabolaPeak(scoreAt(fineTable.get(), bestOffsetX - 1, bestOffsetY), bestScore, scoreAt(fineTable.get(), bestOffsetX + 1, bestOffsetY));
+        refineY = parabolaPeak(scoreAt(fineTable.get(), bestOffsetX, bestOffsetY - 1), bestScore, scoreAt(fineTable.get(), bestOffsetX, bestOffsetY + 1));
+
+        rotatePoints(guess.x, guess.y, guess.yaw + ((bestAngleIndex - 1) * config.angularStep));
+        const uint32_t scoreBefore = scoreAt(fineTable.get(), bestOffsetX, bestOffsetY);
+        rotatePoints(guess.x, guess.y, guess.yaw + ((bestAngleIndex + 1) * config.angularStep));
+        const uint32_t scoreAfter = scoreAt(fineTable.get(), bestOffsetX, bestOffsetY);
+        refineAngle = parabolaPeak(scoreBefore, bestScore, scoreAfter);
+    }
+
+    result.pose.x = guess.x + ((bestOffsetX + refineX) * config.resolution);
+    result.pose.y = guess.y + ((bestOffsetY + refineY) * config.resolution);
+    result.pose.yaw = Pose2D::wrapAngle(guess.yaw + ((bestAngleIndex + refineAngle) * config.angularStep));
+    result.score = (float)bestScore / (255.0f * queryCount);
+    result.valid = bestScore > 0;
+    result.elapsedNsecs = TimeStamp::getMonotonic() - startTime;
+
+    stats.matches++;
+    if (result.timedOut)
+        stats.timeouts++;
+    stats.totalMatchNsecs += result.elapsedNsecs;
+    if (result.elapsedNsecs > stats.maxMatchNsecs)
+        stats.maxMatchNsecs = result.elapsedNsecs;
+
+    return result;
+}
+
+ScanMatcher::Result ScanMatcher::match(const float* xs, const float* ys, const size_t count, const Pose2D& guess) {
+    loadPoints(xs, ys, count);
+    return search(guess);
+}
+
+ScanMatcher::Result ScanMatcher::match(const LD19::LidarPoint* points, const size_t count, const Pose2D& guess) {
+    loadPoints(points, count);
+    return search(guess);
+}
+
+void ScanMatcher::printStats() const {
+    printf("ScanMatcher: %llu matches, %llu timed out, mean %llu us/match, max %llu us/match, mean %llu us/reference\n",
+        (unsigned long long)stats.matches, (unsigned long long)stats.timeouts,
+        (unsigned long long)(stats.getMeanMatchNsecs() / NSECS_TO_USECS), (unsigned long long)(stats.maxMatchNsecs / NSECS_TO_USECS),
+        (unsigned long long)(stats.matches ? (stats.totalReferenceNsecs / stats.matches / NSECS_TO_USECS) : 0));
+}
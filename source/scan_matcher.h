@@ -0,0 +1,129 @@
+#ifndef __SCAN_MATCHER_H__
+#define __SCAN_MATCHER_H__
+
+// Correlative scan matcher (Olson, "Real-Time Correlative Scan Matching") for lidar odometry and localization
+// The reference (the previous scan, or the map around the car) is rasterized into a blurred lookup table, plus a
+// coarse table where each cell holds the max of the fine cells it covers. The search tries every rotation in the
+// angular window: coarse translations first, then only the coarse candidates that could still beat the best fine
+// score are refined (branch and bound), and the winner gets a sub-cell parabola fit. Rotations are tried closest to the guess first, and the search gives up at
+// the time budget with the best pose found so far.
+//
+// Lidar odometry: match each scan against the previous one with the guess from PoseEstimator (or the last motion),
+// then make it the new reference with the matched pose.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+
+#include "fhl_ld19.h"
+#include "pose2d.h"
+#include "occupancy_grid.h"
+
+class ScanMatcher {
+public:
+    static const size_t TABLE_SIZE = 512;   // Cells per side, 25.6m at 5cm
+    static const size_t MAX_POINTS = 1024;
+
+    struct Config {
+        float resolution = 0.05f;           // Meters per cell
+        float linearWindow = 0.3f;          // +- meters searched around the guess
+        float angularWindow = 0.35f;        // +- radians searched around the guess
+        float angularStep = 0.005f;         // Radians (a point at 10m moves 5cm)
+        int coarseFactor = 4;               // Fine cells per coarse step
+
+        float kernelSigma = 0.05f;          // Meters, how much the reference points are blurred
+        float maxRange = 12.0f;             // Meters, points further away are ignored
+        Pose2D lidarMount;                  // Lidar pose in the vehicle frame
+
+        int8_t mapOccupiedLogOdds = 20;     // Map cells above this count as reference points
+        size_t minPoints = 20;              // Fewer valid points than this and the match is rejected
+
+        uint64_t timeBudgetNsecs = 20 * 1000000ull;
+    };
+
+    struct Result {
+        Pose2D pose;                        // Vehicle pose in the world frame
+        float score;                        // 0 - 1, mean lookup value of the scan points
+        bool valid;
+        bool timedOut;                      // Search was cut short, pose is the best found before the budget ran out
+        uint32_t candidatesEvaluated;
+        uint64_t elapsedNsecs;
+    };
+
+    struct Stats {
+        uint64_t matches;
+        uint64_t timeouts;
+        uint64_t totalMatchNsecs;
+        uint64_t maxMatchNsecs;
+        uint64_t totalReferenceNsecs;
+
+        uint64_t getMeanMatchNsecs() const { return matches ? (totalMatchNsecs / matches) : 0; }
+    };
+
+private:
+    struct Candidate {
+        int32_t angleIndex;
+        int32_t offsetX;                    // Fine cells
+        int32_t offsetY;
+        uint32_t score;
+    };
+
+    const Config config;
+    const float invResolution;
+
+    // Lookup tables, row major. fine is the blurred reference, coarse[x, y] = max of fine over [x, x + F) x [y, y + F)
+    std::unique_ptr<uint8_t[]> fineTable;
+    std::unique_ptr<uint8_t[]> coarseTable;
+    float tableOriginX = 0.0f;              // World position of cell (0, 0)
+    float tableOriginY = 0.0f;
+    bool hasReference = false;
+
+    // Blur kernel
+    static const int MAX_KERNEL_RADIUS = 8;
+    int kernelRadius;
+    uint8_t kernel[(2 * MAX_KERNEL_RADIUS + 1) * (2 * MAX_KERNEL_RADIUS + 1)];
+
+    // Query points in the vehicle frame, and rotated into table cells (structure of arrays)
+    float queryX[MAX_POINTS];
+    float queryY[MAX_POINTS];
+    size_t queryCount = 0;
+    int32_t cellX[MAX_POINTS];
+    int32_t cellY[MAX_POINTS];
+
+    std::unique_ptr<Candidate[]> candidates;
+    size_t maxCandidates;
+
+    Stats stats = {};
+
+    size_t loadPoints(const float* xs, const float* ys, const size_t count);
+    size_t loadPoints(const LD19::LidarPoint* points, const size_t count);
+
+    void beginReference(const Pose2D& center);
+    void stampPoint(const float worldX, const float worldY);
+    void finishReference(const uint64_t startTime);
+
+    void rotatePoints(const float x, const float y, const float yaw);
+    uint32_t scoreAt(const uint8_t* table, const int32_t offsetX, const int32_t offsetY) const;
+    static float parabolaPeak(const uint32_t before, const uint32_t peak, const uint32_t after);
+    Result search(const Pose2D& guess);
+
+public:
+    ScanMatcher();
+    ScanMatcher(const Config& config);
+
+    // Reference from a scan (lidar frame, in meters or straight from the LD19) taken at pose
+    void setReference(const float* xs, const float* ys, const size_t count, const Pose2D& pose);
+    void setReference(const LD19::LidarPoint* points, const size_t count, const Pose2D& pose);
+
+    // Reference from the occupied cells of a map, centered on pose (scan-to-map matching)
+    void setReference(const OccupancyGrid& grid, const Pose2D& pose);
+
+    // Finds the pose of a scan against the reference, searching around guess
+    Result match(const float* xs, const float* ys, const size_t count, const Pose2D& guess);
+    Result match(const LD19::LidarPoint* points, const size_t count, const Pose2D& guess);
+
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "scan_merger.h"
+
+#include <string.h>
+
+#include "fast_math.h"
+#include "timestamp.h"
+
+ScanMerger::ScanMerger() : ScanMerger(Config()) {}
+
+ScanMerger::ScanMerger(const Config& config) :
+    config(config),
+    sensorCount((config.sensorCount == 0) ? 1 : ((config.sensorCount > MAX_SENSORS) ? MAX_SENSORS : config.sensorCount)),
+    binCount((config.binCount == 0) ? 1 : ((config.binCount > MAX_BINS) ? MAX_BINS : config.binCount)),
+    binsPerRadian(binCount / (2.0f * (float)M_PI)),
+    queues(new SpscQueue<LD19::LidarPoint, QUEUE_CAPACITY>[MAX_SENSORS]),
+    windows(new Scan[2]) {
+    if (config.sensorCount > MAX_SENSORS)
+        printf("ScanMerger: %zu lidars requested, using %zu\n", config.sensorCount, MAX_SENSORS);
+    if (config.binCount > MAX_BINS)
+        printf("ScanMerger: %zu bins requested, using %zu\n", config.binCount, MAX_BINS);
+
+    for (size_t i = 0; i < MAX_SENSORS; i++) {
+        mountCos[i] = std::cos(config.sensors[i].mount.yaw);
+        mountSin[i] = std::sin(config.sensors[i].mount.yaw);
+    }
+}
+
+bool ScanMerger::start() {
+    if (running) {
+        printf("ScanMerger is already running\n");
+        return false;
+    }
+    running = true;
+    mergeThread = std::thread(&ScanMerger::mergeLoop, this);
+    return true;
+}
+
+bool ScanMerger::stop() {
+    if (!running)
+        return false;
+    running = false;
+    mergeThread.join();
+    return true;
+}
+
+void ScanMerger::addPoints(const size_t sensor, const LD19::LidarPoint* points, const size_t count) {
+    if (sensor >= sensorCount)
+        return;
+    for (size_t i = 0; i < count; i++) {
+        if (!queues[sensor].push(points[i]))
+            queueDrops++;
+    }
+    notifier.notify();
+}
+
+void ScanMerger::clearWindow(Scan& window, const uint64_t start) {
+    window.startTimestamp = start;
+    window.endTimestamp = start + config.windowNsecs;
+    window.binCount = binCount;
+    window.validCount = 0;
+    window.binSize = (2.0f * (float)M_PI) / binCount;
+    window.sensorMask = 0;
+    memset(window.x, 0, binCount * sizeof(float));
+    memset(window.y, 0, binCount * sizeof(float));
+    memset(window.range, 0, binCount * sizeof(float));
+    memset(window.timestamp, 0, binCount * sizeof(uint64_t));
+    memset(window.intensity, 0, binCount);
+    memset(window.sensor, NO_SENSOR, binCount);
+}
+
+void ScanMerger::mergePoint(const size_t sensor, const LD19::LidarPoint& point) {
+    if (point.timestamp > watermark[sensor])
+        watermark[sensor] = point.timestamp;
+    seen[sensor] = true;
+    if (point.distance == 0)
+        return;
+
+    if (!started) {
+        started = true;
+        windowStart = point.timestamp;
+        clearWindow(windows[current], windowStart);
+        clearWindow(windows[1 - current], windowStart + config.windowNsecs);
+    }
+    if (point.timestamp < windowStart) {
+        stats.latePoints++;
+        return;
+    }
+
+    // More than a window ahead of the current one, whoever hasn't caught up by now isn't waited for
+    while (point.timestamp >= (windowStart + (2 * config.windowNsecs)))
+        publishWindow(true);
+
+    const float range = point.distance * 0.001f;
+    if (range < config.sensors[sensor].minRange)
+        return;
+
+    // Lidar frame, then vehicle frame
+    float s;
+    float c;
+    FastMath::sinCos(point.getAngleRadians(), s, c);
+    const float lidarX = range * c;
+    const float lidarY = range * s;
+    const Pose2D& mount = config.sensors[sensor].mount;
+    const float x = mount.x + (mountCos[sensor] * lidarX) - (mountSin[sensor] * lidarY);
+    const float y = mount.y + (mountSin[sensor] * lidarX) + (mountCos[sensor] * lidarY);
+
+    const float bearing = std::atan2(y, x);
+    size_t bin = (size_t)(((bearing < 0.0f) ? (bearing + (2.0f * (float)M_PI)) : bearing) * binsPerRadian);
+    if (bin >= binCount)
+        bin = 0;
+    const float vehicleRange = std::sqrt((x * x) + (y * y));
+
+    Scan& window = windows[(point.timestamp < (windowStart + config.windowNsecs)) ? current : (1 - current)];
+    if (window.sensor[bin] == NO_SENSOR) {
+        window.validCount++;
+    } else {
+        // Overlapping views, keep the closest
+        if (window.sensor[bin] != sensor)
+            stats.overlapDuplicates++;
+        if (vehicleRange >= window.range[bin])
+            return;
+    }
+
+    window.x[bin] = x;
+    window.y[bin] = y;
+    window.range[bin] = vehicleRange;
+    window.timestamp[bin] = point.timestamp;
+    window.intensity[bin] = point.intensity;
+    window.sensor[bin] = sensor;
+    window.sensorMask |= (1 << sensor);
+    stats.pointsMerged++;
+}
+
+void ScanMerger::publishWindow(const bool partial) {
+    Scan& window = windows[current];
+    window.sequence = stats.scans++;
+    if (partial)
+        stats.partialScans++;
+    published.add(window.endTimestamp, window);
+    if (scanCallback)
+        scanCallback(window);
+
+    current = 1 - current;
+    windowStart += config.windowNsecs;
+    clearWindow(windows[1 - current], windowStart + config.windowNsecs);
+}
+
+void ScanMerger::publishReady() {
+    if (!started)
+        return;
+
+    while (true) {
+        const uint64_t windowEnd = windowStart + config.windowNsecs;
+        uint64_t newest = 0;
+        for (size_t i = 0; i < sensorCount; i++) {
+            if (seen[i] && (watermark[i] > newest))
+                newest = watermark[i];
+        }
+
+        // Every lidar that's keeping up has to be past the end of the window
+        bool ready = newest >= windowEnd;
+        bool partial = false;
+        for (size_t i = 0; i < sensorCount; i++) {
+            if (!seen[i] || ((newest - watermark[i]) > config.staleNsecs)) {
+                partial = true;
+                continue;
+            }
+            if (watermark[i] < windowEnd)
+                ready = false;
+        }
+        if (!ready)
+            return;
+        publishWindow(partial);
+    }
+}
+
+void ScanMerger::mergeLoop() {
+    const auto hasPoints = [&]() {
+        for (size_t i = 0; i < sensorCount; i++) {
+            if (queues[i].size() > 0)
+                return true;
+        }
+        return false;
+    };
+
+    while (running) {
+        if (!notifier.waitUntil(hasPoints, 20 * NSECS_TO_MSECS))
+            continue;
+
+        const uint64_t startTime = TimeStamp::getMonotonic();
+
+        // Oldest point across the lidars first, so the windows fill in time order
+        while (true) {
+            size_t oldestSensor = MAX_SENSORS;
+            uint64_t oldestTimestamp = UINT64_MAX;
+            for (size_t i = 0; i < sensorCount; i++) {
+                const LD19::LidarPoint* front = queues[i].front();
+                if (front && (front->timestamp < oldestTimestamp)) {
+                    oldestTimestamp = front->timestamp;
+                    oldestSensor = i;
+                }
+            }
+            if (oldestSensor == MAX_SENSORS)
+                break;
+
+            LD19::LidarPoint point;
+            queues[oldestSensor].pop(point);
+            stats.pointsReceived[oldestSensor]++;
+            mergePoint(oldestSensor, point);
+        }
+        publishReady();
+
+        const uint64_t elapsed = TimeStamp::getMonotonic() - startTime;
+        stats.totalMergeNsecs += elapsed;
+        if (elapsed > stats.maxMergeNsecs)
+            stats.maxMergeNsecs = elapsed;
+    }
+}
+
+bool ScanMerger::getLatest(Scan& scan) const {
+    uint64_t timestamp;
+    return published.getLatest(timestamp, scan);
+}
+
+void ScanMerger::printStats() const {
+    printf("ScanMerger: %llu scans (%llu partial), %llu points merged, %llu overlap duplicates, %llu late, %llu queue drops, busy %.1f ms total (max %.1f us)\n",
+        (unsigned long long)stats.scans, (unsigned long long)stats.partialScans, (unsigned long long)stats.pointsMerged,
+        (unsigned long long)stats.overlapDuplicates, (unsigned long long)stats.latePoints, (unsigned long long)queueDrops.load(),
+        (double)stats.totalMergeNsecs / NSECS_TO_MSECS, (double)stats.maxMergeNsecs / NSECS_TO_USECS);
+    for (size_t i = 0; i < sensorCount; i++)
+        printf("  lidar %zu: %llu points\n", i, (unsigned long long)stats.pointsReceived[i]);
+}
@@ -0,0 +1,162 @@
+#ifndef __SCAN_MERGER_H__
+#define __SCAN_MERGER_H__
+
+// Merges several LD19s (e.g. front and rear) into one vehicle-frame scan
+// Each lidar's sector callback hands its points to addPoints() with the lidar's index, that's the only copy of the
+// sensor data: points go into a per sensor SPSC queue and the merge thread does everything else.
+//
+// Time alignment: merged scans cover fixed windows of windowNsecs by point timestamp (not by each lidar's revolution,
+// they spin out of phase), so every scan holds what all the lidars saw during the same interval. A window is published
+// once every lidar's points have moved past its end. A lidar that stops (or falls staleNsecs behind the others) isn't
+// waited for, the scans go on with the rest.
+//
+// Points are transformed by their lidar's mount and binned by bearing from the vehicle origin (bin 0 starts straight
+// ahead, counter-clockwise, like BinnedScan). Where the lidars' views overlap, points from both land in the same bins
+// and the closest one is kept, so overlapping sectors aren't counted twice.
+//
+//   LD19 front(nullptr, "/dev/ttyAMA3");
+//   LD19 rear(nullptr, "/dev/ttyAMA4");
+//   void frontPoints(const LD19::LidarPoint* points, const size_t count) { merger.addPoints(0, points, count); }
+//   void rearPoints(const LD19::LidarPoint* points, const size_t count) { merger.addPoints(1, points, count); }
+//   front.setSectorCallback(frontPoints);
+//   rear.setSectorCallback(rearPoints);
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <thread>
+
+#include "fhl_ld19.h"
+#include "pose2d.h"
+#include "sensor_history.h"
+#include "shm_ring.h"
+#include "spsc_queue.h"
+
+class ScanMerger {
+public:
+    static const size_t MAX_SENSORS = 4;
+    static const size_t MAX_BINS = 1440;
+    static const uint8_t NO_SENSOR = 0xFF;
+
+    struct SensorConfig {
+        Pose2D mount;                       // Lidar pose in the vehicle frame
+        float minRange = 0.05f;             // Meters, closer points are dropped (e.g. hits on the car itself)
+    };
+
+    struct Config {
+        size_t sensorCount = 2;
+        SensorConfig sensors[MAX_SENSORS];
+
+        size_t binCount = 720;
+        uint64_t windowNsecs = 100 * NSECS_TO_MSECS;    // One LD19 revolution
+        uint64_t staleNsecs = 250 * NSECS_TO_MSECS;
+    };
+
+    struct Scan {
+        uint64_t sequence;
+        uint64_t startTimestamp;            // Nanoseconds since epoch, the window is [start, end)
+        uint64_t endTimestamp;
+        uint16_t binCount;
+        uint16_t validCount;
+        float binSize;                      // Radians
+        uint8_t sensorMask;                 // Bit per lidar that had points in the window
+
+        // Per bin, in the vehicle frame. range is 0 and sensor NO_SENSOR where empty
+        float x[MAX_BINS];
+        float y[MAX_BINS];
+        float range[MAX_BINS];              // Meters from the vehicle origin
+        uint64_t timestamp[MAX_BINS];
+        uint8_t intensity[MAX_BINS];
+        uint8_t sensor[MAX_BINS];
+
+        // Center angle of a bin in radians [-pi, pi)
+        float getBinAngle(const size_t bin) const {
+            const float angle = ((float)bin + 0.5f) * binSize;
+            return (angle >= (float)M_PI) ? (angle - (2.0f * (float)M_PI)) : angle;
+        }
+
+        // Bin that covers an angle in radians (any range)
+        size_t getBinIndex(const float angle) const {
+            const float turns = angle * (float)(0.5 / M_PI);
+            const float fraction = turns - std::floor(turns);
+            const size_t bin = (size_t)(fraction * binCount);
+            return (bin < binCount) ? bin : 0;
+        }
+
+        // Range at an angle, 0 if there's no point there
+        float getRangeAt(const float angle) const { return range[getBinIndex(angle)]; }
+    };
+
+    struct Stats {
+        uint64_t scans;
+        uint64_t partialScans;              // Published without waiting for a stale lidar
+        uint64_t pointsReceived[MAX_SENSORS];
+        uint64_t pointsMerged;
+        uint64_t overlapDuplicates;         // Bins where another lidar's point was already kept (or replaced)
+        uint64_t latePoints;                // Older than the window being merged
+        uint64_t totalMergeNsecs;           // Merge thread busy time
+        uint64_t maxMergeNsecs;
+    };
+
+private:
+    static const size_t QUEUE_CAPACITY = 4096; // ~0.9s of one LD19
+
+    const Config config;
+    const size_t sensorCount;
+    const size_t binCount;
+    const float binsPerRadian;
+
+    // Filled by the lidars' threads
+    std::unique_ptr<SpscQueue<LD19::LidarPoint, QUEUE_CAPACITY>[]> queues;
+    ShmNotifier notifier;
+    std::atomic<uint64_t> queueDrops{0};
+
+    // Merge thread state, the current window and the next one (points can run ahead by a window)
+    std::unique_ptr<Scan[]> windows;
+    size_t current = 0;
+    uint64_t windowStart = 0;
+    bool started = false;
+    uint64_t watermark[MAX_SENSORS] = {};
+    bool seen[MAX_SENSORS] = {};
+    float mountCos[MAX_SENSORS];
+    float mountSin[MAX_SENSORS];
+
+    SensorHistory<Scan, 2> published;
+
+    std::atomic<bool> running{false};
+    std::thread mergeThread;
+
+    Stats stats = {};
+
+    void clearWindow(Scan& window, const uint64_t start);
+    void mergePoint(const size_t sensor, const LD19::LidarPoint& point);
+    void publishWindow(const bool partial);
+    void publishReady();
+    void mergeLoop();
+
+public:
+    // Called on the merge thread with every merged scan (optional, don't block in it)
+    void (*scanCallback)(const Scan&) = nullptr;
+
+    ScanMerger();
+    ScanMerger(const Config& config);
+    ~ScanMerger() { stop(); }
+
+    bool start();
+    bool stop();
+
+    // Call from lidar 'sensor's sector callback (setSectorCallback(callback) streams every frame). Never blocks, points
+    // that don't fit in the queue are dropped and counted
+    void addPoints(const size_t sensor, const LD19::LidarPoint* points, const size_t count);
+
+    // Latest merged scan. Returns false if there isn't one yet
+    bool getLatest(Scan& scan) const;
+
+    uint64_t getQueueDrops() const { return queueDrops.load(); }
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef __SENSOR_HISTORY_H__
+#define __SENSOR_HISTORY_H__
+
+// Fixed capacity, time indexed history of sensor samples
+// One writer thread adds samples in time order, any number of reader threads can look up (and interpolate) the value
+// at a timestamp without locking. Each slot has a sequence number that readers check before and after copying, so a
+// slot being overwritten is detected rather than read half written.
+//
+// Values are interpolated with HistoryInterpolator<T>, which is linear by default and slerp for Quaternion.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <type_traits>
+
+#include "quaternion.h"
+
+template <typename T>
+struct HistoryInterpolator {
+    static T interpolate(const T& a, const T& b, const float t) { return a + ((b - a) * t); }
+};
+
+template <>
+struct HistoryInterpolator<Quaternion> {
+    static Quaternion interpolate(const Quaternion& a, const Quaternion& b, const float t) { return Quaternion::slerp(a, b, t); }
+};
+
+template <typename T, size_t CAPACITY>
+class SensorHistory {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SensorHistory capacity must be a power of 2");
+    static_assert(std::is_trivially_copyable<T>::value, "SensorHistory values must be trivially copyable");
+
+private:
+    struct Slot {
+        // 2 * index + 1 while being written, 2 * index + 2 once it holds sample 'index'
+        std::atomic<uint64_t> sequence;
+        uint64_t timestamp;
+        T value;
+    };
+
+    // Total number of samples ever added
+    alignas(64) std::atomic<uint64_t> writeCount;
+
+    alignas(64) Slot slots[CAPACITY];
+
+    // Copies sample 'index' out of its slot. Returns false if it has been (or is being) overwritten
+    bool read(const uint64_t index, uint64_t& timestamp, T* value) const {
+        const Slot& slot = slots[index & (CAPACITY - 1)];
+        const uint64_t expected = (2 * index) + 2;
+        if (slot.sequence.load(std::memory_order_acquire) != expected)
+            return false;
+        timestamp = slot.timestamp;
+        if (value)
+            *value = slot.value;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == expected;
+    }
+
+    // Oldest index that is safe to start a search from. Leaves some headroom for the writer to keep going
+    uint64_t oldestIndex(const uint64_t count) const {
+        const uint64_t headroom = CAPACITY / 8;
+        return (count > (CAPACITY - headroom)) ? (count - (CAPACITY - headroom)) : 0;
+    }
+
+    // Index of the last sample with timestamp <= 'timestamp' within [begin, end), or begin if there isn't one
+    // Returns false if the data moved under us
+    bool search(uint64_t begin, uint64_t end, const uint64_t timestamp, uint64_t& found) const {
+        while ((end - begin) > 1) {
+            const uint64_t middle = begin + ((end - begin) / 2);
+            uint64_t middleTimestamp;
+            if (!read(middle, middleTimestamp, nullptr))
+                return false;
+            if (middleTimestamp <= timestamp)
+                begin = middle;
+            else
+                end = middle;
+        }
+        found = begin;
+        return true;
+    }
+
+    // Interpolates between samples index and index + 1 (holding the end values outside the history)
+    bool interpolateAt(const uint64_t index, const uint64_t count, const uint64_t timestamp, T& out) const {
+        uint64_t timestampA;
+        T valueA;
+        if (!read(index, timestampA, &valueA))
+            return false;
+
+        if (timestamp <= timestampA || (index + 1) >= count) {
+            out = valueA;
+            return true;
+        }
+
+        uint64_t timestampB;
+        T valueB;
+        if (!read(index + 1, timestampB, &valueB))
+            return false;
+
+        if (timestampB <= timestampA) {
+            out = valueB;
+        } else {
+            const float t = (float)(timestamp - timestampA) / (float)(timestampB - timestampA);
+            out = HistoryInterpolator<T>::interpolate(valueA, valueB, (t > 1.0f) ? 1.0f : t);
+        }
+        return true;
+    }
+
+public:
+    SensorHistory() : writeCount(0) {
+        for (size_t i = 0; i < CAPACITY; i++)
+            slots[i].sequence.store(0, std::memory_order_relaxed);
+    }
+
+    static size_t capacity() { return CAPACITY; }
+
+    // Number of samples currently stored
+    size_t size() const {
+        const uint64_t count = writeCount.load(std::memory_order_acquire);
+        return (count < CAPACITY) ? count : CAPACITY;
+    }
+
+    // Adds a sample. Only call from one thread, with timestamps that never go backwards
+    void add(const uint64_t timestamp, const T& value) {
+        const uint64_t index = writeCount.load(std::memory_order_relaxed);
+        Slot& slot = slots[index & (CAPACITY - 1)];
+
+        slot.sequence.store((2 * index) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.timestamp = timestamp;
+        slot.value = value;
+        slot.sequence.store((2 * index) + 2, std::memory_order_release);
+
+        writeCount.store(index + 1, std::memory_order_release);
+    }
+
+    // Most recent sample. Returns false if the history is empty
+    bool getLatest(uint64_t& timestamp, T& value) const {
+        for (int attempt = 0; attempt < 4; attempt++) {
+            const uint64_t count = writeCount.load(std::memory_order_acquire);
+            if (count == 0)
+                return false;
+            if (read(count - 1, timestamp, &value))
+                return true;
+        }
+        return false;
+    }
+
+    // Interpolated value at a timestamp, O(log n). Timestamps outside the history get the nearest sample
+    // Returns false if the history is empty (or the writer kept lapping us)
+    bool sample(const uint64_t timestamp, T& out) const {
+        for (int attempt = 0; attempt < 4; attempt++) {
+            const uint64_t count = writeCount.load(std::memory_order_acquire);
+            if (count == 0)
+                return false;
+
+            uint64_t index;
+            if (search(oldestIndex(count), count, timestamp, index) && interpolateAt(index, count, timestamp, out))
+                return true;
+        }
+        return false;
+    }
+
+    // Interpolated values for many timestamps at once. When timestamps are in increasing order (like the points in a
+    // scan) only the first one is binary searched, the rest walk forward from there.
+    // Returns the number of values written to out, which is less than count only if the history is empty or lapped
+    size_t sampleBatch(const uint64_t* timestamps, const size_t count, T* out) const {
+        const uint64_t historyCount = writeCount.load(std::memory_order_acquire);
+        if (historyCount == 0 || count == 0)
+            return 0;
+
+        const uint64_t begin = oldestIndex(historyCount);
+        uint64_t index;
+        if (!search(begin, historyCount, timestamps[0], index))
+            return 0;
+
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t timestamp = timestamps[i];
+
+            if (i > 0 && timestamp < timestamps[i - 1]) {
+                // Out of order, fall back to a fresh search
+                if (!search(begin, historyCount, timestamp, index))
+                    return i;
+            } else {
+                // Walk forward
+                uint64_t nextTimestamp;
+                while ((index + 1) < historyCount) {
+                    if (!read(index + 1, nextTimestamp, nullptr))
+                        return i;
+                    if (nextTimestamp > timestamp)
+                        break;
+                    index++;
+                }
+            }
+
+            if (!interpolateAt(index, historyCount, timestamp, out[i]))
+                return i;
+        }
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "shared_sensors.h"
+
+#include <new>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "timestamp.h"
+
+// Creates (or recreates) a shared memory object of 'size' bytes and maps it
+static void* createSharedMemory(const char* name, const size_t size, const mode_t mode) {
+    shm_unlink(name);
+    const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, mode);
+    if (fd < 0) {
+        printf("Failed to create shared memory %s: %s\n", name, strerror(errno));
+        return nullptr;
+    }
+
+    // shm_open() applies the umask, which would take the group access back off
+    if (fchmod(fd, mode) != 0)
+        printf("Failed to set the mode of shared memory %s: %s\n", name, strerror(errno));
+
+    if (ftruncate(fd, size) != 0) {
+        printf("Failed to size shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return nullptr;
+    }
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        printf("Failed to map shared memory %s: %s\n", name, strerror(errno));
+        shm_unlink(name);
+        return nullptr;
+    }
+    return memory;
+}
+
+// Maps an existing shared memory object, if it's the expected size
+static void* openSharedMemory(const char* name, const size_t size) {
+    const int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || ((size_t)info.st_size != size)) {
+        printf("Shared memory %s has the wrong size (publisher built from a different version?)\n", name);
+        close(fd);
+        return nullptr;
+    }
+
+    // Read/write, waiting on a futex registers the reader in the mapping
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return (memory == MAP_FAILED) ? nullptr : memory;
+}
+
+bool SensorPublisher::start(const char* name, const mode_t mode) {
+    if (running)
+        return true;
+
+    this->name = name;
+    commandName = this->name + "_commands";
+
+    void* sensorMemory = createSharedMemory(this->name.c_str(), sizeof(SharedSensors::SensorLayout), mode);
+    if (!sensorMemory)
+        return false;
+    void* commandMemory = createSharedMemory(commandName.c_str(), sizeof(SharedSensors::CommandLayout), mode);
+    if (!commandMemory) {
+        munmap(sensorMemory, sizeof(SharedSensors::SensorLayout));
+        shm_unlink(this->name.c_str());
+        return false;
+    }
+
+    // Construct the rings in place, subscribers only look at them once the magic is there
+    SharedSensors::SensorLayout* layout = new (sensorMemory) SharedSensors::SensorLayout();
+    layout->version = SharedSensors::VERSION;
+    layout->publisherAlive.store(1, std::memory_order_relaxed);
+    commands = new (commandMemory) SharedSensors::CommandLayout();
+    commands->version = SharedSensors::VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    layout->magic = SharedSensors::MAGIC;
+    commands->magic = SharedSensors::MAGIC;
+    sensors.store(layout);
+
+    running = true;
+    commandThread = std::thread(&SensorPublisher::commandLoop, this);
+    return true;
+}
+
+bool SensorPublisher::stop() {
+    if (!running)
+        return true;
+
+    running = false;
+    if (commandThread.joinable())
+        commandThread.join();
+
+    // No new publish calls from here, then wait out the ones that already have the pointer
+    SharedSensors::SensorLayout* layout = sensors.exchange(nullptr);
+    while (publishing.load() > 0)
+        std::this_thread::yield();
+
+    // Subscribers keep their mappings until they close, tell them there won't be anything new
+    layout->publisherAlive.store(0, std::memory_order_release);
+    munmap(layout, sizeof(SharedSensors::SensorLayout));
+    munmap(commands, sizeof(SharedSensors::CommandLayout));
+    commands = nullptr;
+    shm_unlink(name.c_str());
+    shm_unlink(commandName.c_str());
+    return true;
+}
+
+void SensorPublisher::commandLoop() {
+    SharedSensors::Command command;
+    while (running) {
+        // Short timeout so stop() doesn't wait long
+        if (!commands->commands.wait(100 * NSECS_TO_MSECS))
+            continue;
+
+        while (commands->commands.pop(command)) {
+            stats.commandsReceived++;
+            if (commandCallback)
+                commandCallback(command);
+        }
+    }
+}
+
+// Both sides sequentially consistent: either stop() sees the count go up, or this sees its nullptr
+SharedSensors::SensorLayout* SensorPublisher::beginPublish() {
+    publishing.fetch_add(1);
+    SharedSensors::SensorLayout* layout = sensors.load();
+    if (!layout)
+        endPublish();
+    return layout;
+}
+
+void SensorPublisher::publishImu(const MausBoard::ImuData& imuData) {
+    SharedSensors::SensorLayout* layout = beginPublish();
+    if (!layout)
+        return;
+    layout->imu.push(imuData);
+    stats.imuPublished++;
+    endPublish();
+}
+
+void SensorPublisher::publishRawImu(const MausBoard::RawImuSample* samples, const size_t count) {
+    SharedSensors::SensorLayout* layout = beginPublish();
+    if (!layout)
+        return;
+    for (size_t i = 0; i < count; i++)
+        layout->rawImu.push(samples[i]);
+    stats.rawImuPublished += count;
+    endPublish();
+}
+
+void SensorPublisher::publishEsc(const MausBoard::EscTelemetry& escTelemetry) {
+    SharedSensors::SensorLayout* layout = beginPublish();
+    if (!layout)
+        return;
+    layout->esc.push(escTelemetry);
+    stats.escPublished++;
+    endPublish();
+}
+
+void SensorPublisher::publishScan(const LD19::LidarPoint* points, const size_t count) {
+    SharedSensors::SensorLayout* layout = beginPublish();
+    if (!layout)
+        return;
+
+    // Written straight into the slot
+    const size_t kept = std::min(count, (size_t)SharedSensors::MAX_SCAN_POINTS);
+    SharedSensors::Scan& scan = layout->scans.beginWrite();
+    scan.timestamp = (count > 0) ? points[count - 1].timestamp : TimeStamp::get();
+    scan.count = kept;
+    memcpy(scan.points, points, kept * sizeof(LD19::LidarPoint));
+    layout->scans.endWrite();
+
+    stats.scansPublished++;
+    stats.scanPointsDropped += count - kept;
+    endPublish();
+}
+
+void SensorPublisher::printStats() const {
+    printf("SensorPublisher: %llu IMU, %llu raw IMU, %llu ESC, %llu scans (%llu points dropped), %llu commands\n",
+        (unsigned long long)stats.imuPublished, (unsigned long long)stats.rawImuPublished,
+        (unsigned long long)stats.escPublished, (unsigned long long)stats.scansPublished,
+        (unsigned long long)stats.scanPointsDropped, (unsigned long long)stats.commandsReceived);
+}
+
+bool SensorSubscriber::open(const char* name) {
+    close();
+
+    const std::string commandName = std::string(name) + "_commands";
+    void* sensorMemory = openSharedMemory(name, sizeof(SharedSensors::SensorLayout));
+    void* commandMemory = openSharedMemory(commandName.c_str(), sizeof(SharedSensors::CommandLayout));
+    sensors = (SharedSensors::SensorLayout*)sensorMemory;
+    commands = (SharedSensors::CommandLayout*)commandMemory;
+
+    if (!sensors || !commands || (sensors->magic != SharedSensors::MAGIC) || (commands->magic != SharedSensors::MAGIC) ||
+        (sensors->version != SharedSensors::VERSION) || (commands->version != SharedSensors::VERSION)) {
+        close();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+void SensorSubscriber::close() {
+    if (sensors)
+        munmap(sensors, sizeof(SharedSensors::SensorLayout));
+    if (commands)
+        munmap(commands, sizeof(SharedSensors::CommandLayout));
+    sensors = nullptr;
+    commands = nullptr;
+}
+
+bool SensorSubscriber::sendSetServos(const uint16_t steering, const uint16_t throttle) {
+    if (!commands)
+        return false;
+
+    SharedSensors::Command command = {};
+    command.timestamp = TimeStamp::get();
+    command.type = SharedSensors::COMMAND_SET_SERVOS;
+    command.steeringMicros = steering;
+    command.throttleMicros = throttle;
+    return commands->commands.push(command);
+}
+
+bool SensorSubscriber::sendSetImuMode(const MausBoard::ImuMode mode, const uint16_t rateHz) {
+    if (!commands)
+        return false;
+
+    SharedSensors::Command command = {};
+    command.timestamp = TimeStamp::get();
+    command.type = SharedSensors::COMMAND_SET_IMU_MODE;
+    command.imuMode = mode;
+    command.imuRateHz = rateHz;
+    return commands->commands.push(command);
+}
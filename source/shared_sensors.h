@@ -0,0 +1,161 @@
+#ifndef __SHARED_SENSORS_H__
+#define __SHARED_SENSORS_H__
+
+// Sensor data shared with other processes through POSIX shared memory
+// Only one process can own the board and lidar UARTs. That process runs a SensorPublisher and forwards the driver
+// callbacks into it, and any number of other processes (logger, SLAM, controller...) open a SensorSubscriber.
+//
+// Two shared memory objects:
+//   <name>           IMU samples, raw IMU samples, ESC telemetry and scans, each in a ShmRing with sequence numbers.
+//                    Subscribers read the slots in place, the fast path is plain loads (no copies, no syscalls), and
+//                    they can block on a futex until the next item instead of polling.
+//   <name>_commands  ShmQueue of commands going back (sendSetServos, sendSetImuMode), the publisher drains it on its
+//                    own thread and hands each one to commandCallback.
+// Both are created 0600 by default, anyone who can write the command queue can drive the car. Pass 0660 to start() to
+// let processes in the publisher's group subscribe (e.g. a "maus" group the logger and SLAM users are in).
+//
+// Reading the latest scan without copying it:
+//   const auto& scans = subscriber.getSensors().scans;
+//   const uint64_t index = scans.getWriteCount() - 1;
+//   const SharedSensors::Scan* scan = scans.peek(index);
+//   ... use scan->points ...
+//   if (!scans.isIntact(index)) { ... the publisher lapped us, discard what was computed ... }
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "maus_board.h"
+#include "fhl_ld19.h"
+#include "shm_ring.h"
+
+#define DEFAULT_SHARED_SENSORS_NAME "/maus_sensors"
+
+class SharedSensors {
+public:
+    static const uint32_t MAGIC = 0x4D415553; // "MAUS"
+    static const uint32_t VERSION = 1;
+
+    static const size_t MAX_SCAN_POINTS = 1024;
+
+    struct Scan {
+        uint64_t timestamp;                 // Nanoseconds since epoch, last point of the scan
+        uint32_t count;
+        LD19::LidarPoint points[MAX_SCAN_POINTS];
+    };
+
+    enum CommandType : uint8_t {
+        COMMAND_SET_SERVOS = 0,
+        COMMAND_SET_IMU_MODE = 1
+    };
+
+    struct Command {
+        uint64_t timestamp;                 // Nanoseconds since epoch, when it was sent
+        CommandType type;
+        uint16_t steeringMicros;            // COMMAND_SET_SERVOS
+        uint16_t throttleMicros;
+        MausBoard::ImuMode imuMode;         // COMMAND_SET_IMU_MODE
+        uint16_t imuRateHz;
+    };
+
+    struct SensorLayout {
+        uint32_t magic;                     // Written last, once everything else is initialized
+        uint32_t version;
+        std::atomic<uint32_t> publisherAlive;
+
+        ShmRing<MausBoard::ImuData, 1024> imu;
+        ShmRing<MausBoard::RawImuSample, 4096> rawImu;
+        ShmRing<MausBoard::EscTelemetry, 256> esc;
+        ShmRing<Scan, 16> scans;
+    };
+
+    struct CommandLayout {
+        uint32_t magic;
+        uint32_t version;
+
+        ShmQueue<Command, 256> commands;
+    };
+};
+
+class SensorPublisher {
+public:
+    struct Stats {
+        uint64_t imuPublished;
+        uint64_t rawImuPublished;
+        uint64_t escPublished;
+        uint64_t scansPublished;
+        uint64_t scanPointsDropped;         // Points past MAX_SCAN_POINTS
+        uint64_t commandsReceived;
+    };
+
+private:
+    std::string name;
+    std::string commandName;
+    SharedSensors::CommandLayout* commands = nullptr;
+
+    // The driver threads can be inside a publish call while stop() runs. stop() clears sensors first and then waits for
+    // the calls in flight (publishing) before unmapping, so a late callback finds nullptr instead of a dangling mapping
+    std::atomic<SharedSensors::SensorLayout*> sensors{nullptr};
+    std::atomic<uint32_t> publishing{0};
+
+    SharedSensors::SensorLayout* beginPublish();
+    void endPublish() { publishing.fetch_sub(1, std::memory_order_release); }
+
+    std::atomic<bool> running{false};
+    std::thread commandThread;
+
+    Stats stats = {};
+
+    void commandLoop();
+
+public:
+    // Called on the publisher's command thread for each command from a subscriber (e.g. to call board.sendSetServos)
+    void (*commandCallback)(const SharedSensors::Command&) = nullptr;
+
+    ~SensorPublisher() { stop(); }
+
+    // Creates the shared memory (replacing any left over from a previous run) with the given permissions and starts the
+    // command thread
+    bool start(const char* name = DEFAULT_SHARED_SENSORS_NAME, const mode_t mode = 0600);
+
+    // Safe to call while the drivers are still running, publishing after it does nothing
+    bool stop();
+
+    // Call from the driver callbacks. Never block, a slow subscriber just gets lapped
+    void publishImu(const MausBoard::ImuData& imuData);
+    void publishRawImu(const MausBoard::RawImuSample* samples, const size_t count);
+    void publishEsc(const MausBoard::EscTelemetry& escTelemetry);
+    void publishScan(const LD19::LidarPoint* points, const size_t count);
+
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+class SensorSubscriber {
+private:
+    SharedSensors::SensorLayout* sensors = nullptr;
+    SharedSensors::CommandLayout* commands = nullptr;
+
+public:
+    ~SensorSubscriber() { close(); }
+
+    // Maps a running publisher's shared memory. Returns false if there isn't one (yet)
+    bool open(const char* name = DEFAULT_SHARED_SENSORS_NAME);
+    void close();
+    bool isOpen() const { return sensors != nullptr; }
+
+    // False once the publisher stopped (reopen after it restarts, it creates new shared memory)
+    bool isPublisherAlive() const { return sensors && sensors->publisherAlive.load(std::memory_order_acquire); }
+
+    // Rings to read from, see ShmRing. Only valid while open
+    const SharedSensors::SensorLayout& getSensors() const { return *sensors; }
+
+    // Returns false if the command queue is full (or not open)
+    bool sendSetServos(const uint16_t steering, const uint16_t throttle);
+    bool sendSetImuMode(const MausBoard::ImuMode mode, const uint16_t rateHz = 1000);
+};
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef __SHM_RING_H__
+#define __SHM_RING_H__
+
+// Lock-free containers that live in POSIX shared memory, shared between processes
+// Only lock-free atomics are used (they're address free, so they work from different mappings), and waiting is done
+// with a futex on a word inside the mapping. Writers only make the wake syscall when someone is actually waiting.
+//
+// ShmRing: one writer, any number of readers. Same sequence scheme as SensorHistory, but readers can look at a slot
+//          in place (peek) and check it wasn't overwritten afterwards (isIntact), no copies.
+// ShmQueue: any number of writers, one reader (bounded queue with per cell sequences, D. Vyukov's design).
+//
+// Both have to be constructed in the mapping by the process that creates it (placement new), the others just map it.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <errno.h>
+#include <atomic>
+#include <type_traits>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "timestamp.h"
+
+class ShmFutex {
+public:
+    // Blocks while *word == expected, for at most timeoutNsecs. Returns false if it timed out
+    static bool wait(std::atomic<uint32_t>* word, const uint32_t expected, const uint64_t timeoutNsecs) {
+        struct timespec timeout;
+        timeout.tv_sec = timeoutNsecs / NSECS_TO_SECS;
+        timeout.tv_nsec = timeoutNsecs % NSECS_TO_SECS;
+        // Not FUTEX_PRIVATE_FLAG, the word is shared between processes
+        const long result = syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, &timeout, nullptr, 0);
+        return (result == 0) || (errno != ETIMEDOUT);
+    }
+
+    static void wakeAll(std::atomic<uint32_t>* word) {
+        syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+};
+
+// Notification shared by both containers: writers bump the word, waiters sleep on it
+class ShmNotifier {
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared memory needs lock-free 32 bit atomics");
+
+private:
+    mutable std::atomic<uint32_t> word;
+    mutable std::atomic<uint32_t> waiters;
+
+public:
+    ShmNotifier() : word(0), waiters(0) {}
+
+    // Call after publishing. No syscall unless someone is waiting
+    void notify() {
+        word.fetch_add(1, std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_seq_cst) > 0)
+            ShmFutex::wakeAll(&word);
+    }
+
+    // Waits until ready() is true, or timeoutNsecs passed. Returns ready()
+    template <typename Ready>
+    bool waitUntil(Ready ready, const uint64_t timeoutNsecs) const {
+        if (ready())
+            return true;
+
+        const uint64_t deadline = TimeStamp::getMonotonic() + timeoutNsecs;
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        bool result = false;
+        while (true) {
+            const uint32_t seen = word.load(std::memory_order_seq_cst);
+            if (ready()) {
+                result = true;
+                break;
+            }
+            const uint64_t now = TimeStamp::getMonotonic();
+            if (now >= deadline)
+                break;
+            ShmFutex::wait(&word, seen, deadline - now);
+        }
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+        return result;
+    }
+};
+
+template <typename T, size_t CAPACITY>
+class ShmRing {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "ShmRing capacity must be a power of 2");
+    static_assert(std::is_trivially_copyable<T>::value, "ShmRing values must be trivially copyable");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory needs lock-free 64 bit atomics");
+
+private:
+    struct Slot {
+        // 2 * index + 1 while being written, 2 * index + 2 once it holds item 'index'
+        std::atomic<uint64_t> sequence;
+        T value;
+    };
+
+    // Total number of items ever written
+    alignas(64) std::atomic<uint64_t> writeCount;
+    alignas(64) ShmNotifier notifier;
+
+    alignas(64) Slot slots[CAPACITY];
+
+public:
+    ShmRing() : writeCount(0) {
+        for (size_t i = 0; i < CAPACITY; i++)
+            slots[i].sequence.store(0, std::memory_order_relaxed);
+    }
+
+    static size_t capacity() { return CAPACITY; }
+
+    // Writer: fill the slot in place between beginWrite() and endWrite() (for big items like scans), or push()
+    T& beginWrite() {
+        const uint64_t index = writeCount.load(std::memory_order_relaxed);
+        Slot& slot = slots[index & (CAPACITY - 1)];
+        slot.sequence.store((2 * index) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return slot.value;
+    }
+
+    void endWrite() {
+        const uint64_t index = writeCount.load(std::memory_order_relaxed);
+        slots[index & (CAPACITY - 1)].sequence.store((2 * index) + 2, std::memory_order_release);
+        writeCount.store(index + 1, std::memory_order_release);
+        notifier.notify();
+    }
+
+    void push(const T& value) {
+        beginWrite() = value;
+        endWrite();
+    }
+
+    // Readers: items [getWriteCount() - capacity(), getWriteCount()) are available (minus the one being written)
+    uint64_t getWriteCount() const { return writeCount.load(std::memory_order_acquire); }
+
+    // Item 'index' in place, or nullptr if it's not there (yet or anymore). Check isIntact() after using it
+    const T* peek(const uint64_t index) const {
+        const Slot& slot = slots[index & (CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != ((2 * index) + 2))
+            return nullptr;
+        return &slot.value;
+    }
+
+    // Whether item 'index' is still in its slot, i.e. everything read from peek() since is valid
+    bool isIntact(const uint64_t index) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slots[index & (CAPACITY - 1)].sequence.load(std::memory_order_relaxed) == ((2 * index) + 2);
+    }
+
+    // Copies item 'index' out. Returns false if it's not there
+    bool read(const uint64_t index, T& value) const {
+        const T* item = peek(index);
+        if (!item)
+            return false;
+        value = *item;
+        return isIntact(index);
+    }
+
+    // Blocks until more than 'count' items have been written, or the timeout. Returns false on timeout
+    bool waitForCount(const uint64_t count, const uint64_t timeoutNsecs) const {
+        return notifier.waitUntil([&]() { return getWriteCount() > count; }, timeoutNsecs);
+    }
+};
+
+template <typename T, size_t CAPACITY>
+class ShmQueue {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "ShmQueue capacity must be a power of 2");
+    static_assert(std::is_trivially_copyable<T>::value, "ShmQueue values must be trivially copyable");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory needs lock-free 64 bit atomics");
+
+private:
+    struct Cell {
+        // position while free for the writer at 'position', position + 1 once written
+        std::atomic<uint64_t> sequence;
+        T value;
+    };
+
+    alignas(64) std::atomic<uint64_t> tail;     // Next position to write
+    alignas(64) std::atomic<uint64_t> head;     // Next position to read
+    alignas(64) ShmNotifier notifier;
+
+    alignas(64) Cell cells[CAPACITY];
+
+public:
+    ShmQueue() : tail(0), head(0) {
+        for (size_t i = 0; i < CAPACITY; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // Any process. Returns false if the queue is full
+    bool push(const T& value) {
+        uint64_t position = tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[position & (CAPACITY - 1)];
+            const int64_t difference = (int64_t)cell->sequence.load(std::memory_order_acquire) - (int64_t)position;
+            if (difference == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = value;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        notifier.notify();
+        return true;
+    }
+
+    // Only the one reader. Returns false if the queue is empty
+    bool pop(T& value) {
+        const uint64_t position = head.load(std::memory_order_relaxed);
+        Cell& cell = cells[position & (CAPACITY - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != (position + 1))
+            return false;
+        value = cell.value;
+        cell.sequence.store(position + CAPACITY, std::memory_order_release);
+        head.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Blocks until there's something to pop, or the timeout. Returns false on timeout
+    bool wait(const uint64_t timeoutNsecs) const {
+        return notifier.waitUntil([&]() {
+            const uint64_t position = head.load(std::memory_order_relaxed);
+            return cells[position & (CAPACITY - 1)].sequence.load(std::memory_order_acquire) == (position + 1);
+        }, timeoutNsecs);
+    }
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+
+// Fixed capacity single producer, single consumer queue. Lock-free and never allocates
+// push() from one thread and pop() from one other thread
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+template <typename T, size_t CAPACITY>
+class SpscQueue {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SpscQueue capacity must be a power of 2");
+
+private:
+    alignas(64) std::atomic<size_t> head; // Next slot to pop
+    alignas(64) std::atomic<size_t> tail; // Next slot to push
+    T items[CAPACITY];
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    // Returns false if the queue is full
+    bool push(const T& item) {
+        const size_t currentTail = tail.load(std::memory_order_relaxed);
+        if ((currentTail - head.load(std::memory_order_acquire)) >= CAPACITY)
+            return false;
+        items[currentTail & (CAPACITY - 1)] = item;
+        tail.store(currentTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool pop(T& item) {
+        const size_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead == tail.load(std::memory_order_acquire))
+            return false;
+        item = items[currentHead & (CAPACITY - 1)];
+        head.store(currentHead + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Oldest item without popping it, nullptr if the queue is empty. Consumer thread only
+    const T* front() const {
+        const size_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead == tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &items[currentHead & (CAPACITY - 1)];
+    }
+
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+};
+
+#endif
@@ -0,0 +1,705 @@
+#include "tcp_bridge.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <chrono>
+
+// Zigzag varints, small differences of either sign take few bytes
+static uint8_t* writeVarint(uint8_t* out, const int64_t value) {
+    uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    while (zigzag >= 0x80) {
+        *out++ = (uint8_t)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    *out++ = (uint8_t)zigzag;
+    return out;
+}
+
+static const uint8_t* readVarint(const uint8_t* in, const uint8_t* end, int64_t& value) {
+    uint64_t zigzag = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (in >= end)
+            return nullptr;
+        const uint8_t byte = *in++;
+        zigzag |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+            return in;
+        }
+    }
+    return nullptr;
+}
+
+static void setNoDelay(const int fd) {
+    const int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+}
+
+size_t BridgeProtocol::encodeScan(const LD19::LidarPoint* points, const size_t count, uint8_t* out) {
+    const uint16_t pointCount = count;
+    const uint64_t firstTimestamp = (count > 0) ? points[0].timestamp : 0;
+    memcpy(&out[0], &pointCount, 2);
+    memcpy(&out[2], &firstTimestamp, 8);
+
+    uint8_t* position = &out[10];
+    // Deltas wrap around in unsigned, the decoder wraps back
+    uint64_t previousDistance = 0;
+    uint64_t previousAngle = 0;
+    uint64_t previousTimestamp = firstTimestamp;
+    for (size_t i = 0; i < count; i++) {
+        position = writeVarint(position, (int64_t)(points[i].distance - previousDistance));
+        position = writeVarint(position, (int64_t)(points[i].angle - previousAngle));
+        position = writeVarint(position, (int64_t)(points[i].timestamp - previousTimestamp));
+        *position++ = points[i].intensity;
+
+        previousDistance = points[i].distance;
+        previousAngle = points[i].angle;
+        previousTimestamp = points[i].timestamp;
+    }
+    return position - out;
+}
+
+size_t BridgeProtocol::decodeScan(const uint8_t* payload, const size_t length, LD19::LidarPoint* points, const size_t maxPoints) {
+    if (length < 10)
+        return 0;
+    uint16_t count;
+    uint64_t firstTimestamp;
+    memcpy(&count, &payload[0], 2);
+    memcpy(&firstTimestamp, &payload[2], 8);
+    if (count > maxPoints)
+        return 0;
+
+    const uint8_t* position = &payload[10];
+    const uint8_t* end = payload + length;
+    uint64_t distance = 0;
+    uint64_t angle = 0;
+    uint64_t timestamp = firstTimestamp;
+    for (size_t i = 0; i < count; i++) {
+        int64_t distanceDelta;
+        int64_t angleDelta;
+        int64_t timestampDelta;
+        position = readVarint(position, end, distanceDelta);
+        if (position)
+            position = readVarint(position, end, angleDelta);
+        if (position)
+            position = readVarint(position, end, timestampDelta);
+        if (!position || (position >= end))
+            return 0;
+
+        distance += distanceDelta;
+        angle += angleDelta;
+        timestamp += timestampDelta;
+        points[i].distance = distance;
+        points[i].angle = angle;
+        points[i].timestamp = timestamp;
+        points[i].intensity = *position++;
+    }
+    return (position == end) ? count : 0;
+}
+
+void BridgeProtocol::writeHeader(uint8_t* out, const FrameType type, const uint32_t length) {
+    FrameHeader header;
+    header.magic[0] = MAGIC_0;
+    header.magic[1] = MAGIC_1;
+    header.type = type;
+    header.length = length;
+    header.timestamp = TimeStamp::get();
+    memcpy(out, &header, sizeof(header));
+}
+
+bool BridgeProtocol::sendAll(const int fd, const uint8_t* data, const size_t length) {
+    size_t sent = 0;
+    while (sent < length) {
+        const ssize_t result = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        sent += result;
+    }
+    return true;
+}
+
+BridgeServer::BridgeServer() : BridgeServer(Config()) {}
+
+BridgeServer::BridgeServer(const Config& config) :
+    config(config),
+    sendBuffer(new uint8_t[(4 * sizeof(BridgeProtocol::FrameHeader)) + 2 + (MAX_QUEUED_IMU * sizeof(MausBoard::ImuData)) +
+        2 + (MAX_QUEUED_ESC * sizeof(MausBoard::EscTelemetry)) + BridgeProtocol::maxEncodedScanSize(BridgeProtocol::MAX_SCAN_POINTS) + 8]) {}
+
+bool BridgeServer::start() {
+    if (running) {
+        printf("Bridge server is already running\n");
+        return false;
+    }
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.bindAddress.c_str(), &address.sin_addr) != 1) {
+        printf("Invalid bridge bind address %s\n", config.bindAddress.c_str());
+        return false;
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        printf("Unable to create bridge socket: %s\n", strerror(errno));
+        return false;
+    }
+    const int enable = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    if ((bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0) || (listen(listenFd, 1) != 0)) {
+        printf("Unable to listen on %s:%u: %s\n", config.bindAddress.c_str(), config.port, strerror(errno));
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    stats = {};
+    stats.startTimestamp = TimeStamp::getMonotonic();
+    running = true;
+    networkThread = std::thread(&BridgeServer::networkLoop, this);
+    sendThread = std::thread(&BridgeServer::sendLoop, this);
+    return true;
+}
+
+bool BridgeServer::stop() {
+    if (!running)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        running = false;
+    }
+    queueCondition.notify_all();
+    networkThread.join();
+    sendThread.join();
+    close(listenFd);
+    listenFd = -1;
+    return true;
+}
+
+void BridgeServer::closeClient() {
+    const int fd = clientFd.exchange(-1);
+    if (fd < 0)
+        return;
+
+    // Unblocks a send in progress, then wait for the sender to let go of the socket
+    shutdown(fd, SHUT_RDWR);
+    {
+        std::lock_guard<std::mutex> lock(clientMutex);
+        close(fd);
+    }
+
+    if (linkLostCallback)
+        linkLostCallback();
+}
+
+size_t BridgeServer::parseCommands(uint8_t* buffer, size_t& length) {
+    const size_t headerSize = sizeof(BridgeProtocol::FrameHeader);
+    size_t frames = 0;
+    size_t position = 0;
+    while ((length - position) >= headerSize) {
+        BridgeProtocol::FrameHeader header;
+        memcpy(&header, &buffer[position], headerSize);
+        if ((header.magic[0] != BridgeProtocol::MAGIC_0) || (header.magic[1] != BridgeProtocol::MAGIC_1) ||
+            (header.length > (RECEIVE_BUFFER_SIZE - headerSize))) {
+            // Lost sync, look for the next magic
+            position++;
+            continue;
+        }
+        if ((length - position) < (headerSize + header.length))
+            break;
+
+        const uint8_t* payload = &buffer[position + headerSize];
+        if ((header.type == BridgeProtocol::FRAME_SET_SERVOS) && (header.length == 4)) {
+            uint16_t steering;
+            uint16_t throttle;
+            memcpy(&steering, &payload[0], 2);
+            memcpy(&throttle, &payload[2], 2);
+            stats.commandsReceived++;
+            if (setServosCallback)
+                setServosCallback(steering, throttle);
+        } else if ((header.type == BridgeProtocol::FRAME_SET_RGB) && (header.length >= 1) && (header.length == (1 + (payload[0] * 4u)))) {
+            std::vector<uint32_t> colors(payload[0]);
+            memcpy(colors.data(), &payload[1], colors.size() * 4);
+            stats.commandsReceived++;
+            if (setRgbCallback)
+                setRgbCallback(colors);
+        } else if ((header.type == BridgeProtocol::FRAME_PING) && (header.length == 8)) {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                memcpy(&pendingPong, payload, 8);
+                pongPending = true;
+            }
+            queueCondition.notify_one();
+        }
+        position += headerSize + header.length;
+        frames++;
+    }
+
+    memmove(buffer, &buffer[position], length - position);
+    length -= position;
+    return frames;
+}
+
+void BridgeServer::networkLoop() {
+    uint8_t buffer[RECEIVE_BUFFER_SIZE];
+    size_t length = 0;
+
+    while (running) {
+        struct pollfd fds[2];
+        fds[0] = {listenFd, POLLIN, 0};
+        fds[1] = {clientFd.load(), POLLIN, 0};
+        const nfds_t fdCount = (fds[1].fd >= 0) ? 2 : 1;
+        const int ready = poll(fds, fdCount, 100);
+
+        // A client that went silent without closing the connection
+        if ((fdCount > 1) && (config.clientTimeoutNsecs > 0) &&
+            ((TimeStamp::getMonotonic() - lastFrameTimestamp) > config.clientTimeoutNsecs)) {
+            printf("Bridge client timed out\n");
+            stats.clientTimeouts++;
+            closeClient();
+            length = 0;
+            continue;
+        }
+        if (ready <= 0)
+            continue;
+
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept(listenFd, nullptr, nullptr);
+            if ((fd >= 0) && (clientFd.load() >= 0)) {
+                // Already controlled by someone
+                stats.connectionsRefused++;
+                close(fd);
+            } else if (fd >= 0) {
+                setNoDelay(fd);
+                length = 0;
+                lastFrameTimestamp = TimeStamp::getMonotonic();
+                clientFd = fd;
+                stats.connections++;
+            }
+            continue;
+        }
+
+        if ((fdCount > 1) && fds[1].revents) {
+            const ssize_t received = recv(fds[1].fd, &buffer[length], RECEIVE_BUFFER_SIZE - length, 0);
+            if (received <= 0) {
+                closeClient();
+                length = 0;
+                continue;
+            }
+            stats.bytesReceived += received;
+            length += received;
+            if (parseCommands(buffer, length) > 0)
+                lastFrameTimestamp = TimeStamp::getMonotonic();
+        }
+    }
+
+    closeClient();
+}
+
+void BridgeServer::sendLoop() {
+    const size_t headerSize = sizeof(BridgeProtocol::FrameHeader);
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (running) {
+        // Pongs go out right away so they measure the link, everything else waits for the batch
+        queueCondition.wait_for(lock, std::chrono::nanoseconds(config.batchIntervalNsecs), [&]() { return !running || pongPending; });
+        if (!running)
+            break;
+
+        // Take everything that's queued
+        const size_t imuCount = imuQueueCount;
+        for (size_t i = 0; i < imuCount; i++)
+            imuStaging[i] = imuQueue[(imuQueueStart + i) % MAX_QUEUED_IMU];
+        imuQueueStart = 0;
+        imuQueueCount = 0;
+
+        const size_t escCount = escQueueCount;
+        for (size_t i = 0; i < escCount; i++)
+            escStaging[i] = escQueue[(escQueueStart + i) % MAX_QUEUED_ESC];
+        escQueueStart = 0;
+        escQueueCount = 0;
+
+        const size_t scanCount = scanPending ? pendingScanCount : 0;
+        const bool hasScan = scanPending;
+        if (hasScan)
+            memcpy(scanStaging, pendingScan, scanCount * sizeof(LD19::LidarPoint));
+        scanPending = false;
+
+        const bool hasPong = pongPending;
+        const uint64_t pong = pendingPong;
+        pongPending = false;
+        lock.unlock();
+
+        if (clientFd.load() >= 0) {
+            // One buffer, one write
+            uint8_t* buffer = sendBuffer.get();
+            size_t length = 0;
+            if (hasPong) {
+                BridgeProtocol::writeHeader(&buffer[length], BridgeProtocol::FRAME_PONG, 8);
+                memcpy(&buffer[length + headerSize], &pong, 8);
+                length += headerSize + 8;
+            }
+            if (imuCount > 0) {
+                const uint16_t count = imuCount;
+                const size_t payloadSize = 2 + (imuCount * sizeof(MausBoard::ImuData));
+                BridgeProtocol::writeHeader(&buffer[length], BridgeProtocol::FRAME_IMU, payloadSize);
+                memcpy(&buffer[length + headerSize], &count, 2);
+                memcpy(&buffer[length + headerSize + 2], imuStaging, imuCount * sizeof(MausBoard::ImuData));
+                length += headerSize + payloadSize;
+            }
+            if (escCount > 0) {
+                const uint16_t count = escCount;
+                const size_t payloadSize = 2 + (escCount * sizeof(MausBoard::EscTelemetry));
+                BridgeProtocol::writeHeader(&buffer[length], BridgeProtocol::FRAME_ESC, payloadSize);
+                memcpy(&buffer[length + headerSize], &count, 2);
+                memcpy(&buffer[length + headerSize + 2], escStaging, escCount * sizeof(MausBoard::EscTelemetry));
+                length += headerSize + payloadSize;
+            }
+            size_t scanBytes = 0;
+            if (hasScan) {
+                scanBytes = BridgeProtocol::encodeScan(scanStaging, scanCount, &buffer[length + headerSize]);
+                BridgeProtocol::writeHeader(&buffer[length], BridgeProtocol::FRAME_SCAN, scanBytes);
+                length += headerSize + scanBytes;
+            }
+
+            if (length > 0) {
+                std::lock_guard<std::mutex> clientLock(clientMutex);
+                const int fd = clientFd.load();
+                if ((fd >= 0) && BridgeProtocol::sendAll(fd, buffer, length)) {
+                    stats.writes++;
+                    stats.bytesSent += length;
+                    stats.imuSent += imuCount;
+                    stats.escSent += escCount;
+                    if (hasScan) {
+                        stats.scansSent++;
+                        stats.scanRawBytes += scanCount * sizeof(LD19::LidarPoint);
+                        stats.scanEncodedBytes += scanBytes;
+                    }
+                }
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+void BridgeServer::publishImu(const MausBoard::ImuData& imuData) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (imuQueueCount == MAX_QUEUED_IMU) {
+        imuQueueStart = (imuQueueStart + 1) % MAX_QUEUED_IMU;
+        imuQueueCount--;
+        stats.imuDropped++;
+    }
+    imuQueue[(imuQueueStart + imuQueueCount) % MAX_QUEUED_IMU] = imuData;
+    imuQueueCount++;
+}
+
+void BridgeServer::publishEsc(const MausBoard::EscTelemetry& escTelemetry) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (escQueueCount == MAX_QUEUED_ESC) {
+        escQueueStart = (escQueueStart + 1) % MAX_QUEUED_ESC;
+        escQueueCount--;
+        stats.escDropped++;
+    }
+    escQueue[(escQueueStart + escQueueCount) % MAX_QUEUED_ESC] = escTelemetry;
+    escQueueCount++;
+}
+
+void BridgeServer::publishScan(const LD19::LidarPoint* points, const size_t count) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (scanPending)
+        stats.scansDropped++;
+    pendingScanCount = std::min(count, (size_t)BridgeProtocol::MAX_SCAN_POINTS);
+    memcpy(pendingScan, points, pendingScanCount * sizeof(LD19::LidarPoint));
+    scanPending = true;
+}
+
+void BridgeServer::printStats() const {
+    const double seconds = (double)(TimeStamp::getMonotonic() - stats.startTimestamp) / NSECS_TO_SECS;
+    printf("BridgeServer: %llu connections (%llu refused, %llu timed out), %.1f kB/s out (%llu writes), %.1f kB/s in, %llu commands\n",
+        (unsigned long long)stats.connections, (unsigned long long)stats.connectionsRefused, (unsigned long long)stats.clientTimeouts,
+        (stats.bytesSent / 1000.0) / seconds, (unsigned long long)stats.writes,
+        (stats.bytesReceived / 1000.0) / seconds, (unsigned long long)stats.commandsReceived);
+    printf("  IMU %llu sent %llu dropped, ESC %llu sent %llu dropped, scans %llu sent %llu dropped (%.0f%% of raw size)\n",
+        (unsigned long long)stats.imuSent, (unsigned long long)stats.imuDropped,
+        (unsigned long long)stats.escSent, (unsigned long long)stats.escDropped,
+        (unsigned long long)stats.scansSent, (unsigned long long)stats.scansDropped,
+        stats.scanRawBytes ? (100.0 * stats.scanEncodedBytes / stats.scanRawBytes) : 0.0);
+}
+
+BridgeClient::BridgeClient(void (*imuDataCallback)(const MausBoard::ImuData&), void (*escTelemetryCallback)(const MausBoard::EscTelemetry&),
+    void (*fullScanCallback)(std::vector<LD19::LidarPoint>)) :
+    imuDataCallback(imuDataCallback),
+    escTelemetryCallback(escTelemetryCallback),
+    fullScanCallback(fullScanCallback),
+    receiveBuffer(new uint8_t[RECEIVE_BUFFER_SIZE]),
+    scanPoints(BridgeProtocol::MAX_SCAN_POINTS) {}
+
+bool BridgeClient::connectSocket() {
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = serverAddress;
+    address.sin_port = htons(port);
+
+    // Non-blocking, a blocking connect to an unreachable host would wait for the kernel's timeout (minutes)
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if ((fd >= 0) && (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0)) {
+        bool connected = false;
+        if (errno == EINPROGRESS) {
+            const uint64_t deadline = TimeStamp::getMonotonic() + CONNECT_TIMEOUT_NSECS;
+            while (readingSocket && (TimeStamp::getMonotonic() < deadline)) {
+                struct pollfd pending = {fd, POLLOUT, 0};
+                if (poll(&pending, 1, 100) > 0) {
+                    int error = 0;
+                    socklen_t errorLength = sizeof(error);
+                    connected = (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLength) == 0) && (error == 0);
+                    break;
+                }
+            }
+        }
+        if (!connected) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0)
+        return false;
+
+    // Blocking from here on, the reads are polled and the sends are meant to wait
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    setNoDelay(fd);
+    receiveLength = 0;
+    socketFd = fd;
+    stats.connections++;
+    return true;
+}
+
+void BridgeClient::closeSocket() {
+    const int fd = socketFd.exchange(-1);
+    if (fd < 0)
+        return;
+    shutdown(fd, SHUT_RDWR);
+    std::lock_guard<std::mutex> lock(sendMutex);
+    close(fd);
+}
+
+bool BridgeClient::sendFrame(const BridgeProtocol::FrameType type, const uint8_t* payload, const uint32_t length) {
+    uint8_t frame[sizeof(BridgeProtocol::FrameHeader) + 128];
+    if (length > (sizeof(frame) - sizeof(BridgeProtocol::FrameHeader)))
+        return false;
+    BridgeProtocol::writeHeader(frame, type, length);
+    memcpy(&frame[sizeof(BridgeProtocol::FrameHeader)], payload, length);
+
+    std::lock_guard<std::mutex> lock(sendMutex);
+    const int fd = socketFd.load();
+    if ((fd < 0) || !BridgeProtocol::sendAll(fd, frame, sizeof(BridgeProtocol::FrameHeader) + length))
+        return false;
+    stats.bytesSent += sizeof(BridgeProtocol::FrameHeader) + length;
+    return true;
+}
+
+void BridgeClient::handleFrame(const BridgeProtocol::FrameHeader& header, const uint8_t* payload) {
+    if (header.type == BridgeProtocol::FRAME_PONG) {
+        if (header.length != 8)
+            return;
+        uint64_t pingTimestamp;
+        memcpy(&pingTimestamp, payload, 8);
+        const uint64_t roundTrip = TimeStamp::getMonotonic() - pingTimestamp;
+        stats.pings++;
+        stats.totalRoundTripNsecs += roundTrip;
+        if (roundTrip > stats.maxRoundTripNsecs)
+            stats.maxRoundTripNsecs = roundTrip;
+        return;
+    }
+
+    const uint64_t now = TimeStamp::get();
+    if (now > header.timestamp) {
+        const uint64_t latency = now - header.timestamp;
+        stats.latencySamples++;
+        stats.totalLatencyNsecs += latency;
+        if (latency > stats.maxLatencyNsecs)
+            stats.maxLatencyNsecs = latency;
+    }
+
+    uint16_t count = 0;
+    if ((header.type == BridgeProtocol::FRAME_IMU) || (header.type == BridgeProtocol::FRAME_ESC)) {
+        if (header.length < 2) {
+            stats.malformedFrames++;
+            return;
+        }
+        memcpy(&count, payload, 2);
+    }
+
+    if (header.type == BridgeProtocol::FRAME_IMU) {
+        if (header.length != (2 + (count * sizeof(MausBoard::ImuData)))) {
+            stats.malformedFrames++;
+            return;
+        }
+        for (uint16_t i = 0; i < count; i++) {
+            MausBoard::ImuData imuData;
+            memcpy(&imuData, &payload[2 + (i * sizeof(MausBoard::ImuData))], sizeof(MausBoard::ImuData));
+            stats.imuReceived++;
+            if (imuDataCallback)
+                imuDataCallback(imuData);
+        }
+    } else if (header.type == BridgeProtocol::FRAME_ESC) {
+        if (header.length != (2 + (count * sizeof(MausBoard::EscTelemetry)))) {
+            stats.malformedFrames++;
+            return;
+        }
+        for (uint16_t i = 0; i < count; i++) {
+            MausBoard::EscTelemetry escTelemetry;
+            memcpy(&escTelemetry, &payload[2 + (i * sizeof(MausBoard::EscTelemetry))], sizeof(MausBoard::EscTelemetry));
+            stats.escReceived++;
+            if (escTelemetryCallback)
+                escTelemetryCallback(escTelemetry);
+        }
+    } else if (header.type == BridgeProtocol::FRAME_SCAN) {
+        const size_t pointCount = BridgeProtocol::decodeScan(payload, header.length, scanPoints.data(), scanPoints.size());
+        if ((pointCount == 0) && (header.length != 10)) {
+            stats.malformedFrames++;
+            return;
+        }
+        stats.scansReceived++;
+        if (fullScanCallback)
+            fullScanCallback(std::vector<LD19::LidarPoint>(scanPoints.begin(), scanPoints.begin() + pointCount));
+    }
+}
+
+void BridgeClient::parseFrames() {
+    const size_t headerSize = sizeof(BridgeProtocol::FrameHeader);
+    uint8_t* buffer = receiveBuffer.get();
+    size_t position = 0;
+    while ((receiveLength - position) >= headerSize) {
+        BridgeProtocol::FrameHeader header;
+        memcpy(&header, &buffer[position], headerSize);
+        if ((header.magic[0] != BridgeProtocol::MAGIC_0) || (header.magic[1] != BridgeProtocol::MAGIC_1) ||
+            (header.length > BridgeProtocol::MAX_PAYLOAD)) {
+            // Lost sync, look for the next magic
+            stats.malformedFrames++;
+            position++;
+            continue;
+        }
+        if ((receiveLength - position) < (headerSize + header.length))
+            break;
+
+        handleFrame(header, &buffer[position + headerSize]);
+        position += headerSize + header.length;
+    }
+
+    memmove(buffer, &buffer[position], receiveLength - position);
+    receiveLength -= position;
+}
+
+void BridgeClient::readLoop() {
+    uint64_t lastPing = 0;
+    while (readingSocket) {
+        if (socketFd.load() < 0) {
+            if (!connectSocket()) {
+                // In slices, so stopReading() doesn't wait out the interval
+                const uint64_t retry = TimeStamp::getMonotonic() + RECONNECT_INTERVAL_NSECS;
+                while (readingSocket && (TimeStamp::getMonotonic() < retry))
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            lastPing = 0;
+        }
+
+        const uint64_t now = TimeStamp::getMonotonic();
+        if ((now - lastPing) >= PING_INTERVAL_NSECS) {
+            sendFrame(BridgeProtocol::FRAME_PING, (const uint8_t*)&now, 8);
+            lastPing = now;
+        }
+
+        struct pollfd fd = {socketFd.load(), POLLIN, 0};
+        if (poll(&fd, 1, 100) <= 0)
+            continue;
+
+        const ssize_t received = recv(fd.fd, &receiveBuffer[receiveLength], RECEIVE_BUFFER_SIZE - receiveLength, 0);
+        if (received <= 0) {
+            closeSocket();
+            continue;
+        }
+        stats.bytesReceived += received;
+        receiveLength += received;
+        parseFrames();
+    }
+
+    closeSocket();
+}
+
+bool BridgeClient::startReading(const char* host, const uint16_t port) {
+    if (readingSocket) {
+        printf("Cannot start reading. Bridge is already being read\n");
+        return false;
+    }
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addresses = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &addresses) != 0) {
+        printf("Unable to resolve bridge host %s\n", host);
+        return false;
+    }
+    serverAddress = ((struct sockaddr_in*)addresses->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(addresses);
+
+    this->port = port;
+    stats = {};
+    stats.startTimestamp = TimeStamp::getMonotonic();
+    readingSocket = true;
+    readingThread = std::thread(&BridgeClient::readLoop, this);
+    return true;
+}
+
+bool BridgeClient::stopReading() {
+    if (!readingSocket)
+        return false;
+    readingSocket = false;
+    readingThread.join();
+    return true;
+}
+
+void BridgeClient::sendSetServos(const uint16_t steering, const uint16_t throttle) {
+    uint8_t payload[4];
+    memcpy(&payload[0], &steering, 2);
+    memcpy(&payload[2], &throttle, 2);
+    sendFrame(BridgeProtocol::FRAME_SET_SERVOS, payload, 4);
+}
+
+void BridgeClient::sentSetRGB(const std::vector<uint32_t>& colors) {
+    // Same limit as the board
+    uint8_t payload[1 + (16 * 4)];
+    const uint8_t count = std::min(colors.size(), (size_t)16);
+    payload[0] = count;
+    memcpy(&payload[1], colors.data(), count * 4);
+    sendFrame(BridgeProtocol::FRAME_SET_RGB, payload, 1 + (count * 4));
+}
+
+void BridgeClient::printStats() const {
+    const double seconds = (double)(TimeStamp::getMonotonic() - stats.startTimestamp) / NSECS_TO_SECS;
+    printf("BridgeClient: %llu connections, %.1f kB/s in, %llu IMU, %llu ESC, %llu scans, %llu malformed\n",
+        (unsigned long long)stats.connections, (stats.bytesReceived / 1000.0) / seconds,
+        (unsigned long long)stats.imuReceived, (unsigned long long)stats.escReceived,
+        (unsigned long long)stats.scansReceived, (unsigned long long)stats.malformedFrames);
+    printf("  round trip mean %.1f us, max %.1f us, latency mean %.1f us, max %.1f us\n",
+        stats.pings ? ((double)stats.totalRoundTripNsecs / stats.pings / NSECS_TO_USECS) : 0.0,
+        (double)stats.maxRoundTripNsecs / NSECS_TO_USECS,
+        stats.latencySamples ? ((double)stats.totalLatencyNsecs / stats.latencySamples / NSECS_TO_USECS) : 0.0,
+        (double)stats.maxLatencyNsecs / NSECS_TO_USECS);
+}
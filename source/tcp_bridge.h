@@ -0,0 +1,246 @@
+#ifndef __TCP_BRIDGE_H__
+#define __TCP_BRIDGE_H__
+
+// Streams the drivers' data over TCP so heavier processing can run on another machine
+// BridgeServer runs in the process that owns MausBoard and LD19, and the driver callbacks are forwarded into it.
+// BridgeClient runs on the other machine and gives back the same callbacks as MausBoard and LD19, plus
+// sendSetServos/sentSetRGB going the other way.
+//
+// Wire format: frames of [magic 'M' 'B', type, uint32 payload length, uint64 send timestamp] + payload, little endian.
+// Everything queued when the sender wakes up (every batchIntervalNsecs) goes out in a single write. Scans are delta
+// encoded (zigzag varints of the distance, angle and timestamp differences between consecutive points), lossless and
+// about half the size of the raw points.
+//
+// The drivers never wait on the network: IMU and ESC samples go into bounded queues that drop the oldest sample when
+// full, and only the latest scan is kept. A slow link loses data instead of stalling the drivers.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "maus_board.h"
+#include "fhl_ld19.h"
+#include "timestamp.h"
+
+#define DEFAULT_BRIDGE_PORT 5760
+
+class BridgeProtocol {
+public:
+    enum FrameType : uint8_t {
+        FRAME_IMU = 0x01,           // uint16 count, ImuData[count]
+        FRAME_ESC = 0x02,           // uint16 count, EscTelemetry[count]
+        FRAME_SCAN = 0x03,          // See encodeScan()
+        FRAME_PING = 0x04,          // uint64 client timestamp
+        FRAME_PONG = 0x05,          // The ping's payload back
+        FRAME_SET_SERVOS = 0x10,    // uint16 steering, uint16 throttle
+        FRAME_SET_RGB = 0x11        // uint8 count, uint32 colors[count]
+    };
+
+    struct __attribute__((__packed__)) FrameHeader {
+        uint8_t magic[2];
+        uint8_t type;
+        uint32_t length;            // Payload bytes
+        uint64_t timestamp;         // Nanoseconds since epoch, when the frame was sent
+    }; // 15 bytes
+
+    static const uint8_t MAGIC_0 = 'M';
+    static const uint8_t MAGIC_1 = 'B';
+    static const size_t MAX_PAYLOAD = 64 * 1024;
+    static const size_t MAX_SCAN_POINTS = 2048;
+
+    // Scan payload: uint16 count, uint64 first timestamp, then per point zigzag varints of the distance, angle and
+    // timestamp deltas and the intensity byte. out needs maxEncodedScanSize(count) bytes. Returns the bytes written
+    static size_t maxEncodedScanSize(const size_t count) { return 2 + 8 + (count * (3 + 3 + 10 + 1)); }
+    static size_t encodeScan(const LD19::LidarPoint* points, const size_t count, uint8_t* out);
+
+    // Returns the number of points decoded, 0 if the payload is malformed
+    static size_t decodeScan(const uint8_t* payload, const size_t length, LD19::LidarPoint* points, const size_t maxPoints);
+
+    // Writes a frame header into out (FrameHeader bytes)
+    static void writeHeader(uint8_t* out, const FrameType type, const uint32_t length);
+
+    // Blocking write of everything. Returns false if the connection broke
+    static bool sendAll(const int fd, const uint8_t* data, const size_t length);
+};
+
+class BridgeServer {
+public:
+    struct Config {
+        // Whoever connects can drive the car, so only loopback by default (e.g. for an SSH tunnel). "0.0.0.0" listens
+        // on every interface, only do that on a network you trust
+        std::string bindAddress = "127.0.0.1";
+        uint16_t port = DEFAULT_BRIDGE_PORT;
+        uint64_t batchIntervalNsecs = 5 * NSECS_TO_MSECS;
+        // BridgeClient pings every second, a client that sends no frame for this long is gone (e.g. out of WiFi range,
+        // where TCP would take minutes to notice) and is dropped. 0 to never drop
+        uint64_t clientTimeoutNsecs = 3 * (uint64_t)NSECS_TO_SECS;
+    };
+
+    struct Stats {
+        uint64_t connections;
+        uint64_t connectionsRefused;        // While another client was connected
+        uint64_t clientTimeouts;            // Dropped after clientTimeoutNsecs without a frame
+        uint64_t bytesSent;
+        uint64_t bytesReceived;
+        uint64_t writes;                    // Batches, one write each
+        uint64_t imuSent;
+        uint64_t imuDropped;
+        uint64_t escSent;
+        uint64_t escDropped;
+        uint64_t scansSent;
+        uint64_t scansDropped;              // Replaced by a newer scan before they could be sent
+        uint64_t scanRawBytes;              // Scan points as LidarPoints, and as sent
+        uint64_t scanEncodedBytes;
+        uint64_t commandsReceived;
+        uint64_t startTimestamp;            // Monotonic
+    };
+
+private:
+    static const size_t MAX_QUEUED_IMU = 256;
+    static const size_t MAX_QUEUED_ESC = 64;
+    static const size_t RECEIVE_BUFFER_SIZE = 4096;
+
+    const Config config;
+
+    // Queues filled by the drivers, the lock is only held to copy in and out
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    MausBoard::ImuData imuQueue[MAX_QUEUED_IMU];
+    size_t imuQueueStart = 0;
+    size_t imuQueueCount = 0;
+    MausBoard::EscTelemetry escQueue[MAX_QUEUED_ESC];
+    size_t escQueueStart = 0;
+    size_t escQueueCount = 0;
+    LD19::LidarPoint pendingScan[BridgeProtocol::MAX_SCAN_POINTS];
+    size_t pendingScanCount = 0;
+    bool scanPending = false;
+    uint64_t pendingPong = 0;
+    bool pongPending = false;
+
+    // Sender's copies and output buffer
+    MausBoard::ImuData imuStaging[MAX_QUEUED_IMU];
+    MausBoard::EscTelemetry escStaging[MAX_QUEUED_ESC];
+    LD19::LidarPoint scanStaging[BridgeProtocol::MAX_SCAN_POINTS];
+    std::unique_ptr<uint8_t[]> sendBuffer;
+
+    // Sockets, the sender thread writes to the client and the network thread accepts and reads commands
+    int listenFd = -1;
+    std::atomic<int> clientFd{-1};
+    uint64_t lastFrameTimestamp = 0;    // Monotonic, last frame from the client (network thread only)
+    std::mutex clientMutex;             // Held while the client socket is written or closed
+    std::atomic<bool> running{false};
+    std::thread networkThread;
+    std::thread sendThread;
+
+    Stats stats = {};
+
+    void networkLoop();
+    void sendLoop();
+    void closeClient();
+    // Returns the number of frames parsed
+    size_t parseCommands(uint8_t* buffer, size_t& length);
+
+public:
+    // Called on the network thread with commands from the client (e.g. to call board.sendSetServos)
+    void (*setServosCallback)(const uint16_t steering, const uint16_t throttle) = nullptr;
+    void (*setRgbCallback)(const std::vector<uint32_t>& colors) = nullptr;
+    // Called on the network thread when a connected client goes away (closed, broken or timed out), and by stop() if
+    // one was connected. The last command it sent stays on the board, so e.g. neutral the throttle here
+    void (*linkLostCallback)() = nullptr;
+
+    BridgeServer();
+    BridgeServer(const Config& config);
+    ~BridgeServer() { stop(); }
+
+    // Listens for a client. One at a time: while it's connected, other connections are closed straight away, they
+    // can't take over the commands
+    bool start();
+    bool stop();
+    bool isClientConnected() const { return clientFd.load() >= 0; }
+
+    // Call from the driver callbacks, never blocks on the network
+    void publishImu(const MausBoard::ImuData& imuData);
+    void publishEsc(const MausBoard::EscTelemetry& escTelemetry);
+    void publishScan(const LD19::LidarPoint* points, const size_t count);
+
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+class BridgeClient {
+public:
+    struct Stats {
+        uint64_t connections;
+        uint64_t bytesReceived;
+        uint64_t bytesSent;
+        uint64_t imuReceived;
+        uint64_t escReceived;
+        uint64_t scansReceived;
+        uint64_t malformedFrames;
+        uint64_t pings;
+        uint64_t totalRoundTripNsecs;
+        uint64_t maxRoundTripNsecs;
+        uint64_t latencySamples;
+        uint64_t totalLatencyNsecs;         // Frame sent to received, only meaningful with synchronized clocks (e.g. loopback)
+        uint64_t maxLatencyNsecs;
+        uint64_t startTimestamp;            // Monotonic
+    };
+
+private:
+    static const size_t RECEIVE_BUFFER_SIZE = 2 * (sizeof(BridgeProtocol::FrameHeader) + BridgeProtocol::MAX_PAYLOAD);
+    static const uint64_t PING_INTERVAL_NSECS = 1000 * NSECS_TO_MSECS;
+    static const uint64_t RECONNECT_INTERVAL_NSECS = 500 * NSECS_TO_MSECS;
+    static const uint64_t CONNECT_TIMEOUT_NSECS = 2000 * NSECS_TO_MSECS;
+
+    // Same callbacks as MausBoard and LD19
+    void (*imuDataCallback)(const MausBoard::ImuData&);
+    void (*escTelemetryCallback)(const MausBoard::EscTelemetry&);
+    void (*fullScanCallback)(std::vector<LD19::LidarPoint>);
+
+    uint32_t serverAddress = 0;     // IPv4, network byte order, resolved once by startReading()
+    uint16_t port = DEFAULT_BRIDGE_PORT;
+    std::atomic<int> socketFd{-1};
+    std::mutex sendMutex;
+    std::atomic<bool> readingSocket{false};
+    std::thread readingThread;
+
+    std::unique_ptr<uint8_t[]> receiveBuffer;
+    size_t receiveLength = 0;
+    std::vector<LD19::LidarPoint> scanPoints;
+
+    Stats stats = {};
+
+    bool connectSocket();
+    void closeSocket();
+    void readLoop();
+    void parseFrames();
+    void handleFrame(const BridgeProtocol::FrameHeader& header, const uint8_t* payload);
+    bool sendFrame(const BridgeProtocol::FrameType type, const uint8_t* payload, const uint32_t length);
+
+public:
+    BridgeClient(void (*imuDataCallback)(const MausBoard::ImuData&), void (*escTelemetryCallback)(const MausBoard::EscTelemetry&),
+        void (*fullScanCallback)(std::vector<LD19::LidarPoint>));
+    ~BridgeClient() { stopReading(); }
+
+    // Connects to a BridgeServer and calls back from a separate thread until stopReading(), reconnecting if the
+    // connection drops. The host is looked up here, once, and connection attempts give up after
+    // CONNECT_TIMEOUT_NSECS, so stopReading() doesn't hang on an unreachable server
+    bool startReading(const char* host = "127.0.0.1", const uint16_t port = DEFAULT_BRIDGE_PORT);
+    bool stopReading();
+    bool isConnected() const { return socketFd.load() >= 0; }
+
+    // Same as MausBoard's, forwarded by the server. Dropped while disconnected
+    void sendSetServos(const uint16_t steering, const uint16_t throttle);
+    void sentSetRGB(const std::vector<uint32_t>& colors);
+
+    const Stats& getStats() const { return stats; }
+    void printStats() const;
+};
+
+#endif
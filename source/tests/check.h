@@ -0,0 +1,24 @@
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+// Minimal checks for the offline tests (make test). A failed CHECK prints itself and the test carries on, main()
+// returns checkResult() so make stops at the first failing test
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            checkFailures++; \
+        } \
+    } while (0)
+
+static int checkResult(const char* name) {
+    printf("%s: %s\n", name, (checkFailures == 0) ? "passed" : "FAILED");
+    return (checkFailures == 0) ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,172 @@
+// Checks that the drivers' parse paths don't allocate once warmed up: LD19::parse() with the pointer scan callback,
+// sector streaming and a BinnedScan, and MausBoard::parse() with every message the board sends. Built with the
+// counting operator new (see the makefile), whatever DEFINES says.
+
+#include <string.h>
+#include <vector>
+
+#include "alloc_audit.h"
+#include "binned_scan.h"
+#include "fhl_ld19.h"
+#include "maus_board.h"
+#include "check.h"
+
+// Both CRCs are plain CRC-8 (MSB first), the LD19 with polynomial 0x4D, the board with 0x31
+static uint8_t crc8(const uint8_t polynomial, const uint8_t* data, const size_t len) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ polynomial) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+// Board command IDs (MausBoard::CommandIds)
+static const uint8_t CMD_ECHO_REQUEST = 0xFF;
+static const uint8_t CMD_ECHO_RESPONSE = 0xFE;
+static const uint8_t CMD_IMU_DUMP = 0x03;
+static const uint8_t CMD_ESC_TELEMETRY_DUMP = 0x05;
+static const uint8_t CMD_LOOP_STATS = 0x06;
+static const uint8_t CMD_IMU_RAW_DUMP = 0x08;
+
+static void appendLidarFrame(std::vector<uint8_t>& out, const uint16_t startAngle, const uint16_t distance) {
+    uint8_t frame[47];
+    frame[0] = 0x54;
+    frame[1] = 0x2C;
+    const uint16_t speed = 3600;
+    const uint16_t endAngle = (startAngle + 880) % 36000;
+    memcpy(&frame[2], &speed, 2);
+    memcpy(&frame[4], &startAngle, 2);
+    for (int i = 0; i < 12; i++) {
+        memcpy(&frame[6 + (i * 3)], &distance, 2);
+        frame[8 + (i * 3)] = 100;
+    }
+    memcpy(&frame[42], &endAngle, 2);
+    memset(&frame[44], 0, 2);
+    frame[46] = crc8(0x4D, frame, 46);
+    out.insert(out.end(), frame, frame + sizeof(frame));
+}
+
+static void appendBoardMessage(std::vector<uint8_t>& out, const uint8_t* payload, const uint8_t payloadSize) {
+    const uint8_t header[5] = {0x12, 0x34, 0, payloadSize, crc8(0x31, payload, payloadSize)};
+    out.insert(out.end(), header, header + sizeof(header));
+    out.insert(out.end(), payload, payload + payloadSize);
+}
+
+// Allocations on this thread since the previous callback, every callback should see 0
+static uint64_t lastCallbackCount = 0;
+static uint64_t callbackAllocations = 0;
+static size_t scans = 0;
+static size_t sectors = 0;
+static size_t boardMessages = 0;
+static size_t vectorScans = 0;
+
+static void countCallback() {
+    const uint64_t count = AllocationAudit::getThreadCount();
+    callbackAllocations += count - lastCallbackCount;
+    lastCallbackCount = count;
+}
+
+static void scanCallback(const LD19::LidarPoint*, const size_t) { scans++; countCallback(); }
+static void sectorCallback(const LD19::LidarPoint*, const size_t) { sectors++; countCallback(); }
+static void vectorScanCallback(std::vector<LD19::LidarPoint>) { vectorScans++; }
+static void imuCallback(const MausBoard::ImuData&) { boardMessages++; countCallback(); }
+static void escCallback(const MausBoard::EscTelemetry&) { boardMessages++; countCallback(); }
+static void loopStatsCallback(const MausBoard::LoopStats&) { boardMessages++; countCallback(); }
+static void rawImuCallback(const MausBoard::RawImuSample*, const size_t) { boardMessages++; countCallback(); }
+static void echoCallback(const uint8_t*, const uint8_t) { boardMessages++; countCallback(); }
+
+// Feeds in full UART sized reads (MausBoard::parse() splits them up)
+template <typename Parser>
+static void feed(Parser& parser, std::vector<uint8_t>& bytes, const size_t begin, const size_t end) {
+    for (size_t offset = begin; offset < end; offset += 256)
+        parser.parse(&bytes[offset], std::min((size_t)256, end - offset));
+}
+
+int main() {
+    CHECK(AllocationAudit::isEnabled());
+
+    // 40 revolutions of 37 frames, the first 2 are the warmup
+    std::vector<uint8_t> lidarBytes;
+    for (int revolution = 0; revolution < 40; revolution++) {
+        for (int frame = 0; frame < 37; frame++)
+            appendLidarFrame(lidarBytes, (uint16_t)((frame * 12 * 80) % 36000), (uint16_t)(1000 + revolution));
+    }
+    const size_t lidarWarmup = 2 * 37 * 47;
+
+    BinnedScan binnedScan;
+    LD19 lidar(nullptr);
+    lidar.setScanCallback(scanCallback);
+    lidar.setSectorCallback(sectorCallback, 30);
+    lidar.setBinnedScan(&binnedScan);
+    feed(lidar, lidarBytes, 0, lidarWarmup);
+
+    // One of each message the board sends
+    std::vector<uint8_t> boardBytes;
+    for (int repeat = 0; repeat < 50; repeat++) {
+        uint8_t imu[1 + 42] = {CMD_IMU_DUMP};
+        imu[1] = 0x40;
+        appendBoardMessage(boardBytes, imu, sizeof(imu));
+
+        uint8_t esc[1 + 10] = {CMD_ESC_TELEMETRY_DUMP, 30, 0x04, 0xB0};
+        appendBoardMessage(boardBytes, esc, sizeof(esc));
+
+        uint8_t loopStats[1 + ((4 + MausBoard::LoopStats::NUM_BUCKETS + 5) * 4)] = {CMD_LOOP_STATS};
+        appendBoardMessage(boardBytes, loopStats, sizeof(loopStats));
+
+        uint8_t rawImu[2 + (8 * 16)] = {CMD_IMU_RAW_DUMP, 8};
+        for (uint32_t sample = 0; sample < 8; sample++) {
+            const uint32_t micros = (repeat * 10000) + (sample * 1000);
+            memcpy(&rawImu[2 + (sample * 16)], &micros, 4);
+        }
+        appendBoardMessage(boardBytes, rawImu, sizeof(rawImu));
+
+        uint8_t echoResponse[1 + 32] = {CMD_ECHO_RESPONSE};
+        appendBoardMessage(boardBytes, echoResponse, sizeof(echoResponse));
+
+        uint8_t echoRequest[1 + 32] = {CMD_ECHO_REQUEST};
+        appendBoardMessage(boardBytes, echoRequest, sizeof(echoRequest));
+    }
+    const size_t boardWarmup = boardBytes.size() / 50;
+
+    MausBoard board(imuCallback, escCallback);
+    board.loopStatsCallback = loopStatsCallback;
+    board.rawImuCallback = rawImuCallback;
+    board.echoResponseCallback = echoCallback;
+    feed(board, boardBytes, 0, boardWarmup);
+
+    // Steady state: nothing on this thread may allocate from here
+    const size_t warmupScans = scans;
+    const size_t warmupMessages = boardMessages;
+    lastCallbackCount = AllocationAudit::getThreadCount();
+    callbackAllocations = 0;
+    AllocationAudit::setThreadGuard(true);
+    {
+        AllocationAudit::Scope scope;
+        feed(lidar, lidarBytes, lidarWarmup, lidarBytes.size());
+        feed(board, boardBytes, boardWarmup, boardBytes.size());
+        const uint64_t allocations = scope.getCount();
+        AllocationAudit::setThreadGuard(false);
+
+        printf("%zu scans, %zu sectors, %zu board messages after warmup: %llu allocations\n", scans - warmupScans, sectors,
+            boardMessages - warmupMessages, (unsigned long long)allocations);
+        CHECK(allocations == 0);
+    }
+    CHECK(callbackAllocations == 0);
+    CHECK(AllocationAudit::getGuardViolations() == 0);
+    CHECK((scans - warmupScans) >= 37);
+    CHECK(sectors > 0);
+    CHECK((boardMessages - warmupMessages) == (49 * 5)); // Echo requests are answered, not called back
+
+    // The vector callback is kept for compatibility and does allocate, which also shows the counting works
+    LD19 vectorLidar(vectorScanCallback);
+    {
+        AllocationAudit::Scope scope;
+        feed(vectorLidar, lidarBytes, 0, lidarBytes.size());
+        CHECK(vectorScans > 0);
+        CHECK(scope.getCount() >= vectorScans);
+    }
+
+    return checkResult("test_alloc_audit");
+}
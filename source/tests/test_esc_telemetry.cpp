@@ -0,0 +1,208 @@
+// ESCTelemetryFramer (ESP32_firmware/main/esc_telemetry.h) on the host, through ESCTelemetry with a stub Stream:
+// frames back to back, resync after garbage and a corrupted frame with crcRejectCount counting the miss, and the
+// running table CRC against the firmware's old bit-serial CRC over random input
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// The one Arduino class esc_telemetry.h uses, reading from a buffer
+class Stream {
+public:
+    std::vector<uint8_t> bytes;
+    size_t readPos = 0;
+
+    int available() { return (int)(bytes.size() - readPos); }
+    int read() { return bytes[readPos++]; }
+};
+
+#include "esc_telemetry.h"
+#include "check.h"
+
+// The CRC the firmware used before the tables
+static uint8_t getBitSerialCRC8(const uint8_t* data, const size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t crcU = data[i] ^ crc;
+        for (int j = 0; j < 8; j++)
+            crcU = (crcU & 0x80) ? (0x7 ^ (crcU << 1)) : (crcU << 1);
+        crc = crcU;
+    }
+    return crc;
+}
+
+static std::vector<uint8_t> makeFrame(std::mt19937& random) {
+    std::vector<uint8_t> frame(ESC_TELEMETRY_BUF_SIZE);
+    for (size_t i = 0; i < ESC_TELEMETRY_DATA_SIZE; i++)
+        frame[i] = (uint8_t)random();
+    frame[ESC_TELEMETRY_DATA_SIZE] = getBitSerialCRC8(frame.data(), ESC_TELEMETRY_DATA_SIZE);
+    return frame;
+}
+
+// Feeds the bytes to update() in chunks of 1 to 7, like the firmware loop sees them. A chunk is shorter than a frame so
+// no frame overwrites another in the buffer. Returns the frames found
+static std::vector<std::vector<uint8_t>> receive(ESCTelemetry& escTelemetry, Stream& stream, const std::vector<uint8_t>& bytes) {
+    std::vector<std::vector<uint8_t>> frames;
+    size_t chunk = 1;
+    for (size_t offset = 0; offset < bytes.size(); offset += chunk, chunk = (chunk % 7) + 1) {
+        const size_t end = std::min(offset + chunk, bytes.size());
+        stream.bytes.insert(stream.bytes.end(), bytes.begin() + offset, bytes.begin() + end);
+        if (escTelemetry.update())
+            frames.push_back(std::vector<uint8_t>(escTelemetry.buffer, escTelemetry.buffer + ESC_TELEMETRY_BUF_SIZE));
+    }
+    return frames;
+}
+
+static void testInSync() {
+    std::mt19937 random(26);
+    Stream stream;
+    ESCTelemetry escTelemetry(stream);
+
+    // Byte by byte, each frame has to come out on its last byte and nowhere else, even where a data byte happens to
+    // match the CRC of the 9 before it
+    size_t found = 0;
+    size_t misplaced = 0;
+    for (int i = 0; i < 2000; i++) {
+        const std::vector<uint8_t> frame = makeFrame(random);
+        for (size_t j = 0; j < frame.size(); j++) {
+            stream.bytes.push_back(frame[j]);
+            if (escTelemetry.update()) {
+                if ((j == ESC_TELEMETRY_DATA_SIZE) && (memcmp(escTelemetry.buffer, frame.data(), ESC_TELEMETRY_BUF_SIZE) == 0))
+                    found++;
+                else
+                    misplaced++;
+            }
+        }
+    }
+    CHECK(found == 2000);
+    CHECK(misplaced == 0);
+    CHECK(escTelemetry.getCRCRejectCount() == 0);
+}
+
+static void testResync() {
+    std::mt19937 random(27);
+    ESCTelemetryFramer framer;
+    std::vector<uint8_t> stream;
+    std::vector<std::vector<uint8_t>> expected;
+
+    // Garbage to start with (the ESC powering up), frames, a corrupted frame, more frames, a burst of garbage, frames
+    for (int i = 0; i < 23; i++)
+        stream.push_back((uint8_t)random());
+    for (int i = 0; i < 5; i++) {
+        expected.push_back(makeFrame(random));
+        stream.insert(stream.end(), expected.back().begin(), expected.back().end());
+    }
+    std::vector<uint8_t> corrupted = makeFrame(random);
+    corrupted[4] ^= 0x10;
+    stream.insert(stream.end(), corrupted.begin(), corrupted.end());
+    for (int i = 0; i < 5; i++) {
+        expected.push_back(makeFrame(random));
+        stream.insert(stream.end(), expected.back().begin(), expected.back().end());
+    }
+    for (int i = 0; i < 17; i++)
+        stream.push_back((uint8_t)random());
+    for (int i = 0; i < 5; i++) {
+        expected.push_back(makeFrame(random));
+        stream.insert(stream.end(), expected.back().begin(), expected.back().end());
+    }
+
+    // Garbage can hold a valid CRC by chance (1 in 256 per byte), every real frame has to be found in order
+    std::vector<std::vector<uint8_t>> frames;
+    for (uint8_t byte : stream) {
+        if (framer.push(byte))
+            frames.push_back(std::vector<uint8_t>(framer.frame, framer.frame + ESC_TELEMETRY_BUF_SIZE));
+    }
+    size_t next = 0;
+    for (const std::vector<uint8_t>& frame : frames) {
+        if ((next < expected.size()) && (frame == expected[next]))
+            next++;
+    }
+    CHECK(next == expected.size());
+    CHECK(frames.size() == expected.size());
+
+    // The corrupted frame and the garbage burst are both missed frame boundaries
+    CHECK(framer.crcRejectCount == 2);
+
+    // And the same through ESCTelemetry::update() with the stub Stream
+    Stream serialPort;
+    ESCTelemetry escTelemetry(serialPort);
+    const std::vector<std::vector<uint8_t>> received = receive(escTelemetry, serialPort, stream);
+    CHECK(escTelemetry.getCRCRejectCount() == 2);
+    CHECK(!received.empty() && (received.back() == expected.back()));
+
+    // reset() forgets the window, a frame right after it is still found
+    framer.reset();
+    const std::vector<uint8_t> frame = makeFrame(random);
+    bool found = false;
+    for (uint8_t byte : frame)
+        found = framer.push(byte);
+    CHECK(found && (memcmp(framer.frame, frame.data(), ESC_TELEMETRY_BUF_SIZE) == 0));
+}
+
+static void testAgainstBitSerial() {
+    std::mt19937 random(28);
+
+    // Whole buffers of every length
+    int crcMismatches = 0;
+    for (int length = 0; length < 256; length++) {
+        std::vector<uint8_t> data(length);
+        for (uint8_t& byte : data)
+            byte = (uint8_t)random();
+        if (ESCTelemetryFramer::getCRC8(data.data(), (uint8_t)length) != getBitSerialCRC8(data.data(), length))
+            crcMismatches++;
+    }
+    CHECK(crcMismatches == 0);
+
+    // The sliding window: while hunting, a frame is reported exactly where the old code, recomputing the CRC of the
+    // last 9 bytes for every byte, found one. Once synced only at the frame boundary. Random bytes with frames planted
+    // in them, so every case happens
+    std::vector<uint8_t> stream;
+    while (stream.size() < 200000) {
+        if ((random() % 4) == 0) {
+            const std::vector<uint8_t> frame = makeFrame(random);
+            stream.insert(stream.end(), frame.begin(), frame.end());
+        } else {
+            stream.push_back((uint8_t)random());
+        }
+    }
+
+    ESCTelemetryFramer framer;
+    int frameMismatches = 0;
+    int frames = 0;
+    bool synced = false;
+    size_t lastFrame = 0;
+    uint32_t rejects = 0;
+    for (size_t i = 0; i < stream.size(); i++) {
+        const bool found = framer.push(stream[i]);
+        const bool crcMatches = (i >= ESC_TELEMETRY_DATA_SIZE) &&
+            (getBitSerialCRC8(&stream[i - ESC_TELEMETRY_DATA_SIZE], ESC_TELEMETRY_DATA_SIZE) == stream[i]);
+        const bool atBoundary = !synced || ((i - lastFrame) == ESC_TELEMETRY_BUF_SIZE);
+        const bool expected = crcMatches && atBoundary;
+        if (expected) {
+            synced = true;
+            lastFrame = i;
+        } else if (synced && ((i - lastFrame) == ESC_TELEMETRY_BUF_SIZE)) {
+            synced = false;
+            rejects++;
+        }
+
+        if (found != expected)
+            frameMismatches++;
+        if (found && (memcmp(framer.frame, &stream[i - ESC_TELEMETRY_DATA_SIZE], ESC_TELEMETRY_BUF_SIZE) != 0))
+            frameMismatches++;
+        frames += found ? 1 : 0;
+    }
+    printf("%d frames in %zu random bytes, %d differ from the bit-serial CRC\n", frames, stream.size(), frameMismatches);
+    CHECK(frames > 1000);
+    CHECK(frameMismatches == 0);
+    CHECK(framer.crcRejectCount == rejects);
+}
+
+int main() {
+    testInSync();
+    testResync();
+    testAgainstBitSerial();
+    return checkResult("test_esc_telemetry");
+}
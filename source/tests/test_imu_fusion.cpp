@@ -0,0 +1,151 @@
+// ImuFusion on a recorded drive: raw samples written with RawImuSample::writeBytes and replayed with fromBytes, at
+// 1kHz in batches of 8 like the firmware sends them, with the ESC telemetry at 33Hz. The MPU has a known gyro offset.
+// Stopped and still, the bias has to be learned. Driving a 90 degree turn, the yaw has to come out at 90 degrees. A
+// slow coasting turn (ERPM 0 at neutral throttle, rolling vibration) must not be learned as bias.
+
+#include <stdio.h>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "imu_fusion.h"
+#include "check.h"
+
+static const char* RECORDING_PATH = "/tmp/test_imu_fusion.bin";
+static const uint32_t SAMPLE_MICROS = 1000;
+static const size_t BATCH_SIZE = 8;
+
+// MPU zero rate offset, in counts (16.4 per degree/sec)
+static const int16_t GYRO_OFFSET[3] = {-8, 5, 20};
+static const float GYRO_RADIANS_PER_COUNT = (float)(M_PI / 180.0) / 16.4f;
+
+// One phase of the drive: yaw rate, accel noise (vibration) and what the ESC reports
+struct Phase {
+    float seconds;
+    float yawRate;      // rad/s
+    float vibration;    // m/s^2 standard deviation
+    uint16_t ERPM;
+    uint16_t throttleMicros;
+};
+
+struct Recorded {
+    std::vector<MausBoard::RawImuSample> samples;
+    std::vector<size_t> phaseEnds;  // Sample index each phase ends at
+};
+
+static void record(const std::vector<Phase>& phases) {
+    std::mt19937 random(35);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::ofstream of(RECORDING_PATH, std::ios::binary);
+
+    uint64_t timestamp = 1000 * (uint64_t)NSECS_TO_SECS;
+    uint32_t deviceMicros = 4000000000u;  // Wraps during the recording
+    for (const Phase& phase : phases) {
+        const int count = (int)std::lround(phase.seconds * 1000000 / SAMPLE_MICROS);
+        for (int i = 0; i < count; i++) {
+            MausBoard::RawImuSample sample;
+            sample.timestamp = timestamp;
+            sample.deviceMicros = deviceMicros;
+            sample.gyroX = (int16_t)std::lround(GYRO_OFFSET[0] + noise(random));
+            sample.gyroY = (int16_t)std::lround(GYRO_OFFSET[1] + noise(random));
+            sample.gyroZ = (int16_t)std::lround(GYRO_OFFSET[2] + (phase.yawRate / GYRO_RADIANS_PER_COUNT) + noise(random));
+            const float accelCountsPerMetersPerSec2 = 8192.0f / 9.80665f;
+            sample.accelX = (int16_t)std::lround((phase.vibration * noise(random) * accelCountsPerMetersPerSec2) + (30 * noise(random)));
+            sample.accelY = (int16_t)std::lround((phase.vibration * noise(random) * accelCountsPerMetersPerSec2) + (30 * noise(random)));
+            sample.accelZ = (int16_t)std::lround(8192 + (phase.vibration * noise(random) * accelCountsPerMetersPerSec2) + (30 * noise(random)));
+            sample.writeBytes(of);
+
+            timestamp += SAMPLE_MICROS * NSECS_TO_USECS;
+            deviceMicros += SAMPLE_MICROS;
+        }
+    }
+}
+
+static Recorded load(const std::vector<Phase>& phases) {
+    Recorded recorded;
+    std::ifstream in(RECORDING_PATH, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    for (size_t offset = 0; (offset + MausBoard::RawImuSample::sizeBytes()) <= bytes.size(); offset += MausBoard::RawImuSample::sizeBytes())
+        recorded.samples.push_back(MausBoard::RawImuSample::fromBytes(&bytes[offset]));
+
+    size_t end = 0;
+    for (const Phase& phase : phases) {
+        end += (size_t)std::lround(phase.seconds * 1000000 / SAMPLE_MICROS);
+        recorded.phaseEnds.push_back(end);
+    }
+    return recorded;
+}
+
+// Replays samples [begin, end) of the phase, ESC telemetry every 30ms
+static void replay(ImuFusion& fusion, const Recorded& recorded, const size_t begin, const size_t end, const Phase& phase) {
+    uint64_t nextEsc = 0;
+    for (size_t offset = begin; offset < end; offset += BATCH_SIZE) {
+        const MausBoard::RawImuSample& first = recorded.samples[offset];
+        if (first.timestamp >= nextEsc) {
+            MausBoard::EscTelemetry escTelemetry = {};
+            escTelemetry.timestamp = first.timestamp;
+            escTelemetry.ERPM = phase.ERPM;
+            fusion.addEscTelemetry(escTelemetry, phase.throttleMicros);
+            nextEsc = first.timestamp + (30 * NSECS_TO_MSECS);
+        }
+        fusion.update(&first, std::min(BATCH_SIZE, end - offset));
+    }
+}
+
+static float getBiasError(const ImuFusion& fusion, const int axis) {
+    return std::fabs(fusion.getState().gyroBias[axis] - (GYRO_OFFSET[axis] * GYRO_RADIANS_PER_COUNT));
+}
+
+int main() {
+    const float turnRate = 1.0f;
+    const float coastRate = 0.06f;
+    const std::vector<Phase> phases = {
+        {10.0f, 0.0f, 0.0f, 0, 1500},                           // Stopped and still, bias learned
+        {(float)M_PI / (2.0f * turnRate), turnRate, 0.5f, 3000, 1700}, // Driven 90 degree turn
+        {3.0f, coastRate, 0.5f, 0, 1500},                       // Coasting slowly round a bend
+        {2.0f, 0.0f, 0.0f, 0, 1500},                            // Stopped again
+    };
+    record(phases);
+    const Recorded recorded = load(phases);
+    CHECK(recorded.samples.size() == recorded.phaseEnds.back());
+    CHECK(recorded.samples[1].gyroZ != 0);
+
+    ImuFusion fusion;
+    replay(fusion, recorded, 0, recorded.phaseEnds[0], phases[0]);
+    printf("Learned bias %.5f %.5f %.5f rad/s, true %.5f %.5f %.5f\n", fusion.getState().gyroBias[0],
+        fusion.getState().gyroBias[1], fusion.getState().gyroBias[2], GYRO_OFFSET[0] * GYRO_RADIANS_PER_COUNT,
+        GYRO_OFFSET[1] * GYRO_RADIANS_PER_COUNT, GYRO_OFFSET[2] * GYRO_RADIANS_PER_COUNT);
+    for (int axis = 0; axis < 3; axis++)
+        CHECK(getBiasError(fusion, axis) < 0.0005f);
+    CHECK(fusion.getState().still);
+
+    // Until the bias is learned it's integrated, the turn is measured from where the yaw settled
+    const float startYaw = fusion.getState().getYawRadians();
+    printf("Yaw drift while learning %.4f rad\n", startYaw);
+    CHECK(std::fabs(startYaw) < 0.1f);
+    replay(fusion, recorded, recorded.phaseEnds[0], recorded.phaseEnds[1], phases[1]);
+    const float turnYaw = fusion.getState().getYawRadians() - startYaw;
+    printf("Yaw after the turn %.4f rad, true %.4f\n", turnYaw, M_PI / 2.0);
+    CHECK(std::fabs(turnYaw - (float)(M_PI / 2.0)) < 0.01f);
+    CHECK(!fusion.getState().stationary && !fusion.getState().still);
+
+    const float biasBeforeCoasting = fusion.getState().gyroBias[2];
+    const uint64_t biasUpdatesBeforeCoasting = fusion.getStats().biasUpdates;
+    replay(fusion, recorded, recorded.phaseEnds[1], recorded.phaseEnds[2], phases[2]);
+    printf("Coasting: bias z %.5f -> %.5f rad/s, yaw %.4f rad, true %.4f\n", biasBeforeCoasting,
+        fusion.getState().gyroBias[2], fusion.getState().getYawRadians() - startYaw, (M_PI / 2.0) + (3.0 * coastRate));
+    CHECK(fusion.getState().stationary && !fusion.getState().still);
+    CHECK(fusion.getStats().biasUpdates == biasUpdatesBeforeCoasting);
+    CHECK(fusion.getState().gyroBias[2] == biasBeforeCoasting);
+    CHECK(std::fabs(fusion.getState().getYawRadians() - startYaw - (float)((M_PI / 2.0) + (3.0 * coastRate))) < 0.015f);
+
+    replay(fusion, recorded, recorded.phaseEnds[2], recorded.phaseEnds[3], phases[3]);
+    CHECK(fusion.getState().still);
+    CHECK(getBiasError(fusion, 2) < 0.0005f);
+    CHECK(std::fabs(fusion.getState().getYawRadians() - startYaw - (float)((M_PI / 2.0) + (3.0 * coastRate))) < 0.015f);
+
+    fusion.printStats();
+    remove(RECORDING_PATH);
+    return checkResult("test_imu_fusion");
+}
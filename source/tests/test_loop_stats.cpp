@@ -0,0 +1,148 @@
+// The firmware's LoopStats (ESP32_firmware/main/loop_stats.h) on the host: addLoopTime() bucketing and min/mean/max,
+// counters surviving resetLoopTimes(), and serialize() read back by MausBoard::LoopStats::fromRawData, both directly and
+// framed as a CMD_LOOP_STATS message through MausBoard::parse(). The bucket limits are written out on both sides, so they
+// are compared too.
+
+#include <string.h>
+#include <vector>
+
+#include "loop_stats.h"
+#include "maus_board.h"
+#include "check.h"
+
+// MausBoard::CommandIds
+static const uint8_t CMD_LOOP_STATS = 0x06;
+
+// The board's message CRC, CRC-8 polynomial 0x31 (MSB first)
+static uint8_t crc8(const uint8_t* data, const size_t len) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static void testBucketLimits() {
+    CHECK(LOOP_STATS_NUM_BUCKETS == MausBoard::LoopStats::NUM_BUCKETS);
+    for (size_t i = 0; i < (LOOP_STATS_NUM_BUCKETS - 1); i++)
+        CHECK(loopStatsBucketLimitsMicros[i] == MausBoard::LoopStats::bucketLimitsMicros[i]);
+    CHECK(LoopStats::PAYLOAD_SIZE == ((4 + MausBoard::LoopStats::NUM_BUCKETS + LoopStats::NUM_COUNTERS) * 4));
+}
+
+static void testBucketing() {
+    LoopStats loopStats;
+    CHECK((loopStats.getLoopCount() == 0) && (loopStats.getLoopMinMicros() == 0) && (loopStats.getLoopMeanMicros() == 0));
+
+    // Either side of every limit: the limit itself goes in the next bucket
+    std::vector<uint32_t> expected(LOOP_STATS_NUM_BUCKETS, 0);
+    uint64_t total = 0;
+    uint32_t count = 0;
+    loopStats.addLoopTime(0);
+    expected[0]++;
+    count++;
+    for (size_t i = 0; i < (LOOP_STATS_NUM_BUCKETS - 1); i++) {
+        const uint32_t limit = loopStatsBucketLimitsMicros[i];
+        loopStats.addLoopTime(limit - 1);
+        loopStats.addLoopTime(limit);
+        expected[i]++;
+        expected[i + 1]++;
+        total += (2 * limit) - 1;
+        count += 2;
+    }
+    loopStats.addLoopTime(1000000);
+    expected[LOOP_STATS_NUM_BUCKETS - 1]++;
+    total += 1000000;
+    count++;
+
+    for (uint8_t i = 0; i < LOOP_STATS_NUM_BUCKETS; i++)
+        CHECK(loopStats.getBucket(i) == expected[i]);
+    CHECK(loopStats.getLoopCount() == count);
+    CHECK(loopStats.getLoopMinMicros() == 0);
+    CHECK(loopStats.getLoopMaxMicros() == 1000000);
+    CHECK(loopStats.getLoopMeanMicros() == (uint32_t)(total / count));
+
+    // Loop times are per report, counters since boot
+    loopStats.count(LoopStats::COUNTER_FAILSAFE_ACTIVATIONS);
+    loopStats.count(LoopStats::COUNTER_FAILSAFE_ACTIVATIONS, 2);
+    loopStats.resetLoopTimes();
+    CHECK((loopStats.getLoopCount() == 0) && (loopStats.getLoopMaxMicros() == 0) && (loopStats.getLoopMinMicros() == 0));
+    for (uint8_t i = 0; i < LOOP_STATS_NUM_BUCKETS; i++)
+        CHECK(loopStats.getBucket(i) == 0);
+    CHECK(loopStats.getCounter(LoopStats::COUNTER_FAILSAFE_ACTIVATIONS) == 3);
+}
+
+static void fill(LoopStats& loopStats) {
+    const uint32_t loopTimes[] = {35, 48, 72, 180, 190, 450, 820, 1500, 4200, 12000, 260};
+    for (uint32_t loopMicros : loopTimes)
+        loopStats.addLoopTime(loopMicros);
+    loopStats.count(LoopStats::COUNTER_FIFO_OVERFLOWS, 4);
+    loopStats.setCounter(LoopStats::COUNTER_ESC_CRC_REJECTS, 17);
+    loopStats.count(LoopStats::COUNTER_FAILSAFE_ACTIVATIONS);
+    loopStats.setCounter(LoopStats::COUNTER_BYTES_IN, 0x12345678);
+    loopStats.setCounter(LoopStats::COUNTER_BYTES_OUT, 0xFEDCBA98);
+}
+
+static void checkParsed(const MausBoard::LoopStats& parsed, const LoopStats& loopStats) {
+    CHECK(parsed.loopCount == loopStats.getLoopCount());
+    CHECK(parsed.loopMinMicros == loopStats.getLoopMinMicros());
+    CHECK(parsed.loopMeanMicros == loopStats.getLoopMeanMicros());
+    CHECK(parsed.loopMaxMicros == loopStats.getLoopMaxMicros());
+    for (uint8_t i = 0; i < LOOP_STATS_NUM_BUCKETS; i++)
+        CHECK(parsed.buckets[i] == loopStats.getBucket(i));
+    CHECK(parsed.fifoOverflows == 4);
+    CHECK(parsed.escCrcRejects == 17);
+    CHECK(parsed.failsafeActivations == 1);
+    CHECK(parsed.bytesIn == 0x12345678);
+    CHECK(parsed.bytesOut == 0xFEDCBA98);
+}
+
+static void testRoundTrip() {
+    LoopStats loopStats;
+    fill(loopStats);
+    uint8_t payload[LoopStats::PAYLOAD_SIZE];
+    CHECK(loopStats.serialize(payload) == LoopStats::PAYLOAD_SIZE);
+
+    checkParsed(MausBoard::LoopStats::fromRawData(payload, sizeof(payload)), loopStats);
+
+    // A short payload is ignored
+    const MausBoard::LoopStats truncated = MausBoard::LoopStats::fromRawData(payload, sizeof(payload) - 1);
+    CHECK((truncated.loopCount == 0) && (truncated.bytesOut == 0));
+}
+
+static MausBoard::LoopStats received;
+static int receivedCount = 0;
+
+static void loopStatsCallback(const MausBoard::LoopStats& loopStats) {
+    received = loopStats;
+    receivedCount++;
+}
+
+static void testThroughParse() {
+    LoopStats loopStats;
+    fill(loopStats);
+
+    // As main.ino sends it
+    uint8_t payload[1 + LoopStats::PAYLOAD_SIZE];
+    payload[0] = CMD_LOOP_STATS;
+    const size_t payloadSize = 1 + loopStats.serialize(&payload[1]);
+    std::vector<uint8_t> bytes = {0x12, 0x34, 0, (uint8_t)payloadSize, crc8(payload, payloadSize)};
+    bytes.insert(bytes.end(), payload, payload + payloadSize);
+
+    MausBoard board(nullptr, nullptr);
+    board.loopStatsCallback = loopStatsCallback;
+    const uint64_t before = TimeStamp::get();
+    board.parse(bytes.data(), bytes.size());
+    CHECK(receivedCount == 1);
+    checkParsed(received, loopStats);
+    CHECK(received.timestamp >= before);
+}
+
+int main() {
+    testBucketLimits();
+    testBucketing();
+    testRoundTrip();
+    testThroughParse();
+    return checkResult("test_loop_stats");
+}
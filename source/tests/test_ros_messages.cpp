@@ -0,0 +1,236 @@
+// RosSerializer against a byte by byte reference of the CDR layout, for every frame id length that changes the padding
+// (the floats after frame_id align to 4, the Imu doubles to 8, both relative to the end of the encapsulation header),
+// then round trips through the parse functions and the malformed input they have to reject
+
+#include <string.h>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "ros_messages.h"
+#include "check.h"
+
+// Independent of CdrWriter: appends with explicit padding, offsets counted from the end of the encapsulation header
+struct Reference {
+    std::vector<uint8_t> bytes = {0x00, 0x01, 0x00, 0x00};
+
+    void pad(const size_t alignment) {
+        while (((bytes.size() - 4) % alignment) != 0)
+            bytes.push_back(0);
+    }
+
+    template <typename T>
+    void add(const T value) {
+        pad(sizeof(T));
+        const uint8_t* raw = (const uint8_t*)&value;
+        bytes.insert(bytes.end(), raw, raw + sizeof(T));
+    }
+
+    void addString(const std::string& value) {
+        add<uint32_t>(value.size() + 1);
+        bytes.insert(bytes.end(), value.begin(), value.end());
+        bytes.push_back(0);
+    }
+};
+
+static const uint64_t STAMP = 1760000000123456789ULL;
+
+static std::vector<LD19::LidarPoint> makeScan() {
+    std::vector<LD19::LidarPoint> points(450);
+    for (size_t i = 0; i < points.size(); i++) {
+        points[i].distance = (uint16_t)((i % 50 == 0) ? 0 : (1000 + i));
+        points[i].intensity = (uint8_t)(i % 256);
+        points[i].angle = (uint16_t)((i * 80) + 7);
+        points[i].timestamp = STAMP + (i * 222222);
+    }
+    return points;
+}
+
+static void testLaserScan(const std::string& frameId, const std::vector<LD19::LidarPoint>& points) {
+    RosSerializer::Config config;
+    config.scanFrameId = frameId;
+    config.binCount = 360;
+    RosSerializer serializer(config);
+    std::vector<uint8_t> buffer(serializer.getMaxLaserScanSize());
+    const size_t size = serializer.serializeLaserScan(points.data(), points.size(), buffer.data(), buffer.size());
+
+    // Expected bins: the closest point per 1 degree, in the LD19's clockwise order
+    std::vector<float> ranges(360, INFINITY);
+    std::vector<float> intensities(360, 0.0f);
+    for (const LD19::LidarPoint& point : points) {
+        const size_t bin = point.angle / 100;
+        if ((point.distance > 0) && ((point.distance * 0.001f) < ranges[bin])) {
+            ranges[bin] = point.distance * 0.001f;
+            intensities[bin] = point.intensity;
+        }
+    }
+
+    const float binSize = (2.0f * (float)M_PI) / 360;
+    const float scanTime = (float)(points.back().timestamp - points.front().timestamp) / NSECS_TO_SECS;
+    Reference reference;
+    reference.add<int32_t>(STAMP / NSECS_TO_SECS);
+    reference.add<uint32_t>(STAMP % NSECS_TO_SECS);
+    reference.addString(frameId);
+    reference.add<float>(-0.5f * binSize);
+    reference.add<float>((-0.5f * binSize) + (359.0f * -binSize));
+    reference.add<float>(-binSize);
+    reference.add<float>(scanTime / 360);
+    reference.add<float>(scanTime);
+    reference.add<float>(config.rangeMin);
+    reference.add<float>(config.rangeMax);
+    reference.add<uint32_t>(360);
+    for (float range : ranges)
+        reference.add<float>(range);
+    reference.add<uint32_t>(360);
+    for (float intensity : intensities)
+        reference.add<float>(intensity);
+
+    CHECK(size == reference.bytes.size());
+    CHECK((size == reference.bytes.size()) && (memcmp(buffer.data(), reference.bytes.data(), size) == 0));
+
+    static RosSerializer::LaserScan message;
+    CHECK(RosSerializer::parseLaserScan(buffer.data(), size, message));
+    CHECK(message.header.getTimestamp() == STAMP);
+    CHECK(strcmp(message.header.frameId, frameId.c_str()) == 0);
+    CHECK((message.rangeCount == 360) && (message.intensityCount == 360));
+    CHECK(memcmp(message.ranges, ranges.data(), 360 * sizeof(float)) == 0);
+    CHECK(memcmp(message.intensities, intensities.data(), 360 * sizeof(float)) == 0);
+    CHECK(message.angleIncrement == -binSize);
+
+    // Every truncation is rejected, a short buffer isn't written to
+    int accepted = 0;
+    for (size_t length = 0; length < size; length++)
+        accepted += RosSerializer::parseLaserScan(buffer.data(), length, message) ? 1 : 0;
+    CHECK(accepted == 0);
+    CHECK(serializer.serializeLaserScan(points.data(), points.size(), buffer.data(), size - 1) == 0);
+    CHECK(serializer.getStats().bufferTooSmall == 1);
+}
+
+static void testBinnedScan(const std::vector<LD19::LidarPoint>& points) {
+    BinnedScan binnedScan(720);
+    binnedScan.addPoints(points.data(), points.size());
+    LD19::LidarPoint wrap = points[0];
+    wrap.timestamp += 100 * NSECS_TO_MSECS;
+    binnedScan.addPoints(&wrap, 1);
+    static BinnedScan::Scan scan;
+    CHECK(binnedScan.getLatest(scan));
+
+    RosSerializer serializer;
+    std::vector<uint8_t> buffer(serializer.getMaxLaserScanSize());
+    const size_t size = serializer.serializeLaserScan(scan, buffer.data(), buffer.size());
+    static RosSerializer::LaserScan message;
+    CHECK((size > 0) && RosSerializer::parseLaserScan(buffer.data(), size, message));
+    CHECK((message.rangeCount == 720) && (message.intensityCount == 0));
+
+    // Same clockwise order as the raw scans
+    int misplaced = 0;
+    for (const LD19::LidarPoint& point : points) {
+        if (point.distance == 0)
+            continue;
+        const size_t bin = ((uint32_t)point.angle * 720) / 36000;
+        if (std::fabs(message.ranges[bin] - (point.distance * 0.001f)) > 1e-6f)
+            misplaced++;
+    }
+    CHECK(misplaced == 0);
+}
+
+static void addImuReference(Reference& reference, const std::string& frameId, const double* orientation,
+    const double* angularVelocity, const double* linearAcceleration, const RosSerializer::Config& config) {
+    reference.add<int32_t>(STAMP / NSECS_TO_SECS);
+    reference.add<uint32_t>(STAMP % NSECS_TO_SECS);
+    reference.addString(frameId);
+    for (int i = 0; i < 4; i++)
+        reference.add<double>(orientation[i]);
+    for (int i = 0; i < 9; i++)
+        reference.add<double>(config.orientationCovariance[i]);
+    for (int i = 0; i < 3; i++)
+        reference.add<double>(angularVelocity[i]);
+    for (int i = 0; i < 9; i++)
+        reference.add<double>(config.angularVelocityCovariance[i]);
+    for (int i = 0; i < 3; i++)
+        reference.add<double>(linearAcceleration[i]);
+    for (int i = 0; i < 9; i++)
+        reference.add<double>(config.linearAccelerationCovariance[i]);
+}
+
+static void testImu(const std::string& frameId) {
+    RosSerializer::Config config;
+    config.imuFrameId = frameId;
+    config.orientationCovariance[0] = -1.0;
+    RosSerializer serializer(config);
+    std::vector<uint8_t> buffer(serializer.getMaxImuSize());
+
+    MausBoard::ImuData imuData = {};
+    imuData.timestamp = STAMP;
+    imuData.qX = 0.1f;
+    imuData.qY = -0.2f;
+    imuData.qZ = 0.5f;
+    imuData.qW = 0.8f;
+    imuData.gyroZ = 164;
+    imuData.accelX = -300;
+    imuData.accelZ = 8192;
+    size_t size = serializer.serializeImu(imuData, buffer.data(), buffer.size());
+
+    const double orientation[4] = {0.1f, -0.2f, 0.5f, 0.8f};
+    const double angularVelocity[3] = {0.0, 0.0, 164 * config.dmpGyroRadiansPerCount};
+    const double linearAcceleration[3] = {-300 * config.dmpAccelMetersPerSec2PerCount, 0.0, 8192 * config.dmpAccelMetersPerSec2PerCount};
+    Reference reference;
+    addImuReference(reference, frameId, orientation, angularVelocity, linearAcceleration, config);
+    CHECK(size == reference.bytes.size());
+    CHECK((size == reference.bytes.size()) && (memcmp(buffer.data(), reference.bytes.data(), size) == 0));
+
+    static RosSerializer::Imu message;
+    CHECK(RosSerializer::parseImu(buffer.data(), size, message));
+    CHECK(message.header.getTimestamp() == STAMP);
+    CHECK(strcmp(message.header.frameId, frameId.c_str()) == 0);
+    CHECK(memcmp(message.orientation, orientation, sizeof(orientation)) == 0);
+    CHECK(memcmp(message.angularVelocity, angularVelocity, sizeof(angularVelocity)) == 0);
+    CHECK(memcmp(message.linearAcceleration, linearAcceleration, sizeof(linearAcceleration)) == 0);
+    CHECK(message.orientationCovariance[0] == -1.0);
+
+    // ImuFusion output, float to double
+    ImuFusion::State state = {};
+    state.timestamp = STAMP;
+    state.orientation.w = 1.0f;
+    state.gyro[2] = 0.25f;
+    state.accel[2] = 9.81f;
+    size = serializer.serializeImu(state, buffer.data(), buffer.size());
+    CHECK((size == reference.bytes.size()) && RosSerializer::parseImu(buffer.data(), size, message));
+    CHECK((message.orientation[3] == 1.0) && (message.angularVelocity[2] == 0.25) && (message.linearAcceleration[2] == (double)9.81f));
+
+    int accepted = 0;
+    for (size_t length = 0; length < size; length++)
+        accepted += RosSerializer::parseImu(buffer.data(), length, message) ? 1 : 0;
+    CHECK(accepted == 0);
+}
+
+static void testMalformed() {
+    RosSerializer serializer;
+    std::vector<uint8_t> buffer(serializer.getMaxLaserScanSize());
+    const std::vector<LD19::LidarPoint> points = makeScan();
+    const size_t size = serializer.serializeLaserScan(points.data(), points.size(), buffer.data(), buffer.size());
+    static RosSerializer::LaserScan message;
+
+    // Big endian encapsulation isn't supported
+    buffer[1] = 0x00;
+    CHECK(!RosSerializer::parseLaserScan(buffer.data(), size, message));
+    buffer[1] = 0x01;
+
+    // A frame_id length running past the end
+    const uint32_t hugeLength = 0x7FFFFFFF;
+    memcpy(&buffer[12], &hugeLength, 4);
+    CHECK(!RosSerializer::parseLaserScan(buffer.data(), size, message));
+}
+
+int main() {
+    const std::vector<LD19::LidarPoint> points = makeScan();
+
+    // frame_id lengths 0 to 9 go through every padding before the floats (4) and the doubles (8)
+    for (const char* frameId : {"", "l", "la", "las", "lase", "laser", "laser_", "laser_f", "laser_fr", "laser_fra"}) {
+        testLaserScan(frameId, points);
+        testImu(frameId);
+    }
+    testBinnedScan(points);
+    testMalformed();
+    return checkResult("test_ros_messages");
+}
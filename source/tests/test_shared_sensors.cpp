@@ -0,0 +1,121 @@
+// SensorPublisher and SensorSubscriber in one process: samples and scans through the rings, commands back through the
+// queue, the shared memory only accessible to its owner, and stop() while driver threads are still publishing (it
+// used to unmap under them)
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "shared_sensors.h"
+#include "check.h"
+
+static const char* TEST_NAME = "/maus_test_shared_sensors";
+
+static std::atomic<int> servoCommands{0};
+static std::atomic<uint16_t> lastSteering{0};
+
+static void commandCallback(const SharedSensors::Command& command) {
+    if (command.type == SharedSensors::COMMAND_SET_SERVOS) {
+        lastSteering = command.steeringMicros;
+        servoCommands++;
+    }
+}
+
+static mode_t getMode(const char* name) {
+    const int fd = shm_open(name, O_RDONLY, 0);
+    struct stat info = {};
+    if (fd >= 0) {
+        fstat(fd, &info);
+        close(fd);
+    }
+    return info.st_mode & 0777;
+}
+
+static void testRoundTrip() {
+    SensorPublisher publisher;
+    publisher.commandCallback = commandCallback;
+    CHECK(publisher.start(TEST_NAME));
+    CHECK(getMode(TEST_NAME) == 0600);
+    CHECK(getMode((std::string(TEST_NAME) + "_commands").c_str()) == 0600);
+
+    SensorSubscriber subscriber;
+    CHECK(subscriber.open(TEST_NAME));
+    CHECK(subscriber.isPublisherAlive());
+
+    MausBoard::ImuData imuData = {};
+    imuData.timestamp = 1234;
+    imuData.qW = 1.0f;
+    publisher.publishImu(imuData);
+    std::vector<LD19::LidarPoint> points(450);
+    for (size_t i = 0; i < points.size(); i++) {
+        points[i].distance = (uint16_t)(1000 + i);
+        points[i].angle = (uint16_t)(i * 80);
+        points[i].timestamp = 5000 + i;
+    }
+    publisher.publishScan(points.data(), points.size());
+
+    const SharedSensors::SensorLayout& sensors = subscriber.getSensors();
+    MausBoard::ImuData received;
+    CHECK((sensors.imu.getWriteCount() == 1) && sensors.imu.read(0, received) && (received.timestamp == 1234));
+    const SharedSensors::Scan* scan = sensors.scans.peek(0);
+    CHECK(scan && (scan->count == points.size()) && (scan->timestamp == points.back().timestamp));
+    CHECK(scan && (memcmp(scan->points, points.data(), points.size() * sizeof(LD19::LidarPoint)) == 0));
+
+    CHECK(subscriber.sendSetServos(1400, 1500));
+    for (int i = 0; (i < 200) && (servoCommands.load() == 0); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    CHECK((servoCommands.load() == 1) && (lastSteering.load() == 1400));
+
+    publisher.stop();
+    CHECK(!subscriber.isPublisherAlive());
+    subscriber.close();
+
+    // Group access when asked for
+    CHECK(publisher.start(TEST_NAME, 0660));
+    CHECK(getMode(TEST_NAME) == 0660);
+    publisher.stop();
+    CHECK(getMode(TEST_NAME) == 0);
+}
+
+static void testStopWhilePublishing() {
+    // Driver threads keep calling in while the publisher is stopped and started again, a late call must never touch
+    // an unmapped ring
+    SensorPublisher publisher;
+    std::atomic<bool> running{true};
+    std::vector<std::thread> drivers;
+    std::vector<LD19::LidarPoint> points(SharedSensors::MAX_SCAN_POINTS);
+    drivers.emplace_back([&]() {
+        while (running)
+            publisher.publishScan(points.data(), points.size());
+    });
+    drivers.emplace_back([&]() {
+        MausBoard::ImuData imuData = {};
+        while (running)
+            publisher.publishImu(imuData);
+    });
+
+    int restarts = 0;
+    for (int i = 0; i < 20; i++) {
+        restarts += publisher.start(TEST_NAME) ? 1 : 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        publisher.stop();
+    }
+    running = false;
+    for (std::thread& driver : drivers)
+        driver.join();
+
+    CHECK(restarts == 20);
+    CHECK((publisher.getStats().scansPublished > 0) && (publisher.getStats().imuPublished > 0));
+}
+
+int main() {
+    testRoundTrip();
+    testStopWhilePublishing();
+    return checkResult("test_shared_sensors");
+}
@@ -0,0 +1,280 @@
+// BridgeServer and BridgeClient over loopback: scans, IMU and ESC samples out, servo and RGB commands back, a second
+// client refused while the first is connected, a silent client dropped with the link lost callback, and stopReading()
+// not hanging on an unreachable server
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tcp_bridge.h"
+#include "check.h"
+
+static const uint16_t TEST_PORT = 57601;
+
+// Received on the client's and server's threads
+static std::mutex receivedMutex;
+static std::vector<std::vector<LD19::LidarPoint>> receivedScans;
+static std::vector<MausBoard::ImuData> receivedImu;
+static std::vector<MausBoard::EscTelemetry> receivedEsc;
+static std::atomic<int> servoCommands{0};
+static std::atomic<uint16_t> lastSteering{0};
+static std::atomic<uint16_t> lastThrottle{0};
+static std::vector<uint32_t> receivedColors;
+static std::atomic<int> linksLost{0};
+
+static void scanCallback(std::vector<LD19::LidarPoint> points) {
+    std::lock_guard<std::mutex> lock(receivedMutex);
+    receivedScans.push_back(points);
+}
+
+static void imuCallback(const MausBoard::ImuData& imuData) {
+    std::lock_guard<std::mutex> lock(receivedMutex);
+    receivedImu.push_back(imuData);
+}
+
+static void escCallback(const MausBoard::EscTelemetry& escTelemetry) {
+    std::lock_guard<std::mutex> lock(receivedMutex);
+    receivedEsc.push_back(escTelemetry);
+}
+
+static void setServosCallback(const uint16_t steering, const uint16_t throttle) {
+    lastSteering = steering;
+    lastThrottle = throttle;
+    servoCommands++;
+}
+
+static void setRgbCallback(const std::vector<uint32_t>& colors) {
+    std::lock_guard<std::mutex> lock(receivedMutex);
+    receivedColors = colors;
+}
+
+static void linkLostCallback() {
+    linksLost++;
+}
+
+// Polls condition for up to timeoutMsecs
+template <typename Condition>
+static bool waitFor(Condition condition, const int timeoutMsecs = 2000) {
+    for (int waited = 0; waited < timeoutMsecs; waited += 10) {
+        if (condition())
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return condition();
+}
+
+template <typename Container>
+static size_t countReceived(const Container& container) {
+    std::lock_guard<std::mutex> lock(receivedMutex);
+    return container.size();
+}
+
+static bool samePoints(const std::vector<LD19::LidarPoint>& a, const LD19::LidarPoint* b, const size_t count) {
+    if (a.size() != count)
+        return false;
+    for (size_t i = 0; i < count; i++) {
+        if ((a[i].distance != b[i].distance) || (a[i].intensity != b[i].intensity) || (a[i].angle != b[i].angle) ||
+            (a[i].timestamp != b[i].timestamp))
+            return false;
+    }
+    return true;
+}
+
+static void testRoundTrip() {
+    BridgeServer::Config config;
+    config.port = TEST_PORT;
+    BridgeServer server(config);
+    server.setServosCallback = setServosCallback;
+    server.setRgbCallback = setRgbCallback;
+    CHECK(server.start());
+
+    BridgeClient client(imuCallback, escCallback, scanCallback);
+    CHECK(client.startReading("127.0.0.1", TEST_PORT));
+    CHECK(waitFor([&]() { return client.isConnected() && server.isClientConnected(); }));
+
+    // A revolution with every field moving, including angle wraps and timestamp steps that aren't constant
+    std::vector<LD19::LidarPoint> scan(450);
+    const uint64_t start = TimeStamp::get();
+    for (size_t i = 0; i < scan.size(); i++) {
+        scan[i].distance = (uint16_t)((i % 7 == 0) ? 0 : (150 + ((i * 7919) % 12000)));
+        scan[i].intensity = (uint8_t)(i * 37);
+        scan[i].angle = (uint16_t)((35000 + (i * 80)) % 36000);
+        scan[i].timestamp = start + (i * 222222) + ((i % 3) * 1000);
+    }
+    server.publishScan(scan.data(), scan.size());
+    CHECK(waitFor([]() { return countReceived(receivedScans) > 0; }));
+    {
+        std::lock_guard<std::mutex> lock(receivedMutex);
+        CHECK(!receivedScans.empty() && samePoints(receivedScans[0], scan.data(), scan.size()));
+    }
+
+    for (int i = 0; i < 10; i++) {
+        MausBoard::ImuData imuData = {};
+        imuData.timestamp = start + i;
+        imuData.qW = 1.0f;
+        imuData.qZ = i * 0.1f;
+        server.publishImu(imuData);
+
+        MausBoard::EscTelemetry escTelemetry = {};
+        escTelemetry.timestamp = start + i;
+        escTelemetry.voltage = (uint16_t)(1200 + i);
+        escTelemetry.ERPM = (uint16_t)(i * 100);
+        server.publishEsc(escTelemetry);
+    }
+    CHECK(waitFor([]() { return (countReceived(receivedImu) == 10) && (countReceived(receivedEsc) == 10); }));
+    {
+        std::lock_guard<std::mutex> lock(receivedMutex);
+        for (size_t i = 0; i < receivedImu.size(); i++) {
+            CHECK(receivedImu[i].timestamp == (start + i));
+            CHECK(receivedImu[i].qZ == (i * 0.1f));
+        }
+        for (size_t i = 0; i < receivedEsc.size(); i++) {
+            CHECK(receivedEsc[i].voltage == (1200 + i));
+            CHECK(receivedEsc[i].ERPM == (i * 100));
+        }
+    }
+
+    // Commands going back
+    client.sendSetServos(1400, 1600);
+    client.sentSetRGB({0xFF0000, 0x00FF00, 0x0000FF});
+    CHECK(waitFor([]() { return servoCommands.load() == 1; }));
+    CHECK((lastSteering.load() == 1400) && (lastThrottle.load() == 1600));
+    CHECK(waitFor([]() { return countReceived(receivedColors) == 3; }));
+    {
+        std::lock_guard<std::mutex> lock(receivedMutex);
+        CHECK(receivedColors == std::vector<uint32_t>({0xFF0000, 0x00FF00, 0x0000FF}));
+    }
+
+    // A second connection is closed straight away and can't send commands, the first one keeps working
+    const int intruder = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(TEST_PORT);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    CHECK(connect(intruder, (struct sockaddr*)&address, sizeof(address)) == 0);
+    struct timeval timeout = {2, 0};
+    setsockopt(intruder, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    uint8_t byte;
+    CHECK(recv(intruder, &byte, 1, 0) == 0);
+    close(intruder);
+    CHECK(server.getStats().connectionsRefused == 1);
+
+    client.sendSetServos(1500, 1500);
+    CHECK(waitFor([]() { return servoCommands.load() == 2; }));
+    CHECK(client.isConnected());
+
+    client.stopReading();
+    server.stop();
+    CHECK(server.getStats().connections == 1);
+}
+
+// A plain socket connected to the server, standing in for a client that can stop talking
+static int connectRaw() {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(TEST_PORT);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    struct timeval timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+static bool sendPing(const int fd) {
+    uint8_t frame[sizeof(BridgeProtocol::FrameHeader) + 8];
+    BridgeProtocol::writeHeader(frame, BridgeProtocol::FRAME_PING, 8);
+    const uint64_t timestamp = TimeStamp::get();
+    memcpy(&frame[sizeof(BridgeProtocol::FrameHeader)], &timestamp, 8);
+    return BridgeProtocol::sendAll(fd, frame, sizeof(frame));
+}
+
+static void testClientTimeout() {
+    BridgeServer::Config config;
+    config.port = TEST_PORT;
+    config.clientTimeoutNsecs = 300 * NSECS_TO_MSECS;
+    BridgeServer server(config);
+    server.linkLostCallback = linkLostCallback;
+    CHECK(server.start());
+    linksLost = 0;
+
+    // Pinging more often than the timeout keeps it connected
+    int fd = connectRaw();
+    CHECK(fd >= 0);
+    CHECK(waitFor([&]() { return server.isClientConnected(); }));
+    for (int i = 0; i < 10; i++) {
+        CHECK(sendPing(fd));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    CHECK(server.isClientConnected());
+    CHECK(linksLost.load() == 0);
+
+    // Going silent (the connection stays open, like a car out of WiFi range) drops it after the timeout, and the
+    // socket is closed on the server's side
+    const uint64_t silentSince = TimeStamp::getMonotonic() - (100 * (uint64_t)NSECS_TO_MSECS);   // Last ping
+    CHECK(waitFor([&]() { return !server.isClientConnected(); }));
+    const uint64_t dropAfter = TimeStamp::getMonotonic() - silentSince;
+    CHECK((dropAfter >= config.clientTimeoutNsecs) && (dropAfter < (1000 * (uint64_t)NSECS_TO_MSECS)));
+    CHECK(linksLost.load() == 1);
+    CHECK(server.getStats().clientTimeouts == 1);
+    uint8_t byte;
+    ssize_t received;
+    while ((received = recv(fd, &byte, 1, 0)) > 0) {}
+    CHECK(received == 0);
+    close(fd);
+
+    // A client closing its end counts as lost too, not as a timeout
+    fd = connectRaw();
+    CHECK(waitFor([&]() { return server.isClientConnected(); }));
+    close(fd);
+    CHECK(waitFor([&]() { return linksLost.load() == 2; }));
+    CHECK(server.getStats().clientTimeouts == 1);
+
+    // So does stop() with a client connected
+    fd = connectRaw();
+    CHECK(waitFor([&]() { return server.isClientConnected(); }));
+    server.stop();
+    CHECK(linksLost.load() == 3);
+    close(fd);
+}
+
+static void testBindAddress() {
+    BridgeServer::Config config;
+    config.port = TEST_PORT;
+    config.bindAddress = "not an address";
+    BridgeServer server(config);
+    CHECK(!server.start());
+}
+
+static void testStopWhileConnecting() {
+    // Not routable, the SYN goes nowhere so the connect would block for the kernel's timeout
+    BridgeClient client(imuCallback, escCallback, scanCallback);
+    CHECK(client.startReading("10.255.255.1", TEST_PORT));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    const uint64_t start = TimeStamp::getMonotonic();
+    client.stopReading();
+    const uint64_t elapsed = TimeStamp::getMonotonic() - start;
+    printf("stopReading() while connecting took %.1f ms\n", (double)elapsed / NSECS_TO_MSECS);
+    CHECK(elapsed < (300 * (uint64_t)NSECS_TO_MSECS));
+    CHECK(!client.isConnected());
+}
+
+int main() {
+    testRoundTrip();
+    testClientTimeout();
+    testBindAddress();
+    testStopWhileConnecting();
+    return checkResult("test_tcp_bridge");
+}
@@ -0,0 +1,140 @@
+#include "timestamp.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+// Set during static initialization, get() called from another file's static initializers would still see 0
+const uint64_t TimeStamp::epochOffset = TimeStamp::getWall() - TimeStamp::getMonotonic();
+
+std::atomic<bool> TimeStamp::fastCalibrated{false};
+std::atomic<uint32_t> TimeStamp::fastSequence{0};
+std::atomic<uint64_t> TimeStamp::fastBaseTicks{0};
+std::atomic<uint64_t> TimeStamp::fastBaseNsecs{0};
+std::atomic<uint64_t> TimeStamp::fastMultiplier{0};
+
+// One calibration at a time, getFast() doesn't take it
+static std::mutex calibrationMutex;
+
+static bool hasUsableCounter() {
+#if defined(__aarch64__)
+    // The generic timer's virtual count is readable from user space on Linux and runs at a fixed rate
+    return true;
+#elif defined(__x86_64__)
+    // Only an invariant TSC ticks at a constant rate through frequency scaling and sleep states
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (edx & (1 << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+#if defined(__aarch64__) || defined(__x86_64__)
+// Counter ticks and CLOCK_MONOTONIC at (about) the same instant, the tightest of a few tries
+static void sampleCounter(uint64_t& ticks, uint64_t& nsecs) {
+    uint64_t bestWindow = UINT64_MAX;
+    for (int i = 0; i < 5; i++) {
+        const uint64_t before = TimeStamp::getMonotonic();
+        const uint64_t counter = TimeStamp::readCounter();
+        const uint64_t after = TimeStamp::getMonotonic();
+        if ((after - before) < bestWindow) {
+            bestWindow = after - before;
+            ticks = counter;
+            nsecs = before + ((after - before) / 2);
+        }
+    }
+}
+#endif
+
+bool TimeStamp::calibrateFast(const uint64_t calibrationNsecs) {
+    std::lock_guard<std::mutex> lock(calibrationMutex);
+    if (!hasUsableCounter()) {
+        fastCalibrated = false;
+        printf("TimeStamp: no usable cycle counter, getFast() uses CLOCK_MONOTONIC\n");
+        return false;
+    }
+
+#if defined(__aarch64__) || defined(__x86_64__)
+    uint64_t startTicks, startNsecs;
+    uint64_t endTicks, endNsecs;
+    sampleCounter(startTicks, startNsecs);
+    std::this_thread::sleep_for(std::chrono::nanoseconds(calibrationNsecs));
+    sampleCounter(endTicks, endNsecs);
+    if ((endTicks <= startTicks) || (endNsecs <= startNsecs)) {
+        printf("TimeStamp: cycle counter calibration failed\n");
+        fastCalibrated = false;
+        return false;
+    }
+
+    // Readers retry while the sequence is odd or changed under them
+    const uint32_t sequence = fastSequence.load(std::memory_order_relaxed);
+    fastSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    fastMultiplier.store((uint64_t)((((unsigned __int128)(endNsecs - startNsecs)) << FAST_SHIFT) / (endTicks - startTicks)),
+        std::memory_order_relaxed);
+    fastBaseTicks.store(endTicks, std::memory_order_relaxed);
+    fastBaseNsecs.store(endNsecs, std::memory_order_relaxed);
+    fastSequence.store(sequence + 2, std::memory_order_release);
+    fastCalibrated = true;
+    return true;
+#else
+    (void)calibrationNsecs;
+    return false;
+#endif
+}
+
+uint64_t TimeStamp::toWallTime(const uint64_t timestamp) {
+    const uint64_t monotonic = timestamp - epochOffset;
+    const uint64_t currentOffset = getWall() - getMonotonic();
+    return monotonic + currentOffset;
+}
+
+size_t TimeStamp::formatWallTime(const uint64_t wallNsecs, char* out, const size_t size) {
+    if (size == 0)
+        return 0;
+
+    const time_t seconds = (time_t)(wallNsecs / NSECS_TO_SECS);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    size_t length = strftime(out, size, "%Y-%m-%d %H:%M:%S", &local);
+    if (length == 0) {
+        out[0] = '\0';
+        return 0;
+    }
+
+    const int written = snprintf(out + length, size - length, ".%06u", (unsigned)((wallNsecs % NSECS_TO_SECS) / NSECS_TO_USECS));
+    if (written > 0)
+        length = ((length + written) < size) ? (length + written) : (size - 1);
+    return length;
+}
+
+template <typename Source>
+static double benchmarkSource(const size_t iterations, Source source) {
+    volatile uint64_t sink = 0;
+    const uint64_t start = TimeStamp::getMonotonic();
+    for (size_t i = 0; i < iterations; i++)
+        sink = source();
+    (void)sink;
+    return (double)(TimeStamp::getMonotonic() - start) / iterations;
+}
+
+void TimeStamp::printBenchmark(const size_t iterations) {
+    if (!isFastCalibrated())
+        calibrateFast();
+
+    printf("TimeStamp: ns per call over %zu calls\n", iterations);
+    printf("  high_resolution_clock  %6.1f\n", benchmarkSource(iterations, []() { return (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count(); }));
+    printf("  get()                  %6.1f\n", benchmarkSource(iterations, []() { return get(); }));
+    printf("  getMonotonic()         %6.1f\n", benchmarkSource(iterations, []() { return getMonotonic(); }));
+    printf("  getMonotonicRaw()      %6.1f\n", benchmarkSource(iterations, []() { return getMonotonicRaw(); }));
+    printf("  getWall()              %6.1f\n", benchmarkSource(iterations, []() { return getWall(); }));
+    printf("  readCounter()          %6.1f\n", benchmarkSource(iterations, []() { return readCounter(); }));
+    printf("  getFast() %-12s %6.1f\n", isFastCalibrated() ? "(counter)" : "(fallback)", benchmarkSource(iterations, []() { return getFast(); }));
+}
@@ -1,19 +1,121 @@
 #ifndef __TIMESTAMP_H__
 #define __TIMESTAMP_H__
 
+// Timestamps in nanoseconds
+//
+// get() is what sensor data and commands are stamped with. It's CLOCK_MONOTONIC shifted onto the epoch once, when the
+// program starts, so it reads like wall time (ROS stamps, logs, comparing with another machine) but NTP steps and slews
+// after startup never make it jump or run backwards. Over a long run it can drift from the wall clock by whatever NTP
+// corrects, use toWallTime() when the actual wall time matters (e.g. log lines).
+//
+// getFast() reads the CPU's cycle counter (cntvct_el0 on aarch64, e.g. the Pi 4 on a 64 bit OS, invariant TSC on
+// x86_64) scaled onto CLOCK_MONOTONIC. It only does that after calibrateFast(), otherwise (or on a CPU without a usable
+// counter) it's the same as getMonotonic(). It's meant for profiling hot loops, the counter drifts from CLOCK_MONOTONIC
+// by a few ppm so calibrate again to keep long runs lined up (safe while other threads call getFast(), they see the
+// old or the new calibration, never a mix). A counter read on another core can be a little behind the calibration
+// point, getFast() never goes below it. printBenchmark() compares the cost of each source (make bench).
+
 #include <stdint.h>
-#include <chrono>
+#include <stddef.h>
+#include <time.h>
+#include <atomic>
 
 #define NSECS_TO_SECS 1000000000
 #define NSECS_TO_MSECS 1000000
 #define NSECS_TO_USECS 1000
 
 class TimeStamp {
+private:
+    // CLOCK_REALTIME - CLOCK_MONOTONIC when the program started
+    static const uint64_t epochOffset;
+
+    // getFast() scaling, ns = fastBaseNsecs + (((ticks - fastBaseTicks) * fastMultiplier) >> FAST_SHIFT)
+    // calibrateFast() writes them as a seqlock: fastSequence is odd while it's writing, and changes every time
+    static const unsigned FAST_SHIFT = 32;
+    static std::atomic<bool> fastCalibrated;
+    static std::atomic<uint32_t> fastSequence;
+    static std::atomic<uint64_t> fastBaseTicks;
+    static std::atomic<uint64_t> fastBaseNsecs;
+    static std::atomic<uint64_t> fastMultiplier;
+
+    static uint64_t readClock(const clockid_t clock) {
+        struct timespec now;
+        clock_gettime(clock, &now);
+        return ((uint64_t)now.tv_sec * NSECS_TO_SECS) + now.tv_nsec;
+    }
+
 public:
-    // Returns a nanoseconds timestamp since epoch
+    // Returns a nanoseconds timestamp since epoch (monotonic, see above)
     static uint64_t get() {
-        return std::chrono::high_resolution_clock::now().time_since_epoch().count();
+        return getMonotonic() + epochOffset;
+    }
+
+    // Returns a nanoseconds timestamp from CLOCK_MONOTONIC (unaffected by NTP, only useful for measuring intervals)
+    static uint64_t getMonotonic() {
+        return readClock(CLOCK_MONOTONIC);
+    }
+
+    // CLOCK_MONOTONIC_RAW, the hardware clock without NTP's rate correction either
+    static uint64_t getMonotonicRaw() {
+        return readClock(CLOCK_MONOTONIC_RAW);
+    }
+
+    // CLOCK_REALTIME, the wall clock as it is right now (can jump)
+    static uint64_t getWall() {
+        return readClock(CLOCK_REALTIME);
     }
+
+    // Raw cycle counter ticks, 0 if there's no usable counter
+    static uint64_t readCounter() {
+#if defined(__aarch64__)
+        uint64_t ticks;
+        asm volatile("isb; mrs %0, cntvct_el0" : "=r"(ticks) :: "memory");
+        return ticks;
+#elif defined(__x86_64__)
+        uint32_t low;
+        uint32_t high;
+        asm volatile("rdtsc" : "=a"(low), "=d"(high));
+        return ((uint64_t)high << 32) | low;
+#else
+        return 0;
+#endif
+    }
+
+    // Same time base as getMonotonic(), from the cycle counter once calibrated
+    static uint64_t getFast() {
+#if defined(__aarch64__) || defined(__x86_64__)
+        while (fastCalibrated.load(std::memory_order_relaxed)) {
+            const uint32_t sequence = fastSequence.load(std::memory_order_acquire);
+            const uint64_t baseTicks = fastBaseTicks.load(std::memory_order_relaxed);
+            const uint64_t baseNsecs = fastBaseNsecs.load(std::memory_order_relaxed);
+            const uint64_t multiplier = fastMultiplier.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if ((sequence & 1) || (sequence != fastSequence.load(std::memory_order_relaxed)))
+                continue;
+
+            // Signed, the counter on this core can be slightly behind the one that was calibrated
+            const int64_t ticks = (int64_t)(readCounter() - baseTicks);
+            if (ticks <= 0)
+                return baseNsecs;
+            return baseNsecs + (uint64_t)(((unsigned __int128)ticks * multiplier) >> FAST_SHIFT);
+        }
+#endif
+        return getMonotonic();
+    }
+
+    // Measures the counter against CLOCK_MONOTONIC for calibrationNsecs (blocks that long), from any thread. Returns
+    // false if the CPU has no usable counter, getFast() then stays on getMonotonic()
+    static bool calibrateFast(const uint64_t calibrationNsecs = 50 * NSECS_TO_MSECS);
+    static bool isFastCalibrated() { return fastCalibrated.load(std::memory_order_relaxed); }
+
+    // A timestamp from get() as wall clock time, with whatever NTP corrected since startup
+    static uint64_t toWallTime(const uint64_t timestamp);
+
+    // Local time as "2024-01-31 12:34:56.789012" for logs. Returns the length written
+    static size_t formatWallTime(const uint64_t wallNsecs, char* out, const size_t size);
+
+    // Prints ns per call of every source
+    static void printBenchmark(const size_t iterations = 1000000);
 };
 
 #endif
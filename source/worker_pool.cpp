@@ -0,0 +1,93 @@
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(const size_t numThreads) : numThreads((numThreads < MAX_THREADS) ? numThreads : MAX_THREADS) {
+    for (size_t i = 0; i < this->numThreads; i++)
+        threads[i] = std::thread(&WorkerPool::workerLoop, this);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    startCondition.notify_all();
+
+    for (size_t i = 0; i < numThreads; i++)
+        threads[i].join();
+}
+
+void WorkerPool::work() {
+    while (true) {
+        const size_t begin = nextIndex.fetch_add(chunkSize, std::memory_order_relaxed);
+        if (begin >= count)
+            break;
+        const size_t end = ((begin + chunkSize) < count) ? (begin + chunkSize) : count;
+        job(context, begin, end);
+    }
+}
+
+void WorkerPool::workerLoop() {
+    uint64_t lastGeneration = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            startCondition.wait(lock, [&]() { return !running || (generation != lastGeneration); });
+            if (!running)
+                return;
+            lastGeneration = generation;
+        }
+
+        work();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyThreads--;
+        }
+        doneCondition.notify_one();
+    }
+}
+
+void WorkerPool::run(const Job job, void* context, const size_t count, const size_t minChunk) {
+    if (count == 0)
+        return;
+
+    // Small chunks balance better, but each one costs an atomic
+    size_t chunkSize = count / ((numThreads + 1) * 4);
+    if (chunkSize < minChunk)
+        chunkSize = minChunk;
+    if (chunkSize < 1)
+        chunkSize = 1;
+
+    if ((numThreads == 0) || (chunkSize >= count)) {
+        job(context, 0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = job;
+        this->context = context;
+        this->count = count;
+        this->chunkSize = chunkSize;
+        nextIndex.store(0, std::memory_order_relaxed);
+        busyThreads = numThreads;
+        generation++;
+    }
+    startCondition.notify_all();
+
+    // Help out, then wait for the stragglers
+    work();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [&]() { return busyThreads == 0; });
+}
+
+bool WorkerPool::setRealtime(const int priority, const int firstCpuCore) {
+    bool success = true;
+    for (size_t i = 0; i < numThreads; i++) {
+        const int cpuCore = (firstCpuCore < 0) ? -1 : (firstCpuCore + (int)i);
+        success &= Realtime::configureThread(threads[i].native_handle(), priority, cpuCore);
+    }
+    return success;
+}
@@ -0,0 +1,59 @@
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+// Small fixed thread pool for splitting a loop over the Pi's cores
+// run() hands out chunks of [0, count) to the worker threads and the calling thread, and returns once they're all done.
+// Only one run() at a time. Nothing is allocated per run.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "realtime.h"
+
+class WorkerPool {
+public:
+    // Processes indices [begin, end)
+    typedef void (*Job)(void* context, const size_t begin, const size_t end);
+
+    static const size_t MAX_THREADS = 8;
+
+private:
+    std::thread threads[MAX_THREADS];
+    size_t numThreads = 0;
+
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    uint64_t generation = 0;
+    size_t busyThreads = 0;
+    bool running = true;
+
+    // Current job
+    Job job = nullptr;
+    void* context = nullptr;
+    size_t count = 0;
+    size_t chunkSize = 1;
+    std::atomic<size_t> nextIndex{0};
+
+    void work();
+    void workerLoop();
+
+public:
+    // numThreads extra threads (0 runs everything on the calling thread)
+    WorkerPool(const size_t numThreads);
+    ~WorkerPool();
+
+    // Chunks are at least minChunk long, the rest is balanced dynamically
+    void run(const Job job, void* context, const size_t count, const size_t minChunk = 1);
+
+    size_t getNumThreads() const { return numThreads; }
+
+    // Gives every worker SCHED_FIFO priority, worker i gets pinned to firstCpuCore + i (-1 leaves them unpinned)
+    bool setRealtime(const int priority, const int firstCpuCore);
+};
+
+#endif